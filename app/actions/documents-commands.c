@@ -267,18 +267,10 @@ documents_recreate_preview_cmd_callback (GtkAction *action,
 
   if (imagefile && gimp_container_have (container, GIMP_OBJECT (imagefile)))
     {
-      GError *error = NULL;
-
-      if (! gimp_imagefile_create_thumbnail (imagefile,
-                                             context, NULL,
+      gimp_imagefile_create_thumbnail_async (imagefile, context, NULL,
                                              context->gimp->config->thumbnail_size,
-                                             FALSE, &error))
-        {
-          gimp_message_literal (context->gimp,
-                                NULL , GIMP_MESSAGE_ERROR,
-                                error->message);
-          g_clear_error (&error);
-        }
+                                             FALSE,
+                                             GIMP_IMAGEFILE_PRIORITY_VISIBLE);
     }
 }
 
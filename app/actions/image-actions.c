@@ -317,13 +317,12 @@ void
 image_actions_update (GimpActionGroup *group,
                       gpointer         data)
 {
-  GimpImage *image       = action_data_get_image (data);
-  gboolean   is_indexed  = FALSE;
-  gboolean   is_u8_gamma = FALSE;
-  gboolean   aux         = FALSE;
-  gboolean   lp          = FALSE;
-  gboolean   sel         = FALSE;
-  gboolean   groups      = FALSE;
+  GimpImage *image      = action_data_get_image (data);
+  gboolean   is_indexed = FALSE;
+  gboolean   aux        = FALSE;
+  gboolean   lp         = FALSE;
+  gboolean   sel        = FALSE;
+  gboolean   groups     = FALSE;
 
   if (image)
     {
@@ -381,12 +380,10 @@ image_actions_update (GimpActionGroup *group,
 
       gimp_action_group_set_action_active (group, action, TRUE);
 
-      is_indexed  = (gimp_image_get_base_type (image) == GIMP_INDEXED);
-      is_u8_gamma = (gimp_image_get_precision (image) ==
-                     GIMP_PRECISION_U8_GAMMA);
-      aux         = (gimp_image_get_active_channel (image) != NULL);
-      lp          = ! gimp_image_is_empty (image);
-      sel         = ! gimp_channel_is_empty (gimp_image_get_mask (image));
+      is_indexed = (gimp_image_get_base_type (image) == GIMP_INDEXED);
+      aux        = (gimp_image_get_active_channel (image) != NULL);
+      lp         = ! gimp_image_is_empty (image);
+      sel        = ! gimp_channel_is_empty (gimp_image_get_mask (image));
 
       layers = gimp_image_get_layers (image);
 
@@ -398,7 +395,7 @@ image_actions_update (GimpActionGroup *group,
 
   SET_SENSITIVE ("image-convert-rgb",       image);
   SET_SENSITIVE ("image-convert-grayscale", image);
-  SET_SENSITIVE ("image-convert-indexed",   image && !groups && is_u8_gamma);
+  SET_SENSITIVE ("image-convert-indexed",   image && !groups);
 
   SET_SENSITIVE ("image-convert-u8-gamma",      image);
   SET_SENSITIVE ("image-convert-u8-linear",     image && !is_indexed);
@@ -91,6 +91,7 @@ enum
   PROP_DEFAULT_IMAGE,
   PROP_DEFAULT_GRID,
   PROP_UNDO_LEVELS,
+  PROP_MAX_UNDO_LEVELS,
   PROP_UNDO_SIZE,
   PROP_UNDO_PREVIEW_SIZE,
   PROP_PLUG_IN_HISTORY_SIZE,
@@ -377,6 +378,11 @@ gimp_core_config_class_init (GimpCoreConfigClass *klass)
                                 0, 1 << 20, 5,
                                 GIMP_PARAM_STATIC_STRINGS |
                                 GIMP_CONFIG_PARAM_CONFIRM);
+  GIMP_CONFIG_INSTALL_PROP_INT (object_class, PROP_MAX_UNDO_LEVELS,
+                                "max-undo-levels", MAX_UNDO_LEVELS_BLURB,
+                                1, 1 << 20, 1024,
+                                GIMP_PARAM_STATIC_STRINGS |
+                                GIMP_CONFIG_PARAM_CONFIRM);
 
   undo_size = gimp_get_physical_memory_size ();
 
@@ -685,6 +691,9 @@ gimp_core_config_set_property (GObject      *object,
     case PROP_UNDO_LEVELS:
       core_config->levels_of_undo = g_value_get_int (value);
       break;
+    case PROP_MAX_UNDO_LEVELS:
+      core_config->max_undo_levels = g_value_get_int (value);
+      break;
     case PROP_UNDO_SIZE:
       core_config->undo_size = g_value_get_uint64 (value);
       break;
@@ -857,6 +866,9 @@ gimp_core_config_get_property (GObject    *object,
     case PROP_UNDO_LEVELS:
       g_value_set_int (value, core_config->levels_of_undo);
       break;
+    case PROP_MAX_UNDO_LEVELS:
+      g_value_set_int (value, core_config->max_undo_levels);
+      break;
     case PROP_UNDO_SIZE:
       g_value_set_uint64 (value, core_config->undo_size);
       break;
@@ -76,6 +76,7 @@ struct _GimpCoreConfig
   GimpTemplate           *default_image;
   GimpGrid               *default_grid;
   gint                    levels_of_undo;
+  gint                    max_undo_levels;
   guint64                 undo_size;
   GimpViewSize            undo_preview_size;
   gint                    plug_in_history_size;
@@ -501,7 +501,7 @@ gimp_edit_fill_full (GimpImage            *image,
     return TRUE;  /*  nothing to do, but the fill succeeded  */
 
   if (pattern &&
-      babl_format_has_alpha (gimp_temp_buf_get_format (pattern->mask)) &&
+      babl_format_has_alpha (gimp_temp_buf_get_format (gimp_pattern_get_mask (pattern))) &&
       ! gimp_drawable_has_alpha (drawable))
     {
       format = gimp_drawable_get_format_with_alpha (drawable);
@@ -0,0 +1,504 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-parallel.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "core-types.h"
+
+#include "config/gimpgeglconfig.h"
+
+#include "gimp.h"
+#include "gimp-parallel.h"
+
+
+/*  A small worker pool shared by everything in the core that wants to
+ *  spread pixel work across processors.  The pool is sized from
+ *  GimpGeglConfig:num-processors; the calling thread always takes part
+ *  in gimp_parallel_distribute(), so the pool only holds n - 1 threads.
+ *
+ *  Worker threads must never touch GObject signals or anything else
+ *  that belongs to the main loop; they only crunch pixels.
+ */
+
+
+typedef enum
+{
+  GIMP_PARALLEL_JOB_DISTRIBUTE,
+  GIMP_PARALLEL_JOB_ASYNC
+} GimpParallelJobType;
+
+typedef struct _GimpParallelDistributeTask GimpParallelDistributeTask;
+
+struct _GimpParallelDistributeTask
+{
+  GimpParallelDistributeFunc  func;
+  gpointer                    user_data;
+  gint                        n;
+
+  gint                        next;       /*  atomic  */
+  gint                        remaining;  /*  atomic  */
+  gint                        ref_count;  /*  atomic  */
+
+  GMutex                      mutex;
+  GCond                       cond;
+};
+
+typedef struct
+{
+  GimpParallelJobType         type;
+
+  GimpParallelDistributeTask *task;
+
+  GimpParallelRunAsyncFunc    func;
+  gpointer                    user_data;
+} GimpParallelJob;
+
+typedef struct
+{
+  gsize                           size;
+  gsize                           sub_size;
+  GimpParallelDistributeRangeFunc func;
+  gpointer                        user_data;
+} GimpParallelDistributeRangeData;
+
+typedef struct
+{
+  GeglRectangle                   area;
+  gboolean                        vertical;
+  GimpParallelDistributeAreaFunc  func;
+  gpointer                        user_data;
+} GimpParallelDistributeAreaData;
+
+
+/*  local function prototypes  */
+
+static void   gimp_parallel_notify_num_processors (GimpGeglConfig             *config);
+static void   gimp_parallel_set_n_threads         (gint                        n_threads);
+
+static void   gimp_parallel_worker_func           (GimpParallelJob            *job,
+                                                   gpointer                    data);
+
+static void   gimp_parallel_distribute_task_run   (GimpParallelDistributeTask *task);
+static void   gimp_parallel_distribute_task_unref (GimpParallelDistributeTask *task);
+
+static void   gimp_parallel_distribute_range_func (gint                        i,
+                                                   gint                        n,
+                                                   gpointer                    data);
+static void   gimp_parallel_distribute_area_func  (gint                        i,
+                                                   gint                        n,
+                                                   gpointer                    data);
+
+
+/*  local variables  */
+
+static GThreadPool *gimp_parallel_pool      = NULL;
+static gint         gimp_parallel_n_threads = 1;
+static GPrivate     gimp_parallel_worker    = G_PRIVATE_INIT (NULL);
+
+
+/*  public functions  */
+
+void
+gimp_parallel_init (Gimp *gimp)
+{
+  GimpGeglConfig *config;
+
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  config = GIMP_GEGL_CONFIG (gimp->config);
+
+  g_signal_connect (config, "notify::num-processors",
+                    G_CALLBACK (gimp_parallel_notify_num_processors),
+                    NULL);
+
+  gimp_parallel_notify_num_processors (config);
+}
+
+void
+gimp_parallel_exit (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  g_signal_handlers_disconnect_by_func (gimp->config,
+                                        gimp_parallel_notify_num_processors,
+                                        NULL);
+
+  gimp_parallel_set_n_threads (1);
+}
+
+gint
+gimp_parallel_get_n_threads (void)
+{
+  return g_atomic_int_get (&gimp_parallel_n_threads);
+}
+
+gboolean
+gimp_parallel_is_worker_thread (void)
+{
+  return g_private_get (&gimp_parallel_worker) != NULL;
+}
+
+/**
+ * gimp_parallel_distribute:
+ * @max_n:     the maximal number of parts, or -1 for no limit
+ * @func:      function called for each part
+ * @user_data: data passed to @func
+ *
+ * Calls @func (i, n, @user_data) for each i in [0, n), where n is
+ * the number of threads in the pool, limited to @max_n.  The calls
+ * are distributed over the pool's threads and the calling thread, and
+ * the function returns only after all of them have finished.
+ *
+ * When called from inside a worker thread, or when the pool is
+ * disabled, @func is called serially in the calling thread.
+ **/
+void
+gimp_parallel_distribute (gint                       max_n,
+                          GimpParallelDistributeFunc func,
+                          gpointer                   user_data)
+{
+  GimpParallelDistributeTask *task;
+  gint                        n;
+  gint                        i;
+
+  g_return_if_fail (func != NULL);
+
+  if (max_n == 0)
+    return;
+
+  n = gimp_parallel_get_n_threads ();
+
+  if (max_n > 0)
+    n = MIN (n, max_n);
+
+  if (n == 1                               ||
+      ! gimp_parallel_pool                 ||
+      gimp_parallel_is_worker_thread ())
+    {
+      for (i = 0; i < n; i++)
+        func (i, n, user_data);
+
+      return;
+    }
+
+  task = g_slice_new0 (GimpParallelDistributeTask);
+
+  task->func      = func;
+  task->user_data = user_data;
+  task->n         = n;
+  task->next      = 0;
+  task->remaining = n;
+  task->ref_count = n;
+
+  g_mutex_init (&task->mutex);
+  g_cond_init (&task->cond);
+
+  for (i = 1; i < n; i++)
+    {
+      GimpParallelJob *job = g_slice_new0 (GimpParallelJob);
+
+      job->type = GIMP_PARALLEL_JOB_DISTRIBUTE;
+      job->task = task;
+
+      g_thread_pool_push (gimp_parallel_pool, job, NULL);
+    }
+
+  /*  the calling thread claims parts too, so it never waits for a
+   *  part that no worker has picked up yet
+   */
+  gimp_parallel_distribute_task_run (task);
+
+  g_mutex_lock (&task->mutex);
+
+  while (g_atomic_int_get (&task->remaining) > 0)
+    g_cond_wait (&task->cond, &task->mutex);
+
+  g_mutex_unlock (&task->mutex);
+
+  gimp_parallel_distribute_task_unref (task);
+}
+
+/**
+ * gimp_parallel_distribute_range:
+ * @size:         the size of the range
+ * @min_sub_size: the minimal size of a sub-range, or 0
+ * @func:         function called for each sub-range
+ * @user_data:    data passed to @func
+ *
+ * Splits [0, @size) into sub-ranges no smaller than @min_sub_size
+ * and processes them in parallel, see gimp_parallel_distribute().
+ **/
+void
+gimp_parallel_distribute_range (gsize                           size,
+                                gsize                           min_sub_size,
+                                GimpParallelDistributeRangeFunc func,
+                                gpointer                        user_data)
+{
+  GimpParallelDistributeRangeData data;
+  gint                            n;
+
+  g_return_if_fail (func != NULL);
+
+  if (size == 0)
+    return;
+
+  n = gimp_parallel_get_n_threads ();
+
+  if (min_sub_size > 1)
+    n = MIN (n, (gint) MIN (size / min_sub_size, G_MAXINT));
+
+  n = CLAMP (n, 1, (gint) MIN (size, G_MAXINT));
+
+  if (n == 1)
+    {
+      func (0, size, user_data);
+
+      return;
+    }
+
+  data.size      = size;
+  data.sub_size  = (size + n - 1) / n;
+  data.func      = func;
+  data.user_data = user_data;
+
+  gimp_parallel_distribute (n, gimp_parallel_distribute_range_func, &data);
+}
+
+/**
+ * gimp_parallel_distribute_area:
+ * @area:         the area to process
+ * @min_sub_area: the minimal number of pixels of a sub-area, or 0
+ * @func:         function called for each sub-area
+ * @user_data:    data passed to @func
+ *
+ * Splits @area into bands along its longer side, each at least
+ * @min_sub_area pixels large, and processes them in parallel, see
+ * gimp_parallel_distribute().
+ **/
+void
+gimp_parallel_distribute_area (const GeglRectangle            *area,
+                               gsize                           min_sub_area,
+                               GimpParallelDistributeAreaFunc  func,
+                               gpointer                        user_data)
+{
+  GimpParallelDistributeAreaData data;
+  gsize                          n_pixels;
+  gint                           n;
+
+  g_return_if_fail (area != NULL);
+  g_return_if_fail (func != NULL);
+
+  if (area->width <= 0 || area->height <= 0)
+    return;
+
+  n_pixels = (gsize) area->width * (gsize) area->height;
+
+  n = gimp_parallel_get_n_threads ();
+
+  if (min_sub_area > 1)
+    n = MIN (n, (gint) MIN (n_pixels / min_sub_area, G_MAXINT));
+
+  data.area      = *area;
+  data.vertical  = area->height >= area->width;
+  data.func      = func;
+  data.user_data = user_data;
+
+  n = CLAMP (n, 1, data.vertical ? area->height : area->width);
+
+  if (n == 1)
+    {
+      func (area, user_data);
+
+      return;
+    }
+
+  gimp_parallel_distribute (n, gimp_parallel_distribute_area_func, &data);
+}
+
+/**
+ * gimp_parallel_run_async:
+ * @func:      function to run
+ * @user_data: data passed to @func
+ *
+ * Runs @func in one of the pool's threads and returns immediately.
+ * @func must not use anything that belongs to the main loop; results
+ * have to be handed back with an idle source or similar.  When the
+ * pool is disabled, @func is called right away in the calling thread.
+ **/
+void
+gimp_parallel_run_async (GimpParallelRunAsyncFunc func,
+                         gpointer                 user_data)
+{
+  GimpParallelJob *job;
+
+  g_return_if_fail (func != NULL);
+
+  if (! gimp_parallel_pool)
+    {
+      func (user_data);
+
+      return;
+    }
+
+  job = g_slice_new0 (GimpParallelJob);
+
+  job->type      = GIMP_PARALLEL_JOB_ASYNC;
+  job->func      = func;
+  job->user_data = user_data;
+
+  g_thread_pool_push (gimp_parallel_pool, job, NULL);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_parallel_notify_num_processors (GimpGeglConfig *config)
+{
+  gimp_parallel_set_n_threads (config->num_processors);
+}
+
+static void
+gimp_parallel_set_n_threads (gint n_threads)
+{
+  n_threads = MAX (n_threads, 1);
+
+  g_atomic_int_set (&gimp_parallel_n_threads, n_threads);
+
+  if (n_threads > 1)
+    {
+      if (! gimp_parallel_pool)
+        {
+          gimp_parallel_pool =
+            g_thread_pool_new ((GFunc) gimp_parallel_worker_func, NULL,
+                               n_threads - 1, FALSE, NULL);
+        }
+      else
+        {
+          g_thread_pool_set_max_threads (gimp_parallel_pool,
+                                         n_threads - 1, NULL);
+        }
+    }
+  else if (gimp_parallel_pool)
+    {
+      /*  let already queued jobs finish  */
+      g_thread_pool_free (gimp_parallel_pool, FALSE, TRUE);
+      gimp_parallel_pool = NULL;
+    }
+}
+
+static void
+gimp_parallel_worker_func (GimpParallelJob *job,
+                           gpointer         data)
+{
+  g_private_set (&gimp_parallel_worker, GINT_TO_POINTER (TRUE));
+
+  switch (job->type)
+    {
+    case GIMP_PARALLEL_JOB_DISTRIBUTE:
+      gimp_parallel_distribute_task_run (job->task);
+      gimp_parallel_distribute_task_unref (job->task);
+      break;
+
+    case GIMP_PARALLEL_JOB_ASYNC:
+      job->func (job->user_data);
+      break;
+    }
+
+  g_private_set (&gimp_parallel_worker, NULL);
+
+  g_slice_free (GimpParallelJob, job);
+}
+
+static void
+gimp_parallel_distribute_task_run (GimpParallelDistributeTask *task)
+{
+  gint i;
+
+  while ((i = g_atomic_int_add (&task->next, 1)) < task->n)
+    {
+      task->func (i, task->n, task->user_data);
+
+      if (g_atomic_int_dec_and_test (&task->remaining))
+        {
+          g_mutex_lock (&task->mutex);
+          g_cond_signal (&task->cond);
+          g_mutex_unlock (&task->mutex);
+        }
+    }
+}
+
+static void
+gimp_parallel_distribute_task_unref (GimpParallelDistributeTask *task)
+{
+  if (g_atomic_int_dec_and_test (&task->ref_count))
+    {
+      g_mutex_clear (&task->mutex);
+      g_cond_clear (&task->cond);
+
+      g_slice_free (GimpParallelDistributeTask, task);
+    }
+}
+
+static void
+gimp_parallel_distribute_range_func (gint     i,
+                                     gint     n,
+                                     gpointer data)
+{
+  GimpParallelDistributeRangeData *range = data;
+  gsize                            offset;
+  gsize                            size;
+
+  offset = i * range->sub_size;
+
+  if (offset >= range->size)
+    return;
+
+  size = MIN (range->sub_size, range->size - offset);
+
+  range->func (offset, size, range->user_data);
+}
+
+static void
+gimp_parallel_distribute_area_func (gint     i,
+                                    gint     n,
+                                    gpointer data)
+{
+  GimpParallelDistributeAreaData *area_data = data;
+  const GeglRectangle            *area      = &area_data->area;
+  GeglRectangle                   sub_area  = *area;
+
+  if (area_data->vertical)
+    {
+      sub_area.y      = area->y + (gint64) area->height * i       / n;
+      sub_area.height = area->y + (gint64) area->height * (i + 1) / n -
+                        sub_area.y;
+    }
+  else
+    {
+      sub_area.x      = area->x + (gint64) area->width * i       / n;
+      sub_area.width  = area->x + (gint64) area->width * (i + 1) / n -
+                        sub_area.x;
+    }
+
+  if (sub_area.width > 0 && sub_area.height > 0)
+    area_data->func (&sub_area, area_data->user_data);
+}
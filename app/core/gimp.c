@@ -46,6 +46,7 @@
 #include "gimp-contexts.h"
 #include "gimp-gradients.h"
 #include "gimp-modules.h"
+#include "gimp-parallel.h"
 #include "gimp-parasites.h"
 #include "gimp-templates.h"
 #include "gimp-units.h"
@@ -58,6 +59,7 @@
 #include "gimpbuffer.h"
 #include "gimpcontext.h"
 #include "gimpdatafactory.h"
+#include "gimpdrawableundo.h"
 #include "gimpdynamics.h"
 #include "gimpdynamics-load.h"
 #include "gimpdocumentlist.h"
@@ -446,6 +448,11 @@ gimp_finalize (GObject *object)
 
   gimp_paint_exit (gimp);
 
+  if (gimp->config)
+    gimp_parallel_exit (gimp);
+
+  gimp_drawable_undo_exit ();
+
   if (gimp->parasites)
     {
       g_object_unref (gimp->parasites);
@@ -558,41 +565,42 @@ gimp_real_initialize (Gimp               *gimp,
 {
   static const GimpDataFactoryLoaderEntry brush_loader_entries[] =
   {
-    { gimp_brush_load,           GIMP_BRUSH_FILE_EXTENSION,           FALSE },
-    { gimp_brush_load,           GIMP_BRUSH_PIXMAP_FILE_EXTENSION,    FALSE },
-    { gimp_brush_load_abr,       GIMP_BRUSH_PS_FILE_EXTENSION,        FALSE },
-    { gimp_brush_load_abr,       GIMP_BRUSH_PSP_FILE_EXTENSION,       FALSE },
-    { gimp_brush_generated_load, GIMP_BRUSH_GENERATED_FILE_EXTENSION, TRUE  },
-    { gimp_brush_pipe_load,      GIMP_BRUSH_PIPE_FILE_EXTENSION,      FALSE }
+    { gimp_brush_load,           GIMP_BRUSH_FILE_EXTENSION,           FALSE, TRUE,  gimp_brush_new_stub   },
+    { gimp_brush_load,           GIMP_BRUSH_PIXMAP_FILE_EXTENSION,    FALSE, TRUE,  gimp_brush_new_stub   },
+    { gimp_brush_load_abr,       GIMP_BRUSH_PS_FILE_EXTENSION,        FALSE, TRUE,  NULL                  },
+    { gimp_brush_load_abr,       GIMP_BRUSH_PSP_FILE_EXTENSION,       FALSE, TRUE,  NULL                  },
+    { gimp_brush_generated_load, GIMP_BRUSH_GENERATED_FILE_EXTENSION, TRUE,  TRUE,  NULL                  },
+    { gimp_brush_pipe_load,      GIMP_BRUSH_PIPE_FILE_EXTENSION,      FALSE, TRUE,  NULL                  }
   };
 
   static const GimpDataFactoryLoaderEntry dynamics_loader_entries[] =
   {
-    { gimp_dynamics_load,        GIMP_DYNAMICS_FILE_EXTENSION,        TRUE  }
+    { gimp_dynamics_load,        GIMP_DYNAMICS_FILE_EXTENSION,        TRUE,  FALSE, NULL                  }
   };
 
   static const GimpDataFactoryLoaderEntry pattern_loader_entries[] =
   {
-    { gimp_pattern_load,         GIMP_PATTERN_FILE_EXTENSION,         FALSE },
-    { gimp_pattern_load_pixbuf,  NULL,                                FALSE }
+    { gimp_pattern_load,         GIMP_PATTERN_FILE_EXTENSION,         FALSE, TRUE,  gimp_pattern_new_stub },
+    { gimp_pattern_load_pixbuf,  NULL,                                FALSE, TRUE,  gimp_pattern_new_stub }
   };
 
   static const GimpDataFactoryLoaderEntry gradient_loader_entries[] =
   {
-    { gimp_gradient_load,        GIMP_GRADIENT_FILE_EXTENSION,        TRUE  },
-    { gimp_gradient_load_svg,    GIMP_GRADIENT_SVG_FILE_EXTENSION,    FALSE },
-    { gimp_gradient_load,        NULL /* legacy loader */,            TRUE  }
+    { gimp_gradient_load,        GIMP_GRADIENT_FILE_EXTENSION,        TRUE,  TRUE,  NULL                  },
+    { gimp_gradient_load_svg,    GIMP_GRADIENT_SVG_FILE_EXTENSION,    FALSE, TRUE,  NULL                  },
+    { gimp_gradient_load,        NULL /* legacy loader */,            TRUE,  TRUE,  NULL                  }
   };
 
+  /*  the palette loader reports problems using g_message()  */
   static const GimpDataFactoryLoaderEntry palette_loader_entries[] =
   {
-    { gimp_palette_load,         GIMP_PALETTE_FILE_EXTENSION,         TRUE  },
-    { gimp_palette_load,         NULL /* legacy loader */,            TRUE  }
+    { gimp_palette_load,         GIMP_PALETTE_FILE_EXTENSION,         TRUE,  FALSE, NULL                  },
+    { gimp_palette_load,         NULL /* legacy loader */,            TRUE,  FALSE, NULL                  }
   };
 
   static const GimpDataFactoryLoaderEntry tool_preset_loader_entries[] =
   {
-    { gimp_tool_preset_load,     GIMP_TOOL_PRESET_FILE_EXTENSION,     TRUE  }
+    { gimp_tool_preset_load,     GIMP_TOOL_PRESET_FILE_EXTENSION,     TRUE,  FALSE, NULL                  }
   };
 
   GimpData *clipboard_brush;
@@ -930,6 +938,8 @@ gimp_load_config (Gimp        *gimp,
   g_signal_connect_object (gimp->edit_config, "notify",
                            G_CALLBACK (gimp_edit_config_notify),
                            gimp->config, 0);
+
+  gimp_parallel_init (gimp);
 }
 
 void
@@ -81,6 +81,11 @@ static gchar       * gimp_brush_get_description       (GimpViewable         *vie
 static void          gimp_brush_dirty                 (GimpData             *data);
 static const gchar * gimp_brush_get_extension         (GimpData             *data);
 
+static gint64        gimp_brush_temp_buf_get_memsize  (GimpTempBuf          *buf,
+                                                       gint64               *gui_size);
+static gint64        gimp_brush_boundary_get_memsize  (GimpBezierDesc       *desc,
+                                                       gint64               *gui_size);
+
 static void          gimp_brush_real_begin_use        (GimpBrush            *brush);
 static void          gimp_brush_real_end_use          (GimpBrush            *brush);
 static GimpBrush   * gimp_brush_real_select_brush     (GimpBrush            *brush,
@@ -92,6 +97,8 @@ static gboolean      gimp_brush_real_want_null_motion (GimpBrush            *bru
 
 static gchar       * gimp_brush_get_checksum          (GimpTagged           *tagged);
 
+static void          gimp_brush_load_stub             (GimpBrush            *brush);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpBrush, gimp_brush, GIMP_TYPE_DATA,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_TAGGED,
@@ -205,6 +212,12 @@ gimp_brush_finalize (GObject *object)
       brush->boundary_cache = NULL;
     }
 
+  if (brush->stub_checksum)
+    {
+      g_free (brush->stub_checksum);
+      brush->stub_checksum = NULL;
+    }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -239,7 +252,7 @@ gimp_brush_get_property (GObject    *object,
   switch (property_id)
     {
     case PROP_SPACING:
-      g_value_set_double (value, brush->spacing);
+      g_value_set_double (value, gimp_brush_get_spacing (brush));
       break;
 
     default:
@@ -258,6 +271,11 @@ gimp_brush_get_memsize (GimpObject *object,
   memsize += gimp_temp_buf_get_memsize (brush->mask);
   memsize += gimp_temp_buf_get_memsize (brush->pixmap);
 
+  memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->mask_cache), NULL);
+  memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->pixmap_cache), NULL);
+  memsize += gimp_object_get_memsize (GIMP_OBJECT (brush->boundary_cache),
+                                      NULL);
+
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
 }
@@ -267,10 +285,20 @@ gimp_brush_get_size (GimpViewable *viewable,
                      gint         *width,
                      gint         *height)
 {
-  GimpBrush *brush = GIMP_BRUSH (viewable);
+  GimpBrush *brush      = GIMP_BRUSH (viewable);
+  gint       stub_width = g_atomic_int_get (&brush->stub_width);
 
-  *width  = gimp_temp_buf_get_width  (brush->mask);
-  *height = gimp_temp_buf_get_height (brush->mask);
+  /*  don't load a stub's pixels just to know its size  */
+  if (stub_width)
+    {
+      *width  = stub_width;
+      *height = brush->stub_height;
+    }
+  else
+    {
+      *width  = gimp_temp_buf_get_width  (brush->mask);
+      *height = gimp_temp_buf_get_height (brush->mask);
+    }
 
   return TRUE;
 }
@@ -292,8 +320,8 @@ gimp_brush_get_new_preview (GimpViewable *viewable,
   gint               x, y;
   gboolean           scaled = FALSE;
 
-  mask_buf   = brush->mask;
-  pixmap_buf = brush->pixmap;
+  mask_buf   = gimp_brush_get_mask (brush);
+  pixmap_buf = gimp_brush_get_pixmap (brush);
 
   mask_width  = gimp_temp_buf_get_width  (mask_buf);
   mask_height = gimp_temp_buf_get_height (mask_buf);
@@ -383,11 +411,14 @@ gimp_brush_get_description (GimpViewable  *viewable,
                             gchar        **tooltip)
 {
   GimpBrush *brush = GIMP_BRUSH (viewable);
+  gint       width;
+  gint       height;
+
+  gimp_viewable_get_size (viewable, &width, &height);
 
   return g_strdup_printf ("%s (%d × %d)",
                           gimp_object_get_name (brush),
-                          gimp_temp_buf_get_width  (brush->mask),
-                          gimp_temp_buf_get_height (brush->mask));
+                          width, height);
 }
 
 static void
@@ -413,17 +444,37 @@ gimp_brush_get_extension (GimpData *data)
   return GIMP_BRUSH_FILE_EXTENSION;
 }
 
+static gint64
+gimp_brush_temp_buf_get_memsize (GimpTempBuf *buf,
+                                 gint64      *gui_size)
+{
+  return gimp_temp_buf_get_memsize (buf);
+}
+
+static gint64
+gimp_brush_boundary_get_memsize (GimpBezierDesc *desc,
+                                 gint64         *gui_size)
+{
+  return sizeof (GimpBezierDesc) + desc->num_data * sizeof (cairo_path_data_t);
+}
+
 static void
 gimp_brush_real_begin_use (GimpBrush *brush)
 {
   brush->mask_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'M', 'm');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          (GimpMemsizeFunc) gimp_brush_temp_buf_get_memsize,
+                          'M', 'm');
 
   brush->pixmap_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'P', 'p');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          (GimpMemsizeFunc) gimp_brush_temp_buf_get_memsize,
+                          'P', 'p');
 
   brush->boundary_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free, 'B', 'b');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free,
+                          (GimpMemsizeFunc) gimp_brush_boundary_get_memsize,
+                          'B', 'b');
 }
 
 static void
@@ -461,7 +512,12 @@ gimp_brush_get_checksum (GimpTagged *tagged)
   GimpBrush *brush           = GIMP_BRUSH (tagged);
   gchar     *checksum_string = NULL;
 
-  if (brush->mask)
+  /*  the tag cache asks every brush, answer it from the index  */
+  if (g_atomic_int_get (&brush->stub_width))
+    {
+      checksum_string = g_strdup (brush->stub_checksum);
+    }
+  else if (brush->mask)
     {
       GChecksum *checksum = g_checksum_new (G_CHECKSUM_MD5);
 
@@ -482,6 +538,80 @@ gimp_brush_get_checksum (GimpTagged *tagged)
   return checksum_string;
 }
 
+static void
+gimp_brush_load_stub (GimpBrush *brush)
+{
+  static GMutex mutex;
+
+  g_mutex_lock (&mutex);
+
+  /*  another thread may have loaded it while we were waiting  */
+  if (brush->stub_width)
+    {
+      const gchar *filename = gimp_data_get_filename (GIMP_DATA (brush));
+      GList       *list     = NULL;
+      GimpBrush   *loaded   = NULL;
+      GError      *error    = NULL;
+
+      if (filename)
+        list = gimp_brush_load (NULL, filename, &error);
+
+      if (list && ! list->next &&
+          G_TYPE_FROM_INSTANCE (list->data) == GIMP_TYPE_BRUSH)
+        {
+          loaded = list->data;
+
+          if (gimp_temp_buf_get_width  (loaded->mask) != brush->stub_width ||
+              gimp_temp_buf_get_height (loaded->mask) != brush->stub_height)
+            loaded = NULL;
+        }
+
+      if (loaded)
+        {
+          brush->pixmap  = loaded->pixmap;
+          brush->mask    = loaded->mask;
+          brush->spacing = loaded->spacing;
+
+          loaded->pixmap = NULL;
+          loaded->mask   = NULL;
+        }
+      else
+        {
+          /*  the file changed or vanished since it was indexed, use an
+           *  empty mask of the promised size until the next refresh
+           */
+          if (error)
+            g_message ("%s", error->message);
+          else
+            g_message (_("Brush file '%s' changed since GIMP was started."),
+                       filename ? gimp_filename_to_utf8 (filename) : "???");
+
+          g_clear_error (&error);
+
+          brush->mask = gimp_temp_buf_new (brush->stub_width,
+                                           brush->stub_height,
+                                           babl_format ("Y u8"));
+          gimp_temp_buf_data_clear (brush->mask);
+        }
+
+      g_list_free_full (list, (GDestroyNotify) g_object_unref);
+
+      g_free (brush->stub_checksum);
+      brush->stub_checksum = NULL;
+
+      g_atomic_int_set (&brush->stub_width, 0);
+    }
+
+  g_mutex_unlock (&mutex);
+}
+
+static inline void
+gimp_brush_ensure_loaded (const GimpBrush *brush)
+{
+  if (G_UNLIKELY (g_atomic_int_get (&brush->stub_width)))
+    gimp_brush_load_stub ((GimpBrush *) brush);
+}
+
 /*  public functions  */
 
 GimpData *
@@ -514,6 +644,40 @@ gimp_brush_get_standard (GimpContext *context)
   return standard_brush;
 }
 
+/*  creates a brush from a data factory index entry, its pixels are
+ *  read from the brush's file on first use, see gimp_brush_get_mask()
+ */
+GimpData *
+gimp_brush_new_stub (const gchar *filename,
+                     const gchar *name,
+                     gint         width,
+                     gint         height,
+                     const gchar *checksum)
+{
+  GimpBrush *brush;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  brush = g_object_new (GIMP_TYPE_BRUSH,
+                        "name",      name,
+                        "mime-type", "image/x-gimp-gbr",
+                        NULL);
+
+  /*  same as gimp_brush_load_brush()  */
+  brush->x_axis.x = width  / 2.0;
+  brush->x_axis.y = 0.0;
+  brush->y_axis.x = 0.0;
+  brush->y_axis.y = height / 2.0;
+
+  brush->stub_width    = width;
+  brush->stub_height   = height;
+  brush->stub_checksum = g_strdup (checksum);
+
+  return GIMP_DATA (brush);
+}
+
 void
 gimp_brush_begin_use (GimpBrush *brush)
 {
@@ -578,6 +742,8 @@ gimp_brush_transform_size (GimpBrush     *brush,
   g_return_if_fail (width != NULL);
   g_return_if_fail (height != NULL);
 
+  gimp_brush_ensure_loaded (brush);
+
   if (scale        == 1.0 &&
       aspect_ratio == 0.0 &&
       ((angle == 0.0) || (angle == 0.5) || (angle == 1.0)))
@@ -654,7 +820,7 @@ gimp_brush_transform_pixmap (GimpBrush *brush,
   gint               height;
 
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
-  g_return_val_if_fail (brush->pixmap != NULL, NULL);
+  g_return_val_if_fail (gimp_brush_get_pixmap (brush) != NULL, NULL);
   g_return_val_if_fail (scale > 0.0, NULL);
 
   gimp_brush_transform_size (brush,
@@ -748,6 +914,8 @@ gimp_brush_get_mask (const GimpBrush *brush)
   g_return_val_if_fail (brush != NULL, NULL);
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
 
+  gimp_brush_ensure_loaded (brush);
+
   return brush->mask;
 }
 
@@ -757,6 +925,8 @@ gimp_brush_get_pixmap (const GimpBrush *brush)
   g_return_val_if_fail (brush != NULL, NULL);
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
 
+  gimp_brush_ensure_loaded (brush);
+
   return brush->pixmap;
 }
 
@@ -765,6 +935,8 @@ gimp_brush_get_spacing (const GimpBrush *brush)
 {
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), 0);
 
+  gimp_brush_ensure_loaded (brush);
+
   return brush->spacing;
 }
 
@@ -774,6 +946,8 @@ gimp_brush_set_spacing (GimpBrush *brush,
 {
   g_return_if_fail (GIMP_IS_BRUSH (brush));
 
+  gimp_brush_ensure_loaded (brush);
+
   if (brush->spacing != spacing)
     {
       brush->spacing = spacing;
@@ -47,6 +47,10 @@ struct _GimpBrush
   GimpBrushCache *mask_cache;
   GimpBrushCache *pixmap_cache;
   GimpBrushCache *boundary_cache;
+
+  gint            stub_width;    /*  set while the mask is not loaded  */
+  gint            stub_height;
+  gchar          *stub_checksum;
 };
 
 struct _GimpBrushClass
@@ -96,6 +100,11 @@ GType                  gimp_brush_get_type           (void) G_GNUC_CONST;
 GimpData             * gimp_brush_new                (GimpContext      *context,
                                                       const gchar      *name);
 GimpData             * gimp_brush_get_standard       (GimpContext      *context);
+GimpData             * gimp_brush_new_stub           (const gchar      *filename,
+                                                      const gchar      *name,
+                                                      gint              width,
+                                                      gint              height,
+                                                      const gchar      *checksum);
 
 void                   gimp_brush_begin_use          (GimpBrush        *brush);
 void                   gimp_brush_end_use            (GimpBrush        *brush);
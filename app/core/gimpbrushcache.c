@@ -33,7 +33,24 @@
 enum
 {
   PROP_0,
-  PROP_DATA_DESTROY
+  PROP_DATA_DESTROY,
+  PROP_DATA_GET_MEMSIZE
+};
+
+
+typedef struct _GimpBrushCacheUnit GimpBrushCacheUnit;
+
+struct _GimpBrushCacheUnit
+{
+  gpointer  data;
+  gint64    size;
+
+  gint      width;
+  gint      height;
+  gdouble   scale;
+  gdouble   aspect_ratio;
+  gdouble   angle;
+  gdouble   hardness;
 };
 
 
@@ -48,6 +65,12 @@ static void   gimp_brush_cache_get_property (GObject      *object,
                                              GValue       *value,
                                              GParamSpec   *pspec);
 
+static gint64 gimp_brush_cache_get_memsize  (GimpObject   *object,
+                                             gint64       *gui_size);
+
+static void   gimp_brush_cache_unit_free    (GimpBrushCache     *cache,
+                                             GimpBrushCacheUnit *unit);
+
 
 G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
 
@@ -57,23 +80,33 @@ G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
 static void
 gimp_brush_cache_class_init (GimpBrushCacheClass *klass)
 {
-  GObjectClass  *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass    *object_class      = G_OBJECT_CLASS (klass);
+  GimpObjectClass *gimp_object_class = GIMP_OBJECT_CLASS (klass);
+
+  object_class->constructed      = gimp_brush_cache_constructed;
+  object_class->finalize         = gimp_brush_cache_finalize;
+  object_class->set_property     = gimp_brush_cache_set_property;
+  object_class->get_property     = gimp_brush_cache_get_property;
 
-  object_class->constructed  = gimp_brush_cache_constructed;
-  object_class->finalize     = gimp_brush_cache_finalize;
-  object_class->set_property = gimp_brush_cache_set_property;
-  object_class->get_property = gimp_brush_cache_get_property;
+  gimp_object_class->get_memsize = gimp_brush_cache_get_memsize;
 
   g_object_class_install_property (object_class, PROP_DATA_DESTROY,
                                    g_param_spec_pointer ("data-destroy",
                                                          NULL, NULL,
                                                          GIMP_PARAM_READWRITE |
                                                          G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (object_class, PROP_DATA_GET_MEMSIZE,
+                                   g_param_spec_pointer ("data-get-memsize",
+                                                         NULL, NULL,
+                                                         GIMP_PARAM_READWRITE |
+                                                         G_PARAM_CONSTRUCT_ONLY));
 }
 
 static void
-gimp_brush_cache_init (GimpBrushCache *brush)
+gimp_brush_cache_init (GimpBrushCache *cache)
 {
+  g_queue_init (&cache->cached_units);
 }
 
 static void
@@ -84,6 +117,7 @@ gimp_brush_cache_constructed (GObject *object)
   G_OBJECT_CLASS (parent_class)->constructed (object);
 
   g_assert (cache->data_destroy != NULL);
+  g_assert (cache->data_get_memsize != NULL);
 }
 
 static void
@@ -91,11 +125,11 @@ gimp_brush_cache_finalize (GObject *object)
 {
   GimpBrushCache *cache = GIMP_BRUSH_CACHE (object);
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  gimp_brush_cache_clear (cache);
+
+  if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
+    g_printerr ("\nbrush cache '%c': %d hits, %d misses\n",
+                cache->debug_hit, cache->n_hits, cache->n_misses);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -113,6 +147,9 @@ gimp_brush_cache_set_property (GObject      *object,
     case PROP_DATA_DESTROY:
       cache->data_destroy = g_value_get_pointer (value);
       break;
+    case PROP_DATA_GET_MEMSIZE:
+      cache->data_get_memsize = g_value_get_pointer (value);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -133,6 +170,9 @@ gimp_brush_cache_get_property (GObject    *object,
     case PROP_DATA_DESTROY:
       g_value_set_pointer (value, cache->data_destroy);
       break;
+    case PROP_DATA_GET_MEMSIZE:
+      g_value_set_pointer (value, cache->data_get_memsize);
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -140,20 +180,38 @@ gimp_brush_cache_get_property (GObject    *object,
     }
 }
 
+static gint64
+gimp_brush_cache_get_memsize (GimpObject *object,
+                              gint64     *gui_size)
+{
+  GimpBrushCache *cache   = GIMP_BRUSH_CACHE (object);
+  gint64          memsize = 0;
+
+  memsize += (cache->cached_units.length *
+              (sizeof (GList) + sizeof (GimpBrushCacheUnit)));
+  memsize += cache->cached_size;
+
+  return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
+                                                                  gui_size);
+}
+
 
 /*  public functions  */
 
 GimpBrushCache *
 gimp_brush_cache_new (GDestroyNotify  data_destroy,
+                      GimpMemsizeFunc data_get_memsize,
                       gchar           debug_hit,
                       gchar           debug_miss)
 {
   GimpBrushCache *cache;
 
   g_return_val_if_fail (data_destroy != NULL, NULL);
+  g_return_val_if_fail (data_get_memsize != NULL, NULL);
 
   cache =  g_object_new (GIMP_TYPE_BRUSH_CACHE,
-                         "data-destroy", data_destroy,
+                         "data-destroy",     data_destroy,
+                         "data-get-memsize", data_get_memsize,
                          NULL);
 
   cache->debug_hit  = debug_hit;
@@ -165,13 +223,12 @@ gimp_brush_cache_new (GDestroyNotify  data_destroy,
 void
 gimp_brush_cache_clear (GimpBrushCache *cache)
 {
+  GimpBrushCacheUnit *unit;
+
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  while ((unit = g_queue_pop_head (&cache->cached_units)))
+    gimp_brush_cache_unit_free (cache, unit);
 }
 
 gconstpointer
@@ -183,22 +240,41 @@ gimp_brush_cache_get (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GList *list;
+
   g_return_val_if_fail (GIMP_IS_BRUSH_CACHE (cache), NULL);
 
-  if (cache->last_data                         &&
-      cache->last_width        == width        &&
-      cache->last_height       == height       &&
-      cache->last_scale        == scale        &&
-      cache->last_aspect_ratio == aspect_ratio &&
-      cache->last_angle        == angle        &&
-      cache->last_hardness     == hardness)
+  for (list = cache->cached_units.head; list; list = g_list_next (list))
     {
-      if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
-        g_printerr ("%c", cache->debug_hit);
-
-      return (gconstpointer) cache->last_data;
+      GimpBrushCacheUnit *unit = list->data;
+
+      if (unit->width        == width        &&
+          unit->height       == height       &&
+          unit->scale        == scale        &&
+          unit->aspect_ratio == aspect_ratio &&
+          unit->angle        == angle        &&
+          unit->hardness     == hardness)
+        {
+          /*  move the unit to the front, so the least recently used
+           *  ones are the first to go
+           */
+          if (list != cache->cached_units.head)
+            {
+              g_queue_unlink (&cache->cached_units, list);
+              g_queue_push_head_link (&cache->cached_units, list);
+            }
+
+          cache->n_hits++;
+
+          if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
+            g_printerr ("%c", cache->debug_hit);
+
+          return (gconstpointer) unit->data;
+        }
     }
 
+  cache->n_misses++;
+
   if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
     g_printerr ("%c", cache->debug_miss);
 
@@ -215,20 +291,53 @@ gimp_brush_cache_add (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GimpBrushCacheUnit *unit;
+
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
   g_return_if_fail (data != NULL);
 
-  if (data == cache->last_data)
+  unit = g_queue_peek_head (&cache->cached_units);
+
+  if (unit && unit->data == data)
     return;
 
-  if (cache->last_data)
-    cache->data_destroy (cache->last_data);
+  unit = g_slice_new (GimpBrushCacheUnit);
+
+  unit->data         = data;
+  unit->size         = cache->data_get_memsize (data, NULL);
+  unit->width        = width;
+  unit->height       = height;
+  unit->scale        = scale;
+  unit->aspect_ratio = aspect_ratio;
+  unit->angle        = angle;
+  unit->hardness     = hardness;
+
+  g_queue_push_head (&cache->cached_units, unit);
+
+  cache->cached_size += unit->size;
+
+  /*  drop the least recently used units while the cache is too big,
+   *  the new one is never dropped here, callers still hold on to its
+   *  data
+   */
+  while (cache->cached_size > GIMP_BRUSH_CACHE_MAX_SIZE &&
+         cache->cached_units.length > 1)
+    {
+      gimp_brush_cache_unit_free (cache,
+                                  g_queue_pop_tail (&cache->cached_units));
+    }
+}
+
+
+/*  private functions  */
+
+static void
+gimp_brush_cache_unit_free (GimpBrushCache     *cache,
+                            GimpBrushCacheUnit *unit)
+{
+  cache->cached_size -= unit->size;
+
+  cache->data_destroy (unit->data);
 
-  cache->last_data         = data;
-  cache->last_width        = width;
-  cache->last_height       = height;
-  cache->last_scale        = scale;
-  cache->last_aspect_ratio = aspect_ratio;
-  cache->last_angle        = angle;
-  cache->last_hardness     = hardness;
+  g_slice_free (GimpBrushCacheUnit, unit);
 }
@@ -33,24 +33,29 @@
 #define GIMP_BRUSH_CACHE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GIMP_TYPE_BRUSH_CACHE, GimpBrushCacheClass))
 
 
+/*  the maximum number of bytes of transformed brushes kept per cache,
+ *  the most recently used one is always kept
+ */
+#define GIMP_BRUSH_CACHE_MAX_SIZE (16 * 1024 * 1024)
+
+
 typedef struct _GimpBrushCacheClass GimpBrushCacheClass;
 
 struct _GimpBrushCache
 {
   GimpObject      parent_instance;
 
-  GDestroyNotify  data_destroy;
+  GDestroyNotify   data_destroy;
+  GimpMemsizeFunc  data_get_memsize;
+
+  GQueue           cached_units;  /* most recently used first */
+  gint64           cached_size;
 
-  gpointer        last_data;
-  gint            last_width;
-  gint            last_height;
-  gdouble         last_scale;
-  gdouble         last_aspect_ratio;
-  gdouble         last_angle;
-  gdouble         last_hardness;
+  gint             n_hits;
+  gint             n_misses;
 
-  gchar           debug_hit;
-  gchar           debug_miss;
+  gchar            debug_hit;
+  gchar            debug_miss;
 };
 
 struct _GimpBrushCacheClass
@@ -62,6 +67,7 @@ struct _GimpBrushCacheClass
 GType            gimp_brush_cache_get_type (void) G_GNUC_CONST;
 
 GimpBrushCache * gimp_brush_cache_new      (GDestroyNotify  data_destory,
+                                            GimpMemsizeFunc data_get_memsize,
                                             gchar           debug_hit,
                                             gchar           debug_miss);
 
@@ -33,10 +33,12 @@
 #include "core-types.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimpcontext.h"
 #include "gimpdata.h"
 #include "gimpdatafactory.h"
 #include "gimplist.h"
+#include "gimptagged.h"
 
 #include "gimp-intl.h"
 
@@ -54,6 +56,46 @@ typedef void (* GimpDataForeachFunc) (GimpDataFactory *factory,
                                       gpointer         user_data);
 
 
+/*  What the index remembers about a data file, enough to create a
+ *  stub without reading the file, see gimp_data_factory_data_init()
+ */
+typedef struct
+{
+  gint64  mtime;
+  gchar  *name;
+  gint    width;
+  gint    height;
+  gchar  *checksum;
+} GimpDataIndexEntry;
+
+typedef struct
+{
+  const GimpDataFactoryLoaderEntry *loader;
+  gchar                            *filename;
+  gchar                            *dirname;
+  gchar                            *top_directory;
+  gint64                            mtime;
+  gboolean                          cached;     /* data_list is from the
+                                                 * refresh cache
+                                                 */
+  const GimpDataIndexEntry         *stub;       /* create a stub from it */
+  gboolean                          loaded;
+  GList                            *data_list;
+  gchar                            *checksum;
+  GError                           *error;
+} GimpDataLoadFile;
+
+typedef struct
+{
+  GimpDataFactory *factory;
+  GimpContext     *context;
+  GHashTable      *cache;
+  GHashTable      *index;
+  const gchar     *top_directory;
+  GArray          *files;
+  gint             next_file;
+} GimpDataLoadContext;
+
 struct _GimpDataFactoryPriv
 {
   Gimp                             *gimp;
@@ -69,6 +111,9 @@ struct _GimpDataFactoryPriv
 
   GimpDataNewFunc                   data_new_func;
   GimpDataGetStandardFunc           data_get_standard_func;
+
+  GHashTable                       *index;
+  gboolean                          index_dirty;
 };
 
 
@@ -90,6 +135,19 @@ static void    gimp_data_factory_load_data  (const GimpDatafileData *file_data,
 static void    gimp_data_factory_load_data_recursive (const GimpDatafileData *file_data,
                                                       gpointer                data);
 
+static void    gimp_data_factory_load_files (gint                    i,
+                                             gint                    n,
+                                             GimpDataLoadContext    *context);
+static void    gimp_data_factory_add_loaded (GimpDataLoadContext    *context,
+                                             GimpDataLoadFile       *file);
+
+static gboolean     gimp_data_factory_has_stubs       (GimpDataFactory    *factory);
+static gchar      * gimp_data_factory_get_index_file  (GimpDataFactory    *factory);
+static GHashTable * gimp_data_factory_index_new       (void);
+static void         gimp_data_factory_index_load      (GimpDataFactory    *factory);
+static void         gimp_data_factory_index_save      (GimpDataFactory    *factory);
+static void         gimp_data_index_entry_free        (GimpDataIndexEntry *entry);
+
 G_DEFINE_TYPE (GimpDataFactory, gimp_data_factory, GIMP_TYPE_OBJECT)
 
 #define parent_class gimp_data_factory_parent_class
@@ -124,6 +182,8 @@ gimp_data_factory_init (GimpDataFactory *factory)
   factory->priv->n_loader_entries       = 0;
   factory->priv->data_new_func          = NULL;
   factory->priv->data_get_standard_func = NULL;
+  factory->priv->index                  = NULL;
+  factory->priv->index_dirty            = FALSE;
 }
 
 static void
@@ -155,6 +215,12 @@ gimp_data_factory_finalize (GObject *object)
       factory->priv->writable_property_name = NULL;
     }
 
+  if (factory->priv->index)
+    {
+      g_hash_table_unref (factory->priv->index);
+      factory->priv->index = NULL;
+    }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -215,6 +281,14 @@ gimp_data_factory_new (Gimp                             *gimp,
   return factory;
 }
 
+/*  Loaders with a new_stub() function return exactly one object per
+ *  file.  Their files are listed in an index, which is written by
+ *  gimp_data_factory_data_save().  As long as a file's mtime matches
+ *  its index entry, it is not read when loading the data, but a stub
+ *  is created from the index entry.  The stub knows its name, size
+ *  and checksum, so the data views and the tag cache can use it, and
+ *  loads its pixels from the file when they are first asked for.
+ */
 void
 gimp_data_factory_data_init (GimpDataFactory *factory,
                              GimpContext     *context,
@@ -305,14 +379,6 @@ gimp_data_factory_data_foreach (GimpDataFactory     *factory,
     }
 }
 
-typedef struct
-{
-  GimpDataFactory *factory;
-  GimpContext     *context;
-  GHashTable      *cache;
-  const gchar     *top_directory;
-} GimpDataLoadContext;
-
 static void
 gimp_data_factory_data_load (GimpDataFactory *factory,
                              GimpContext     *context,
@@ -331,6 +397,8 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
       GList               *writable_list = NULL;
       gchar               *tmp;
       GimpDataLoadContext  load_context = { 0, };
+      gint                 n_parse      = 0;
+      gint                 i;
 
       load_context.factory = factory;
       load_context.context = context;
@@ -352,6 +420,19 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
                              WRITABLE_PATH_KEY, writable_list);
         }
 
+      if (gimp_data_factory_has_stubs (factory))
+        {
+          if (! factory->priv->index)
+            gimp_data_factory_index_load (factory);
+
+          /*  the index is rebuilt from the files found below  */
+          load_context.index = gimp_data_factory_index_new ();
+        }
+
+      load_context.files = g_array_new (FALSE, FALSE,
+                                        sizeof (GimpDataLoadFile));
+
+      /*  first collect the files to load...  */
       gimp_datafiles_read_directories (path, G_FILE_TEST_IS_REGULAR,
                                        gimp_data_factory_load_data,
                                        &load_context);
@@ -360,6 +441,48 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
                                        gimp_data_factory_load_data_recursive,
                                        &load_context);
 
+      for (i = 0; i < load_context.files->len; i++)
+        {
+          GimpDataLoadFile *file = &g_array_index (load_context.files,
+                                                   GimpDataLoadFile, i);
+
+          if (! file->loaded && file->loader->threadsafe)
+            n_parse++;
+        }
+
+      /*  ...then parse the ones that are neither cached nor indexed
+       *  on all threads...
+       */
+      if (n_parse > 0)
+        gimp_parallel_distribute (n_parse,
+                                  (GimpParallelDistributeFunc)
+                                  gimp_data_factory_load_files,
+                                  &load_context);
+
+      /*  ...and add the results in the order the files were found,
+       *  so name collisions are resolved the same way on every run
+       */
+      for (i = 0; i < load_context.files->len; i++)
+        {
+          GimpDataLoadFile *file = &g_array_index (load_context.files,
+                                                   GimpDataLoadFile, i);
+
+          gimp_data_factory_add_loaded (&load_context, file);
+        }
+
+      g_array_free (load_context.files, TRUE);
+
+      if (load_context.index)
+        {
+          /*  files went away since the index was written  */
+          if (g_hash_table_size (load_context.index) !=
+              g_hash_table_size (factory->priv->index))
+            factory->priv->index_dirty = TRUE;
+
+          g_hash_table_unref (factory->priv->index);
+          factory->priv->index = load_context.index;
+        }
+
       if (writable_path)
         {
           gimp_path_free (writable_list);
@@ -418,6 +541,9 @@ gimp_data_factory_data_save (GimpDataFactory *factory)
 
   g_return_if_fail (GIMP_IS_DATA_FACTORY (factory));
 
+  if (factory->priv->index_dirty)
+    gimp_data_factory_index_save (factory);
+
   if (gimp_container_is_empty (factory->priv->container))
     return;
 
@@ -844,8 +970,7 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
   GimpDataFactory                  *factory = context->factory;
   GHashTable                       *cache   = context->cache;
   const GimpDataFactoryLoaderEntry *loader  = NULL;
-  GError                           *error   = NULL;
-  GList                            *data_list;
+  GimpDataLoadFile                  file    = { 0, };
   gint                              i;
 
   for (i = 0; i < factory->priv->n_loader_entries; i++)
@@ -865,6 +990,13 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
   return;
 
  insert:
+  /*  the file is added later, see gimp_data_factory_data_load()  */
+  file.loader        = loader;
+  file.filename      = g_strdup (file_data->filename);
+  file.dirname       = g_strdup (file_data->dirname);
+  file.top_directory = g_strdup (context->top_directory);
+  file.mtime         = file_data->mtime;
+
   if (cache)
     {
       GList *cached_data;
@@ -875,25 +1007,140 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
           gimp_data_get_mtime (cached_data->data) != 0 &&
           gimp_data_get_mtime (cached_data->data) == file_data->mtime)
         {
-          GList *list;
+          file.cached    = TRUE;
+          file.loaded    = TRUE;
+          file.data_list = cached_data;
+        }
+    }
+
+  if (! file.loaded && loader->new_stub && context->index)
+    {
+      const GimpDataIndexEntry *entry;
+
+      entry = g_hash_table_lookup (factory->priv->index, file_data->filename);
+
+      if (entry && entry->mtime == file_data->mtime)
+        {
+          file.stub   = entry;
+          file.loaded = TRUE;
+        }
+    }
+
+  g_array_append_val (context->files, file);
+}
+
+static void
+gimp_data_factory_load_files (gint                 i,
+                              gint                 n,
+                              GimpDataLoadContext *context)
+{
+  gint j;
+
+  /*  hand out the files one by one, their loading times vary a lot  */
+  while ((j = g_atomic_int_add (&context->next_file, 1)) <
+         (gint) context->files->len)
+    {
+      GimpDataLoadFile *file = &g_array_index (context->files,
+                                               GimpDataLoadFile, j);
+
+      /*  skip cached and indexed files, and leave the loaders that
+       *  need the main thread to gimp_data_factory_add_loaded()
+       */
+      if (! file->loaded && file->loader->threadsafe)
+        {
+          file->data_list = file->loader->load_func (context->context,
+                                                     file->filename,
+                                                     &file->error);
+          file->loaded    = TRUE;
+
+          /*  the index needs the checksum, which reads all pixels  */
+          if (file->loader->new_stub && context->index &&
+              file->data_list && ! file->data_list->next)
+            file->checksum =
+              gimp_tagged_get_checksum (GIMP_TAGGED (file->data_list->data));
+        }
+    }
+}
+
+static void
+gimp_data_factory_add_loaded (GimpDataLoadContext *context,
+                              GimpDataLoadFile    *file)
+{
+  GimpDataFactory *factory = context->factory;
+
+  if (file->stub)
+    {
+      GimpData *data = file->loader->new_stub (file->filename,
+                                               file->stub->name,
+                                               file->stub->width,
+                                               file->stub->height,
+                                               file->stub->checksum);
+
+      file->data_list = g_list_prepend (NULL, data);
+    }
+  else if (! file->loaded)
+    {
+      file->data_list = file->loader->load_func (context->context,
+                                                 file->filename,
+                                                 &file->error);
+    }
+
+  if (context->index && file->loader->new_stub)
+    {
+      const GimpDataIndexEntry *old_entry;
+      GimpDataIndexEntry       *entry = NULL;
+
+      old_entry = g_hash_table_lookup (factory->priv->index, file->filename);
+
+      if (old_entry && old_entry->mtime == file->mtime)
+        {
+          entry = g_slice_dup (GimpDataIndexEntry, old_entry);
 
-          for (list = cached_data; list; list = g_list_next (list))
-            gimp_container_add (factory->priv->container, list->data);
+          entry->name     = g_strdup (old_entry->name);
+          entry->checksum = g_strdup (old_entry->checksum);
+        }
+      else if (file->data_list && ! file->data_list->next)
+        {
+          GimpData *data = file->data_list->data;
+
+          if (! file->checksum)
+            file->checksum = gimp_tagged_get_checksum (GIMP_TAGGED (data));
+
+          if (file->checksum)
+            {
+              entry = g_slice_new0 (GimpDataIndexEntry);
+
+              entry->mtime    = file->mtime;
+              entry->name     = g_strdup (gimp_object_get_name (data));
+              entry->checksum = g_strdup (file->checksum);
 
-          return;
+              gimp_viewable_get_size (GIMP_VIEWABLE (data),
+                                      &entry->width, &entry->height);
+
+              factory->priv->index_dirty = TRUE;
+            }
         }
+
+      if (entry)
+        g_hash_table_insert (context->index, g_strdup (file->filename), entry);
     }
 
-  data_list = loader->load_func (context->context, file_data->filename, &error);
+  if (file->cached)
+    {
+      GList *list;
 
-  if (G_LIKELY (data_list))
+      /*  the refresh cache keeps its references and the list  */
+      for (list = file->data_list; list; list = g_list_next (list))
+        gimp_container_add (factory->priv->container, list->data);
+    }
+  else if (G_LIKELY (file->data_list))
     {
       GList    *list;
       gboolean  obsolete;
       gboolean  writable  = FALSE;
       gboolean  deletable = FALSE;
 
-      obsolete = (strstr (file_data->dirname,
+      obsolete = (strstr (file->dirname,
                           GIMP_OBSOLETE_DATA_DIR_NAME) != 0);
 
       /* obsolete files are immutable, don't check their writability */
@@ -904,20 +1151,20 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
           writable_list = g_object_get_data (G_OBJECT (factory),
                                              WRITABLE_PATH_KEY);
 
-          deletable = (g_list_length (data_list) == 1 &&
-                       gimp_data_factory_is_dir_writable (file_data->dirname,
+          deletable = (g_list_length (file->data_list) == 1 &&
+                       gimp_data_factory_is_dir_writable (file->dirname,
                                                           writable_list));
 
-          writable = (deletable && loader->writable);
+          writable = (deletable && file->loader->writable);
         }
 
-      for (list = data_list; list; list = g_list_next (list))
+      for (list = file->data_list; list; list = g_list_next (list))
         {
           GimpData *data = list->data;
 
-          gimp_data_set_filename (data, file_data->filename,
+          gimp_data_set_filename (data, file->filename,
                                   writable, deletable);
-          gimp_data_set_mtime (data, file_data->mtime);
+          gimp_data_set_mtime (data, file->mtime);
 
           gimp_data_clean (data);
 
@@ -928,7 +1175,7 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
             }
           else
             {
-              gimp_data_set_folder_tags (data, context->top_directory);
+              gimp_data_set_folder_tags (data, file->top_directory);
 
               gimp_container_add (factory->priv->container,
                                   GIMP_OBJECT (data));
@@ -937,13 +1184,221 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
           g_object_unref (data);
         }
 
-      g_list_free (data_list);
+      g_list_free (file->data_list);
     }
 
-  if (G_UNLIKELY (error))
+  if (G_UNLIKELY (file->error))
     {
       gimp_message (factory->priv->gimp, NULL, GIMP_MESSAGE_ERROR,
-                    _("Failed to load data:\n\n%s"), error->message);
+                    _("Failed to load data:\n\n%s"), file->error->message);
+      g_clear_error (&file->error);
+    }
+
+  g_free (file->filename);
+  g_free (file->dirname);
+  g_free (file->top_directory);
+  g_free (file->checksum);
+}
+
+static gboolean
+gimp_data_factory_has_stubs (GimpDataFactory *factory)
+{
+  gint i;
+
+  for (i = 0; i < factory->priv->n_loader_entries; i++)
+    {
+      if (factory->priv->loader_entries[i].new_stub)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gchar *
+gimp_data_factory_get_index_file (GimpDataFactory *factory)
+{
+  const gchar *property = factory->priv->path_property_name;
+  gchar       *basename;
+  gchar       *filename;
+
+  /*  "brush-path" => "brushindex"  */
+  if (g_str_has_suffix (property, "-path"))
+    basename = g_strndup (property, strlen (property) - strlen ("-path"));
+  else
+    basename = g_strdup (property);
+
+  filename = g_strconcat (basename, "index", NULL);
+  g_free (basename);
+
+  basename = gimp_personal_rc_file (filename);
+  g_free (filename);
+
+  return basename;
+}
+
+static GHashTable *
+gimp_data_factory_index_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal,
+                                (GDestroyNotify) g_free,
+                                (GDestroyNotify) gimp_data_index_entry_free);
+}
+
+static GTokenType
+gimp_data_factory_index_load_entry (GScanner   *scanner,
+                                    GHashTable *index)
+{
+  GimpDataIndexEntry *entry    = g_slice_new0 (GimpDataIndexEntry);
+  gchar              *filename = NULL;
+
+  if (! gimp_scanner_parse_string_no_validate (scanner, &filename) ||
+      ! gimp_scanner_parse_int64 (scanner, &entry->mtime)          ||
+      ! gimp_scanner_parse_string (scanner, &entry->name)          ||
+      ! gimp_scanner_parse_int (scanner, &entry->width)            ||
+      ! gimp_scanner_parse_int (scanner, &entry->height)           ||
+      ! gimp_scanner_parse_string (scanner, &entry->checksum)      ||
+      ! filename || ! entry->name || ! entry->checksum             ||
+      entry->width < 1 || entry->height < 1)
+    {
+      g_free (filename);
+      gimp_data_index_entry_free (entry);
+
+      return G_TOKEN_STRING;
+    }
+
+  g_hash_table_replace (index, filename, entry);
+
+  return G_TOKEN_RIGHT_PAREN;
+}
+
+static void
+gimp_data_factory_index_load (GimpDataFactory *factory)
+{
+  GScanner   *scanner;
+  GTokenType  token;
+  gchar      *filename;
+
+  factory->priv->index = gimp_data_factory_index_new ();
+
+  filename = gimp_data_factory_get_index_file (factory);
+
+  if (factory->priv->gimp->be_verbose)
+    g_print ("Parsing '%s'\n", gimp_filename_to_utf8 (filename));
+
+  /*  a missing index only means that all files are read  */
+  scanner = gimp_scanner_new_file (filename, NULL);
+  g_free (filename);
+
+  if (! scanner)
+    return;
+
+#define INDEX_FILE 1
+
+  g_scanner_scope_add_symbol (scanner, 0, "file",
+                              GINT_TO_POINTER (INDEX_FILE));
+
+  token = G_TOKEN_LEFT_PAREN;
+
+  while (g_scanner_peek_next_token (scanner) == token)
+    {
+      token = g_scanner_get_next_token (scanner);
+
+      switch (token)
+        {
+        case G_TOKEN_LEFT_PAREN:
+          token = G_TOKEN_SYMBOL;
+          break;
+
+        case G_TOKEN_SYMBOL:
+          if (scanner->value.v_symbol == GINT_TO_POINTER (INDEX_FILE))
+            token = gimp_data_factory_index_load_entry (scanner,
+                                                        factory->priv->index);
+          else
+            token = G_TOKEN_RIGHT_PAREN;
+          break;
+
+        case G_TOKEN_RIGHT_PAREN:
+          token = G_TOKEN_LEFT_PAREN;
+          break;
+
+        default: /* do nothing */
+          break;
+        }
+    }
+
+#undef INDEX_FILE
+
+  /*  don't trust a broken index, and write a new one on exit  */
+  if (token != G_TOKEN_LEFT_PAREN)
+    g_hash_table_remove_all (factory->priv->index);
+
+  gimp_scanner_destroy (scanner);
+}
+
+static void
+gimp_data_factory_index_save (GimpDataFactory *factory)
+{
+  GimpConfigWriter *writer;
+  gchar            *filename;
+  GError           *error = NULL;
+
+  filename = gimp_data_factory_get_index_file (factory);
+
+  if (factory->priv->gimp->be_verbose)
+    g_print ("Writing '%s'\n", gimp_filename_to_utf8 (filename));
+
+  writer = gimp_config_writer_new_file (filename,
+                                        TRUE,
+                                        "GIMP data index\n\n"
+                                        "This file lists data files and what "
+                                        "is needed to show them before they "
+                                        "are read.  It is rewritten when the "
+                                        "files change.",
+                                        &error);
+  g_free (filename);
+
+  if (writer)
+    {
+      GHashTableIter  iter;
+      gpointer        key;
+      gpointer        value;
+
+      g_hash_table_iter_init (&iter, factory->priv->index);
+
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          const GimpDataIndexEntry *entry = value;
+
+          gimp_config_writer_open (writer, "file");
+          gimp_config_writer_string (writer, key);
+          gimp_config_writer_printf (writer, "%" G_GINT64_FORMAT, entry->mtime);
+          gimp_config_writer_string (writer, entry->name);
+          gimp_config_writer_printf (writer, "%d %d",
+                                     entry->width, entry->height);
+          gimp_config_writer_string (writer, entry->checksum);
+          gimp_config_writer_close (writer);
+        }
+
+      gimp_config_writer_finish (writer, "end of data index", &error);
+    }
+
+  if (error)
+    {
+      gimp_message_literal (factory->priv->gimp, NULL, GIMP_MESSAGE_WARNING,
+                            error->message);
       g_clear_error (&error);
     }
+  else
+    {
+      factory->priv->index_dirty = FALSE;
+    }
+}
+
+static void
+gimp_data_index_entry_free (GimpDataIndexEntry *entry)
+{
+  g_free (entry->name);
+  g_free (entry->checksum);
+
+  g_slice_free (GimpDataIndexEntry, entry);
 }
@@ -31,15 +31,24 @@ typedef GList    * (* GimpDataLoadFunc)        (GimpContext  *context,
                                                 const gchar  *filename,
                                                 GError      **error);
 typedef GimpData * (* GimpDataGetStandardFunc) (GimpContext  *context);
+typedef GimpData * (* GimpDataNewStubFunc)     (const gchar  *filename,
+                                                const gchar  *name,
+                                                gint          width,
+                                                gint          height,
+                                                const gchar  *checksum);
 
 
 typedef struct _GimpDataFactoryLoaderEntry GimpDataFactoryLoaderEntry;
 
 struct _GimpDataFactoryLoaderEntry
 {
-  GimpDataLoadFunc  load_func;
-  const gchar      *extension;
-  gboolean          writable;
+  GimpDataLoadFunc     load_func;
+  const gchar         *extension;
+  gboolean             writable;
+  gboolean             threadsafe;  /* may run outside the main thread   */
+  GimpDataNewStubFunc  new_stub;    /* for loaders returning one object,
+                                     * see gimp_data_factory_data_init()
+                                     */
 };
 
 
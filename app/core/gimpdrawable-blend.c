@@ -34,6 +34,7 @@
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimp-utils.h"
 #include "gimpchannel.h"
 #include "gimpcontext.h"
@@ -47,6 +48,10 @@
 
 //#define USE_GRADIENT_CACHE 1
 
+/*  rows rendered between progress updates, and minimal area per thread  */
+#define GRADIENT_STRIPE_HEIGHT   256
+#define GRADIENT_MIN_SUB_AREA    (64 * 64)
+
 
 typedef struct
 {
@@ -65,7 +70,6 @@ typedef struct
   gdouble           dist;
   gdouble           vec[2];
   GimpRepeatMode    repeat;
-  GRand            *seed;
   GeglBuffer       *dist_buffer;
 } RenderBlendData;
 
@@ -77,6 +81,22 @@ typedef struct
   GRand         *dither_rand;
 } PutPixelData;
 
+typedef struct
+{
+  RenderBlendData *rbd;
+  GeglBuffer      *buffer;
+  gint             width;
+  gint             y;
+  gint             height;
+  gint             max_depth;
+  gdouble          threshold;
+  gboolean         dither;
+  guint32          seed;
+  GimpProgress    *progress;
+  gint             total_height;
+  gint             rows_done;     /*  in the current stripe, atomic  */
+} FillRegionData;
+
 
 /*  local function prototypes  */
 
@@ -131,6 +151,18 @@ static GeglBuffer * gradient_precalc_shapeburst (GimpImage           *image,
                                                  gdouble              dist,
                                                  GimpProgress        *progress);
 
+static gdouble  gradient_calc_factor        (RenderBlendData     *rbd,
+                                             gdouble              x,
+                                             gdouble              y);
+static void     gradient_calc_row_factors   (RenderBlendData     *rbd,
+                                             gint                 x,
+                                             gint                 y,
+                                             gint                 width,
+                                             gdouble             *factors,
+                                             gfloat              *dist_row);
+static void     gradient_factor_to_color    (RenderBlendData     *rbd,
+                                             gdouble              factor,
+                                             GimpRGB             *color);
 static void     gradient_render_pixel       (gdouble              x,
                                              gdouble              y,
                                              GimpRGB             *color,
@@ -140,6 +172,17 @@ static void     gradient_put_pixel          (gint                 x,
                                              GimpRGB             *color,
                                              gpointer             put_pixel_data);
 
+static void     gradient_fill_area          (const GeglRectangle *area,
+                                             gpointer             data);
+static void     gradient_supersample_rows   (gint                 i,
+                                             gint                 n,
+                                             gpointer             data);
+static void     gradient_supersample_progress
+                                            (gint                 min,
+                                             gint                 max,
+                                             gint                 current,
+                                             gpointer             data);
+
 static void     gradient_fill_region        (GimpImage           *image,
                                              GimpDrawable        *drawable,
                                              GimpContext         *context,
@@ -643,83 +686,201 @@ gradient_precalc_shapeburst (GimpImage           *image,
 }
 
 
-static void
-gradient_render_pixel (gdouble   x,
-                       gdouble   y,
-                       GimpRGB  *color,
-                       gpointer  render_data)
+static gdouble
+gradient_calc_factor (RenderBlendData *rbd,
+                      gdouble          x,
+                      gdouble          y)
 {
-  RenderBlendData *rbd = render_data;
-  gdouble          factor;
-
-  /* Calculate blending factor */
-
   switch (rbd->gradient_type)
     {
     case GIMP_GRADIENT_LINEAR:
-      factor = gradient_calc_linear_factor (rbd->dist,
-                                            rbd->vec, rbd->offset,
-                                            x - rbd->sx, y - rbd->sy);
-      break;
+      return gradient_calc_linear_factor (rbd->dist,
+                                          rbd->vec, rbd->offset,
+                                          x - rbd->sx, y - rbd->sy);
 
     case GIMP_GRADIENT_BILINEAR:
-      factor = gradient_calc_bilinear_factor (rbd->dist,
-                                              rbd->vec, rbd->offset,
-                                              x - rbd->sx, y - rbd->sy);
-      break;
+      return gradient_calc_bilinear_factor (rbd->dist,
+                                            rbd->vec, rbd->offset,
+                                            x - rbd->sx, y - rbd->sy);
 
     case GIMP_GRADIENT_RADIAL:
-      factor = gradient_calc_radial_factor (rbd->dist,
-                                            rbd->offset,
-                                            x - rbd->sx, y - rbd->sy);
-      break;
+      return gradient_calc_radial_factor (rbd->dist,
+                                          rbd->offset,
+                                          x - rbd->sx, y - rbd->sy);
 
     case GIMP_GRADIENT_SQUARE:
-      factor = gradient_calc_square_factor (rbd->dist, rbd->offset,
-                                            x - rbd->sx, y - rbd->sy);
-      break;
+      return gradient_calc_square_factor (rbd->dist, rbd->offset,
+                                          x - rbd->sx, y - rbd->sy);
 
     case GIMP_GRADIENT_CONICAL_SYMMETRIC:
-      factor = gradient_calc_conical_sym_factor (rbd->dist,
-                                                 rbd->vec, rbd->offset,
-                                                 x - rbd->sx, y - rbd->sy);
-      break;
+      return gradient_calc_conical_sym_factor (rbd->dist,
+                                               rbd->vec, rbd->offset,
+                                               x - rbd->sx, y - rbd->sy);
 
     case GIMP_GRADIENT_CONICAL_ASYMMETRIC:
-      factor = gradient_calc_conical_asym_factor (rbd->dist,
-                                                  rbd->vec, rbd->offset,
-                                                  x - rbd->sx, y - rbd->sy);
-      break;
+      return gradient_calc_conical_asym_factor (rbd->dist,
+                                                rbd->vec, rbd->offset,
+                                                x - rbd->sx, y - rbd->sy);
 
     case GIMP_GRADIENT_SHAPEBURST_ANGULAR:
-      factor = gradient_calc_shapeburst_angular_factor (rbd->dist_buffer, x, y);
-      break;
+      return gradient_calc_shapeburst_angular_factor (rbd->dist_buffer, x, y);
 
     case GIMP_GRADIENT_SHAPEBURST_SPHERICAL:
-      factor = gradient_calc_shapeburst_spherical_factor (rbd->dist_buffer, x, y);
-      break;
+      return gradient_calc_shapeburst_spherical_factor (rbd->dist_buffer, x, y);
 
     case GIMP_GRADIENT_SHAPEBURST_DIMPLED:
-      factor = gradient_calc_shapeburst_dimpled_factor (rbd->dist_buffer, x, y);
-      break;
+      return gradient_calc_shapeburst_dimpled_factor (rbd->dist_buffer, x, y);
 
     case GIMP_GRADIENT_SPIRAL_CLOCKWISE:
-      factor = gradient_calc_spiral_factor (rbd->dist,
-                                            rbd->vec, rbd->offset,
-                                            x - rbd->sx, y - rbd->sy, TRUE);
-      break;
+      return gradient_calc_spiral_factor (rbd->dist,
+                                          rbd->vec, rbd->offset,
+                                          x - rbd->sx, y - rbd->sy, TRUE);
 
     case GIMP_GRADIENT_SPIRAL_ANTICLOCKWISE:
-      factor = gradient_calc_spiral_factor (rbd->dist,
-                                            rbd->vec, rbd->offset,
-                                            x - rbd->sx, y - rbd->sy, FALSE);
-      break;
+      return gradient_calc_spiral_factor (rbd->dist,
+                                          rbd->vec, rbd->offset,
+                                          x - rbd->sx, y - rbd->sy, FALSE);
 
     default:
       g_assert_not_reached ();
-      return;
+      return 0.0;
     }
+}
+
+/*  Calculates the blending factors of a whole row of pixels.
+ *  The switch over the gradient type is done once per row, and the
+ *  per-pixel loops are simple enough for the compiler to keep them in
+ *  registers (and vectorize them where possible).
+ */
+static void
+gradient_calc_row_factors (RenderBlendData *rbd,
+                           gint             x,
+                           gint             y,
+                           gint             width,
+                           gdouble         *factors,
+                           gfloat          *dist_row)
+{
+  gdouble dy = y - rbd->sy;
+  gint    i;
+
+  switch (rbd->gradient_type)
+    {
+    case GIMP_GRADIENT_LINEAR:
+    case GIMP_GRADIENT_BILINEAR:
+      if (rbd->dist == 0.0)
+        {
+          memset (factors, 0, width * sizeof (gdouble));
+        }
+      else
+        {
+          gdouble offset = rbd->offset / 100.0;
+          gdouble step   = rbd->vec[0] / rbd->dist;
+          gdouble rat0   = (rbd->vec[0] * (x - rbd->sx) +
+                            rbd->vec[1] * dy) / rbd->dist;
+
+          for (i = 0; i < width; i++)
+            {
+              gdouble r = rat0 + i * step;
+
+              if (rbd->gradient_type == GIMP_GRADIENT_BILINEAR)
+                {
+                  if (offset == 1.0)
+                    {
+                      factors[i] = (r == 1.0) ? 1.0 : 0.0;
+                      continue;
+                    }
+
+                  r = fabs (r);
+                }
+
+              if (r >= 0.0 && r < offset)
+                factors[i] = 0.0;
+              else if (offset == 1.0)
+                factors[i] = (r >= 1.0) ? 1.0 : 0.0;
+              else if (r < 0.0)
+                factors[i] = r / (1.0 - offset);
+              else
+                factors[i] = (r - offset) / (1.0 - offset);
+            }
+        }
+      break;
+
+    case GIMP_GRADIENT_RADIAL:
+    case GIMP_GRADIENT_SQUARE:
+      if (rbd->dist == 0.0)
+        {
+          memset (factors, 0, width * sizeof (gdouble));
+        }
+      else
+        {
+          gdouble offset = rbd->offset / 100.0;
+
+          for (i = 0; i < width; i++)
+            {
+              gdouble dx = x + i - rbd->sx;
+              gdouble rat;
+
+              if (rbd->gradient_type == GIMP_GRADIENT_RADIAL)
+                rat = sqrt (SQR (dx) + SQR (dy)) / rbd->dist;
+              else
+                rat = MAX (abs (dx), abs (dy)) / rbd->dist;
+
+              if (rat < offset)
+                factors[i] = 0.0;
+              else if (offset == 1.0)
+                factors[i] = (rat >= 1.0) ? 1.0 : 0.0;
+              else
+                factors[i] = (rat - offset) / (1.0 - offset);
+            }
+        }
+      break;
+
+    case GIMP_GRADIENT_SHAPEBURST_ANGULAR:
+    case GIMP_GRADIENT_SHAPEBURST_SPHERICAL:
+    case GIMP_GRADIENT_SHAPEBURST_DIMPLED:
+      {
+        gint dist_width  = gegl_buffer_get_width  (rbd->dist_buffer);
+        gint dist_height = gegl_buffer_get_height (rbd->dist_buffer);
+        gint row_x       = CLAMP (x, 0, dist_width - 1);
+        gint row_width   = CLAMP (x + width, 0, dist_width) - row_x;
+
+        /*  one read per row instead of one per pixel  */
+        if (row_width > 0)
+          gegl_buffer_get (rbd->dist_buffer,
+                           GEGL_RECTANGLE (row_x,
+                                           CLAMP (y, 0, dist_height - 1),
+                                           row_width, 1),
+                           1.0, NULL, dist_row,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+        for (i = 0; i < width; i++)
+          {
+            gint   col   = CLAMP (x + i, row_x, row_x + row_width - 1) - row_x;
+            gfloat value = dist_row[col];
+
+            if (rbd->gradient_type == GIMP_GRADIENT_SHAPEBURST_ANGULAR)
+              factors[i] = 1.0 - value;
+            else if (rbd->gradient_type == GIMP_GRADIENT_SHAPEBURST_SPHERICAL)
+              factors[i] = 1.0 - sin (0.5 * G_PI * value);
+            else
+              factors[i] = cos (0.5 * G_PI * value);
+          }
+      }
+      break;
 
+    default:
+      /*  conical and spiral gradients are dominated by atan2() anyway  */
+      for (i = 0; i < width; i++)
+        factors[i] = gradient_calc_factor (rbd, x + i, y);
+      break;
+    }
+}
+
+static void
+gradient_factor_to_color (RenderBlendData *rbd,
+                          gdouble          factor,
+                          GimpRGB         *color)
+{
   /* Adjust for repeat */
 
   switch (rbd->repeat)
@@ -780,6 +941,17 @@ gradient_render_pixel (gdouble   x,
     }
 }
 
+static void
+gradient_render_pixel (gdouble   x,
+                       gdouble   y,
+                       GimpRGB  *color,
+                       gpointer  render_data)
+{
+  RenderBlendData *rbd = render_data;
+
+  gradient_factor_to_color (rbd, gradient_calc_factor (rbd, x, y), color);
+}
+
 static void
 gradient_put_pixel (gint      x,
                     gint      y,
@@ -814,6 +986,130 @@ gradient_put_pixel (gint      x,
                      GEGL_AUTO_ROWSTRIDE);
 }
 
+static void
+gradient_fill_area (const GeglRectangle *area,
+                    gpointer             data)
+{
+  FillRegionData     *fill = data;
+  RenderBlendData    *rbd  = fill->rbd;
+  GeglBufferIterator *iter;
+  GeglRectangle      *roi;
+  GRand              *dither_rand = NULL;
+  gdouble            *factors;
+  gfloat             *dist_row;
+
+  factors  = g_new (gdouble, area->width);
+  dist_row = g_new (gfloat,  area->width);
+
+  /*  every area gets its own random sequence, so the result doesn't
+   *  depend on which thread renders it when
+   */
+  if (fill->dither)
+    dither_rand = g_rand_new_with_seed (fill->seed ^
+                                        (area->y * 65599 + area->x));
+
+  iter = gegl_buffer_iterator_new (fill->buffer, area, 0,
+                                   babl_format ("R'G'B'A float"),
+                                   GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+  roi = &iter->roi[0];
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      gfloat *dest = iter->data[0];
+      gint    endy = roi->y + roi->height;
+      gint    x, y;
+
+      for (y = roi->y; y < endy; y++)
+        {
+          gradient_calc_row_factors (rbd, roi->x, y, roi->width,
+                                     factors, dist_row);
+
+          for (x = 0; x < roi->width; x++)
+            {
+              GimpRGB color = { 0.0, 0.0, 0.0, 1.0 };
+
+              gradient_factor_to_color (rbd, factors[x], &color);
+
+              if (dither_rand)
+                {
+                  gint i = g_rand_int (dither_rand);
+
+                  *dest++ = color.r + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
+                  *dest++ = color.g + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
+                  *dest++ = color.b + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
+                  *dest++ = color.a + (gdouble) (i & 0xff) / 256.0 / 256.0;
+                }
+              else
+                {
+                  *dest++ = color.r;
+                  *dest++ = color.g;
+                  *dest++ = color.b;
+                  *dest++ = color.a;
+                }
+            }
+        }
+    }
+
+  if (dither_rand)
+    g_rand_free (dither_rand);
+
+  g_free (dist_row);
+  g_free (factors);
+}
+
+/*  Adaptive supersampling only looks at neighboring samples within
+ *  the area it is given, so bands of rows can be supersampled
+ *  independently.
+ */
+static void
+gradient_supersample_rows (gint     i,
+                           gint     n,
+                           gpointer data)
+{
+  FillRegionData *fill = data;
+  PutPixelData    ppd;
+  gint            y1   = fill->y + fill->height * i       / n;
+  gint            y2   = fill->y + fill->height * (i + 1) / n;
+
+  if (y2 <= y1)
+    return;
+
+  ppd.buffer      = fill->buffer;
+  ppd.row_data    = g_malloc (sizeof (float) * 4 * fill->width);
+  ppd.width       = fill->width;
+  ppd.dither_rand = g_rand_new_with_seed (fill->seed ^ y1);
+
+  gimp_adaptive_supersample_area (0, y1,
+                                  (fill->width - 1), (y2 - 1),
+                                  fill->max_depth, fill->threshold,
+                                  gradient_render_pixel, fill->rbd,
+                                  gradient_put_pixel, &ppd,
+                                  gradient_supersample_progress, fill);
+
+  g_rand_free (ppd.dither_rand);
+  g_free (ppd.row_data);
+}
+
+/*  Called for every supersampled row by all bands.  Only the band
+ *  running in the calling thread reports the progress, for the rows
+ *  of all bands.
+ */
+static void
+gradient_supersample_progress (gint     min,
+                               gint     max,
+                               gint     current,
+                               gpointer data)
+{
+  FillRegionData *fill = data;
+  gint            rows;
+
+  rows = g_atomic_int_add (&fill->rows_done, 1) + 1;
+
+  if (fill->progress && ! gimp_parallel_is_worker_thread ())
+    gimp_progress_update_and_flush (0, fill->total_height,
+                                    fill->y + rows, fill->progress);
+}
+
 static void
 gradient_fill_region (GimpImage           *image,
                       GimpDrawable        *drawable,
@@ -835,7 +1131,9 @@ gradient_fill_region (GimpImage           *image,
                       gdouble              ey,
                       GimpProgress        *progress)
 {
-  RenderBlendData rbd = { 0, };
+  RenderBlendData rbd  = { 0, };
+  FillRegionData  fill = { 0, };
+  gint            y;
 
   GIMP_TIMER_START();
 
@@ -957,95 +1255,47 @@ gradient_fill_region (GimpImage           *image,
 
   /* Render the gradient! */
 
-  if (supersample)
-    {
-      PutPixelData  ppd;
-
-      ppd.buffer      = buffer;
-      ppd.row_data    = g_malloc (sizeof (float) * 4 * buffer_region->width);
-      ppd.width       = buffer_region->width;
-      ppd.dither_rand = g_rand_new ();
-
-      gimp_adaptive_supersample_area (0, 0,
-                                      (buffer_region->width  - 1),
-                                      (buffer_region->height - 1),
-                                      max_depth, threshold,
-                                      gradient_render_pixel, &rbd,
-                                      gradient_put_pixel, &ppd,
-                                      progress ?
-                                      gimp_progress_update_and_flush : NULL,
-                                      progress);
-
-      g_rand_free (ppd.dither_rand);
-      g_free (ppd.row_data);
-    }
-  else
-    {
-      GeglBufferIterator *iter;
-      GeglRectangle      *roi;
-      gint                total = buffer_region->width * buffer_region->height;
-      gint                done  = 0;
+  fill.rbd       = &rbd;
+  fill.buffer    = buffer;
+  fill.width     = buffer_region->width;
+  fill.max_depth = max_depth;
+  fill.threshold = threshold;
+  fill.dither    = dither;
+  fill.seed      = g_random_int ();
 
-      iter = gegl_buffer_iterator_new (buffer, buffer_region, 0,
-                                       babl_format ("R'G'B'A float"),
-                                       GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-      roi = &iter->roi[0];
+  fill.progress     = progress;
+  fill.total_height = buffer_region->height;
 
-      if (dither)
-        rbd.seed = g_rand_new ();
+  /*  render in stripes on all threads, so the progress can be updated
+   *  in between
+   */
+  for (y = 0; y < buffer_region->height; y += GRADIENT_STRIPE_HEIGHT)
+    {
+      fill.y      = y;
+      fill.height = MIN (GRADIENT_STRIPE_HEIGHT, buffer_region->height - y);
 
-      while (gegl_buffer_iterator_next (iter))
+      if (supersample)
         {
-          gfloat *dest = iter->data[0];
-          gint    endx  = roi->x + roi->width;
-          gint    endy  = roi->y + roi->height;
-          gint    x, y;
-
-          if (rbd.seed)
-            {
-              GRand *dither_rand = g_rand_new_with_seed (g_rand_int (rbd.seed));
-
-              for (y = roi->y; y < endy; y++)
-                for (x = roi->x; x < endx; x++)
-                  {
-                    GimpRGB  color = { 0.0, 0.0, 0.0, 1.0 };
-                    gint     i = g_rand_int (dither_rand);
-
-                    gradient_render_pixel (x, y, &color, &rbd);
+          fill.rows_done = 0;
 
-                    *dest++ = color.r + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
-                    *dest++ = color.g + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
-                    *dest++ = color.b + (gdouble) (i & 0xff) / 256.0 / 256.0; i >>= 8;
-                    *dest++ = color.a + (gdouble) (i & 0xff) / 256.0 / 256.0;
-                  }
-
-              g_rand_free (dither_rand);
-            }
-          else
-            {
-              for (y = roi->y; y < endy; y++)
-                for (x = roi->x; x < endx; x++)
-                  {
-                    GimpRGB  color = { 0.0, 0.0, 0.0, 1.0 };
-
-                    gradient_render_pixel (x, y, &color, &rbd);
-
-                    *dest++ = color.r;
-                    *dest++ = color.g;
-                    *dest++ = color.b;
-                    *dest++ = color.a;
-                  }
-            }
-
-          done += roi->width * roi->height;
-
-          if (progress)
-            gimp_progress_set_value (progress,
-                                     (gdouble) done / (gdouble) total);
+          gimp_parallel_distribute (fill.height,
+                                    gradient_supersample_rows,
+                                    &fill);
+        }
+      else
+        {
+          gimp_parallel_distribute_area (GEGL_RECTANGLE (buffer_region->x,
+                                                         buffer_region->y + y,
+                                                         buffer_region->width,
+                                                         fill.height),
+                                         GRADIENT_MIN_SUB_AREA,
+                                         gradient_fill_area, &fill);
         }
 
-      if (dither)
-        g_rand_free (rbd.seed);
+      if (progress)
+        gimp_progress_set_value (progress,
+                                 (gdouble) (y + fill.height) /
+                                 (gdouble) buffer_region->height);
     }
 
 #ifdef USE_GRADIENT_CACHE
@@ -34,6 +34,7 @@
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimp-transform-resize.h"
 #include "gimpchannel.h"
 #include "gimpcontext.h"
@@ -61,6 +62,53 @@
 #endif
 
 
+/*  flips and rotations are done in blocks of this size, each block
+ *  is read, permuted and written as a whole
+ */
+#define BLOCK_SIZE       128
+#define BLOCK_SUB_SIZE   32
+
+
+typedef enum
+{
+  TRANSFORM_FLIP_HORIZONTAL,
+  TRANSFORM_FLIP_VERTICAL,
+  TRANSFORM_ROTATE_90,
+  TRANSFORM_ROTATE_180,
+  TRANSFORM_ROTATE_270
+} TransformOp;
+
+typedef struct
+{
+  TransformOp    op;
+  GeglBuffer    *src_buffer;
+  GeglBuffer    *dest_buffer;
+  const Babl    *format;
+  gint           bpp;
+  GeglRectangle  src_rect;
+  GeglRectangle  dest_rect;
+} TransformBlocksData;
+
+
+/*  local function prototypes  */
+
+static void   gimp_drawable_transform_blocks      (TransformOp          op,
+                                                   GeglBuffer          *src_buffer,
+                                                   const GeglRectangle *src_rect,
+                                                   GeglBuffer          *dest_buffer,
+                                                   const GeglRectangle *dest_rect);
+static void   gimp_drawable_transform_blocks_area (const GeglRectangle *area,
+                                                   gpointer             data);
+static void   gimp_drawable_transform_block       (TransformOp          op,
+                                                   const guchar        *src,
+                                                   gint                 src_stride,
+                                                   guchar              *dest,
+                                                   gint                 dest_stride,
+                                                   gint                 width,
+                                                   gint                 height,
+                                                   gint                 bpp);
+
+
 /*  public functions  */
 
 GeglBuffer *
@@ -154,7 +202,6 @@ gimp_drawable_transform_buffer_flip (GimpDrawable        *drawable,
   gint           orig_width, orig_height;
   gint           new_x, new_y;
   gint           new_width, new_height;
-  gint           i;
 
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
   g_return_val_if_fail (gimp_item_is_attached (GIMP_ITEM (drawable)), NULL);
@@ -238,48 +285,28 @@ gimp_drawable_transform_buffer_flip (GimpDrawable        *drawable,
   if (new_width == 0 && new_height == 0)
     return new_buffer;
 
+  src_rect.x      = orig_x;
+  src_rect.y      = orig_y;
+  src_rect.width  = orig_width;
+  src_rect.height = orig_height;
+
+  dest_rect.x      = new_x;
+  dest_rect.y      = new_y;
+  dest_rect.width  = new_width;
+  dest_rect.height = new_height;
+
   switch (flip_type)
     {
     case GIMP_ORIENTATION_HORIZONTAL:
-      src_rect.x      = orig_x;
-      src_rect.y      = orig_y;
-      src_rect.width  = 1;
-      src_rect.height = orig_height;
-
-      dest_rect.x      = new_x + new_width - 1;
-      dest_rect.y      = new_y;
-      dest_rect.width  = 1;
-      dest_rect.height = new_height;
-
-      for (i = 0; i < orig_width; i++)
-        {
-          src_rect.x  = i + orig_x;
-          dest_rect.x = new_x + new_width - i - 1;
-
-          gegl_buffer_copy (orig_buffer, &src_rect,
-                            new_buffer, &dest_rect);
-        }
+      gimp_drawable_transform_blocks (TRANSFORM_FLIP_HORIZONTAL,
+                                      orig_buffer, &src_rect,
+                                      new_buffer, &dest_rect);
       break;
 
     case GIMP_ORIENTATION_VERTICAL:
-      src_rect.x      = orig_x;
-      src_rect.y      = orig_y;
-      src_rect.width  = orig_width;
-      src_rect.height = 1;
-
-      dest_rect.x      = new_x;
-      dest_rect.y      = new_y + new_height - 1;
-      dest_rect.width  = new_width;
-      dest_rect.height = 1;
-
-      for (i = 0; i < orig_height; i++)
-        {
-          src_rect.y  = i + orig_y;
-          dest_rect.y = new_y + new_height - i - 1;
-
-          gegl_buffer_copy (orig_buffer, &src_rect,
-                            new_buffer, &dest_rect);
-        }
+      gimp_drawable_transform_blocks (TRANSFORM_FLIP_VERTICAL,
+                                      orig_buffer, &src_rect,
+                                      new_buffer, &dest_rect);
       break;
 
     case GIMP_ORIENTATION_UNKNOWN:
@@ -341,7 +368,6 @@ gimp_drawable_transform_buffer_rotate (GimpDrawable     *drawable,
   GeglRectangle  dest_rect;
   gint           orig_x, orig_y;
   gint           orig_width, orig_height;
-  gint           orig_bpp;
   gint           new_x, new_y;
   gint           new_width, new_height;
 
@@ -354,7 +380,6 @@ gimp_drawable_transform_buffer_rotate (GimpDrawable     *drawable,
   orig_y      = orig_offset_y;
   orig_width  = gegl_buffer_get_width (orig_buffer);
   orig_height = gegl_buffer_get_height (orig_buffer);
-  orig_bpp    = babl_format_get_bytes_per_pixel (gegl_buffer_get_format (orig_buffer));
 
   switch (rotate_type)
     {
@@ -505,101 +530,27 @@ gimp_drawable_transform_buffer_rotate (GimpDrawable     *drawable,
   switch (rotate_type)
     {
     case GIMP_ROTATE_90:
-      {
-        guchar *buf = g_new (guchar, new_height * orig_bpp);
-        gint    i;
-
-        g_assert (new_height == orig_width);
-
-        src_rect.y      = orig_y + orig_height - 1;
-        src_rect.height = 1;
+      g_assert (new_height == orig_width);
 
-        dest_rect.x     = new_x;
-        dest_rect.width = 1;
-
-        for (i = 0; i < orig_height; i++)
-          {
-            src_rect.y  = orig_y + orig_height - 1 - i;
-            dest_rect.x = new_x + i;
-
-            gegl_buffer_get (orig_buffer, &src_rect, 1.0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-            gegl_buffer_set (new_buffer, &dest_rect, 0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE);
-          }
-
-        g_free (buf);
-      }
+      gimp_drawable_transform_blocks (TRANSFORM_ROTATE_90,
+                                      orig_buffer, &src_rect,
+                                      new_buffer, &dest_rect);
       break;
 
     case GIMP_ROTATE_180:
-      {
-        guchar *buf = g_new (guchar, new_width * orig_bpp);
-        gint    i, j, k;
-
-        g_assert (new_width == orig_width);
-
-        src_rect.y      = orig_y + orig_height - 1;
-        src_rect.height = 1;
-
-        dest_rect.y      = new_y;
-        dest_rect.height = 1;
-
-        for (i = 0; i < orig_height; i++)
-          {
-            src_rect.y  = orig_y + orig_height - 1 - i;
-            dest_rect.y = new_y + i;
-
-            gegl_buffer_get (orig_buffer, &src_rect, 1.0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-            for (j = 0; j < orig_width / 2; j++)
-              {
-                guchar *left  = buf + j * orig_bpp;
-                guchar *right = buf + (orig_width - 1 - j) * orig_bpp;
-
-                for (k = 0; k < orig_bpp; k++)
-                  {
-                    guchar tmp = left[k];
-                    left[k]    = right[k];
-                    right[k]   = tmp;
-                  }
-              }
+      g_assert (new_width == orig_width);
 
-            gegl_buffer_set (new_buffer, &dest_rect, 0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE);
-          }
-
-        g_free (buf);
-      }
+      gimp_drawable_transform_blocks (TRANSFORM_ROTATE_180,
+                                      orig_buffer, &src_rect,
+                                      new_buffer, &dest_rect);
       break;
 
     case GIMP_ROTATE_270:
-      {
-        guchar *buf = g_new (guchar, new_width * orig_bpp);
-        gint    i;
-
-        g_assert (new_width == orig_height);
-
-        src_rect.x     = orig_x + orig_width - 1;
-        src_rect.width = 1;
-
-        dest_rect.y      = new_y;
-        dest_rect.height = 1;
-
-        for (i = 0; i < orig_width; i++)
-          {
-            src_rect.x  = orig_x + orig_width - 1 - i;
-            dest_rect.y = new_y + i;
-
-            gegl_buffer_get (orig_buffer, &src_rect, 1.0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-            gegl_buffer_set (new_buffer, &dest_rect, 0, NULL, buf,
-                             GEGL_AUTO_ROWSTRIDE);
-          }
+      g_assert (new_width == orig_height);
 
-        g_free (buf);
-      }
+      gimp_drawable_transform_blocks (TRANSFORM_ROTATE_270,
+                                      orig_buffer, &src_rect,
+                                      new_buffer, &dest_rect);
       break;
     }
 
@@ -980,3 +931,220 @@ gimp_drawable_transform_paste (GimpDrawable *drawable,
 
   return drawable;
 }
+
+
+/*  private functions  */
+
+/*  Copies @src_rect of @src_buffer to @dest_rect of @dest_buffer,
+ *  flipped or rotated according to @op.  The destination is walked in
+ *  blocks, the matching source block is read in one go, permuted in
+ *  memory and written as a whole; the blocks are distributed over all
+ *  threads.
+ */
+static void
+gimp_drawable_transform_blocks (TransformOp          op,
+                                GeglBuffer          *src_buffer,
+                                const GeglRectangle *src_rect,
+                                GeglBuffer          *dest_buffer,
+                                const GeglRectangle *dest_rect)
+{
+  TransformBlocksData data;
+
+  if (dest_rect->width < 1 || dest_rect->height < 1)
+    return;
+
+  data.op          = op;
+  data.src_buffer  = src_buffer;
+  data.dest_buffer = dest_buffer;
+  data.format      = gegl_buffer_get_format (src_buffer);
+  data.bpp         = babl_format_get_bytes_per_pixel (data.format);
+  data.src_rect    = *src_rect;
+  data.dest_rect   = *dest_rect;
+
+  gimp_parallel_distribute_area (dest_rect, BLOCK_SIZE * BLOCK_SIZE,
+                                 gimp_drawable_transform_blocks_area,
+                                 &data);
+}
+
+static void
+gimp_drawable_transform_blocks_area (const GeglRectangle *area,
+                                     gpointer             user_data)
+{
+  TransformBlocksData *data = user_data;
+  gint                 W    = data->src_rect.width;
+  gint                 H    = data->src_rect.height;
+  guchar              *src_buf;
+  guchar              *dest_buf;
+  gint                 x, y;
+
+  src_buf  = g_malloc (BLOCK_SIZE * BLOCK_SIZE * data->bpp);
+  dest_buf = g_malloc (BLOCK_SIZE * BLOCK_SIZE * data->bpp);
+
+  for (y = area->y; y < area->y + area->height; y += BLOCK_SIZE)
+    {
+      for (x = area->x; x < area->x + area->width; x += BLOCK_SIZE)
+        {
+          GeglRectangle dest;
+          GeglRectangle src;
+          gint          u, v;
+
+          dest.x      = x;
+          dest.y      = y;
+          dest.width  = MIN (BLOCK_SIZE, area->x + area->width  - x);
+          dest.height = MIN (BLOCK_SIZE, area->y + area->height - y);
+
+          /*  the block's position relative to the destination rect  */
+          u = dest.x - data->dest_rect.x;
+          v = dest.y - data->dest_rect.y;
+
+          switch (data->op)
+            {
+            case TRANSFORM_FLIP_HORIZONTAL:
+              src.x      = W - u - dest.width;
+              src.y      = v;
+              src.width  = dest.width;
+              src.height = dest.height;
+              break;
+
+            case TRANSFORM_FLIP_VERTICAL:
+              src.x      = u;
+              src.y      = H - v - dest.height;
+              src.width  = dest.width;
+              src.height = dest.height;
+              break;
+
+            case TRANSFORM_ROTATE_180:
+              src.x      = W - u - dest.width;
+              src.y      = H - v - dest.height;
+              src.width  = dest.width;
+              src.height = dest.height;
+              break;
+
+            case TRANSFORM_ROTATE_90:
+              src.x      = v;
+              src.y      = H - u - dest.width;
+              src.width  = dest.height;
+              src.height = dest.width;
+              break;
+
+            case TRANSFORM_ROTATE_270:
+              src.x      = W - v - dest.height;
+              src.y      = u;
+              src.width  = dest.height;
+              src.height = dest.width;
+              break;
+
+            default:
+              g_assert_not_reached ();
+            }
+
+          src.x += data->src_rect.x;
+          src.y += data->src_rect.y;
+
+          gegl_buffer_get (data->src_buffer, &src, 1.0,
+                           data->format, src_buf,
+                           src.width * data->bpp, GEGL_ABYSS_NONE);
+
+          gimp_drawable_transform_block (data->op,
+                                         src_buf, src.width * data->bpp,
+                                         dest_buf, dest.width * data->bpp,
+                                         dest.width, dest.height,
+                                         data->bpp);
+
+          gegl_buffer_set (data->dest_buffer, &dest, 0,
+                           data->format, dest_buf,
+                           dest.width * data->bpp);
+        }
+    }
+
+  g_free (dest_buf);
+  g_free (src_buf);
+}
+
+/*  Permutes the pixels of a single block.  The rotations by 90 degrees
+ *  transpose the block in sub-blocks, so both the rows read and the
+ *  rows written stay in cache.
+ */
+static void
+gimp_drawable_transform_block (TransformOp   op,
+                               const guchar *src,
+                               gint          src_stride,
+                               guchar       *dest,
+                               gint          dest_stride,
+                               gint          width,
+                               gint          height,
+                               gint          bpp)
+{
+  gint i, j;
+
+  switch (op)
+    {
+    case TRANSFORM_FLIP_VERTICAL:
+      for (j = 0; j < height; j++)
+        memcpy (dest + j * dest_stride,
+                src  + (height - 1 - j) * src_stride,
+                width * bpp);
+      break;
+
+    case TRANSFORM_FLIP_HORIZONTAL:
+    case TRANSFORM_ROTATE_180:
+      for (j = 0; j < height; j++)
+        {
+          const guchar *s;
+          guchar       *d = dest + j * dest_stride;
+
+          if (op == TRANSFORM_FLIP_HORIZONTAL)
+            s = src + j * src_stride;
+          else
+            s = src + (height - 1 - j) * src_stride;
+
+          s += (width - 1) * bpp;
+
+          for (i = 0; i < width; i++)
+            {
+              memcpy (d, s, bpp);
+
+              d += bpp;
+              s -= bpp;
+            }
+        }
+      break;
+
+    case TRANSFORM_ROTATE_90:
+    case TRANSFORM_ROTATE_270:
+      {
+        gint bi, bj;
+
+        /*  the source block is height pixels wide and width pixels
+         *  high; dest (i, j) comes from source (j, width - 1 - i) for
+         *  90 degrees and from source (height - 1 - j, i) for 270
+         */
+        for (bj = 0; bj < height; bj += BLOCK_SUB_SIZE)
+          for (bi = 0; bi < width; bi += BLOCK_SUB_SIZE)
+            {
+              gint j_end = MIN (bj + BLOCK_SUB_SIZE, height);
+              gint i_end = MIN (bi + BLOCK_SUB_SIZE, width);
+
+              for (j = bj; j < j_end; j++)
+                {
+                  guchar *d = dest + j * dest_stride + bi * bpp;
+
+                  for (i = bi; i < i_end; i++)
+                    {
+                      const guchar *s;
+
+                      if (op == TRANSFORM_ROTATE_90)
+                        s = src + (width - 1 - i) * src_stride + j * bpp;
+                      else
+                        s = src + i * src_stride + (height - 1 - j) * bpp;
+
+                      memcpy (d, s, bpp);
+
+                      d += bpp;
+                    }
+                }
+            }
+      }
+      break;
+    }
+}
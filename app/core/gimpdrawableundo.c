@@ -17,6 +17,9 @@
 
 #include "config.h"
 
+#include <zlib.h>
+
+#include <glib/gstdio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gegl.h>
 
@@ -24,12 +27,21 @@
 
 #include "core-types.h"
 
+#include "config/gimpcoreconfig.h"
+
+#include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimp-utils.h"
 #include "gimpimage.h"
+#include "gimpimage-undo.h"
 #include "gimpdrawable.h"
 #include "gimpdrawableundo.h"
 
 
+/*  the number of rows compressed or decompressed at once  */
+#define STORE_STRIP_HEIGHT 64
+
+
 enum
 {
   PROP_0,
@@ -39,6 +51,38 @@ enum
 };
 
 
+/*  A drawable undo's pixels are compressed on the parallel pool right
+ *  after they are pushed, and the uncompressed buffer is dropped once
+ *  that is done.  The least recently compressed stores of an image are
+ *  written to swap files, again on the pool, when they use more than
+ *  half of the undo-size in memory, so they don't count against it any
+ *  longer.  The pixels are only decompressed when the undo is popped.
+ */
+struct _GimpDrawableUndoStore
+{
+  GimpDrawableUndo *undo;       /* NULL once the undo let go of it      */
+  GimpImage        *image;
+  GeglBuffer       *buffer;     /* the pixels being compressed          */
+  gboolean          pending;    /* a job on the pool still uses it      */
+
+  GeglRectangle     rect;
+  const Babl       *format;
+
+  guchar           *data;       /* the compressed pixels, NULL if they  */
+  gsize             data_size;  /* failed to compress or were swapped   */
+  gchar            *swap_file;
+  gboolean          swap_failed;
+
+  GList            *link;       /* in the image's store list            */
+};
+
+typedef struct
+{
+  GQueue  stores;               /* least recently used first            */
+  guint64 size;
+} GimpDrawableUndoStoreList;
+
+
 static void     gimp_drawable_undo_constructed  (GObject             *object);
 static void     gimp_drawable_undo_set_property (GObject             *object,
                                                  guint                property_id,
@@ -58,12 +102,37 @@ static void     gimp_drawable_undo_pop          (GimpUndo            *undo,
 static void     gimp_drawable_undo_free         (GimpUndo            *undo,
                                                  GimpUndoMode         undo_mode);
 
+static void     gimp_drawable_undo_compress     (GimpDrawableUndo    *drawable_undo);
+
+static void     gimp_drawable_undo_store_compress   (gpointer               data);
+static gboolean gimp_drawable_undo_store_compressed (gpointer               data);
+static void     gimp_drawable_undo_store_swap       (gpointer               data);
+static gboolean gimp_drawable_undo_store_swapped    (gpointer               data);
+static GeglBuffer *
+                gimp_drawable_undo_store_load       (GimpDrawableUndoStore *store);
+static void     gimp_drawable_undo_store_free       (GimpDrawableUndoStore *store);
+static void     gimp_drawable_undo_store_run_async  (GimpDrawableUndoStore *store,
+                                                     GimpParallelRunAsyncFunc func);
+static void     gimp_drawable_undo_store_done       (GimpDrawableUndoStore *store);
+
+static void     gimp_drawable_undo_stores_add       (GimpDrawableUndoStore *store,
+                                                     gboolean               head);
+static void     gimp_drawable_undo_stores_remove    (GimpDrawableUndoStore *store);
+static void     gimp_drawable_undo_stores_swap_out  (GimpImage             *image);
+
 
 G_DEFINE_TYPE (GimpDrawableUndo, gimp_drawable_undo, GIMP_TYPE_ITEM_UNDO)
 
 #define parent_class gimp_drawable_undo_parent_class
 
 
+/*  the compressed stores still in memory, per image  */
+static GHashTable *gimp_drawable_undo_stores         = NULL;
+
+/*  the stores a job on the pool is busy with  */
+static GQueue      gimp_drawable_undo_pending_stores = G_QUEUE_INIT;
+
+
 static void
 gimp_drawable_undo_class_init (GimpDrawableUndoClass *klass)
 {
@@ -113,6 +182,8 @@ gimp_drawable_undo_constructed (GObject *object)
 
   g_assert (GIMP_IS_DRAWABLE (GIMP_ITEM_UNDO (object)->item));
   g_assert (drawable_undo->buffer != NULL);
+
+  gimp_drawable_undo_compress (drawable_undo);
 }
 
 static void
@@ -152,7 +223,11 @@ gimp_drawable_undo_get_property (GObject    *object,
   switch (property_id)
     {
     case PROP_BUFFER:
-      g_value_set_object (value, drawable_undo->buffer);
+      if (drawable_undo->buffer)
+        g_value_set_object (value, drawable_undo->buffer);
+      else
+        g_value_take_object (value,
+                             gimp_drawable_undo_store_load (drawable_undo->store));
       break;
     case PROP_X:
       g_value_set_int (value, drawable_undo->x);
@@ -176,6 +251,17 @@ gimp_drawable_undo_get_memsize (GimpObject *object,
 
   memsize += gimp_gegl_buffer_get_memsize (drawable_undo->buffer);
 
+  if (drawable_undo->store)
+    {
+      memsize += sizeof (GimpDrawableUndoStore);
+
+      /*  swapped out pixels don't count  */
+      if (drawable_undo->store->data)
+        memsize += drawable_undo->store->data_size;
+
+      memsize += gimp_string_get_memsize (drawable_undo->store->swap_file);
+    }
+
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
 }
@@ -189,10 +275,29 @@ gimp_drawable_undo_pop (GimpUndo            *undo,
 
   GIMP_UNDO_CLASS (parent_class)->pop (undo, undo_mode, accum);
 
+  if (drawable_undo->store)
+    {
+      if (! drawable_undo->buffer)
+        drawable_undo->buffer =
+          gimp_drawable_undo_store_load (drawable_undo->store);
+
+      gimp_drawable_undo_store_free (drawable_undo->store);
+      drawable_undo->store = NULL;
+    }
+
+  if (! drawable_undo->buffer)
+    {
+      g_warning ("%s: failed to restore the undo's pixels", G_STRFUNC);
+      return;
+    }
+
   gimp_drawable_swap_pixels (GIMP_DRAWABLE (GIMP_ITEM_UNDO (undo)->item),
                              drawable_undo->buffer,
                              drawable_undo->x,
                              drawable_undo->y);
+
+  /*  the buffer now holds the pixels for the opposite direction  */
+  gimp_drawable_undo_compress (drawable_undo);
 }
 
 static void
@@ -201,6 +306,12 @@ gimp_drawable_undo_free (GimpUndo     *undo,
 {
   GimpDrawableUndo *drawable_undo = GIMP_DRAWABLE_UNDO (undo);
 
+  if (drawable_undo->store)
+    {
+      gimp_drawable_undo_store_free (drawable_undo->store);
+      drawable_undo->store = NULL;
+    }
+
   if (drawable_undo->buffer)
     {
       g_object_unref (drawable_undo->buffer);
@@ -215,3 +326,421 @@ gimp_drawable_undo_free (GimpUndo     *undo,
 
   GIMP_UNDO_CLASS (parent_class)->free (undo, undo_mode);
 }
+
+static void
+gimp_drawable_undo_compress (GimpDrawableUndo *drawable_undo)
+{
+  GimpDrawableUndoStore *store;
+
+  g_return_if_fail (drawable_undo->store == NULL);
+
+  store = g_slice_new0 (GimpDrawableUndoStore);
+
+  store->undo    = drawable_undo;
+  store->image   = GIMP_UNDO (drawable_undo)->image;
+  store->buffer  = gegl_buffer_dup (drawable_undo->buffer);
+  store->rect    = *gegl_buffer_get_extent (drawable_undo->buffer);
+  store->format  = gegl_buffer_get_format (drawable_undo->buffer);
+
+  drawable_undo->store = store;
+
+  gimp_drawable_undo_store_run_async (store,
+                                      gimp_drawable_undo_store_compress);
+}
+
+/*  runs on the parallel pool, and only touches store->buffer and the
+ *  compressed data until it hands the store back to the main thread
+ */
+static void
+gimp_drawable_undo_store_compress (gpointer data)
+{
+  GimpDrawableUndoStore *store  = data;
+  GByteArray            *array  = NULL;
+  guchar                *strip  = NULL;
+  z_stream               zs     = { 0, };
+  gsize                  stride;
+  gint                   y;
+  gboolean               success;
+
+  stride = ((gsize) store->rect.width *
+            babl_format_get_bytes_per_pixel (store->format));
+
+  success = (store->rect.width > 0 && store->rect.height > 0 &&
+             deflateInit (&zs, Z_BEST_SPEED) == Z_OK);
+
+  if (success)
+    {
+      array = g_byte_array_sized_new (stride * store->rect.height / 4 + 64);
+      strip = g_malloc (stride * STORE_STRIP_HEIGHT);
+    }
+
+  for (y = 0; success && y < store->rect.height; y += STORE_STRIP_HEIGHT)
+    {
+      gint height = MIN (STORE_STRIP_HEIGHT, store->rect.height - y);
+      gint flush  = (y + height < store->rect.height) ? Z_NO_FLUSH : Z_FINISH;
+
+      gegl_buffer_get (store->buffer,
+                       GEGL_RECTANGLE (store->rect.x, store->rect.y + y,
+                                       store->rect.width, height),
+                       1.0, store->format, strip,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      zs.next_in  = strip;
+      zs.avail_in = stride * height;
+
+      do
+        {
+          guint length = array->len;
+          guint avail  = MAX (stride, 4096);
+
+          g_byte_array_set_size (array, length + avail);
+
+          zs.next_out  = array->data + length;
+          zs.avail_out = avail;
+
+          if (deflate (&zs, flush) == Z_STREAM_ERROR)
+            success = FALSE;
+
+          g_byte_array_set_size (array, length + avail - zs.avail_out);
+        }
+      while (success && zs.avail_out == 0);
+    }
+
+  if (array)
+    deflateEnd (&zs);
+
+  g_free (strip);
+
+  if (success)
+    {
+      store->data_size = array->len;
+      store->data      = g_byte_array_free (array, FALSE);
+    }
+  else if (array)
+    {
+      g_byte_array_free (array, TRUE);
+    }
+
+  g_idle_add (gimp_drawable_undo_store_compressed, store);
+}
+
+static gboolean
+gimp_drawable_undo_store_compressed (gpointer data)
+{
+  GimpDrawableUndoStore *store = data;
+  GimpDrawableUndo      *drawable_undo;
+
+  gimp_drawable_undo_store_done (store);
+
+  g_object_unref (store->buffer);
+  store->buffer = NULL;
+
+  drawable_undo = store->undo;
+
+  if (! drawable_undo)
+    {
+      /*  the undo was popped or freed in the meantime  */
+      gimp_drawable_undo_store_free (store);
+    }
+  else if (! store->data)
+    {
+      /*  keep the uncompressed buffer  */
+      drawable_undo->store = NULL;
+      gimp_drawable_undo_store_free (store);
+    }
+  else
+    {
+      g_object_unref (drawable_undo->buffer);
+      drawable_undo->buffer = NULL;
+
+      gimp_drawable_undo_stores_add (store, FALSE);
+
+      gimp_image_undo_update_memsize (store->image, GIMP_UNDO (drawable_undo));
+
+      gimp_drawable_undo_stores_swap_out (store->image);
+    }
+
+  return FALSE;
+}
+
+/*  runs on the parallel pool, store->data stays untouched on the main
+ *  thread until the store is handed back
+ */
+static void
+gimp_drawable_undo_store_swap (gpointer data)
+{
+  GimpDrawableUndoStore *store = data;
+
+  store->swap_failed = ! g_file_set_contents (store->swap_file,
+                                              (const gchar *) store->data,
+                                              store->data_size,
+                                              NULL);
+
+  g_idle_add (gimp_drawable_undo_store_swapped, store);
+}
+
+static gboolean
+gimp_drawable_undo_store_swapped (gpointer data)
+{
+  GimpDrawableUndoStore *store = data;
+
+  gimp_drawable_undo_store_done (store);
+
+  if (! store->undo)
+    {
+      /*  the undo was popped or freed in the meantime  */
+      gimp_drawable_undo_store_free (store);
+    }
+  else if (store->swap_failed)
+    {
+      /*  keep it in memory, it is tried again on the next swap out  */
+      g_unlink (store->swap_file);
+      g_free (store->swap_file);
+      store->swap_file = NULL;
+
+      gimp_drawable_undo_stores_add (store, TRUE);
+    }
+  else
+    {
+      g_free (store->data);
+      store->data = NULL;
+
+      gimp_image_undo_update_memsize (store->image, GIMP_UNDO (store->undo));
+    }
+
+  return FALSE;
+}
+
+static GeglBuffer *
+gimp_drawable_undo_store_load (GimpDrawableUndoStore *store)
+{
+  GeglBuffer *buffer;
+  guchar     *data      = store->data;
+  gsize       data_size = store->data_size;
+  guchar     *strip;
+  z_stream    zs        = { 0, };
+  gsize       stride;
+  gint        y;
+  gboolean    success   = TRUE;
+
+  if (! data)
+    {
+      if (! store->swap_file ||
+          ! g_file_get_contents (store->swap_file,
+                                 (gchar **) &data, &data_size, NULL))
+        return NULL;
+    }
+
+  if (inflateInit (&zs) != Z_OK)
+    {
+      if (data != store->data)
+        g_free (data);
+
+      return NULL;
+    }
+
+  buffer = gegl_buffer_new (&store->rect, store->format);
+
+  stride = ((gsize) store->rect.width *
+            babl_format_get_bytes_per_pixel (store->format));
+  strip  = g_malloc (stride * STORE_STRIP_HEIGHT);
+
+  zs.next_in  = data;
+  zs.avail_in = data_size;
+
+  for (y = 0; success && y < store->rect.height; y += STORE_STRIP_HEIGHT)
+    {
+      gint height = MIN (STORE_STRIP_HEIGHT, store->rect.height - y);
+      gint ret;
+
+      zs.next_out  = strip;
+      zs.avail_out = stride * height;
+
+      ret = inflate (&zs, Z_NO_FLUSH);
+
+      if ((ret != Z_OK && ret != Z_STREAM_END) || zs.avail_out != 0)
+        {
+          success = FALSE;
+          break;
+        }
+
+      gegl_buffer_set (buffer,
+                       GEGL_RECTANGLE (store->rect.x, store->rect.y + y,
+                                       store->rect.width, height),
+                       0, store->format, strip, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  inflateEnd (&zs);
+
+  g_free (strip);
+
+  if (data != store->data)
+    g_free (data);
+
+  if (! success)
+    {
+      g_object_unref (buffer);
+      return NULL;
+    }
+
+  return buffer;
+}
+
+static void
+gimp_drawable_undo_store_free (GimpDrawableUndoStore *store)
+{
+  if (store->pending)
+    {
+      /*  gimp_drawable_undo_store_compressed() will free it  */
+      store->undo = NULL;
+      return;
+    }
+
+  if (store->link)
+    gimp_drawable_undo_stores_remove (store);
+
+  if (store->swap_file)
+    {
+      g_unlink (store->swap_file);
+      g_free (store->swap_file);
+    }
+
+  g_free (store->data);
+
+  g_slice_free (GimpDrawableUndoStore, store);
+}
+
+static void
+gimp_drawable_undo_store_run_async (GimpDrawableUndoStore    *store,
+                                    GimpParallelRunAsyncFunc  func)
+{
+  store->pending = TRUE;
+
+  g_queue_push_tail (&gimp_drawable_undo_pending_stores, store);
+
+  gimp_parallel_run_async (func, store);
+}
+
+static void
+gimp_drawable_undo_store_done (GimpDrawableUndoStore *store)
+{
+  store->pending = FALSE;
+
+  g_queue_remove (&gimp_drawable_undo_pending_stores, store);
+}
+
+static void
+gimp_drawable_undo_store_list_free (GimpDrawableUndoStoreList *list)
+{
+  g_slice_free (GimpDrawableUndoStoreList, list);
+}
+
+static void
+gimp_drawable_undo_stores_add (GimpDrawableUndoStore *store,
+                               gboolean               head)
+{
+  GimpDrawableUndoStoreList *list = NULL;
+
+  if (! gimp_drawable_undo_stores)
+    gimp_drawable_undo_stores =
+      g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                             (GDestroyNotify) gimp_drawable_undo_store_list_free);
+  else
+    list = g_hash_table_lookup (gimp_drawable_undo_stores, store->image);
+
+  if (! list)
+    {
+      list = g_slice_new0 (GimpDrawableUndoStoreList);
+
+      g_hash_table_insert (gimp_drawable_undo_stores, store->image, list);
+    }
+
+  if (head)
+    {
+      g_queue_push_head (&list->stores, store);
+      store->link = g_queue_peek_head_link (&list->stores);
+    }
+  else
+    {
+      g_queue_push_tail (&list->stores, store);
+      store->link = g_queue_peek_tail_link (&list->stores);
+    }
+
+  list->size += store->data_size;
+}
+
+static void
+gimp_drawable_undo_stores_remove (GimpDrawableUndoStore *store)
+{
+  GimpDrawableUndoStoreList *list;
+
+  list = g_hash_table_lookup (gimp_drawable_undo_stores, store->image);
+
+  g_queue_delete_link (&list->stores, store->link);
+  store->link = NULL;
+
+  list->size -= store->data_size;
+
+  /*  the image's undos are all gone before it is, so this also drops
+   *  the lists of destroyed images
+   */
+  if (g_queue_is_empty (&list->stores))
+    g_hash_table_remove (gimp_drawable_undo_stores, store->image);
+}
+
+static void
+gimp_drawable_undo_stores_swap_out (GimpImage *image)
+{
+  GimpDrawableUndoStoreList *list;
+  guint64                    max_size;
+
+  max_size = image->gimp->config->undo_size / 2;
+
+  while ((list = g_hash_table_lookup (gimp_drawable_undo_stores, image)) &&
+         list->size > max_size)
+    {
+      GimpDrawableUndoStore *store = g_queue_peek_head (&list->stores);
+
+      gimp_drawable_undo_stores_remove (store);
+
+      store->swap_file   = gimp_get_temp_filename (image->gimp, "undo");
+      store->swap_failed = FALSE;
+
+      gimp_drawable_undo_store_run_async (store,
+                                          gimp_drawable_undo_store_swap);
+    }
+}
+
+
+/*  public functions  */
+
+/**
+ * gimp_drawable_undo_exit:
+ *
+ * Hands back the stores whose compression or swap file was finished
+ * by the parallel pool, but whose idle callbacks didn't get to run,
+ * so they are freed and their swap files removed.  Must be called
+ * after gimp_parallel_exit() let the pool's jobs finish.
+ **/
+void
+gimp_drawable_undo_exit (void)
+{
+  GimpDrawableUndoStore *store;
+
+  while ((store = g_queue_peek_head (&gimp_drawable_undo_pending_stores)))
+    {
+      g_source_remove_by_user_data (store);
+
+      if (store->swap_file)
+        gimp_drawable_undo_store_swapped (store);
+      else
+        gimp_drawable_undo_store_compressed (store);
+    }
+
+  if (gimp_drawable_undo_stores &&
+      g_hash_table_size (gimp_drawable_undo_stores) == 0)
+    {
+      g_hash_table_unref (gimp_drawable_undo_stores);
+      gimp_drawable_undo_stores = NULL;
+    }
+}
@@ -31,15 +31,19 @@
 
 
 typedef struct _GimpDrawableUndoClass GimpDrawableUndoClass;
+typedef struct _GimpDrawableUndoStore GimpDrawableUndoStore;
 
 struct _GimpDrawableUndo
 {
   GimpItemUndo  parent_instance;
 
-  GeglBuffer   *buffer;
+  GeglBuffer   *buffer;   /* NULL while only the store has the pixels */
   gint          x;
   gint          y;
 
+  /* the buffer's pixels, compressed in the background */
+  GimpDrawableUndoStore *store;
+
   /* stuff for "Fade" */
   GeglBuffer           *applied_buffer;
   GimpLayerModeEffects  paint_mode;
@@ -54,5 +58,7 @@ struct _GimpDrawableUndoClass
 
 GType   gimp_drawable_undo_get_type (void) G_GNUC_CONST;
 
+void    gimp_drawable_undo_exit     (void);
+
 
 #endif /* __GIMP_DRAWABLE_UNDO_H__ */
@@ -30,53 +30,83 @@
 
 #include "gegl/gimp-babl.h"
 
+#include "gimp-parallel.h"
 #include "gimpdrawable.h"
 #include "gimpimage.h"
 #include "gimpimage-contiguous-region.h"
 #include "gimppickable.h"
 
 
+#define CONTIGUOUS_REGION_TILE_SHIFT   6
+#define CONTIGUOUS_REGION_TILE_SIZE    (1 << CONTIGUOUS_REGION_TILE_SHIFT)
+#define CONTIGUOUS_REGION_MIN_SUB_AREA (CONTIGUOUS_REGION_TILE_SIZE * \
+                                        CONTIGUOUS_REGION_TILE_SIZE * 4)
+
+
+/*  A horizontal run of pixels [start, end] on row y, whose neighbors
+ *  the flood fill still has to look at
+ */
+typedef struct
+{
+  gint y;
+  gint start;
+  gint end;
+} ContiguousSpan;
+
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+
+  /*  the flood fill's lazily computed tiles, each holding one value per
+   *  pixel: 0 if the pixel can't be selected, the negated difference if
+   *  it can but wasn't reached yet, and the difference once it is part
+   *  of the region
+   */
+  gint                 width;
+  gint                 height;
+  gint                 n_tile_cols;
+  gint                 n_tile_rows;
+  gfloat             **tiles;
+  gfloat              *src_tile;
+} ContiguousRegion;
+
+
 /*  local function prototypes  */
 
-static const Babl * choose_format         (GeglBuffer          *buffer,
-                                           GimpSelectCriterion  select_criterion,
-                                           gint                *n_components,
-                                           gboolean            *has_alpha);
-static gfloat   pixel_difference          (const gfloat        *col1,
-                                           const gfloat        *col2,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion);
-static gboolean find_contiguous_segment   (const gfloat        *col,
-                                           GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *src_format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gint                 width,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 initial_x,
-                                           gint                 initial_y,
-                                           gint                *start,
-                                           gint                *end);
-static void find_contiguous_region_helper (GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 x,
-                                           gint                 y,
-                                           const gfloat        *col);
+static const Babl * choose_format             (GeglBuffer          *buffer,
+                                               GimpSelectCriterion  select_criterion,
+                                               gint                *n_components,
+                                               gboolean            *has_alpha);
+static gfloat   pixel_difference              (const gfloat        *col1,
+                                               const gfloat        *col2,
+                                               gboolean             antialias,
+                                               gfloat               threshold,
+                                               gint                 n_components,
+                                               gboolean             has_alpha,
+                                               gboolean             select_transparent,
+                                               GimpSelectCriterion  select_criterion);
+static gfloat * contiguous_region_load_tile   (ContiguousRegion    *region,
+                                               gint                 tile_col,
+                                               gint                 tile_row);
+static gboolean find_contiguous_segment       (ContiguousRegion    *region,
+                                               gint                 initial_x,
+                                               gint                 y,
+                                               gint                *start,
+                                               gint                *end);
+static void     find_contiguous_region        (ContiguousRegion    *region,
+                                               gint                 x,
+                                               gint                 y);
+static void     find_by_color_area            (const GeglRectangle *area,
+                                               gpointer             data);
 
 
 /*  public functions  */
@@ -92,13 +122,14 @@ gimp_image_contiguous_region_by_seed (GimpImage           *image,
                                       gint                 x,
                                       gint                 y)
 {
-  GimpPickable *pickable;
-  GeglBuffer   *src_buffer;
-  GeglBuffer   *mask_buffer;
-  const Babl   *format;
-  gint          n_components;
-  gboolean      has_alpha;
-  gfloat        start_col[MAX_CHANNELS];
+  ContiguousRegion  region;
+  GimpPickable     *pickable;
+  GeglBuffer       *src_buffer;
+  GeglBuffer       *mask_buffer;
+  const Babl       *format;
+  gint              n_components;
+  gboolean          has_alpha;
+  gfloat            start_col[MAX_CHANNELS];
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), NULL);
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
@@ -137,11 +168,18 @@ gimp_image_contiguous_region_by_seed (GimpImage           *image,
   mask_buffer = gegl_buffer_new (gegl_buffer_get_extent (src_buffer),
                                  babl_format ("Y float"));
 
-  find_contiguous_region_helper (src_buffer, mask_buffer,
-                                 format, n_components, has_alpha,
-                                 select_transparent, select_criterion,
-                                 antialias, threshold,
-                                 x, y, start_col);
+  region.src_buffer         = src_buffer;
+  region.mask_buffer        = mask_buffer;
+  region.format             = format;
+  region.n_components       = n_components;
+  region.has_alpha          = has_alpha;
+  region.select_transparent = select_transparent;
+  region.select_criterion   = select_criterion;
+  region.antialias          = antialias;
+  region.threshold          = threshold;
+  region.col                = start_col;
+
+  find_contiguous_region (&region, x, y);
 
   return mask_buffer;
 }
@@ -162,7 +200,7 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
    *  fuzzy_select.  Modify the image's mask to reflect the
    *  additional selection
    */
-  GeglBufferIterator *iter;
+  ContiguousRegion    region;
   GimpPickable       *pickable;
   GeglBuffer         *src_buffer;
   GeglBuffer         *mask_buffer;
@@ -207,35 +245,23 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
   mask_buffer = gegl_buffer_new (gegl_buffer_get_extent (src_buffer),
                                  babl_format ("Y float"));
 
-  iter = gegl_buffer_iterator_new (src_buffer,
-                                   NULL, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
-
-  gegl_buffer_iterator_add (iter, mask_buffer,
-                            NULL, 0, babl_format ("Y float"),
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-  while (gegl_buffer_iterator_next (iter))
-    {
-      const gfloat *src   = iter->data[0];
-      gfloat       *dest  = iter->data[1];
-      gint          count = iter->length;
-
-      while (count--)
-        {
-          /*  Find how closely the colors match  */
-          *dest = pixel_difference (start_col, src,
-                                    antialias,
-                                    threshold,
-                                    n_components,
-                                    has_alpha,
-                                    select_transparent,
-                                    select_criterion);
-
-          src  += n_components;
-          dest += 1;
-        }
-    }
+  region.src_buffer         = src_buffer;
+  region.mask_buffer        = mask_buffer;
+  region.format             = format;
+  region.n_components       = n_components;
+  region.has_alpha          = has_alpha;
+  region.select_transparent = select_transparent;
+  region.select_criterion   = select_criterion;
+  region.antialias          = antialias;
+  region.threshold          = threshold;
+  region.col                = start_col;
+
+  /*  there is no connectivity constraint, so each pixel can be
+   *  looked at independently
+   */
+  gimp_parallel_distribute_area (gegl_buffer_get_extent (src_buffer),
+                                 CONTIGUOUS_REGION_MIN_SUB_AREA,
+                                 find_by_color_area, &region);
 
   return mask_buffer;
 }
@@ -380,154 +406,252 @@ pixel_difference (const gfloat        *col1,
     }
 }
 
-static gboolean
-find_contiguous_segment (const gfloat        *col,
-                         GeglBuffer          *src_buffer,
-                         GeglBuffer          *mask_buffer,
-                         const Babl          *format,
-                         gint                 n_components,
-                         gboolean             has_alpha,
-                         gint                 width,
-                         gboolean             select_transparent,
-                         GimpSelectCriterion  select_criterion,
-                         gboolean             antialias,
-                         gfloat               threshold,
-                         gint                 initial_x,
-                         gint                 initial_y,
-                         gint                *start,
-                         gint                *end)
+static gfloat *
+contiguous_region_load_tile (ContiguousRegion *region,
+                             gint              tile_col,
+                             gint              tile_row)
 {
-  gfloat s[MAX_CHANNELS];
-  gfloat mask_row[width];
-  gfloat diff;
+  GeglRectangle  rect;
+  gfloat        *tile;
+  gint           row;
 
-  gegl_buffer_sample (src_buffer, initial_x, initial_y, NULL, s, format,
-                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  rect.x      = tile_col * CONTIGUOUS_REGION_TILE_SIZE;
+  rect.y      = tile_row * CONTIGUOUS_REGION_TILE_SIZE;
+  rect.width  = MIN (CONTIGUOUS_REGION_TILE_SIZE, region->width  - rect.x);
+  rect.height = MIN (CONTIGUOUS_REGION_TILE_SIZE, region->height - rect.y);
 
-  diff = pixel_difference (col, s, antialias, threshold,
-                           n_components, has_alpha, select_transparent,
-                           select_criterion);
+  gegl_buffer_get (region->src_buffer, &rect, 1.0,
+                   region->format, region->src_tile,
+                   CONTIGUOUS_REGION_TILE_SIZE *
+                   region->n_components * sizeof (gfloat),
+                   GEGL_ABYSS_NONE);
 
-  /* check the starting pixel */
-  if (! diff)
-    return FALSE;
+  tile = g_new0 (gfloat, CONTIGUOUS_REGION_TILE_SIZE *
+                         CONTIGUOUS_REGION_TILE_SIZE);
 
-  mask_row[initial_x] = diff;
+  for (row = 0; row < rect.height; row++)
+    {
+      const gfloat *src  = (region->src_tile +
+                            row * CONTIGUOUS_REGION_TILE_SIZE *
+                            region->n_components);
+      gfloat       *dest = tile + row * CONTIGUOUS_REGION_TILE_SIZE;
+      gint          col;
 
-  *start = initial_x - 1;
+      for (col = 0; col < rect.width; col++)
+        {
+          dest[col] = -pixel_difference (region->col, src,
+                                         region->antialias,
+                                         region->threshold,
+                                         region->n_components,
+                                         region->has_alpha,
+                                         region->select_transparent,
+                                         region->select_criterion);
+
+          src += region->n_components;
+        }
+    }
 
-  while (*start >= 0 && diff)
-    {
-      gegl_buffer_sample (src_buffer, *start, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  region->tiles[tile_row * region->n_tile_cols + tile_col] = tile;
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+  return tile;
+}
 
-      mask_row[*start] = diff;
+static inline gfloat *
+contiguous_region_get_pixel (ContiguousRegion *region,
+                             gint              x,
+                             gint              y)
+{
+  gint    tile_col = x >> CONTIGUOUS_REGION_TILE_SHIFT;
+  gint    tile_row = y >> CONTIGUOUS_REGION_TILE_SHIFT;
+  gfloat *tile;
 
-      if (diff)
-        (*start)--;
-    }
+  tile = region->tiles[tile_row * region->n_tile_cols + tile_col];
 
-  diff = 1;
-  *end = initial_x + 1;
+  if (! tile)
+    tile = contiguous_region_load_tile (region, tile_col, tile_row);
 
-  while (*end < width && diff)
-    {
-      gegl_buffer_sample (src_buffer, *end, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  return tile + (((y & (CONTIGUOUS_REGION_TILE_SIZE - 1)) <<
+                  CONTIGUOUS_REGION_TILE_SHIFT) +
+                 (x & (CONTIGUOUS_REGION_TILE_SIZE - 1)));
+}
+
+/*  Adds the run of not yet reached pixels around (initial_x, y) to the
+ *  region, and returns its extents in [start, end]
+ */
+static gboolean
+find_contiguous_segment (ContiguousRegion *region,
+                         gint              initial_x,
+                         gint              y,
+                         gint             *start,
+                         gint             *end)
+{
+  gfloat *pixel;
+
+  pixel = contiguous_region_get_pixel (region, initial_x, y);
+
+  /* check the starting pixel */
+  if (*pixel >= 0.0)
+    return FALSE;
+
+  *pixel = -*pixel;
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+  for (*start = initial_x; *start > 0; (*start)--)
+    {
+      pixel = contiguous_region_get_pixel (region, *start - 1, y);
 
-      mask_row[*end] = diff;
+      if (*pixel >= 0.0)
+        break;
 
-      if (diff)
-        (*end)++;
+      *pixel = -*pixel;
     }
 
-  gegl_buffer_set (mask_buffer, GEGL_RECTANGLE (*start, initial_y,
-                                                *end - *start, 1),
-                   0, babl_format ("Y float"), &mask_row[*start],
-                   GEGL_AUTO_ROWSTRIDE);
+  for (*end = initial_x; *end < region->width - 1; (*end)++)
+    {
+      pixel = contiguous_region_get_pixel (region, *end + 1, y);
+
+      if (*pixel >= 0.0)
+        break;
+
+      *pixel = -*pixel;
+    }
 
   return TRUE;
 }
 
 static void
-find_contiguous_region_helper (GeglBuffer          *src_buffer,
-                               GeglBuffer          *mask_buffer,
-                               const Babl          *format,
-                               gint                 n_components,
-                               gboolean             has_alpha,
-                               gboolean             select_transparent,
-                               GimpSelectCriterion  select_criterion,
-                               gboolean             antialias,
-                               gfloat               threshold,
-                               gint                 x,
-                               gint                 y,
-                               const gfloat        *col)
+find_contiguous_region (ContiguousRegion *region,
+                        gint              x,
+                        gint              y)
 {
-  gint    start, end;
-  gint    new_start, new_end;
-  GQueue *coord_stack;
+  GArray         *span_stack;
+  ContiguousSpan  span;
+  gint            n_tiles;
+  gint            i;
 
-  coord_stack = g_queue_new ();
+  region->width       = gegl_buffer_get_width  (region->src_buffer);
+  region->height      = gegl_buffer_get_height (region->src_buffer);
 
-  /* To avoid excessive memory allocation (y, start, end) tuples are
-   * stored in interleaved format:
-   *
-   * [y1] [start1] [end1] [y2] [start2] [end2]
-   */
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (y));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x - 1));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x + 1));
+  if (x < 0 || x >= region->width ||
+      y < 0 || y >= region->height)
+    return;
+
+  region->n_tile_cols = ((region->width + CONTIGUOUS_REGION_TILE_SIZE - 1) >>
+                         CONTIGUOUS_REGION_TILE_SHIFT);
+  region->n_tile_rows = ((region->height + CONTIGUOUS_REGION_TILE_SIZE - 1) >>
+                         CONTIGUOUS_REGION_TILE_SHIFT);
+
+  n_tiles = region->n_tile_cols * region->n_tile_rows;
+
+  region->tiles    = g_new0 (gfloat *, n_tiles);
+  region->src_tile = g_new (gfloat, CONTIGUOUS_REGION_TILE_SIZE *
+                                    CONTIGUOUS_REGION_TILE_SIZE *
+                                    region->n_components);
+
+  span_stack = g_array_new (FALSE, FALSE, sizeof (ContiguousSpan));
+
+  span.y     = y;
+  span.start = x;
+  span.end   = x;
 
-  do
+  g_array_append_val (span_stack, span);
+
+  while (span_stack->len > 0)
     {
-      y     = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      start = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      end   = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
+      span = g_array_index (span_stack, ContiguousSpan, span_stack->len - 1);
+      g_array_set_size (span_stack, span_stack->len - 1);
 
-      for (x = start + 1; x < end; x++)
+      for (x = span.start; x <= span.end; x++)
         {
-          gfloat val;
-
-          gegl_buffer_sample (mask_buffer, x, y, NULL, &val,
-                              babl_format ("Y float"),
-                              GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-          if (val != 0.0)
-            continue;
+          ContiguousSpan new_span;
 
-          if (! find_contiguous_segment (col, src_buffer, mask_buffer,
-                                         format,
-                                         n_components,
-                                         has_alpha,
-                                         gegl_buffer_get_width (src_buffer),
-                                         select_transparent, select_criterion,
-                                         antialias, threshold, x, y,
-                                         &new_start, &new_end))
+          if (! find_contiguous_segment (region, x, span.y,
+                                         &new_span.start, &new_span.end))
             continue;
 
-          if (y + 1 < gegl_buffer_get_height (src_buffer))
+          if (span.y + 1 < region->height)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y + 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              new_span.y = span.y + 1;
+              g_array_append_val (span_stack, new_span);
             }
 
-          if (y - 1 >= 0)
+          if (span.y - 1 >= 0)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y - 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              new_span.y = span.y - 1;
+              g_array_append_val (span_stack, new_span);
             }
+
+          /*  the pixel after the segment can't be part of another one  */
+          x = new_span.end + 1;
         }
     }
-  while (! g_queue_is_empty (coord_stack));
 
-  g_queue_free (coord_stack);
+  g_array_free (span_stack, TRUE);
+
+  /*  write out all tiles the fill has looked at, dropping the pixels
+   *  it didn't reach
+   */
+  for (i = 0; i < n_tiles; i++)
+    {
+      gfloat        *tile = region->tiles[i];
+      GeglRectangle  rect;
+      gint           j;
+
+      if (! tile)
+        continue;
+
+      for (j = 0; j < CONTIGUOUS_REGION_TILE_SIZE * CONTIGUOUS_REGION_TILE_SIZE; j++)
+        tile[j] = MAX (tile[j], 0.0);
+
+      rect.x      = (i % region->n_tile_cols) * CONTIGUOUS_REGION_TILE_SIZE;
+      rect.y      = (i / region->n_tile_cols) * CONTIGUOUS_REGION_TILE_SIZE;
+      rect.width  = MIN (CONTIGUOUS_REGION_TILE_SIZE, region->width  - rect.x);
+      rect.height = MIN (CONTIGUOUS_REGION_TILE_SIZE, region->height - rect.y);
+
+      gegl_buffer_set (region->mask_buffer, &rect, 0,
+                       babl_format ("Y float"), tile,
+                       CONTIGUOUS_REGION_TILE_SIZE * sizeof (gfloat));
+
+      g_free (tile);
+    }
+
+  g_free (region->src_tile);
+  g_free (region->tiles);
+}
+
+static void
+find_by_color_area (const GeglRectangle *area,
+                    gpointer             data)
+{
+  ContiguousRegion   *region = data;
+  GeglBufferIterator *iter;
+
+  iter = gegl_buffer_iterator_new (region->src_buffer,
+                                   area, 0, region->format,
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, region->mask_buffer,
+                            area, 0, babl_format ("Y float"),
+                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *src   = iter->data[0];
+      gfloat       *dest  = iter->data[1];
+      gint          count = iter->length;
+
+      while (count--)
+        {
+          /*  Find how closely the colors match  */
+          *dest = pixel_difference (region->col, src,
+                                    region->antialias,
+                                    region->threshold,
+                                    region->n_components,
+                                    region->has_alpha,
+                                    region->select_transparent,
+                                    region->select_criterion);
+
+          src  += region->n_components;
+          dest += 1;
+        }
+    }
 }
@@ -141,9 +141,11 @@
 
 #include "core-types.h"
 
+#include "gegl/gimp-babl.h"
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimpcontainer.h"
 #include "gimpdrawable.h"
 #include "gimperror.h"
@@ -165,6 +167,12 @@
 #include "gimp-intl.h"
 
 
+/* the smallest area that is worth a thread of its own */
+#define QUANTIZE_MIN_SUB_AREA (128 * 128)
+
+/* the number of rows Floyd-Steinberg prepares ahead of the diffusion */
+#define FS_BAND_HEIGHT 32
+
 /* basic memory/quality tradeoff */
 #define PRECISION_R 8
 #define PRECISION_G 6
@@ -197,9 +205,19 @@ typedef void (* Pass2_Func)   (QuantizeObj *quantize_obj,
                                GimpLayer   *layer,
                                GeglBuffer  *new_buffer);
 typedef void (* Cleanup_Func) (QuantizeObj *quantize_obj);
-typedef unsigned long ColorFreq;
+typedef gsize ColorFreq;
 typedef ColorFreq *CFHistogram;
 
+/*  In pass 2 the histogram is the inverse colormap cache, which the
+ *  parallel remap functions read without locking while another thread
+ *  might be filling it, so they go through these.  ColorFreq is
+ *  pointer sized to allow for it.
+ */
+#define CACHE_GET(cachep) \
+  GPOINTER_TO_SIZE (g_atomic_pointer_get ((gpointer *) (cachep)))
+#define CACHE_SET(cachep,val) \
+  g_atomic_pointer_set ((gpointer *) (cachep), GSIZE_TO_POINTER (val))
+
 typedef enum {AXIS_UNDEF, AXIS_RED, AXIS_BLUE, AXIS_GREEN} axisType;
 
 typedef double etype;
@@ -469,6 +487,8 @@ struct _QuantizeObj
   Color clin[256];                  /* .. converted back to linear space */
   gulong index_used_count[256];     /* how many times an index was used */
   CFHistogram histogram;            /* holds the histogram               */
+  GMutex inverse_cmap_mutex;        /* serializes filling the inverse cmap */
+  GSList *area_histograms;          /* spare AreaHistograms for pass 1   */
 
   gboolean want_alpha_dither;
   int      error_freedom;           /* 0=much bleed, 1=controlled bleed */
@@ -503,13 +523,118 @@ typedef struct
 
 } box, *boxptr;
 
+/*  The histogram of one area of a layer, counted in parallel to the
+ *  other areas.  Only the cells listed in @cells are not zero, so it
+ *  is merged and cleared quickly, and kept around for the next area.
+ */
+typedef struct
+{
+  CFHistogram  histogram;
+  GArray      *cells;
+} AreaHistogram;
+
+typedef struct _LayerPass LayerPass;
+
+typedef void (* LayerPassFunc) (LayerPass           *pass,
+                                const GeglRectangle *area,
+                                gulong              *index_used_count);
+
+/*  A histogram or remap pass over one layer, split into areas which
+ *  are processed in parallel
+ */
+struct _LayerPass
+{
+  QuantizeObj   *quantobj;
+  CFHistogram    histogram;
+  GimpLayer     *layer;
+  GeglBuffer    *src_buffer;
+  GeglBuffer    *dest_buffer;
+  const Babl    *src_format;
+  gint           offsetx;
+  gint           offsety;
+  gint           col_limit;
+  gboolean       alpha_dither;
+  LayerPassFunc  func;
+
+  GMutex         mutex;
+  GimpProgress  *progress;
+  gint           nth_layer;
+  gint           n_layers;
+  glong          layer_size;
+  glong          total_size;
+};
+
+typedef struct _FSDither FSDither;
+
+typedef void (* FSDitherRowFunc) (FSDither     *fs,
+                                  gint          row,
+                                  const guchar *src,
+                                  const gint   *lin);
+
+/*  State of a Floyd-Steinberg pass.  The error diffusion itself has to
+ *  run row after row, but fetching the source rows and converting them
+ *  to linear space doesn't depend on the error, so the rows of the next
+ *  band are prepared in parallel while the current band is diffused.
+ */
+struct _FSDither
+{
+  QuantizeObj     *quantobj;
+  GeglBuffer      *src_buffer;
+  GeglBuffer      *dest_buffer;
+  const Babl      *src_format;
+  gint             src_bpp;
+  gint             dest_bpp;
+  gboolean         has_alpha;
+  gboolean         alpha_dither;
+  gint             width;
+  gint             height;
+  gint             offsetx;
+  gint             offsety;
+  gint             red_pix;
+  gint             green_pix;
+  gint             blue_pix;
+  gint             alpha_pix;
+
+  /*  two bands of prepared rows, used alternately  */
+  guchar          *src_rows[2];
+  gint            *lin_rows[2];
+  gint             prepare_band;
+  gint             diffuse_band;
+  FSDitherRowFunc  row_func;
+
+  /*  the error diffusion state, only used by the diffusing thread  */
+  gint            *error_limiter;
+  const guchar    *range_limiter;
+  guchar          *dest_buf;
+  gint            *next_row[3];
+  gint            *prev_row[3];
+  gboolean         odd_row;
+  gint             global_gmax, global_gmin;
+  gint             global_bmax, global_bmin;
+};
+
+
+static const Babl * get_quantize_format (GimpLayer    *layer);
+
+static void layer_pass_init         (LayerPass    *pass,
+                                     GimpLayer    *layer,
+                                     GimpProgress *progress,
+                                     gint          nth_layer,
+                                     gint          n_layers);
+static void layer_pass_clear        (LayerPass    *pass);
+static void layer_pass_progress     (LayerPass    *pass,
+                                     glong         n_pixels);
+static void layer_pass_run          (QuantizeObj  *quantobj,
+                                     GimpLayer    *layer,
+                                     GeglBuffer   *new_buffer,
+                                     LayerPassFunc func);
 
 static void zero_histogram_gray     (CFHistogram   histogram);
 static void zero_histogram_rgb      (CFHistogram   histogram);
 static void generate_histogram_gray (CFHistogram   hostogram,
                                      GimpLayer    *layer,
                                      gboolean      alpha_dither);
-static void generate_histogram_rgb  (CFHistogram   histogram,
+static void generate_histogram_rgb  (QuantizeObj  *quantobj,
                                      GimpLayer    *layer,
                                      gint          col_limit,
                                      gboolean      alpha_dither,
@@ -752,6 +877,7 @@ gimp_image_convert_type (GimpImage               *image,
 {
   QuantizeObj       *quantobj = NULL;
   GimpImageBaseType  old_type;
+  GimpPrecision      old_precision;
   GList             *all_layers;
   GList             *list;
   const gchar       *undo_desc = NULL;
@@ -817,6 +943,20 @@ gimp_image_convert_type (GimpImage               *image,
 
   g_object_set (image, "base-type", new_type, NULL);
 
+  /*  Indexed images are always 8 bit, but the quantizer reads layers
+   *  of any precision directly, so there is no need to convert them to
+   *  8 bit first.  Only the other drawables are converted below.
+   */
+  old_precision = gimp_image_get_precision (image);
+
+  if (new_type      == GIMP_INDEXED &&
+      old_precision != GIMP_PRECISION_U8_GAMMA)
+    {
+      gimp_image_undo_push_image_precision (image, NULL);
+
+      g_object_set (image, "precision", GIMP_PRECISION_U8_GAMMA, NULL);
+    }
+
   /*  Convert to indexed?  Build histogram if necessary.  */
   if (new_type == GIMP_INDEXED)
     {
@@ -868,7 +1008,7 @@ gimp_image_convert_type (GimpImage               *image,
                 generate_histogram_gray (quantobj->histogram,
                                          layer, alpha_dither);
               else
-                generate_histogram_rgb (quantobj->histogram,
+                generate_histogram_rgb (quantobj,
                                         layer, num_cols, alpha_dither,
                                         progress, nth_layer, n_layers);
 
@@ -1016,14 +1156,57 @@ gimp_image_convert_type (GimpImage               *image,
           gimp_drawable_set_buffer (GIMP_DRAWABLE (layer), TRUE, NULL,
                                     new_buffer);
           g_object_unref (new_buffer);
+
+          if (gimp_layer_get_mask (layer) &&
+              old_precision != gimp_image_get_precision (image))
+            {
+              gimp_drawable_convert_type (GIMP_DRAWABLE (gimp_layer_get_mask (layer)),
+                                          image, GIMP_GRAY,
+                                          gimp_image_get_precision (image),
+                                          0, 0,
+                                          TRUE);
+            }
         }
       else
         {
           gimp_drawable_convert_type (GIMP_DRAWABLE (layer), image, new_type,
-                                      gimp_drawable_get_precision (GIMP_DRAWABLE (layer)),
+                                      gimp_image_get_precision (image),
+                                      0, 0,
+                                      TRUE);
+        }
+    }
+
+  /*  Convert the channels and the selection mask to 8 bit  */
+  if (old_precision != gimp_image_get_precision (image))
+    {
+      GimpChannel *mask = gimp_image_get_mask (image);
+      GList       *all_channels;
+      GeglBuffer  *buffer;
+
+      all_channels = gimp_image_get_channel_list (image);
+
+      for (list = all_channels; list; list = g_list_next (list))
+        {
+          gimp_drawable_convert_type (list->data, image, GIMP_GRAY,
+                                      gimp_image_get_precision (image),
                                       0, 0,
                                       TRUE);
         }
+
+      g_list_free (all_channels);
+
+      gimp_image_undo_push_mask_precision (image, NULL, mask);
+
+      buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                                gimp_image_get_width  (image),
+                                                gimp_image_get_height (image)),
+                                gimp_image_get_mask_format (image));
+
+      gegl_buffer_copy (gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)), NULL,
+                        buffer, NULL);
+
+      gimp_drawable_set_buffer (GIMP_DRAWABLE (mask), FALSE, NULL, buffer);
+      g_object_unref (buffer);
     }
 
   /*  Set the final palette on the image  */
@@ -1099,6 +1282,10 @@ gimp_image_convert_type (GimpImage               *image,
   gimp_image_undo_group_end (image);
 
   gimp_image_mode_changed (image);
+
+  if (old_precision != gimp_image_get_precision (image))
+    gimp_image_precision_changed (image);
+
   g_object_thaw_notify (G_OBJECT (image));
 
   g_list_free (all_layers);
@@ -1130,26 +1317,132 @@ zero_histogram_rgb (CFHistogram histogram)
 }
 
 
+/*  The quantizer works on 8 bit gamma data.  Layers of any other
+ *  precision are simply read in the matching 8 bit format, which
+ *  saves converting the whole image to 8 bit first.
+ */
+static const Babl *
+get_quantize_format (GimpLayer *layer)
+{
+  GimpDrawable *drawable = GIMP_DRAWABLE (layer);
+
+  return gimp_babl_format (gimp_drawable_get_base_type (drawable),
+                           GIMP_PRECISION_U8_GAMMA,
+                           gimp_drawable_has_alpha (drawable));
+}
+
 static void
-generate_histogram_gray (CFHistogram  histogram,
-                         GimpLayer   *layer,
-                         gboolean     alpha_dither)
+layer_pass_init (LayerPass    *pass,
+                 GimpLayer    *layer,
+                 GimpProgress *progress,
+                 gint          nth_layer,
+                 gint          n_layers)
+{
+  memset (pass, 0, sizeof (LayerPass));
+
+  pass->layer      = layer;
+  pass->src_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  pass->src_format = get_quantize_format (layer);
+  pass->progress   = progress;
+  pass->nth_layer  = nth_layer;
+  pass->n_layers   = n_layers;
+  pass->layer_size = ((glong) gimp_item_get_width  (GIMP_ITEM (layer)) *
+                      (glong) gimp_item_get_height (GIMP_ITEM (layer)));
+
+  gimp_item_get_offset (GIMP_ITEM (layer), &pass->offsetx, &pass->offsety);
+
+  g_mutex_init (&pass->mutex);
+}
+
+static void
+layer_pass_clear (LayerPass *pass)
+{
+  g_mutex_clear (&pass->mutex);
+}
+
+static void
+layer_pass_progress (LayerPass *pass,
+                     glong      n_pixels)
+{
+  glong total_size;
+
+  g_mutex_lock (&pass->mutex);
+
+  pass->total_size += n_pixels;
+  total_size = pass->total_size;
+
+  g_mutex_unlock (&pass->mutex);
+
+  /*  only the thread that started the pass may talk to the progress  */
+  if (pass->progress && ! gimp_parallel_is_worker_thread ())
+    gimp_progress_set_value (pass->progress,
+                             (pass->nth_layer +
+                              ((gdouble) total_size) / pass->layer_size) /
+                             (gdouble) pass->n_layers);
+}
+
+static void
+layer_pass_area (const GeglRectangle *area,
+                 LayerPass           *pass)
+{
+  gulong index_used_count[256] = { 0, };
+  gint   i;
+
+  pass->func (pass, area, index_used_count);
+
+  g_mutex_lock (&pass->mutex);
+
+  for (i = 0; i < 256; i++)
+    pass->quantobj->index_used_count[i] += index_used_count[i];
+
+  g_mutex_unlock (&pass->mutex);
+}
+
+/*  Runs one of the pass2 functions which map each pixel independently
+ *  of its neighbours over @layer, in parallel.  The inverse colormap
+ *  cache is shared between the threads, see fill_inverse_cmap_rgb().
+ */
+static void
+layer_pass_run (QuantizeObj   *quantobj,
+                GimpLayer     *layer,
+                GeglBuffer    *new_buffer,
+                LayerPassFunc  func)
+{
+  LayerPass pass;
+
+  layer_pass_init (&pass, layer, quantobj->progress,
+                   quantobj->nth_layer, quantobj->n_layers);
+
+  pass.quantobj     = quantobj;
+  pass.histogram    = quantobj->histogram;
+  pass.dest_buffer  = new_buffer;
+  pass.alpha_dither = quantobj->want_alpha_dither;
+  pass.func         = func;
+
+  gimp_parallel_distribute_area (gegl_buffer_get_extent (pass.src_buffer),
+                                 QUANTIZE_MIN_SUB_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 layer_pass_area,
+                                 &pass);
+
+  layer_pass_clear (&pass);
+}
+
+static void
+generate_histogram_gray_area (const GeglRectangle *area,
+                              LayerPass           *pass)
 {
   GeglBufferIterator *iter;
-  const Babl         *format;
+  ColorFreq           histogram[256] = { 0, };
   gint                bpp;
   gboolean            has_alpha;
+  gint                i;
 
-  format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-
-  g_return_if_fail (format == babl_format ("Y' u8") ||
-                    format == babl_format ("Y'A u8"));
+  bpp       = babl_format_get_bytes_per_pixel (pass->src_format);
+  has_alpha = babl_format_has_alpha (pass->src_format);
 
-  bpp       = babl_format_get_bytes_per_pixel (format);
-  has_alpha = babl_format_has_alpha (format);
-
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, format,
+  iter = gegl_buffer_iterator_new (pass->src_buffer,
+                                   area, 0, pass->src_format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
@@ -1177,212 +1470,275 @@ generate_histogram_gray (CFHistogram  histogram,
             }
         }
     }
+
+  g_mutex_lock (&pass->mutex);
+
+  for (i = 0; i < 256; i++)
+    pass->histogram[i] += histogram[i];
+
+  g_mutex_unlock (&pass->mutex);
 }
 
+static void
+generate_histogram_gray (CFHistogram  histogram,
+                         GimpLayer   *layer,
+                         gboolean     alpha_dither)
+{
+  LayerPass pass;
+
+  layer_pass_init (&pass, layer, NULL, 0, 1);
+
+  pass.histogram = histogram;
+
+  gimp_parallel_distribute_area (gegl_buffer_get_extent (pass.src_buffer),
+                                 QUANTIZE_MIN_SUB_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 generate_histogram_gray_area,
+                                 &pass);
 
+  layer_pass_clear (&pass);
+}
+
+/*  Each area is counted into a histogram of its own, and the colors
+ *  found while we still hope to get away without quantizing are
+ *  collected separately too.  Both are merged when the area is done,
+ *  so the result doesn't depend on the order the areas are processed
+ *  in.  When the layer isn't split, it is counted into the result
+ *  directly.
+ */
 static void
-generate_histogram_rgb (CFHistogram   histogram,
-                        GimpLayer    *layer,
-                        gint          col_limit,
-                        gboolean      alpha_dither,
-                        GimpProgress *progress,
-                        gint          nth_layer,
-                        gint          n_layers)
+generate_histogram_rgb_area (const GeglRectangle *area,
+                             LayerPass           *pass)
 {
   GeglBufferIterator *iter;
-  const Babl         *format;
   GeglRectangle      *roi;
+  AreaHistogram      *area_hist = NULL;
+  CFHistogram         histogram;
   ColorFreq          *colfreq;
+  guchar              area_cols[MAXNUMCOLORS][3];
+  gint                n_area_cols = 0;
+  gboolean            area_needs_quantize;
   gint                nfc_iter;
   gint                row, col, coledge;
-  gint                offsetx, offsety;
-  glong               layer_size;
-  glong               total_size = 0;
-  gint                count      = 0;
   gint                bpp;
   gboolean            has_alpha;
+  gint                i;
+
+  bpp       = babl_format_get_bytes_per_pixel (pass->src_format);
+  has_alpha = babl_format_has_alpha (pass->src_format);
 
-  format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
+  if (gegl_rectangle_equal (area, gegl_buffer_get_extent (pass->src_buffer)))
+    histogram = pass->histogram;
+  else
+    histogram = NULL;
 
-  g_return_if_fail (format == babl_format ("R'G'B' u8") ||
-                    format == babl_format ("R'G'B'A u8"));
+  g_mutex_lock (&pass->mutex);
 
-  bpp       = babl_format_get_bytes_per_pixel (format);
-  has_alpha = babl_format_has_alpha (format);
+  area_needs_quantize = needs_quantize;
+
+  if (! histogram && pass->quantobj->area_histograms)
+    {
+      GSList *spare = pass->quantobj->area_histograms;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+      area_hist = spare->data;
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
+      pass->quantobj->area_histograms = g_slist_delete_link (spare, spare);
+    }
 
-  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+  g_mutex_unlock (&pass->mutex);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, format,
+  if (! histogram)
+    {
+      if (! area_hist)
+        {
+          area_hist = g_slice_new (AreaHistogram);
+
+          area_hist->histogram = g_new0 (ColorFreq,
+                                         HIST_R_ELEMS *
+                                         HIST_G_ELEMS *
+                                         HIST_B_ELEMS);
+          area_hist->cells     = g_array_new (FALSE, FALSE, sizeof (guint));
+        }
+
+      histogram = area_hist->histogram;
+    }
+
+  iter = gegl_buffer_iterator_new (pass->src_buffer,
+                                   area, 0, pass->src_format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   roi = &iter->roi[0];
 
-  if (progress)
-    gimp_progress_set_value (progress, 0.0);
-
   while (gegl_buffer_iterator_next (iter))
     {
       const guchar *data   = iter->data[0];
       gint          length = iter->length;
 
-      total_size += length;
+      /* if alpha-dithering, we need to be deterministic w.r.t. offsets */
+      col = roi->x + pass->offsetx;
+      coledge = col + roi->width;
+      row = roi->y + pass->offsety;
 
-      /* g_printerr (" [%d,%d - %d,%d]", srcPR.x, src_roi->y, offsetx, offsety); */
-
-      if (needs_quantize)
+      while (length--)
         {
-          if (alpha_dither)
+          gboolean transparent = FALSE;
+
+          if (has_alpha)
             {
-              /* if alpha-dithering,
-                 we need to be deterministic w.r.t. offsets */
+              if (pass->alpha_dither)
+                {
+                  if (data[ALPHA] <
+                      DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
+                    transparent = TRUE;
+                }
+              else
+                {
+                  if (data[ALPHA] <= 127)
+                    transparent = TRUE;
+                }
+            }
 
-              col = roi->x + offsetx;
-              coledge = col + roi->width;
-              row = roi->y + offsety;
+          if (! transparent)
+            {
+              colfreq = HIST_RGB (histogram,
+                                  data[RED],
+                                  data[GREEN],
+                                  data[BLUE]);
 
-              while (length--)
+              if ((*colfreq)++ == 0 && area_hist)
                 {
-                  gboolean transparent = FALSE;
+                  guint cell = colfreq - histogram;
 
-                  if (has_alpha &&
-                      data[ALPHA] <
-                      DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
-                    transparent = TRUE;
+                  g_array_append_val (area_hist->cells, cell);
+                }
 
-                  if (! transparent)
+              if (! area_needs_quantize)
+                {
+                  for (nfc_iter = 0;
+                       nfc_iter < n_area_cols;
+                       nfc_iter++)
                     {
-                      colfreq = HIST_RGB (histogram,
-                                          data[RED],
-                                          data[GREEN],
-                                          data[BLUE]);
-                      (*colfreq)++;
+                      if ((data[RED]   == area_cols[nfc_iter][0]) &&
+                          (data[GREEN] == area_cols[nfc_iter][1]) &&
+                          (data[BLUE]  == area_cols[nfc_iter][2]))
+                        goto already_found;
                     }
 
-                  col++;
-                  if (col == coledge)
+                  if (n_area_cols == pass->col_limit)
                     {
-                      col = roi->x + offsetx;
-                      row++;
+                      /* There are more colors in the image
+                       *  than were allowed.  We switch to plain
+                       *  histogram calculation with a view to
+                       *  quantizing at a later stage.
+                       */
+                      area_needs_quantize = TRUE;
                     }
-
-                  data += bpp;
-                }
-            }
-          else
-            {
-              while (length--)
-                {
-                  if ((has_alpha && ((data[ALPHA] > 127)))
-                      || (!has_alpha))
+                  else
                     {
-                      colfreq = HIST_RGB (histogram,
-                                          data[RED],
-                                          data[GREEN],
-                                          data[BLUE]);
-                      (*colfreq)++;
+                      /* Remember the new color we just found.
+                       */
+                      area_cols[n_area_cols][0] = data[RED];
+                      area_cols[n_area_cols][1] = data[GREEN];
+                      area_cols[n_area_cols][2] = data[BLUE];
+                      n_area_cols++;
                     }
-
-                  data += bpp;
                 }
             }
-        }
-      else
-        {
-          /* if alpha-dithering, we need to be deterministic w.r.t. offsets */
-          col = roi->x + offsetx;
-          coledge = col + roi->width;
-          row = roi->y + offsety;
+        already_found:
 
-          while (length--)
+          col++;
+          if (col == coledge)
             {
-	      gboolean transparent = FALSE;
-
-	      if (has_alpha)
-	        {
-		  if (alpha_dither)
-		    {
-		      if (data[ALPHA] <
-                          DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
-		  	transparent = TRUE;
-		    }
-		  else
-		    {
-		      if (data[ALPHA] <= 127)
-			transparent = TRUE;
-		    }
-		}
-
-	      if (! transparent)
-                {
-                  colfreq = HIST_RGB (histogram,
-                                      data[RED],
-                                      data[GREEN],
-                                      data[BLUE]);
-                  (*colfreq)++;
+              col = roi->x + pass->offsetx;
+              row++;
+            }
 
-                  if (!needs_quantize)
-                    {
-                      for (nfc_iter = 0;
-                           nfc_iter < num_found_cols;
-                           nfc_iter++)
-                        {
-                          if ((data[RED]   == found_cols[nfc_iter][0]) &&
-                              (data[GREEN] == found_cols[nfc_iter][1]) &&
-                              (data[BLUE]  == found_cols[nfc_iter][2]))
-                            goto already_found;
-                        }
+          data += bpp;
+        }
 
-                      /* Color was not in the table of
-                       * existing colors
-                       */
+      layer_pass_progress (pass, iter->length);
+    }
 
-                      num_found_cols++;
+  g_mutex_lock (&pass->mutex);
 
-                      if (num_found_cols > col_limit)
-                        {
-                          /* There are more colors in the image
-                           *  than were allowed.  We switch to plain
-                           *  histogram calculation with a view to
-                           *  quantizing at a later stage.
-                           */
-                          needs_quantize = TRUE;
-                          /* g_print ("\nmax colors exceeded - needs quantize.\n");*/
-                          goto already_found;
-                        }
-                      else
-                        {
-                          /* Remember the new color we just found.
-                           */
-                          found_cols[num_found_cols-1][0] = data[RED];
-                          found_cols[num_found_cols-1][1] = data[GREEN];
-                          found_cols[num_found_cols-1][2] = data[BLUE];
-                        }
-                    }
-                }
-            already_found:
+  if (area_hist)
+    {
+      for (i = 0; i < area_hist->cells->len; i++)
+        {
+          guint cell = g_array_index (area_hist->cells, guint, i);
 
-              col++;
-              if (col == coledge)
-                {
-                  col = roi->x + offsetx;
-                  row++;
-                }
+          pass->histogram[cell] += histogram[cell];
+          histogram[cell] = 0;
+        }
 
-              data += bpp;
-            }
+      g_array_set_size (area_hist->cells, 0);
+
+      pass->quantobj->area_histograms =
+        g_slist_prepend (pass->quantobj->area_histograms, area_hist);
+    }
+
+  if (area_needs_quantize)
+    needs_quantize = TRUE;
+
+  for (i = 0; i < n_area_cols && ! needs_quantize; i++)
+    {
+      for (nfc_iter = 0; nfc_iter < num_found_cols; nfc_iter++)
+        {
+          if ((area_cols[i][0] == found_cols[nfc_iter][0]) &&
+              (area_cols[i][1] == found_cols[nfc_iter][1]) &&
+              (area_cols[i][2] == found_cols[nfc_iter][2]))
+            break;
         }
 
-      if (progress && (count % 16 == 0))
-        gimp_progress_set_value (progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
+      if (nfc_iter < num_found_cols)
+        continue;
+
+      if (num_found_cols == pass->col_limit)
+        {
+          needs_quantize = TRUE;
+        }
+      else
+        {
+          found_cols[num_found_cols][0] = area_cols[i][0];
+          found_cols[num_found_cols][1] = area_cols[i][1];
+          found_cols[num_found_cols][2] = area_cols[i][2];
+          num_found_cols++;
+        }
     }
 
+  g_mutex_unlock (&pass->mutex);
+}
+
+static void
+generate_histogram_rgb (QuantizeObj  *quantobj,
+                        GimpLayer    *layer,
+                        gint          col_limit,
+                        gboolean      alpha_dither,
+                        GimpProgress *progress,
+                        gint          nth_layer,
+                        gint          n_layers)
+{
+  LayerPass pass;
+
+  layer_pass_init (&pass, layer, progress, nth_layer, n_layers);
+
+  pass.quantobj     = quantobj;
+  pass.histogram    = quantobj->histogram;
+  pass.col_limit    = col_limit;
+  pass.alpha_dither = alpha_dither;
+
+  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+
+  if (progress)
+    gimp_progress_set_value (progress, 0.0);
+
+  gimp_parallel_distribute_area (gegl_buffer_get_extent (pass.src_buffer),
+                                 QUANTIZE_MIN_SUB_AREA,
+                                 (GimpParallelDistributeAreaFunc)
+                                 generate_histogram_rgb_area,
+                                 &pass);
+
+  layer_pass_clear (&pass);
+
 /*  g_print ("O: col_limit = %d, nfc = %d\n", col_limit, num_found_cols);*/
 }
 
@@ -2673,6 +3029,15 @@ fill_inverse_cmap_gray (QuantizeObj *quantobj,
   int    mindisti;
   int   i;
 
+  g_mutex_lock (&quantobj->inverse_cmap_mutex);
+
+  /* another thread might have filled the entry in the meantime */
+  if (histogram[pixel])
+    {
+      g_mutex_unlock (&quantobj->inverse_cmap_mutex);
+      return;
+    }
+
   cmap = quantobj->cmap;
 
   mindist = 65536;
@@ -2690,7 +3055,9 @@ fill_inverse_cmap_gray (QuantizeObj *quantobj,
     }
 
   if (i >= 0)
-    histogram[pixel] = mindisti + 1;
+    CACHE_SET (&histogram[pixel], mindisti + 1);
+
+  g_mutex_unlock (&quantobj->inverse_cmap_mutex);
 }
 
 
@@ -2703,6 +3070,10 @@ fill_inverse_cmap_rgb (QuantizeObj *quantobj,
 /* Fill the inverse-colormap entries in the update box that contains */
 /* histogram cell R/G/B.  (Only that one cell MUST be filled, but */
 /* we can fill as many others as we wish.) */
+/* The cache is read without locking by the parallel pass2 functions, */
+/* see CACHE_GET(); entries only ever change from 0 to their final */
+/* value, so a reader which sees 0 simply ends up here and waits for */
+/* the writer. */
 {
   int  minR, minG, minB; /* lower left corner of update box */
   int  iR, iG, iB;
@@ -2713,6 +3084,14 @@ fill_inverse_cmap_rgb (QuantizeObj *quantobj,
   /* This array holds the actually closest colormap index for each cell. */
   int  bestcolor[BOX_R_ELEMS * BOX_G_ELEMS * BOX_B_ELEMS] = { 0, };
 
+  g_mutex_lock (&quantobj->inverse_cmap_mutex);
+
+  if (*HIST_LIN (histogram, R, G, B))
+    {
+      g_mutex_unlock (&quantobj->inverse_cmap_mutex);
+      return;
+    }
+
   /* Convert cell coordinates to update box id */
   R >>= BOX_R_LOG;
   G >>= BOX_G_LOG;
@@ -2746,10 +3125,13 @@ fill_inverse_cmap_rgb (QuantizeObj *quantobj,
         {
           for (iB = 0; iB < BOX_B_ELEMS; iB++)
             {
-              *HIST_LIN (histogram, R + iR, G + iG, B + iB) = (*cptr++) + 1;
+              CACHE_SET (HIST_LIN (histogram, R + iR, G + iG, B + iB),
+                         (*cptr++) + 1);
             }
         }
     }
+
+  g_mutex_unlock (&quantobj->inverse_cmap_mutex);
 }
 
 
@@ -2829,10 +3211,11 @@ custompal_pass1 (QuantizeObj *quantobj)
  */
 
 static void
-median_cut_pass2_no_dither_gray (QuantizeObj *quantobj,
-                                 GimpLayer   *layer,
-                                 GeglBuffer  *new_buffer)
+median_cut_pass2_no_dither_gray_area (LayerPass           *pass,
+                                      const GeglRectangle *area,
+                                      gulong              *index_used_count)
 {
+  QuantizeObj        *quantobj = pass->quantobj;
   GeglBufferIterator *iter;
   CFHistogram         histogram = quantobj->histogram;
   ColorFreq          *cachep;
@@ -2842,27 +3225,27 @@ median_cut_pass2_no_dither_gray (QuantizeObj *quantobj,
   gint                src_bpp;
   gint                dest_bpp;
   gint                has_alpha;
-  gulong             *index_used_count = quantobj->index_used_count;
-  gboolean            alpha_dither     = quantobj->want_alpha_dither;
+  gboolean            alpha_dither     = pass->alpha_dither;
   gint                offsetx, offsety;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = pass->offsetx;
+  offsety = pass->offsety;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = pass->src_format;
+  dest_format = gegl_buffer_get_format (pass->dest_buffer);
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
+  iter = gegl_buffer_iterator_new (pass->src_buffer,
+                                   area, 0, src_format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   src_roi = &iter->roi[0];
 
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
+  gegl_buffer_iterator_add (iter, pass->dest_buffer,
+                            area, 0, NULL,
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
@@ -2884,7 +3267,7 @@ median_cut_pass2_no_dither_gray (QuantizeObj *quantobj,
               cachep = &histogram[pixel];
               /* If we have not seen this color before, find nearest colormap entry */
               /* and update the cache */
-              if (*cachep == 0)
+              if (CACHE_GET (cachep) == 0)
                 fill_inverse_cmap_gray (quantobj, histogram, pixel);
 
               if (has_alpha)
@@ -2912,13 +3295,13 @@ median_cut_pass2_no_dither_gray (QuantizeObj *quantobj,
                   else
                     {
                       dest[ALPHA_I] = 255;
-                      index_used_count[dest[INDEXED] = *cachep - 1]++;
+                      index_used_count[dest[INDEXED] = CACHE_GET (cachep) - 1]++;
                     }
                 }
               else
                 {
                   /* Now emit the colormap index for this cell */
-                  index_used_count[dest[INDEXED] = *cachep - 1]++;
+                  index_used_count[dest[INDEXED] = CACHE_GET (cachep) - 1]++;
                 }
 
               src  += src_bpp;
@@ -2929,13 +3312,23 @@ median_cut_pass2_no_dither_gray (QuantizeObj *quantobj,
 }
 
 static void
-median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
-                                    GimpLayer   *layer,
-                                    GeglBuffer  *new_buffer)
+median_cut_pass2_no_dither_gray (QuantizeObj *quantobj,
+                                 GimpLayer   *layer,
+                                 GeglBuffer  *new_buffer)
 {
-  GeglBufferIterator *iter;
-  CFHistogram         histogram = quantobj->histogram;
-  ColorFreq          *cachep;
+  layer_pass_run (quantobj, layer, new_buffer,
+                  median_cut_pass2_no_dither_gray_area);
+}
+
+static void
+median_cut_pass2_fixed_dither_gray_area (LayerPass           *pass,
+                                         const GeglRectangle *area,
+                                         gulong              *index_used_count)
+{
+  QuantizeObj        *quantobj = pass->quantobj;
+  GeglBufferIterator *iter;
+  CFHistogram         histogram = quantobj->histogram;
+  ColorFreq          *cachep;
   const Babl         *src_format;
   const Babl         *dest_format;
   GeglRectangle      *src_roi;
@@ -2948,27 +3341,27 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
   gint                err2;
   Color              *color1;
   Color              *color2;
-  gulong             *index_used_count = quantobj->index_used_count;
-  gboolean            alpha_dither     = quantobj->want_alpha_dither;
+  gboolean            alpha_dither     = pass->alpha_dither;
   gint                offsetx, offsety;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = pass->offsetx;
+  offsety = pass->offsety;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = pass->src_format;
+  dest_format = gegl_buffer_get_format (pass->dest_buffer);
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
+  iter = gegl_buffer_iterator_new (pass->src_buffer,
+                                   area, 0, src_format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   src_roi = &iter->roi[0];
 
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
+  gegl_buffer_iterator_add (iter, pass->dest_buffer,
+                            area, 0, NULL,
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
@@ -2993,10 +3386,10 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
               cachep = &histogram[pixel];
               /* If we have not seen this color before, find nearest colormap entry */
               /* and update the cache */
-              if (*cachep == 0)
+              if (CACHE_GET (cachep) == 0)
                 fill_inverse_cmap_gray (quantobj, histogram, pixel);
 
-              pixval1 = *cachep - 1;
+              pixval1 = CACHE_GET (cachep) - 1;
               color1 = &quantobj->cmap[pixval1];
 
               if (quantobj->actual_number_of_colors > 2)
@@ -3010,11 +3403,11 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
                       cachep = &histogram[R];
                       /* If we have not seen this color before, find nearest
                          colormap entry and update the cache */
-                      if (*cachep == 0)
+                      if (CACHE_GET (cachep) == 0)
                         {
                           fill_inverse_cmap_gray (quantobj, histogram, R);
                         }
-                      pixval2 = *cachep - 1;
+                      pixval2 = CACHE_GET (cachep) - 1;
                       RV += re;
                     }
                   while ((pixval1 == pixval2) &&
@@ -3093,10 +3486,20 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
 }
 
 static void
-median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
-                                GimpLayer   *layer,
-                                GeglBuffer  *new_buffer)
+median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
+                                    GimpLayer   *layer,
+                                    GeglBuffer  *new_buffer)
 {
+  layer_pass_run (quantobj, layer, new_buffer,
+                  median_cut_pass2_fixed_dither_gray_area);
+}
+
+static void
+median_cut_pass2_no_dither_rgb_area (LayerPass           *pass,
+                                     const GeglRectangle *area,
+                                     gulong              *index_used_count)
+{
+  QuantizeObj        *quantobj = pass->quantobj;
   GeglBufferIterator *iter;
   CFHistogram         histogram = quantobj->histogram;
   ColorFreq          *cachep;
@@ -3111,19 +3514,14 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
   gint                green_pix        = GREEN;
   gint                blue_pix         = BLUE;
   gint                alpha_pix        = ALPHA;
-  gboolean            alpha_dither     = quantobj->want_alpha_dither;
+  gboolean            alpha_dither     = pass->alpha_dither;
   gint                offsetx, offsety;
-  gulong             *index_used_count = quantobj->index_used_count;
-  glong               total_size       = 0;
-  glong               layer_size;
-  gint                count            = 0;
-  gint                nth_layer        = quantobj->nth_layer;
-  gint                n_layers         = quantobj->n_layers;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = pass->offsetx;
+  offsety = pass->offsety;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = pass->src_format;
+  dest_format = gegl_buffer_get_format (pass->dest_buffer);
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
@@ -3133,32 +3531,27 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
   /*  In the case of web/mono palettes, we actually force
    *   grayscale drawables through the rgb pass2 functions
    */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
+  if (gimp_drawable_is_gray (GIMP_DRAWABLE (pass->layer)))
     {
       red_pix = green_pix = blue_pix = GRAY;
       alpha_pix = ALPHA_G;
     }
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
+  iter = gegl_buffer_iterator_new (pass->src_buffer,
+                                   area, 0, src_format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   src_roi = &iter->roi[0];
 
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
+  gegl_buffer_iterator_add (iter, pass->dest_buffer,
+                            area, 0, NULL,
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
-
   while (gegl_buffer_iterator_next (iter))
     {
       const guchar *src  = iter->data[0];
       guchar       *dest = iter->data[1];
       gint          row;
 
-      total_size += src_roi->height * src_roi->width;
-
       for (row = 0; row < src_roi->height; row++)
         {
           gint col;
@@ -3199,11 +3592,11 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
               cachep = HIST_LIN(histogram,R,G,B);
               /* If we have not seen this color before, find nearest
                  colormap entry and update the cache */
-              if (*cachep == 0)
+              if (CACHE_GET (cachep) == 0)
                 fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
 
               /* Now emit the colormap index for this cell, barfbarf */
-              index_used_count[dest[INDEXED] = *cachep - 1]++;
+              index_used_count[dest[INDEXED] = CACHE_GET (cachep) - 1]++;
 
             next_pixel:
 
@@ -3212,18 +3605,25 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
             }
         }
 
-      if (quantobj->progress && (count % 16 == 0))
-         gimp_progress_set_value (quantobj->progress,
-                                  (nth_layer + ((gdouble) total_size)/
-                                   layer_size) / (gdouble) n_layers);
+      layer_pass_progress (pass, src_roi->width * src_roi->height);
     }
 }
 
 static void
-median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
-                                   GimpLayer   *layer,
-                                   GeglBuffer  *new_buffer)
+median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
+                                GimpLayer   *layer,
+                                GeglBuffer  *new_buffer)
 {
+  layer_pass_run (quantobj, layer, new_buffer,
+                  median_cut_pass2_no_dither_rgb_area);
+}
+
+static void
+median_cut_pass2_fixed_dither_rgb_area (LayerPass           *pass,
+                                        const GeglRectangle *area,
+                                        gulong              *index_used_count)
+{
+  QuantizeObj        *quantobj = pass->quantobj;
   GeglBufferIterator *iter;
   CFHistogram         histogram = quantobj->histogram;
   ColorFreq          *cachep;
@@ -3244,19 +3644,14 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
   gint                green_pix        = GREEN;
   gint                blue_pix         = BLUE;
   gint                alpha_pix        = ALPHA;
-  gboolean            alpha_dither     = quantobj->want_alpha_dither;
+  gboolean            alpha_dither     = pass->alpha_dither;
   gint                offsetx, offsety;
-  gulong             *index_used_count = quantobj->index_used_count;
-  glong               total_size       = 0;
-  glong               layer_size;
-  gint                count            = 0;
-  gint                nth_layer        = quantobj->nth_layer;
-  gint                n_layers         = quantobj->n_layers;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = pass->offsetx;
+  offsety = pass->offsety;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = pass->src_format;
+  dest_format = gegl_buffer_get_format (pass->dest_buffer);
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
@@ -3266,32 +3661,27 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
   /*  In the case of web/mono palettes, we actually force
    *   grayscale drawables through the rgb pass2 functions
    */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
+  if (gimp_drawable_is_gray (GIMP_DRAWABLE (pass->layer)))
     {
       red_pix = green_pix = blue_pix = GRAY;
       alpha_pix = ALPHA_G;
     }
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
+  iter = gegl_buffer_iterator_new (pass->src_buffer,
+                                   area, 0, src_format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   src_roi = &iter->roi[0];
 
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
+  gegl_buffer_iterator_add (iter, pass->dest_buffer,
+                            area, 0, NULL,
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
-
   while (gegl_buffer_iterator_next (iter))
     {
       const guchar *src  = iter->data[0];
       guchar       *dest = iter->data[1];
       gint          row;
 
-      total_size += src_roi->height * src_roi->width;
-
       for (row = 0; row < src_roi->height; row++)
         {
           gint col;
@@ -3334,7 +3724,7 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
               cachep = HIST_LIN(histogram,R,G,B);
               /* If we have not seen this color before, find nearest
                  colormap entry and update the cache */
-              if (*cachep == 0)
+              if (CACHE_GET (cachep) == 0)
                 fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
 
               /* We now try to find a color which, when mixed in some fashion
@@ -3344,7 +3734,7 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
                  color cell.  Then we assess the distance of both mixer
                  colors from the intended color to determine their relative
                  probabilities of being chosen. */
-              pixval1 = *cachep - 1;
+              pixval1 = CACHE_GET (cachep) - 1;
               color1 = &quantobj->cmap[pixval1];
 
               if (quantobj->actual_number_of_colors > 2)
@@ -3366,11 +3756,11 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
 
                       /* If we have not seen this color before, find nearest
                          colormap entry and update the cache */
-                      if (*cachep == 0)
+                      if (CACHE_GET (cachep) == 0)
                         {
                           fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
                         }
-                      pixval2 = *cachep - 1;
+                      pixval2 = CACHE_GET (cachep) - 1;
                       RV += re;  GV += ge;  BV += be;
                     }
                   while ((pixval1 == pixval2) &&
@@ -3443,18 +3833,25 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
             }
         }
 
-      if (quantobj->progress && (count % 16 == 0))
-        gimp_progress_set_value (quantobj->progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
+      layer_pass_progress (pass, src_roi->width * src_roi->height);
     }
 }
 
 static void
-median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
-                                        GimpLayer   *layer,
-                                        GeglBuffer  *new_buffer)
+median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
+                                   GimpLayer   *layer,
+                                   GeglBuffer  *new_buffer)
 {
+  layer_pass_run (quantobj, layer, new_buffer,
+                  median_cut_pass2_fixed_dither_rgb_area);
+}
+
+static void
+median_cut_pass2_nodestruct_dither_rgb_area (LayerPass           *pass,
+                                             const GeglRectangle *area,
+                                             gulong              *index_used_count)
+{
+  QuantizeObj        *quantobj = pass->quantobj;
   GeglBufferIterator *iter;
   const Babl         *src_format;
   const Babl         *dest_format;
@@ -3462,7 +3859,7 @@ median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
   gint                src_bpp;
   gint                dest_bpp;
   gint                has_alpha;
-  gboolean            alpha_dither = quantobj->want_alpha_dither;
+  gboolean            alpha_dither = pass->alpha_dither;
   gint                red_pix      = RED;
   gint                green_pix    = GREEN;
   gint                blue_pix     = BLUE;
@@ -3473,23 +3870,24 @@ median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
   gint                lastblue     = -1;
   gint                offsetx, offsety;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  offsetx = pass->offsetx;
+  offsety = pass->offsety;
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  src_format  = pass->src_format;
+  dest_format = gegl_buffer_get_format (pass->dest_buffer);
 
   src_bpp  = babl_format_get_bytes_per_pixel (src_format);
   dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
 
   has_alpha = babl_format_has_alpha (src_format);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
+  iter = gegl_buffer_iterator_new (pass->src_buffer,
+                                   area, 0, src_format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   src_roi = &iter->roi[0];
 
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
+  gegl_buffer_iterator_add (iter, pass->dest_buffer,
+                            area, 0, NULL,
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
   while (gegl_buffer_iterator_next (iter))
@@ -3574,6 +3972,15 @@ median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
     }
 }
 
+static void
+median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
+                                        GimpLayer   *layer,
+                                        GeglBuffer  *new_buffer)
+{
+  layer_pass_run (quantobj, layer, new_buffer,
+                  median_cut_pass2_nodestruct_dither_rgb_area);
+}
+
 
 /*
  * Initialize the error-limiting transfer function (lookup table).
@@ -3664,224 +4071,391 @@ init_error_limit (const int error_freedom)
  */
 
 static void
-median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
-                                 GimpLayer   *layer,
-                                 GeglBuffer  *new_buffer)
+fs_dither_prepare_row (FSDither *fs,
+                       gint      row)
+{
+  gint    band = row / FS_BAND_HEIGHT;
+  gint    y    = row % FS_BAND_HEIGHT;
+  guchar *src;
+
+  src = fs->src_rows[band & 1] + (gsize) y * fs->width * fs->src_bpp;
+
+  gegl_buffer_get (fs->src_buffer, GEGL_RECTANGLE (0, row, fs->width, 1),
+                   1.0, fs->src_format, src,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  if (fs->lin_rows[band & 1])
+    {
+      gint *lin = fs->lin_rows[band & 1] + (gsize) y * fs->width * 3;
+      gint  col;
+
+      for (col = 0; col < fs->width; col++)
+        {
+          rgb_to_unshifted_lin (src[fs->red_pix],
+                                src[fs->green_pix],
+                                src[fs->blue_pix],
+                                &lin[0], &lin[1], &lin[2]);
+
+          src += fs->src_bpp;
+          lin += 3;
+        }
+    }
+}
+
+static void
+fs_dither_diffuse_band (FSDither *fs)
 {
-  GeglBuffer   *src_buffer;
+  gint band = fs->diffuse_band;
+  gint y;
+
+  for (y = 0; y < FS_BAND_HEIGHT; y++)
+    {
+      gint          row = band * FS_BAND_HEIGHT + y;
+      const guchar *src;
+      const gint   *lin = NULL;
+
+      if (row >= fs->height)
+        break;
+
+      src = fs->src_rows[band & 1] + (gsize) y * fs->width * fs->src_bpp;
+
+      if (fs->lin_rows[band & 1])
+        lin = fs->lin_rows[band & 1] + (gsize) y * fs->width * 3;
+
+      fs->row_func (fs, row, src, lin);
+    }
+}
+
+static void
+fs_dither_band_func (gint      i,
+                     gint      n,
+                     FSDither *fs)
+{
+  gint first_row = fs->prepare_band * FS_BAND_HEIGHT;
+  gint last_row  = MIN (first_row + FS_BAND_HEIGHT, fs->height);
+  gint row;
+
+  /*  part 0 diffuses the current band, all others prepare the next
+   *  one.  If we are on our own, we simply do both.
+   */
+  if (i == 0)
+    {
+      if (fs->diffuse_band >= 0)
+        fs_dither_diffuse_band (fs);
+
+      if (n > 1)
+        return;
+
+      i = 1;
+      n = 2;
+    }
+
+  if (fs->prepare_band >= 0)
+    {
+      for (row = first_row + i - 1; row < last_row; row += n - 1)
+        fs_dither_prepare_row (fs, row);
+    }
+}
+
+static void
+fs_dither_init (FSDither    *fs,
+                QuantizeObj *quantobj,
+                GimpLayer   *layer,
+                GeglBuffer  *new_buffer,
+                gboolean     lin)
+{
+  gint n_channels = lin ? 3 : 1;
+  gint i;
+
+  memset (fs, 0, sizeof (FSDither));
+
+  fs->quantobj     = quantobj;
+  fs->src_buffer   = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  fs->dest_buffer  = new_buffer;
+  fs->src_format   = get_quantize_format (layer);
+  fs->src_bpp      = babl_format_get_bytes_per_pixel (fs->src_format);
+  fs->dest_bpp     = babl_format_get_bytes_per_pixel (gegl_buffer_get_format (new_buffer));
+  fs->has_alpha    = babl_format_has_alpha (fs->src_format);
+  fs->alpha_dither = quantobj->want_alpha_dither;
+  fs->width        = gimp_item_get_width  (GIMP_ITEM (layer));
+  fs->height       = gimp_item_get_height (GIMP_ITEM (layer));
+
+  gimp_item_get_offset (GIMP_ITEM (layer), &fs->offsetx, &fs->offsety);
+
+  fs->red_pix   = RED;
+  fs->green_pix = GREEN;
+  fs->blue_pix  = BLUE;
+  fs->alpha_pix = ALPHA;
+
+  /*  In the case of web/mono palettes, we actually force
+   *   grayscale drawables through the rgb pass2 functions
+   */
+  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
+    {
+      fs->red_pix   = fs->green_pix = fs->blue_pix = GRAY;
+      fs->alpha_pix = ALPHA_G;
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      fs->src_rows[i] = g_malloc ((gsize) FS_BAND_HEIGHT *
+                                  fs->width * fs->src_bpp);
+
+      if (lin)
+        fs->lin_rows[i] = g_new (gint, (gsize) FS_BAND_HEIGHT *
+                                       fs->width * 3);
+    }
+
+  fs->error_limiter = init_error_limit (quantobj->error_freedom);
+  fs->range_limiter = range_array + 256;
+
+  fs->dest_buf = g_malloc (fs->width * fs->dest_bpp);
+
+  for (i = 0; i < n_channels; i++)
+    {
+      fs->next_row[i] = g_new (gint, fs->width + 2);
+      fs->prev_row[i] = g_new0 (gint, fs->width + 2);
+    }
+}
+
+static void
+fs_dither_run (FSDither        *fs,
+               FSDitherRowFunc  row_func)
+{
+  QuantizeObj *quantobj = fs->quantobj;
+  gint         n_bands;
+  gint         band;
+
+  fs->row_func = row_func;
+
+  n_bands = (fs->height + FS_BAND_HEIGHT - 1) / FS_BAND_HEIGHT;
+
+  for (band = 0; band <= n_bands; band++)
+    {
+      fs->diffuse_band = band - 1;
+      fs->prepare_band = band < n_bands ? band : -1;
+
+      gimp_parallel_distribute (-1,
+                                (GimpParallelDistributeFunc)
+                                fs_dither_band_func,
+                                fs);
+
+      if (quantobj->progress && fs->diffuse_band >= 0)
+        gimp_progress_set_value (quantobj->progress,
+                                 (quantobj->nth_layer +
+                                  ((gdouble) MIN (band * FS_BAND_HEIGHT,
+                                                  fs->height)) /
+                                  fs->height) /
+                                 (gdouble) quantobj->n_layers);
+    }
+}
+
+static void
+fs_dither_clear (FSDither *fs)
+{
+  gint i;
+
+  for (i = 0; i < 2; i++)
+    {
+      g_free (fs->src_rows[i]);
+      g_free (fs->lin_rows[i]);
+    }
+
+  for (i = 0; i < 3; i++)
+    {
+      g_free (fs->next_row[i]);
+      g_free (fs->prev_row[i]);
+    }
+
+  g_free (fs->error_limiter - 255); /* good lord. */
+  g_free (fs->dest_buf);
+}
+
+static void
+fs_dither_gray_row (FSDither     *fs,
+                    gint          row,
+                    const guchar *src,
+                    const gint   *lin)
+{
+  QuantizeObj  *quantobj  = fs->quantobj;
   CFHistogram   histogram = quantobj->histogram;
   ColorFreq    *cachep;
   Color        *color;
-  gint         *error_limiter;
+  const gint   *error_limiter = fs->error_limiter;
+  const guchar *range_limiter = fs->range_limiter;
   const gshort *fs_err1, *fs_err2;
   const gshort *fs_err3, *fs_err4;
-  const guchar *range_limiter;
-  const Babl   *src_format;
-  const Babl   *dest_format;
-  gint          src_bpp;
-  gint          dest_bpp;
-  guchar       *src_buf, *dest_buf;
-  gint         *next_row, *prev_row;
+  gint          src_bpp   = fs->src_bpp;
+  gint          dest_bpp  = fs->dest_bpp;
+  guchar       *dest      = fs->dest_buf;
   gint         *nr, *pr;
   gint         *tmp;
   gint          pixel;
   gint          pixele;
-  gint          row, col;
+  gint          col;
   gint          index;
   gint          step_dest, step_src;
-  gint          odd_row;
-  gboolean      has_alpha;
-  gint          offsetx, offsety;
-  gboolean      alpha_dither = quantobj->want_alpha_dither;
-  gint          width, height;
+  gint          odd_row   = fs->odd_row;
+  gboolean      has_alpha = fs->has_alpha;
+  gint          offsetx   = fs->offsetx;
+  gint          offsety   = fs->offsety;
+  gboolean      alpha_dither     = fs->alpha_dither;
+  gint          width            = fs->width;
   gulong       *index_used_count = quantobj->index_used_count;
 
-  src_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
-
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
-
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
-
-  src_bpp  = babl_format_get_bytes_per_pixel (src_format);
-  dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
-
-  has_alpha = babl_format_has_alpha (src_format);
-
-  width  = gimp_item_get_width  (GIMP_ITEM (layer));
-  height = gimp_item_get_height (GIMP_ITEM (layer));
-
-  error_limiter = init_error_limit (quantobj->error_freedom);
-  range_limiter = range_array + 256;
-
-  src_buf  = g_malloc (width * src_bpp);
-  dest_buf = g_malloc (width * dest_bpp);
-
-  next_row = g_new (gint, width + 2);
-  prev_row = g_new0 (gint, width + 2);
-
   fs_err1 = floyd_steinberg_error1 + 511;
   fs_err2 = floyd_steinberg_error2 + 511;
   fs_err3 = floyd_steinberg_error3 + 511;
   fs_err4 = floyd_steinberg_error4 + 511;
 
-  odd_row = 0;
+  nr = fs->next_row[0];
+  pr = fs->prev_row[0] + 1;
 
-  for (row = 0; row < height; row++)
+  if (odd_row)
     {
-      const guchar *src;
-      guchar       *dest;
-
-      gegl_buffer_get (src_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       1.0, NULL, src_buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+      step_dest = -dest_bpp;
+      step_src  = -src_bpp;
 
-      src  = src_buf;
-      dest = dest_buf;
+      src  += (width * src_bpp) - src_bpp;
+      dest += (width * dest_bpp) - dest_bpp;
 
-      nr = next_row;
-      pr = prev_row + 1;
+      nr += width + 1;
+      pr += width;
 
-      if (odd_row)
-        {
-          step_dest = -dest_bpp;
-          step_src  = -src_bpp;
-
-          src  += (width * src_bpp) - src_bpp;
-          dest += (width * dest_bpp) - dest_bpp;
+      *(nr - 1) = 0;
+    }
+  else
+    {
+      step_dest = dest_bpp;
+      step_src  = src_bpp;
 
-          nr += width + 1;
-          pr += width;
+      *(nr + 1) = 0;
+    }
 
-          *(nr - 1) = 0;
-        }
-      else
-        {
-          step_dest = dest_bpp;
-          step_src  = src_bpp;
+  *nr = 0;
 
-          *(nr + 1) = 0;
-        }
+  for (col = 0; col < width; col++)
+    {
+      pixel = range_limiter[src[GRAY] + error_limiter[*pr]];
 
-      *nr = 0;
+      cachep = &histogram[pixel];
+      /* If we have not seen this color before, find nearest colormap entry */
+      /* and update the cache */
+      if (*cachep == 0)
+        fill_inverse_cmap_gray (quantobj, histogram, pixel);
 
-      for (col = 0; col < width; col++)
+      if (has_alpha)
         {
-          pixel = range_limiter[src[GRAY] + error_limiter[*pr]];
-
-          cachep = &histogram[pixel];
-          /* If we have not seen this color before, find nearest colormap entry */
-          /* and update the cache */
-          if (*cachep == 0)
-            fill_inverse_cmap_gray (quantobj, histogram, pixel);
+          gboolean transparent = FALSE;
 
-          if (has_alpha)
+          if (odd_row)
             {
-              gboolean transparent = FALSE;
-
-              if (odd_row)
+              if (alpha_dither)
                 {
-                  if (alpha_dither)
-                    {
-                      gint dither_x = ((width-col)+offsetx-1) & DM_WIDTHMASK;
-                      gint dither_y = (row+offsety) & DM_HEIGHTMASK;
+                  gint dither_x = ((width-col)+offsetx-1) & DM_WIDTHMASK;
+                  gint dither_y = (row+offsety) & DM_HEIGHTMASK;
 
-                      if ((src[ALPHA_G]) < DM[dither_x][dither_y])
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[ALPHA_G] <= 127)
-                        transparent = TRUE;
-                    }
+                  if ((src[ALPHA_G]) < DM[dither_x][dither_y])
+                    transparent = TRUE;
+                }
+              else
+                {
+                  if (src[ALPHA_G] <= 127)
+                    transparent = TRUE;
+                }
 
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                      pr--;
-                      nr--;
-                      *(nr - 1) = 0;
-                      goto next_pixel;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                    }
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                  pr--;
+                  nr--;
+                  *(nr - 1) = 0;
+                  goto next_pixel;
                 }
               else
                 {
-                  if (alpha_dither)
-                    {
-                      gint dither_x = (col + offsetx) & DM_WIDTHMASK;
-                      gint dither_y = (row + offsety) & DM_HEIGHTMASK;
+                  dest[ALPHA_I] = 255;
+                }
+            }
+          else
+            {
+              if (alpha_dither)
+                {
+                  gint dither_x = (col + offsetx) & DM_WIDTHMASK;
+                  gint dither_y = (row + offsety) & DM_HEIGHTMASK;
 
-                      if ((src[ALPHA_G]) < DM[dither_x][dither_y])
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[ALPHA_G] <= 127)
-                        transparent = TRUE;
-                    }
+                  if ((src[ALPHA_G]) < DM[dither_x][dither_y])
+                    transparent = TRUE;
+                }
+              else
+                {
+                  if (src[ALPHA_G] <= 127)
+                    transparent = TRUE;
+                }
 
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                      pr++;
-                      nr++;
-                      *(nr + 1) = 0;
-                      goto next_pixel;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                    }
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                  pr++;
+                  nr++;
+                  *(nr + 1) = 0;
+                  goto next_pixel;
+                }
+              else
+                {
+                  dest[ALPHA_I] = 255;
                 }
             }
+        }
 
-          index = *cachep - 1;
-          index_used_count[dest[INDEXED] = index]++;
+      index = *cachep - 1;
+      index_used_count[dest[INDEXED] = index]++;
 
-          color = &quantobj->cmap[index];
-          pixele = pixel - color->red;
+      color = &quantobj->cmap[index];
+      pixele = pixel - color->red;
 
-          if (odd_row)
-            {
-              *(--pr) += fs_err1[pixele];
-              *nr-- += fs_err2[pixele];
-              *nr += fs_err3[pixele];
-              *(nr-1) = fs_err4[pixele];
-            }
-          else
-            {
-              *(++pr) += fs_err1[pixele];
-              *nr++ += fs_err2[pixele];
-              *nr += fs_err3[pixele];
-              *(nr+1) = fs_err4[pixele];
-            }
+      if (odd_row)
+        {
+          *(--pr) += fs_err1[pixele];
+          *nr-- += fs_err2[pixele];
+          *nr += fs_err3[pixele];
+          *(nr-1) = fs_err4[pixele];
+        }
+      else
+        {
+          *(++pr) += fs_err1[pixele];
+          *nr++ += fs_err2[pixele];
+          *nr += fs_err3[pixele];
+          *(nr+1) = fs_err4[pixele];
+        }
 
-        next_pixel:
+    next_pixel:
 
-          dest += step_dest;
-          src += step_src;
-        }
+      dest += step_dest;
+      src += step_src;
+    }
 
-      tmp = next_row;
-      next_row = prev_row;
-      prev_row = tmp;
+  tmp = fs->next_row[0];
+  fs->next_row[0] = fs->prev_row[0];
+  fs->prev_row[0] = tmp;
 
-      odd_row = !odd_row;
+  fs->odd_row = ! odd_row;
 
-      gegl_buffer_set (new_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       0, NULL, dest_buf,
-                       GEGL_AUTO_ROWSTRIDE);
-    }
+  gegl_buffer_set (fs->dest_buffer, GEGL_RECTANGLE (0, row, width, 1),
+                   0, NULL, fs->dest_buf,
+                   GEGL_AUTO_ROWSTRIDE);
+}
+
+static void
+median_cut_pass2_fs_dither_gray (QuantizeObj *quantobj,
+                                 GimpLayer   *layer,
+                                 GeglBuffer  *new_buffer)
+{
+  FSDither fs;
 
-  g_free (error_limiter - 255); /* good lord. */
-  g_free (next_row);
-  g_free (prev_row);
-  g_free (src_buf);
-  g_free (dest_buf);
+  fs_dither_init (&fs, quantobj, layer, new_buffer, FALSE);
+  fs_dither_run (&fs, fs_dither_gray_row);
+  fs_dither_clear (&fs);
 }
 
 static void
@@ -3916,384 +4490,316 @@ median_cut_pass2_gray_init (QuantizeObj *quantobj)
 }
 
 static void
-median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
-                                GimpLayer   *layer,
-                                GeglBuffer  *new_buffer)
+fs_dither_rgb_row (FSDither     *fs,
+                   gint          row,
+                   const guchar *src,
+                   const gint   *lin)
 {
-  GeglBuffer   *src_buffer;
+  QuantizeObj  *quantobj  = fs->quantobj;
   CFHistogram   histogram = quantobj->histogram;
   ColorFreq    *cachep;
   Color        *color;
-  gint         *error_limiter;
+  const gint   *error_limiter = fs->error_limiter;
+  const guchar *range_limiter = fs->range_limiter;
   const gshort *fs_err1, *fs_err2;
   const gshort *fs_err3, *fs_err4;
-  const guchar *range_limiter;
-  const Babl   *src_format;
-  const Babl   *dest_format;
-  gint          src_bpp;
-  gint          dest_bpp;
-  guchar       *src_buf, *dest_buf;
-  gint         *red_n_row, *red_p_row;
-  gint         *grn_n_row, *grn_p_row;
-  gint         *blu_n_row, *blu_p_row;
+  gint          src_bpp   = fs->src_bpp;
+  gint          dest_bpp  = fs->dest_bpp;
+  guchar       *dest      = fs->dest_buf;
   gint         *rnr, *rpr;
   gint         *gnr, *gpr;
   gint         *bnr, *bpr;
   gint         *tmp;
   gint          re, ge, be;
-  gint          row, col;
+  gint          col;
   gint          index;
-  gint          step_dest, step_src;
-  gint          odd_row;
-  gboolean      has_alpha;
-  gint          width, height;
-  gint          red_pix   = RED;
-  gint          green_pix = GREEN;
-  gint          blue_pix  = BLUE;
-  gint          alpha_pix = ALPHA;
-  gint          offsetx, offsety;
-  gboolean      alpha_dither     = quantobj->want_alpha_dither;
+  gint          step_dest, step_src, step_lin;
+  gint          odd_row   = fs->odd_row;
+  gboolean      has_alpha = fs->has_alpha;
+  gint          width     = fs->width;
+  gint          alpha_pix = fs->alpha_pix;
+  gint          offsetx   = fs->offsetx;
+  gint          offsety   = fs->offsety;
+  gboolean      alpha_dither     = fs->alpha_dither;
   gulong       *index_used_count = quantobj->index_used_count;
-  gint          global_rmax = 0, global_rmin = G_MAXINT;
-  gint          global_gmax = 0, global_gmin = G_MAXINT;
-  gint          global_bmax = 0, global_bmin = G_MAXINT;
-  gint          nth_layer = quantobj->nth_layer;
-  gint          n_layers  = quantobj->n_layers;
-
-  src_buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
-
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
-
-  /*  In the case of web/mono palettes, we actually force
-   *   grayscale drawables through the rgb pass2 functions
-   */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
-    red_pix = green_pix = blue_pix = GRAY;
-
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
-
-  src_bpp  = babl_format_get_bytes_per_pixel (src_format);
-  dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
-
-  has_alpha = babl_format_has_alpha (src_format);
-
-  width  = gimp_item_get_width  (GIMP_ITEM (layer));
-  height = gimp_item_get_height (GIMP_ITEM (layer));
-
-  error_limiter = init_error_limit (quantobj->error_freedom);
-  range_limiter = range_array + 256;
-
-  /* find the bounding box of the palette colors --
-     we use this for hard-clamping our error-corrected
-     values so that we can't continuously accelerate outside
-     of our attainable gamut, which looks icky. */
-  for (index = 0; index < quantobj->actual_number_of_colors; index++)
-    {
-      global_rmax = MAX(global_rmax, quantobj->clin[index].red);
-      global_rmin = MIN(global_rmin, quantobj->clin[index].red);
-      global_gmax = MAX(global_gmax, quantobj->clin[index].green);
-      global_gmin = MIN(global_gmin, quantobj->clin[index].green);
-      global_bmax = MAX(global_bmax, quantobj->clin[index].blue);
-      global_bmin = MIN(global_bmin, quantobj->clin[index].blue);
-    }
-
-  src_buf  = g_malloc (width * src_bpp);
-  dest_buf = g_malloc (width * dest_bpp);
-
-  red_n_row = g_new (gint, width + 2);
-  red_p_row = g_new0 (gint, width + 2);
-  grn_n_row = g_new (gint, width + 2);
-  grn_p_row = g_new0 (gint, width + 2);
-  blu_n_row = g_new (gint, width + 2);
-  blu_p_row = g_new0 (gint, width + 2);
+  gint          global_gmax = fs->global_gmax, global_gmin = fs->global_gmin;
+  gint          global_bmax = fs->global_bmax, global_bmin = fs->global_bmin;
 
   fs_err1 = floyd_steinberg_error1 + 511;
   fs_err2 = floyd_steinberg_error2 + 511;
   fs_err3 = floyd_steinberg_error3 + 511;
   fs_err4 = floyd_steinberg_error4 + 511;
 
-  odd_row = 0;
+  rnr = fs->next_row[0];
+  gnr = fs->next_row[1];
+  bnr = fs->next_row[2];
+  rpr = fs->prev_row[0] + 1;
+  gpr = fs->prev_row[1] + 1;
+  bpr = fs->prev_row[2] + 1;
 
-  for (row = 0; row < height; row++)
+  if (odd_row)
     {
-      const guchar *src;
-      guchar       *dest;
-
-      gegl_buffer_get (src_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       1.0, NULL, src_buf,
-                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
-
-      src  = src_buf;
-      dest = dest_buf;
-
-      rnr = red_n_row;
-      gnr = grn_n_row;
-      bnr = blu_n_row;
-      rpr = red_p_row + 1;
-      gpr = grn_p_row + 1;
-      bpr = blu_p_row + 1;
-
-      if (odd_row)
-        {
-          step_dest = -dest_bpp;
-          step_src  = -src_bpp;
+      step_dest = -dest_bpp;
+      step_src  = -src_bpp;
+      step_lin  = -3;
+
+      src += (width * src_bpp) - src_bpp;
+      dest += (width * dest_bpp) - dest_bpp;
+      lin += (width * 3) - 3;
+
+      rnr += width + 1;
+      gnr += width + 1;
+      bnr += width + 1;
+      rpr += width;
+      gpr += width;
+      bpr += width;
+
+      *(rnr - 1) = *(gnr - 1) = *(bnr - 1) = 0;
+    }
+  else
+    {
+      step_dest = dest_bpp;
+      step_src  = src_bpp;
+      step_lin  = 3;
 
-          src += (width * src_bpp) - src_bpp;
-          dest += (width * dest_bpp) - dest_bpp;
+      *(rnr + 1) = *(gnr + 1) = *(bnr + 1) = 0;
+    }
 
-          rnr += width + 1;
-          gnr += width + 1;
-          bnr += width + 1;
-          rpr += width;
-          gpr += width;
-          bpr += width;
+  *rnr = *gnr = *bnr = 0;
 
-          *(rnr - 1) = *(gnr - 1) = *(bnr - 1) = 0;
-        }
-      else
+  for (col = 0; col < width; col++)
+    {
+      if (has_alpha)
         {
-          step_dest = dest_bpp;
-          step_src  = src_bpp;
+          gboolean transparent = FALSE;
 
-          *(rnr + 1) = *(gnr + 1) = *(bnr + 1) = 0;
-        }
-
-      *rnr = *gnr = *bnr = 0;
-
-      for (col = 0; col < width; col++)
-        {
-          if (has_alpha)
+          if (odd_row)
             {
-              gboolean transparent = FALSE;
-
-              if (odd_row)
+              if (alpha_dither)
                 {
-                  if (alpha_dither)
-                    {
-                      gint dither_x = ((width-col)+offsetx-1) & DM_WIDTHMASK;
-                      gint dither_y = (row+offsety) & DM_HEIGHTMASK;
+                  gint dither_x = ((width-col)+offsetx-1) & DM_WIDTHMASK;
+                  gint dither_y = (row+offsety) & DM_HEIGHTMASK;
 
-                      if ((src[alpha_pix]) < DM[dither_x][dither_y])
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[alpha_pix] <= 127)
-                        transparent = TRUE;
-                    }
-
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                      rpr--; gpr--; bpr--;
-                      rnr--; gnr--; bnr--;
-                      *(rnr - 1) = *(gnr - 1) = *(bnr - 1) = 0;
-                      goto next_pixel;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                    }
+                  if ((src[alpha_pix]) < DM[dither_x][dither_y])
+                    transparent = TRUE;
                 }
               else
                 {
-                  if (alpha_dither)
-                    {
-                      gint dither_x = (col + offsetx) & DM_WIDTHMASK;
-                      gint dither_y = (row + offsety) & DM_HEIGHTMASK;
-
-                      if ((src[alpha_pix]) < DM[dither_x][dither_y])
-                        transparent = TRUE;
-                    }
-                  else
-                    {
-                      if (src[alpha_pix] <= 127)
-                        transparent = TRUE;
-                    }
+                  if (src[alpha_pix] <= 127)
+                    transparent = TRUE;
+                }
 
-                  if (transparent)
-                    {
-                      dest[ALPHA_I] = 0;
-                      rpr++; gpr++; bpr++;
-                      rnr++; gnr++; bnr++;
-                      *(rnr + 1) = *(gnr + 1) = *(bnr + 1) = 0;
-                      goto next_pixel;
-                    }
-                  else
-                    {
-                      dest[ALPHA_I] = 255;
-                    }
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                  rpr--; gpr--; bpr--;
+                  rnr--; gnr--; bnr--;
+                  *(rnr - 1) = *(gnr - 1) = *(bnr - 1) = 0;
+                  goto next_pixel;
+                }
+              else
+                {
+                  dest[ALPHA_I] = 255;
                 }
             }
+          else
+            {
+              if (alpha_dither)
+                {
+                  gint dither_x = (col + offsetx) & DM_WIDTHMASK;
+                  gint dither_y = (row + offsety) & DM_HEIGHTMASK;
 
-#if 0
-          /* hmm. */
+                  if ((src[alpha_pix]) < DM[dither_x][dither_y])
+                    transparent = TRUE;
+                }
+              else
+                {
+                  if (src[alpha_pix] <= 127)
+                    transparent = TRUE;
+                }
 
-          r = range_limiter[src[red_pix] + error_limiter[*rpr]];
-          g = range_limiter[src[green_pix] + error_limiter[*gpr]];
-          b = range_limiter[src[blue_pix] + error_limiter[*bpr]];
+              if (transparent)
+                {
+                  dest[ALPHA_I] = 0;
+                  rpr++; gpr++; bpr++;
+                  rnr++; gnr++; bnr++;
+                  *(rnr + 1) = *(gnr + 1) = *(bnr + 1) = 0;
+                  goto next_pixel;
+                }
+              else
+                {
+                  dest[ALPHA_I] = 255;
+                }
+            }
+        }
 
-          re = r >> R_SHIFT;
-          ge = g >> G_SHIFT;
-          be = b >> B_SHIFT;
+      /* the pixel was converted to linear space in advance, see
+       * fs_dither_prepare_row()
+       */
+      re = lin[0];
+      ge = lin[1];
+      be = lin[2];
 
-          rgb_to_lin (r, g, b, &re, &ge, &be);
-#endif
-          rgb_to_unshifted_lin (src[red_pix], src[green_pix], src[blue_pix],
-                                &re, &ge, &be);
+      /*
+        re = CLAMP(re, global_rmin, global_rmax);
+        ge = CLAMP(ge, global_gmin, global_gmax);
+        be = CLAMP(be, global_bmin, global_bmax);*/
+
+      re = range_limiter[re + error_limiter[*rpr]];
+      ge = range_limiter[ge + error_limiter[*gpr]];
+      be = range_limiter[be + error_limiter[*bpr]];
+
+      cachep = HIST_LIN(histogram,
+                        RSDF(re),
+                        GSDF(ge),
+                        BSDF(be));
+      /* If we have not seen this color before, find nearest
+         colormap entry and update the cache */
+      if (*cachep == 0)
+        fill_inverse_cmap_rgb (quantobj, histogram,
+                               RSDF(re),
+                               GSDF(ge),
+                               BSDF(be));
+
+      index = *cachep - 1;
+      index_used_count[index]++;
+      dest[INDEXED] = index;
+
+      /* We constrain chroma error extra-hard so that it
+         doesn't run away and steal the thunder from the
+         lightness error where all the detail usually is. */
+      if (ge > global_gmax)
+        ge = (ge + 3*global_gmax) / 4;
+      else if (ge < global_gmin)
+        ge = (ge + 3*global_gmin) / 4;
+      if (be > global_bmax)
+        be = (be + 3*global_bmax) / 4;
+      else if (be < global_bmin)
+        be = (be + 3*global_bmin) / 4;
+
+      color = &quantobj->clin[index];
+
+      if (re <= 0 || re >= 255)
+        re = ge = be = 0;
+      else
+        {
+          re = re - color->red;
+          ge = ge - color->green;
+          be = be - color->blue;
+        }
 
-          /*
-            re = CLAMP(re, global_rmin, global_rmax);
-            ge = CLAMP(ge, global_gmin, global_gmax);
-            be = CLAMP(be, global_bmin, global_bmax);*/
-
-          re = range_limiter[re + error_limiter[*rpr]];
-          ge = range_limiter[ge + error_limiter[*gpr]];
-          be = range_limiter[be + error_limiter[*bpr]];
-
-          cachep = HIST_LIN(histogram,
-                            RSDF(re),
-                            GSDF(ge),
-                            BSDF(be));
-          /* If we have not seen this color before, find nearest
-             colormap entry and update the cache */
-          if (*cachep == 0)
-            fill_inverse_cmap_rgb (quantobj, histogram,
-                                   RSDF(re),
-                                   GSDF(ge),
-                                   BSDF(be));
-
-          index = *cachep - 1;
-          index_used_count[index]++;
-          dest[INDEXED] = index;
-
-          /*if (re > global_rmax)
-            re = (re + 3*global_rmax) / 4;
-          else if (re < global_rmin)
-          re = (re + 3*global_rmin) / 4;*/
-
-          /* We constrain chroma error extra-hard so that it
-             doesn't run away and steal the thunder from the
-             lightness error where all the detail usually is. */
-          if (ge > global_gmax)
-            ge = (ge + 3*global_gmax) / 4;
-          else if (ge < global_gmin)
-            ge = (ge + 3*global_gmin) / 4;
-          if (be > global_bmax)
-            be = (be + 3*global_bmax) / 4;
-          else if (be < global_bmin)
-            be = (be + 3*global_bmin) / 4;
-
-          color = &quantobj->clin[index];
+      if (odd_row)
+        {
+          *(--rpr) += fs_err1[re];
+          *(--gpr) += fs_err1[ge];
+          *(--bpr) += fs_err1[be];
 
-#if 0
-          if ((re > 0 && re < 255) /* HMM &&
-              ge >= 0 && ge <= 255 &&
-              be >= 0 && be <= 255*/)
-            {
-              ge = ge - color->green;
-              be = be - color->blue;
-              re = re - color->red;
-            }
-          else
-            {
-              /* color pretty much undefined now; nullify error. */
-              re = ge = be = 0;
-            }
-#endif
+          *rnr-- += fs_err2[re];
+          *gnr-- += fs_err2[ge];
+          *bnr-- += fs_err2[be];
 
-          if (re <= 0 || re >= 255)
-            re = ge = be = 0;
-          else
-            {
-              re = re - color->red;
-              ge = ge - color->green;
-              be = be - color->blue;
-            }
+          *rnr += fs_err3[re];
+          *gnr += fs_err3[ge];
+          *bnr += fs_err3[be];
 
-          if (odd_row)
-            {
-              *(--rpr) += fs_err1[re];
-              *(--gpr) += fs_err1[ge];
-              *(--bpr) += fs_err1[be];
+          *(rnr-1) = fs_err4[re];
+          *(gnr-1) = fs_err4[ge];
+          *(bnr-1) = fs_err4[be];
+        }
+      else
+        {
+          *(++rpr) += fs_err1[re];
+          *(++gpr) += fs_err1[ge];
+          *(++bpr) += fs_err1[be];
 
-              *rnr-- += fs_err2[re];
-              *gnr-- += fs_err2[ge];
-              *bnr-- += fs_err2[be];
+          *rnr++ += fs_err2[re];
+          *gnr++ += fs_err2[ge];
+          *bnr++ += fs_err2[be];
 
-              *rnr += fs_err3[re];
-              *gnr += fs_err3[ge];
-              *bnr += fs_err3[be];
+          *rnr += fs_err3[re];
+          *gnr += fs_err3[ge];
+          *bnr += fs_err3[be];
 
-              *(rnr-1) = fs_err4[re];
-              *(gnr-1) = fs_err4[ge];
-              *(bnr-1) = fs_err4[be];
-            }
-          else
-            {
-              *(++rpr) += fs_err1[re];
-              *(++gpr) += fs_err1[ge];
-              *(++bpr) += fs_err1[be];
+          *(rnr+1) = fs_err4[re];
+          *(gnr+1) = fs_err4[ge];
+          *(bnr+1) = fs_err4[be];
+        }
 
-              *rnr++ += fs_err2[re];
-              *gnr++ += fs_err2[ge];
-              *bnr++ += fs_err2[be];
+    next_pixel:
 
-              *rnr += fs_err3[re];
-              *gnr += fs_err3[ge];
-              *bnr += fs_err3[be];
+      dest += step_dest;
+      src += step_src;
+      lin += step_lin;
+    }
 
-              *(rnr+1) = fs_err4[re];
-              *(gnr+1) = fs_err4[ge];
-              *(bnr+1) = fs_err4[be];
-            }
+  tmp = fs->next_row[0];
+  fs->next_row[0] = fs->prev_row[0];
+  fs->prev_row[0] = tmp;
 
-        next_pixel:
+  tmp = fs->next_row[1];
+  fs->next_row[1] = fs->prev_row[1];
+  fs->prev_row[1] = tmp;
 
-          dest += step_dest;
-          src += step_src;
-        }
+  tmp = fs->next_row[2];
+  fs->next_row[2] = fs->prev_row[2];
+  fs->prev_row[2] = tmp;
 
-      tmp = red_n_row;
-      red_n_row = red_p_row;
-      red_p_row = tmp;
+  fs->odd_row = ! odd_row;
 
-      tmp = grn_n_row;
-      grn_n_row = grn_p_row;
-      grn_p_row = tmp;
+  gegl_buffer_set (fs->dest_buffer, GEGL_RECTANGLE (0, row, width, 1),
+                   0, NULL, fs->dest_buf,
+                   GEGL_AUTO_ROWSTRIDE);
+}
 
-      tmp = blu_n_row;
-      blu_n_row = blu_p_row;
-      blu_p_row = tmp;
+static void
+median_cut_pass2_fs_dither_rgb (QuantizeObj *quantobj,
+                                GimpLayer   *layer,
+                                GeglBuffer  *new_buffer)
+{
+  FSDither fs;
+  gint     index;
 
-      odd_row = !odd_row;
+  fs_dither_init (&fs, quantobj, layer, new_buffer, TRUE);
 
-      gegl_buffer_set (new_buffer, GEGL_RECTANGLE (0, row, width, 1),
-                       0, NULL, dest_buf,
-                       GEGL_AUTO_ROWSTRIDE);
+  /* find the bounding box of the palette colors --
+     we use this for hard-clamping our error-corrected
+     values so that we can't continuously accelerate outside
+     of our attainable gamut, which looks icky. */
+  fs.global_gmax = 0;
+  fs.global_gmin = G_MAXINT;
+  fs.global_bmax = 0;
+  fs.global_bmin = G_MAXINT;
 
-      if (quantobj->progress && (row % 16 == 0))
-        gimp_progress_set_value (quantobj->progress,
-                                 (nth_layer + ((gdouble) row) /
-                                  height) / (gdouble) n_layers);
+  for (index = 0; index < quantobj->actual_number_of_colors; index++)
+    {
+      fs.global_gmax = MAX(fs.global_gmax, quantobj->clin[index].green);
+      fs.global_gmin = MIN(fs.global_gmin, quantobj->clin[index].green);
+      fs.global_bmax = MAX(fs.global_bmax, quantobj->clin[index].blue);
+      fs.global_bmin = MIN(fs.global_bmin, quantobj->clin[index].blue);
     }
 
-  g_free (error_limiter - 255);
-  g_free (red_n_row);
-  g_free (red_p_row);
-  g_free (grn_n_row);
-  g_free (grn_p_row);
-  g_free (blu_n_row);
-  g_free (blu_p_row);
-  g_free (src_buf);
-  g_free (dest_buf);
+  fs_dither_run (&fs, fs_dither_rgb_row);
+  fs_dither_clear (&fs);
 }
 
 
+static void
+area_histogram_free (AreaHistogram *area_hist)
+{
+  g_free (area_hist->histogram);
+  g_array_free (area_hist->cells, TRUE);
+
+  g_slice_free (AreaHistogram, area_hist);
+}
+
 static void
 delete_median_cut (QuantizeObj *quantobj)
 {
+  g_mutex_clear (&quantobj->inverse_cmap_mutex);
+
+  g_slist_free_full (quantobj->area_histograms,
+                     (GDestroyNotify) area_histogram_free);
+
   g_free (quantobj->histogram);
   g_free (quantobj);
 }
@@ -4351,6 +4857,9 @@ initialize_median_cut (GimpImageBaseType       type,
   quantobj->desired_number_of_colors = num_colors;
   quantobj->want_alpha_dither        = want_alpha_dither;
   quantobj->progress                 = progress;
+  quantobj->area_histograms          = NULL;
+
+  g_mutex_init (&quantobj->inverse_cmap_mutex);
 
   switch (type)
     {
@@ -338,13 +338,17 @@ gimp_image_undo_group_end (GimpImage *image)
 
   if (private->group_count == 0)
     {
+      GimpUndo *undo_group = gimp_undo_stack_peek (private->undo_stack);
+
       private->pushing_undo_group = GIMP_UNDO_GROUP_NONE;
 
+      /*  the group's memsize was taken when it was still empty  */
+      gimp_undo_stack_update_undo (private->undo_stack, undo_group);
+
       /* Do it here, since undo_push doesn't emit this event while in
        * the middle of a group
        */
-      gimp_image_undo_event (image, GIMP_UNDO_EVENT_UNDO_PUSHED,
-                             gimp_undo_stack_peek (private->undo_stack));
+      gimp_image_undo_event (image, GIMP_UNDO_EVENT_UNDO_PUSHED, undo_group);
 
       gimp_image_undo_free_space (image);
     }
@@ -482,6 +486,53 @@ gimp_image_undo_get_fadeable (GimpImage *image)
   return NULL;
 }
 
+/*  Lets the undo stacks know that the memsize of @undo changed after
+ *  it was pushed, like when its data was compressed.  Recently pushed
+ *  undos are found first.
+ */
+void
+gimp_image_undo_update_memsize (GimpImage *image,
+                                GimpUndo  *undo)
+{
+  GimpImagePrivate *private;
+  GimpUndoStack    *stacks[2];
+  gint              i;
+
+  g_return_if_fail (GIMP_IS_IMAGE (image));
+  g_return_if_fail (GIMP_IS_UNDO (undo));
+
+  private = GIMP_IMAGE_GET_PRIVATE (image);
+
+  stacks[0] = private->undo_stack;
+  stacks[1] = private->redo_stack;
+
+  for (i = 0; i < G_N_ELEMENTS (stacks); i++)
+    {
+      GList *list;
+
+      for (list = GIMP_LIST (stacks[i]->undos)->list;
+           list;
+           list = g_list_next (list))
+        {
+          GimpUndo *top = list->data;
+
+          if (top == undo)
+            {
+              gimp_undo_stack_update_undo (stacks[i], undo);
+              return;
+            }
+          else if (GIMP_IS_UNDO_STACK (top) &&
+                   gimp_container_have (GIMP_UNDO_STACK (top)->undos,
+                                        GIMP_OBJECT (undo)))
+            {
+              gimp_undo_stack_update_undo (GIMP_UNDO_STACK (top), undo);
+              gimp_undo_stack_update_undo (stacks[i], top);
+              return;
+            }
+        }
+    }
+}
+
 
 /*  private functions  */
 
@@ -546,20 +597,20 @@ gimp_image_undo_free_space (GimpImage *image)
   container = private->undo_stack->undos;
 
   min_undo_levels = image->gimp->config->levels_of_undo;
-  max_undo_levels = 1024; /* FIXME */
+  max_undo_levels = image->gimp->config->max_undo_levels;
   undo_size       = image->gimp->config->undo_size;
 
 #ifdef DEBUG_IMAGE_UNDO
   g_printerr ("undo_steps: %d    undo_bytes: %ld\n",
               gimp_container_get_n_children (container),
-              (glong) gimp_object_get_memsize (GIMP_OBJECT (container), NULL));
+              (glong) gimp_undo_stack_get_undos_memsize (private->undo_stack));
 #endif
 
   /*  keep at least min_undo_levels undo steps  */
   if (gimp_container_get_n_children (container) <= min_undo_levels)
     return;
 
-  while ((gimp_object_get_memsize (GIMP_OBJECT (container), NULL) > undo_size) ||
+  while ((gimp_undo_stack_get_undos_memsize (private->undo_stack) > undo_size) ||
          (gimp_container_get_n_children (container) > max_undo_levels))
     {
       GimpUndo *freed = gimp_undo_stack_free_bottom (private->undo_stack,
@@ -568,8 +619,7 @@ gimp_image_undo_free_space (GimpImage *image)
 #ifdef DEBUG_IMAGE_UNDO
       g_printerr ("freed one step: undo_steps: %d    undo_bytes: %ld\n",
                   gimp_container_get_n_children (container),
-                  (glong) gimp_object_get_memsize (GIMP_OBJECT (container),
-                                                   NULL));
+                  (glong) gimp_undo_stack_get_undos_memsize (private->undo_stack));
 #endif
 
       gimp_image_undo_event (image, GIMP_UNDO_EVENT_UNDO_EXPIRED, freed);
@@ -590,7 +640,7 @@ gimp_image_undo_free_redo (GimpImage *image)
 #ifdef DEBUG_IMAGE_UNDO
   g_printerr ("redo_steps: %d    redo_bytes: %ld\n",
               gimp_container_get_n_children (container),
-              (glong) gimp_object_get_memsize (GIMP_OBJECT (container), NULL));
+              (glong) gimp_undo_stack_get_undos_memsize (private->redo_stack));
 #endif
 
   if (gimp_container_is_empty (container))
@@ -604,8 +654,7 @@ gimp_image_undo_free_redo (GimpImage *image)
 #ifdef DEBUG_IMAGE_UNDO
       g_printerr ("freed one step: redo_steps: %d    redo_bytes: %ld\n",
                   gimp_container_get_n_children (container),
-                  (glong )gimp_object_get_memsize (GIMP_OBJECT (container),
-                                                   NULL));
+                  (glong) gimp_undo_stack_get_undos_memsize (private->redo_stack));
 #endif
 
       gimp_image_undo_event (image, GIMP_UNDO_EVENT_REDO_EXPIRED, freed);
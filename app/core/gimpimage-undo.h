@@ -55,5 +55,8 @@ GimpUndo      * gimp_image_undo_can_compress    (GimpImage        *image,
 
 GimpUndo      * gimp_image_undo_get_fadeable    (GimpImage        *image);
 
+void            gimp_image_undo_update_memsize  (GimpImage        *image,
+                                                 GimpUndo         *undo);
+
 
 #endif /* __GIMP_IMAGE__UNDO_H__ */
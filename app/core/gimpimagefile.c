@@ -38,6 +38,7 @@
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimpcontainer.h"
 #include "gimpcontext.h"
 #include "gimpimage.h"
@@ -78,44 +79,85 @@ struct _GimpImagefilePrivate
                                                             GimpImagefilePrivate)
 
 
-static void        gimp_imagefile_dispose          (GObject        *object);
-static void        gimp_imagefile_finalize         (GObject        *object);
+typedef struct _GimpImagefileJob GimpImagefileJob;
 
-static void        gimp_imagefile_name_changed     (GimpObject     *object);
-
-static void        gimp_imagefile_info_changed     (GimpImagefile  *imagefile);
-static void        gimp_imagefile_notify_thumbnail (GimpImagefile  *imagefile,
-                                                    GParamSpec     *pspec);
-
-static GdkPixbuf * gimp_imagefile_get_new_pixbuf   (GimpViewable   *viewable,
-                                                    GimpContext    *context,
-                                                    gint            width,
-                                                    gint            height);
-static GdkPixbuf * gimp_imagefile_load_thumb       (GimpImagefile  *imagefile,
-                                                    gint            width,
-                                                    gint            height);
-static gboolean    gimp_imagefile_save_thumb       (GimpImagefile  *imagefile,
-                                                    GimpImage      *image,
-                                                    gint            size,
-                                                    gboolean        replace,
-                                                    GError        **error);
-
-static gchar     * gimp_imagefile_get_description  (GimpViewable   *viewable,
-                                                    gchar         **tooltip);
+struct _GimpImagefileJob
+{
+  gchar                 *uri;
+  GimpImagefile         *target;    /*  weak pointer  */
+  GimpContext           *context;
+  GimpProgress          *progress;  /*  weak pointer  */
+  gint                   size;
+  gboolean               replace;
+  GimpImagefilePriority  priority;
+
+  /*  set while the thumbnail is written from a worker thread  */
+  GimpImagefile *local;
+  GimpThumbnail *thumbnail;
+  GdkPixbuf     *pixbuf;
+  gboolean       success;
+  GError        *error;
+};
 
-static void        gimp_imagefile_icon_callback    (GObject        *source_object,
-                                                    GAsyncResult   *result,
-                                                    gpointer        data);
 
-static void     gimp_thumbnail_set_info_from_image (GimpThumbnail  *thumbnail,
-                                                    const gchar    *mime_type,
-                                                    GimpImage      *image);
-static void     gimp_thumbnail_set_info            (GimpThumbnail  *thumbnail,
-                                                    const gchar    *mime_type,
-                                                    gint            width,
-                                                    gint            height,
-                                                    const Babl     *format,
-                                                    gint            num_layers);
+static void        gimp_imagefile_dispose          (GObject          *object);
+static void        gimp_imagefile_finalize         (GObject          *object);
+
+static void        gimp_imagefile_name_changed     (GimpObject       *object);
+
+static void        gimp_imagefile_info_changed     (GimpImagefile    *imagefile);
+static void        gimp_imagefile_notify_thumbnail (GimpImagefile    *imagefile,
+                                                    GParamSpec       *pspec);
+
+static GdkPixbuf * gimp_imagefile_get_new_pixbuf   (GimpViewable     *viewable,
+                                                    GimpContext      *context,
+                                                    gint              width,
+                                                    gint              height);
+static GdkPixbuf * gimp_imagefile_load_thumb       (GimpImagefile    *imagefile,
+                                                    gint              width,
+                                                    gint              height);
+static gboolean    gimp_imagefile_save_thumb       (GimpImagefile    *imagefile,
+                                                    GimpImage        *image,
+                                                    gint              size,
+                                                    gboolean          replace,
+                                                    GimpImagefileJob *job,
+                                                    GError          **error);
+static gboolean    gimp_imagefile_create_thumb     (GimpImagefile    *imagefile,
+                                                    GimpContext      *context,
+                                                    GimpProgress     *progress,
+                                                    gint              size,
+                                                    gboolean          replace,
+                                                    GimpImagefileJob *job,
+                                                    GError          **error);
+
+static void        gimp_imagefile_thumb_queue_push (GimpImagefileJob *job);
+static void        gimp_imagefile_thumb_queue_schedule
+                                                   (void);
+static void        gimp_imagefile_thumb_job_set_progress
+                                                   (GimpImagefileJob *job,
+                                                    GimpProgress     *progress);
+static gboolean    gimp_imagefile_thumb_queue_idle (gpointer          data);
+static void        gimp_imagefile_thumb_job_save   (GimpImagefileJob *job);
+static gboolean    gimp_imagefile_thumb_job_saved  (GimpImagefileJob *job);
+static void        gimp_imagefile_thumb_job_finish (GimpImagefileJob *job,
+                                                    gboolean          success);
+
+static gchar     * gimp_imagefile_get_description  (GimpViewable     *viewable,
+                                                    gchar           **tooltip);
+
+static void        gimp_imagefile_icon_callback    (GObject          *source_object,
+                                                    GAsyncResult     *result,
+                                                    gpointer          data);
+
+static void     gimp_thumbnail_set_info_from_image (GimpThumbnail    *thumbnail,
+                                                    const gchar      *mime_type,
+                                                    GimpImage        *image);
+static void     gimp_thumbnail_set_info            (GimpThumbnail    *thumbnail,
+                                                    const gchar      *mime_type,
+                                                    gint              width,
+                                                    gint              height,
+                                                    const Babl       *format,
+                                                    gint              num_layers);
 
 
 G_DEFINE_TYPE (GimpImagefile, gimp_imagefile, GIMP_TYPE_VIEWABLE)
@@ -124,6 +166,10 @@ G_DEFINE_TYPE (GimpImagefile, gimp_imagefile, GIMP_TYPE_VIEWABLE)
 
 static guint gimp_imagefile_signals[LAST_SIGNAL] = { 0 };
 
+static GQueue   gimp_imagefile_thumb_queue   = G_QUEUE_INIT;
+static guint    gimp_imagefile_thumb_idle_id = 0;
+static gboolean gimp_imagefile_thumb_busy    = FALSE;
+
 
 static void
 gimp_imagefile_class_init (GimpImagefileClass *klass)
@@ -325,133 +371,13 @@ gimp_imagefile_create_thumbnail (GimpImagefile  *imagefile,
                                  gboolean        replace,
                                  GError        **error)
 {
-  GimpImagefilePrivate *private;
-  GimpThumbnail        *thumbnail;
-  GimpThumbState        image_state;
-
   g_return_val_if_fail (GIMP_IS_IMAGEFILE (imagefile), FALSE);
   g_return_val_if_fail (GIMP_IS_CONTEXT (context), FALSE);
   g_return_val_if_fail (progress == NULL || GIMP_IS_PROGRESS (progress), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  /* thumbnailing is disabled, we successfully did nothing */
-  if (size < 1)
-    return TRUE;
-
-  private = GET_PRIVATE (imagefile);
-
-  thumbnail = private->thumbnail;
-
-  gimp_thumbnail_set_uri (thumbnail,
-                          gimp_object_get_name (imagefile));
-
-  image_state = gimp_thumbnail_peek_image (thumbnail);
-
-  if (image_state == GIMP_THUMB_STATE_REMOTE ||
-      image_state >= GIMP_THUMB_STATE_EXISTS)
-    {
-      GFile         *file;
-      GimpImage     *image;
-      gboolean       success;
-      gint           width      = 0;
-      gint           height     = 0;
-      const gchar   *mime_type  = NULL;
-      const Babl    *format     = NULL;
-      gint           num_layers = -1;
-
-      file = g_file_new_for_uri (thumbnail->image_uri);
-
-      /*  we only want to attempt thumbnailing on readable, regular files  */
-      if (g_file_is_native (file))
-        {
-          GFileInfo *file_info;
-          gboolean   regular;
-          gboolean   readable;
-
-          file_info = g_file_query_info (file,
-                                         G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-                                         G_FILE_ATTRIBUTE_ACCESS_CAN_READ,
-                                         G_FILE_QUERY_INFO_NONE,
-                                         NULL, NULL);
-
-          regular  = (g_file_info_get_file_type (file_info) == G_FILE_TYPE_REGULAR);
-          readable = g_file_info_get_attribute_boolean (file_info,
-                                                        G_FILE_ATTRIBUTE_ACCESS_CAN_READ);
-
-          g_object_unref (file_info);
-
-          if (! (regular && readable))
-            {
-              g_object_unref (file);
-              return TRUE;
-            }
-        }
-
-      g_object_unref (file);
-
-      g_object_ref (imagefile);
-
-      /* don't pass the error, we're only interested in errors from
-       * actual thumbnail saving
-       */
-      image = file_open_thumbnail (private->gimp, context, progress,
-                                   thumbnail->image_uri, size,
-                                   &mime_type, &width, &height,
-                                   &format, &num_layers, NULL);
-
-      if (image)
-        {
-          gimp_thumbnail_set_info (private->thumbnail,
-                                   mime_type, width, height,
-                                   format, num_layers);
-        }
-      else
-        {
-          GimpPDBStatusType  status;
-
-          /* don't pass the error, we're only interested in errors
-           * from actual thumbnail saving
-           */
-          image = file_open_image (private->gimp, context, progress,
-                                   thumbnail->image_uri,
-                                   thumbnail->image_uri,
-                                   FALSE, NULL, GIMP_RUN_NONINTERACTIVE,
-                                   &status, &mime_type, NULL);
-
-          if (image)
-            gimp_thumbnail_set_info_from_image (private->thumbnail,
-                                                mime_type, image);
-        }
-
-      if (image)
-        {
-          success = gimp_imagefile_save_thumb (imagefile,
-                                               image, size, replace,
-                                               error);
-
-          g_object_unref (image);
-        }
-      else
-        {
-          success = gimp_thumbnail_save_failure (thumbnail,
-                                                 "GIMP " GIMP_VERSION,
-                                                 error);
-          gimp_imagefile_update (imagefile);
-        }
-
-      g_object_unref (imagefile);
-
-      if (! success)
-        {
-          g_object_set (thumbnail,
-                        "thumb-state", GIMP_THUMB_STATE_FAILED,
-                        NULL);
-        }
-
-      return success;
-    }
-
-  return TRUE;
+  return gimp_imagefile_create_thumb (imagefile, context, progress,
+                                      size, replace, NULL, error);
 }
 
 /*  The weak version doesn't ref the imagefile but deals gracefully
@@ -514,6 +440,139 @@ gimp_imagefile_create_thumbnail_weak (GimpImagefile *imagefile,
   g_object_unref (local);
 }
 
+/**
+ * gimp_imagefile_create_thumbnail_async:
+ * @imagefile: a #GimpImagefile
+ * @context:   the context to load the image with
+ * @progress:  a #GimpProgress for loading the image, or %NULL
+ * @size:      the thumbnail size
+ * @replace:   whether to delete thumbnails of other sizes
+ * @priority:  whether the user is waiting for the thumbnail
+ *
+ * Queues the creation of a thumbnail for @imagefile's current URI and
+ * returns immediately. Like gimp_imagefile_create_thumbnail_weak(),
+ * the thumbnail is created for a local copy, and @imagefile is updated
+ * when it is ready, unless it was destroyed or renamed meanwhile.
+ *
+ * Queued requests are handled one at a time from an idle handler,
+ * %GIMP_IMAGEFILE_PRIORITY_VISIBLE requests first, the most recent
+ * one of them first. A visible request demotes the earlier visible
+ * requests for @imagefile to the background, because @imagefile now
+ * shows another file. Requesting a thumbnail that is already queued
+ * only changes the queued request if it raises its priority.
+ *
+ * Images are loaded in the main thread, using the file procedure's
+ * thumbnail loader first if there is one, and report to @progress,
+ * which can also cancel the load. Only visible requests use
+ * @progress. Encoding and writing the thumbnail file is done by a
+ * worker thread.
+ **/
+void
+gimp_imagefile_create_thumbnail_async (GimpImagefile         *imagefile,
+                                       GimpContext           *context,
+                                       GimpProgress          *progress,
+                                       gint                   size,
+                                       gboolean               replace,
+                                       GimpImagefilePriority  priority)
+{
+  GimpImagefileJob *job = NULL;
+  const gchar      *uri;
+  GList            *list;
+
+  g_return_if_fail (GIMP_IS_IMAGEFILE (imagefile));
+  g_return_if_fail (GIMP_IS_CONTEXT (context));
+  g_return_if_fail (progress == NULL || GIMP_IS_PROGRESS (progress));
+
+  if (size < 1)
+    return;
+
+  uri = gimp_object_get_name (imagefile);
+  if (! uri)
+    return;
+
+  for (list = gimp_imagefile_thumb_queue.head; list; list = g_list_next (list))
+    {
+      GimpImagefileJob *queued = list->data;
+
+      if (queued->size == size && ! strcmp (queued->uri, uri))
+        {
+          job = queued;
+          break;
+        }
+    }
+
+  if (job)
+    {
+      if (priority <= job->priority)
+        return;
+
+      g_queue_unlink (&gimp_imagefile_thumb_queue, list);
+      g_list_free (list);
+
+      job->replace |= replace;
+
+      if (job->target != imagefile)
+        {
+          if (job->target)
+            g_object_remove_weak_pointer (G_OBJECT (job->target),
+                                          (gpointer) &job->target);
+
+          job->target = imagefile;
+          g_object_add_weak_pointer (G_OBJECT (job->target),
+                                     (gpointer) &job->target);
+        }
+    }
+  else
+    {
+      job = g_slice_new0 (GimpImagefileJob);
+
+      job->uri     = g_strdup (uri);
+      job->target  = imagefile;
+      job->context = g_object_ref (context);
+      job->size    = size;
+      job->replace = replace;
+
+      g_object_add_weak_pointer (G_OBJECT (job->target),
+                                 (gpointer) &job->target);
+    }
+
+  job->priority = priority;
+
+  if (priority == GIMP_IMAGEFILE_PRIORITY_VISIBLE)
+    {
+      GList *next;
+
+      /*  whatever @imagefile showed before is no longer visible  */
+      for (list = gimp_imagefile_thumb_queue.head; list; list = next)
+        {
+          GimpImagefileJob *queued = list->data;
+
+          next = g_list_next (list);
+
+          if (queued->target   == imagefile &&
+              queued->priority == GIMP_IMAGEFILE_PRIORITY_VISIBLE)
+            {
+              g_queue_delete_link (&gimp_imagefile_thumb_queue, list);
+
+              queued->priority = GIMP_IMAGEFILE_PRIORITY_BACKGROUND;
+              gimp_imagefile_thumb_job_set_progress (queued, NULL);
+
+              gimp_imagefile_thumb_queue_push (queued);
+            }
+        }
+
+      gimp_imagefile_thumb_job_set_progress (job, progress);
+    }
+  else
+    {
+      gimp_imagefile_thumb_job_set_progress (job, NULL);
+    }
+
+  gimp_imagefile_thumb_queue_push (job);
+
+  gimp_imagefile_thumb_queue_schedule ();
+}
+
 gboolean
 gimp_imagefile_check_thumbnail (GimpImagefile *imagefile)
 {
@@ -563,7 +622,7 @@ gimp_imagefile_save_thumbnail (GimpImagefile  *imagefile,
 
       success = gimp_imagefile_save_thumb (imagefile,
                                            image, size, FALSE,
-                                           error);
+                                           NULL, error);
     }
 
   return success;
@@ -950,11 +1009,146 @@ gimp_imagefile_load_thumb (GimpImagefile *imagefile,
 }
 
 static gboolean
-gimp_imagefile_save_thumb (GimpImagefile  *imagefile,
-                           GimpImage      *image,
-                           gint            size,
-                           gboolean        replace,
-                           GError        **error)
+gimp_imagefile_create_thumb (GimpImagefile     *imagefile,
+                             GimpContext       *context,
+                             GimpProgress      *progress,
+                             gint               size,
+                             gboolean           replace,
+                             GimpImagefileJob  *job,
+                             GError           **error)
+{
+  GimpImagefilePrivate *private;
+  GimpThumbnail        *thumbnail;
+  GimpThumbState        image_state;
+
+  /* thumbnailing is disabled, we successfully did nothing */
+  if (size < 1)
+    return TRUE;
+
+  private = GET_PRIVATE (imagefile);
+
+  thumbnail = private->thumbnail;
+
+  gimp_thumbnail_set_uri (thumbnail,
+                          gimp_object_get_name (imagefile));
+
+  image_state = gimp_thumbnail_peek_image (thumbnail);
+
+  if (image_state == GIMP_THUMB_STATE_REMOTE ||
+      image_state >= GIMP_THUMB_STATE_EXISTS)
+    {
+      GFile         *file;
+      GimpImage     *image;
+      gboolean       success;
+      gint           width      = 0;
+      gint           height     = 0;
+      const gchar   *mime_type  = NULL;
+      const Babl    *format     = NULL;
+      gint           num_layers = -1;
+
+      file = g_file_new_for_uri (thumbnail->image_uri);
+
+      /*  we only want to attempt thumbnailing on readable, regular files  */
+      if (g_file_is_native (file))
+        {
+          GFileInfo *file_info;
+          gboolean   regular;
+          gboolean   readable;
+
+          file_info = g_file_query_info (file,
+                                         G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                         G_FILE_ATTRIBUTE_ACCESS_CAN_READ,
+                                         G_FILE_QUERY_INFO_NONE,
+                                         NULL, NULL);
+
+          regular  = (g_file_info_get_file_type (file_info) == G_FILE_TYPE_REGULAR);
+          readable = g_file_info_get_attribute_boolean (file_info,
+                                                        G_FILE_ATTRIBUTE_ACCESS_CAN_READ);
+
+          g_object_unref (file_info);
+
+          if (! (regular && readable))
+            {
+              g_object_unref (file);
+              return TRUE;
+            }
+        }
+
+      g_object_unref (file);
+
+      g_object_ref (imagefile);
+
+      /* don't pass the error, we're only interested in errors from
+       * actual thumbnail saving
+       */
+      image = file_open_thumbnail (private->gimp, context, progress,
+                                   thumbnail->image_uri, size,
+                                   &mime_type, &width, &height,
+                                   &format, &num_layers, NULL);
+
+      if (image)
+        {
+          gimp_thumbnail_set_info (private->thumbnail,
+                                   mime_type, width, height,
+                                   format, num_layers);
+        }
+      else
+        {
+          GimpPDBStatusType  status;
+
+          /* don't pass the error, we're only interested in errors
+           * from actual thumbnail saving
+           */
+          image = file_open_image (private->gimp, context, progress,
+                                   thumbnail->image_uri,
+                                   thumbnail->image_uri,
+                                   FALSE, NULL, GIMP_RUN_NONINTERACTIVE,
+                                   &status, &mime_type, NULL);
+
+          if (image)
+            gimp_thumbnail_set_info_from_image (private->thumbnail,
+                                                mime_type, image);
+        }
+
+      if (image)
+        {
+          success = gimp_imagefile_save_thumb (imagefile,
+                                               image, size, replace,
+                                               job, error);
+
+          g_object_unref (image);
+        }
+      else
+        {
+          success = gimp_thumbnail_save_failure (thumbnail,
+                                                 "GIMP " GIMP_VERSION,
+                                                 error);
+          gimp_imagefile_update (imagefile);
+        }
+
+      g_object_unref (imagefile);
+
+      if (! success)
+        {
+          g_object_set (thumbnail,
+                        "thumb-state", GIMP_THUMB_STATE_FAILED,
+                        NULL);
+        }
+
+      return success;
+    }
+
+  return TRUE;
+}
+
+
+static gboolean
+gimp_imagefile_save_thumb (GimpImagefile     *imagefile,
+                           GimpImage         *image,
+                           gint               size,
+                           gboolean           replace,
+                           GimpImagefileJob  *job,
+                           GError           **error)
 {
   GimpImagefilePrivate *private   = GET_PRIVATE (imagefile);
   GimpThumbnail        *thumbnail = private->thumbnail;
@@ -1001,6 +1195,36 @@ gimp_imagefile_save_thumb (GimpImagefile  *imagefile,
   if (! pixbuf)
     return TRUE;
 
+  if (job)
+    {
+      /*  hand encoding and writing the PNG to a worker, using a
+       *  thumbnail object of its own so that nothing the main thread
+       *  is looking at gets touched from there
+       */
+      job->local     = g_object_ref (imagefile);
+      job->thumbnail = gimp_thumbnail_new ();
+      job->pixbuf    = pixbuf;
+      job->size      = size;
+
+      gimp_thumbnail_set_uri (job->thumbnail, thumbnail->image_uri);
+
+      g_object_set (job->thumbnail,
+                    "image-mtime",      thumbnail->image_mtime,
+                    "image-filesize",   thumbnail->image_filesize,
+                    "image-mimetype",   thumbnail->image_mimetype,
+                    "image-width",      thumbnail->image_width,
+                    "image-height",     thumbnail->image_height,
+                    "image-type",       thumbnail->image_type,
+                    "image-num-layers", thumbnail->image_num_layers,
+                    NULL);
+
+      gimp_parallel_run_async ((GimpParallelRunAsyncFunc)
+                               gimp_imagefile_thumb_job_save,
+                               job);
+
+      return TRUE;
+    }
+
   success = gimp_thumbnail_save_thumb (thumbnail,
                                        pixbuf,
                                        "GIMP " GIMP_VERSION,
@@ -1021,6 +1245,172 @@ gimp_imagefile_save_thumb (GimpImagefile  *imagefile,
   return success;
 }
 
+/*  visible jobs go before all background jobs, the most recent visible
+ *  job first, background jobs are handled in order
+ */
+static void
+gimp_imagefile_thumb_queue_push (GimpImagefileJob *job)
+{
+  if (job->priority == GIMP_IMAGEFILE_PRIORITY_VISIBLE)
+    g_queue_push_head (&gimp_imagefile_thumb_queue, job);
+  else
+    g_queue_push_tail (&gimp_imagefile_thumb_queue, job);
+}
+
+/*  loading an image runs the main loop, the queue must not be handled
+ *  again from within
+ */
+static void
+gimp_imagefile_thumb_queue_schedule (void)
+{
+  if (! gimp_imagefile_thumb_idle_id &&
+      ! gimp_imagefile_thumb_busy    &&
+      ! g_queue_is_empty (&gimp_imagefile_thumb_queue))
+    {
+      gimp_imagefile_thumb_idle_id =
+        g_idle_add_full (G_PRIORITY_LOW,
+                         gimp_imagefile_thumb_queue_idle,
+                         NULL, NULL);
+    }
+}
+
+static void
+gimp_imagefile_thumb_job_set_progress (GimpImagefileJob *job,
+                                       GimpProgress     *progress)
+{
+  if (progress == job->progress)
+    return;
+
+  if (job->progress)
+    g_object_remove_weak_pointer (G_OBJECT (job->progress),
+                                  (gpointer) &job->progress);
+
+  job->progress = progress;
+
+  if (job->progress)
+    g_object_add_weak_pointer (G_OBJECT (job->progress),
+                               (gpointer) &job->progress);
+}
+
+static gboolean
+gimp_imagefile_thumb_queue_idle (gpointer data)
+{
+  GimpImagefileJob *job;
+
+  gimp_imagefile_thumb_idle_id = 0;
+  gimp_imagefile_thumb_busy    = TRUE;
+
+  job = g_queue_pop_head (&gimp_imagefile_thumb_queue);
+
+  if (job)
+    {
+      if (job->target)
+        {
+          GimpImagefilePrivate *private = GET_PRIVATE (job->target);
+          GimpImagefile        *local;
+          gboolean              success;
+
+          local = gimp_imagefile_new (private->gimp, job->uri);
+
+          success = gimp_imagefile_create_thumb (local, job->context,
+                                                 job->progress,
+                                                 job->size, job->replace,
+                                                 job, NULL);
+
+          g_object_unref (local);
+
+          /*  unless the thumbnail is now being written by a worker  */
+          if (! job->local)
+            gimp_imagefile_thumb_job_finish (job, success);
+        }
+      else
+        {
+          gimp_imagefile_thumb_job_finish (job, TRUE);
+        }
+    }
+
+  gimp_imagefile_thumb_busy = FALSE;
+
+  gimp_imagefile_thumb_queue_schedule ();
+
+  return FALSE;
+}
+
+/*  runs in a worker thread  */
+static void
+gimp_imagefile_thumb_job_save (GimpImagefileJob *job)
+{
+  job->success = gimp_thumbnail_save_thumb (job->thumbnail,
+                                            job->pixbuf,
+                                            "GIMP " GIMP_VERSION,
+                                            &job->error);
+
+  if (job->success)
+    {
+      if (job->replace)
+        gimp_thumbnail_delete_others (job->thumbnail, job->size);
+      else
+        gimp_thumbnail_delete_failure (job->thumbnail);
+    }
+
+  g_idle_add ((GSourceFunc) gimp_imagefile_thumb_job_saved, job);
+}
+
+static gboolean
+gimp_imagefile_thumb_job_saved (GimpImagefileJob *job)
+{
+  if (job->error)
+    {
+#ifdef GIMP_UNSTABLE
+      g_printerr ("%s: %s\n", G_STRFUNC, job->error->message);
+#endif
+
+      g_clear_error (&job->error);
+    }
+
+  g_object_unref (job->thumbnail);
+  g_object_unref (job->pixbuf);
+
+  gimp_imagefile_update (job->local);
+  g_object_unref (job->local);
+
+  gimp_imagefile_thumb_job_finish (job, job->success);
+
+  return FALSE;
+}
+
+static void
+gimp_imagefile_thumb_job_finish (GimpImagefileJob *job,
+                                 gboolean          success)
+{
+  if (job->target)
+    {
+      GimpImagefilePrivate *private = GET_PRIVATE (job->target);
+      const gchar          *uri     = gimp_object_get_name (job->target);
+
+      if (uri && strcmp (uri, job->uri) == 0)
+        {
+          /*  see gimp_imagefile_create_thumbnail_weak()  */
+          if (! success)
+            g_object_set (private->thumbnail,
+                          "thumb-state", GIMP_THUMB_STATE_FAILED,
+                          NULL);
+
+          gimp_imagefile_update (job->target);
+        }
+
+      g_object_remove_weak_pointer (G_OBJECT (job->target),
+                                    (gpointer) &job->target);
+    }
+
+  gimp_imagefile_thumb_job_set_progress (job, NULL);
+
+  g_object_unref (job->context);
+  g_free (job->uri);
+
+  g_slice_free (GimpImagefileJob, job);
+}
+
 static void
 gimp_thumbnail_set_info_from_image (GimpThumbnail *thumbnail,
                                     const gchar   *mime_type,
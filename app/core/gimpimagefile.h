@@ -30,6 +30,13 @@
 #include "gimpviewable.h"
 
 
+typedef enum
+{
+  GIMP_IMAGEFILE_PRIORITY_BACKGROUND,  /*  nobody is waiting for it     */
+  GIMP_IMAGEFILE_PRIORITY_VISIBLE      /*  shown to the user right now  */
+} GimpImagefilePriority;
+
+
 #define GIMP_TYPE_IMAGEFILE            (gimp_imagefile_get_type ())
 #define GIMP_IMAGEFILE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_IMAGEFILE, GimpImagefile))
 #define GIMP_IMAGEFILE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GIMP_TYPE_IMAGEFILE, GimpImagefileClass))
@@ -53,34 +60,39 @@ struct _GimpImagefileClass
 };
 
 
-GType           gimp_imagefile_get_type              (void) G_GNUC_CONST;
-
-GimpImagefile * gimp_imagefile_new                   (Gimp           *gimp,
-                                                      const gchar    *uri);
-
-GimpThumbnail * gimp_imagefile_get_thumbnail         (GimpImagefile  *imagefile);
-GIcon         * gimp_imagefile_get_gicon             (GimpImagefile  *imagefile);
-
-void            gimp_imagefile_set_mime_type         (GimpImagefile  *imagefile,
-                                                      const gchar    *mime_type);
-void            gimp_imagefile_update                (GimpImagefile  *imagefile);
-gboolean        gimp_imagefile_create_thumbnail      (GimpImagefile  *imagefile,
-                                                      GimpContext    *context,
-                                                      GimpProgress   *progress,
-                                                      gint            size,
-                                                      gboolean        replace,
-                                                      GError        **error);
-void            gimp_imagefile_create_thumbnail_weak (GimpImagefile  *imagefile,
-                                                      GimpContext    *context,
-                                                      GimpProgress   *progress,
-                                                      gint            size,
-                                                      gboolean        replace);
-gboolean        gimp_imagefile_check_thumbnail       (GimpImagefile  *imagefile);
-gboolean        gimp_imagefile_save_thumbnail        (GimpImagefile  *imagefile,
-                                                      const gchar    *mime_type,
-                                                      GimpImage      *image,
-                                                      GError        **error);
-const gchar   * gimp_imagefile_get_desc_string       (GimpImagefile  *imagefile);
-
+GType           gimp_imagefile_get_type               (void) G_GNUC_CONST;
+
+GimpImagefile * gimp_imagefile_new                    (Gimp                  *gimp,
+                                                       const gchar           *uri);
+
+GimpThumbnail * gimp_imagefile_get_thumbnail          (GimpImagefile         *imagefile);
+GIcon         * gimp_imagefile_get_gicon              (GimpImagefile         *imagefile);
+
+void            gimp_imagefile_set_mime_type          (GimpImagefile         *imagefile,
+                                                       const gchar           *mime_type);
+void            gimp_imagefile_update                 (GimpImagefile         *imagefile);
+gboolean        gimp_imagefile_create_thumbnail       (GimpImagefile         *imagefile,
+                                                       GimpContext           *context,
+                                                       GimpProgress          *progress,
+                                                       gint                   size,
+                                                       gboolean               replace,
+                                                       GError               **error);
+void            gimp_imagefile_create_thumbnail_weak  (GimpImagefile         *imagefile,
+                                                       GimpContext           *context,
+                                                       GimpProgress          *progress,
+                                                       gint                   size,
+                                                       gboolean               replace);
+void            gimp_imagefile_create_thumbnail_async (GimpImagefile         *imagefile,
+                                                       GimpContext           *context,
+                                                       GimpProgress          *progress,
+                                                       gint                   size,
+                                                       gboolean               replace,
+                                                       GimpImagefilePriority  priority);
+gboolean        gimp_imagefile_check_thumbnail        (GimpImagefile         *imagefile);
+gboolean        gimp_imagefile_save_thumbnail         (GimpImagefile         *imagefile,
+                                                       const gchar           *mime_type,
+                                                       GimpImage             *image,
+                                                       GError               **error);
+const gchar   * gimp_imagefile_get_desc_string        (GimpImagefile         *imagefile);
 
 #endif /* __GIMP_IMAGEFILE_H__ */
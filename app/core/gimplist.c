@@ -30,6 +30,12 @@
 #include "gimplist.h"
 
 
+/*  lists with fewer children are simply searched, the lookup caches
+ *  would cost more than they save
+ */
+#define MIN_CACHED_CHILDREN 16
+
+
 enum
 {
   PROP_0,
@@ -39,6 +45,7 @@ enum
 };
 
 
+static void         gimp_list_finalize           (GObject             *object);
 static void         gimp_list_set_property       (GObject             *object,
                                                   guint                property_id,
                                                   const GValue        *value,
@@ -76,6 +83,14 @@ static void         gimp_list_uniquefy_name      (GimpList            *gimp_list
 static void         gimp_list_object_renamed     (GimpObject          *object,
                                                   GimpList            *list);
 
+static GHashTable * gimp_list_get_name_table     (GimpList            *list);
+static GimpObject * gimp_list_find_name          (GimpList            *list,
+                                                  const gchar         *name,
+                                                  GimpObject          *except);
+static void         gimp_list_invalidate_names   (GimpList            *list);
+static gboolean     gimp_list_validate_index     (GimpList            *list);
+static void         gimp_list_invalidate_index   (GimpList            *list);
+
 
 G_DEFINE_TYPE (GimpList, gimp_list, GIMP_TYPE_CONTAINER)
 
@@ -89,6 +104,7 @@ gimp_list_class_init (GimpListClass *klass)
   GimpObjectClass    *gimp_object_class = GIMP_OBJECT_CLASS (klass);
   GimpContainerClass *container_class   = GIMP_CONTAINER_CLASS (klass);
 
+  object_class->finalize              = gimp_list_finalize;
   object_class->set_property          = gimp_list_set_property;
   object_class->get_property          = gimp_list_get_property;
 
@@ -134,6 +150,17 @@ gimp_list_init (GimpList *list)
   list->append       = FALSE;
 }
 
+static void
+gimp_list_finalize (GObject *object)
+{
+  GimpList *list = GIMP_LIST (object);
+
+  gimp_list_invalidate_names (list);
+  gimp_list_invalidate_index (list);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
 static void
 gimp_list_set_property (GObject      *object,
                         guint         property_id,
@@ -213,15 +240,15 @@ static void
 gimp_list_add (GimpContainer *container,
                GimpObject    *object)
 {
-  GimpList *list = GIMP_LIST (container);
+  GimpList    *list = GIMP_LIST (container);
+  const gchar *name;
 
   if (list->unique_names)
     gimp_list_uniquefy_name (list, object);
 
-  if (list->unique_names || list->sort_func)
-    g_signal_connect (object, "name-changed",
-                      G_CALLBACK (gimp_list_object_renamed),
-                      list);
+  g_signal_connect (object, "name-changed",
+                    G_CALLBACK (gimp_list_object_renamed),
+                    list);
 
   if (list->sort_func)
     list->list = g_list_insert_sorted (list->list, object, list->sort_func);
@@ -230,6 +257,39 @@ gimp_list_add (GimpContainer *container,
   else
     list->list = g_list_prepend (list->list, object);
 
+  name = gimp_object_get_name (object);
+
+  if (list->name_table && name)
+    {
+      if (! g_hash_table_lookup (list->name_table, name))
+        {
+          g_hash_table_insert (list->name_table, g_strdup (name), object);
+        }
+      else if (list->sort_func)
+        {
+          /*  we don't know if the new child comes first  */
+          gimp_list_invalidate_names (list);
+        }
+      else if (! list->append)
+        {
+          g_hash_table_insert (list->name_table, g_strdup (name), object);
+        }
+    }
+
+  if (list->index_array)
+    {
+      if (list->append && ! list->sort_func)
+        {
+          g_ptr_array_add (list->index_array, object);
+          g_hash_table_insert (list->index_table, object,
+                               GINT_TO_POINTER (list->index_array->len));
+        }
+      else
+        {
+          gimp_list_invalidate_index (list);
+        }
+    }
+
   GIMP_CONTAINER_CLASS (parent_class)->add (container, object);
 }
 
@@ -237,15 +297,27 @@ static void
 gimp_list_remove (GimpContainer *container,
                   GimpObject    *object)
 {
-  GimpList *list = GIMP_LIST (container);
+  GimpList    *list = GIMP_LIST (container);
+  const gchar *name = gimp_object_get_name (object);
 
-  if (list->unique_names || list->sort_func)
-    g_signal_handlers_disconnect_by_func (object,
-                                          gimp_list_object_renamed,
-                                          list);
+  g_signal_handlers_disconnect_by_func (object,
+                                        gimp_list_object_renamed,
+                                        list);
 
   list->list = g_list_remove (list->list, object);
 
+  if (list->name_table && name &&
+      g_hash_table_lookup (list->name_table, name) == object)
+    {
+      /*  without unique names, another child may have the same name  */
+      if (list->unique_names)
+        g_hash_table_remove (list->name_table, name);
+      else
+        gimp_list_invalidate_names (list);
+    }
+
+  gimp_list_invalidate_index (list);
+
   GIMP_CONTAINER_CLASS (parent_class)->remove (container, object);
 }
 
@@ -262,6 +334,11 @@ gimp_list_reorder (GimpContainer *container,
     list->list = g_list_append (list->list, object);
   else
     list->list = g_list_insert (list->list, object, new_index);
+
+  if (! list->unique_names)
+    gimp_list_invalidate_names (list);
+
+  gimp_list_invalidate_index (list);
 }
 
 static void
@@ -279,6 +356,9 @@ gimp_list_have (const GimpContainer *container,
 {
   GimpList *list = GIMP_LIST (container);
 
+  if (gimp_list_validate_index (list))
+    return g_hash_table_lookup (list->index_table, object) != NULL;
+
   return g_list_find (list->list, object) ? TRUE : FALSE;
 }
 
@@ -297,17 +377,8 @@ gimp_list_get_child_by_name (const GimpContainer *container,
                              const gchar         *name)
 {
   GimpList *list = GIMP_LIST (container);
-  GList    *glist;
 
-  for (glist = list->list; glist; glist = g_list_next (glist))
-    {
-      GimpObject *object = glist->data;
-
-      if (! strcmp (gimp_object_get_name (object), name))
-        return object;
-    }
-
-  return NULL;
+  return gimp_list_find_name (list, name, NULL);
 }
 
 static GimpObject *
@@ -317,6 +388,14 @@ gimp_list_get_child_by_index (const GimpContainer *container,
   GimpList *list = GIMP_LIST (container);
   GList    *glist;
 
+  if (gimp_list_validate_index (list))
+    {
+      if (index >= 0 && index < list->index_array->len)
+        return g_ptr_array_index (list->index_array, index);
+
+      return NULL;
+    }
+
   glist = g_list_nth (list->list, index);
 
   if (glist)
@@ -331,6 +410,10 @@ gimp_list_get_child_index (const GimpContainer *container,
 {
   GimpList *list = GIMP_LIST (container);
 
+  if (gimp_list_validate_index (list))
+    return GPOINTER_TO_INT (g_hash_table_lookup (list->index_table,
+                                                 object)) - 1;
+
   return g_list_index (list->list, (gpointer) object);
 }
 
@@ -417,6 +500,8 @@ gimp_list_reverse (GimpList *list)
     {
       gimp_container_freeze (GIMP_CONTAINER (list));
       list->list = g_list_reverse (list->list);
+      gimp_list_invalidate_names (list);
+      gimp_list_invalidate_index (list);
       gimp_container_thaw (GIMP_CONTAINER (list));
     }
 }
@@ -481,6 +566,8 @@ gimp_list_sort (GimpList     *list,
     {
       gimp_container_freeze (GIMP_CONTAINER (list));
       list->list = g_list_sort (list->list, sort_func);
+      gimp_list_invalidate_names (list);
+      gimp_list_invalidate_index (list);
       gimp_container_thaw (GIMP_CONTAINER (list));
     }
 }
@@ -507,23 +594,11 @@ gimp_list_uniquefy_name (GimpList   *gimp_list,
                          GimpObject *object)
 {
   gchar *name = (gchar *) gimp_object_get_name (object);
-  GList *list;
 
   if (! name)
     return;
 
-  for (list = gimp_list->list; list; list = g_list_next (list))
-    {
-      GimpObject  *object2 = list->data;
-      const gchar *name2   = gimp_object_get_name (object2);
-
-      if (object != object2 &&
-          name2             &&
-          ! strcmp (name, name2))
-        break;
-    }
-
-  if (list)
+  if (gimp_list_find_name (gimp_list, name, object))
     {
       gchar *ext;
       gchar *new_name   = NULL;
@@ -562,19 +637,8 @@ gimp_list_uniquefy_name (GimpList   *gimp_list,
           g_free (new_name);
 
           new_name = g_strdup_printf ("%s #%d", name, unique_ext);
-
-          for (list = gimp_list->list; list; list = g_list_next (list))
-            {
-              GimpObject  *object2 = list->data;
-              const gchar *name2   = gimp_object_get_name (object2);
-
-              if (object != object2 &&
-                  name2             &&
-                  ! strcmp (new_name, name2))
-                break;
-            }
         }
-      while (list);
+      while (gimp_list_find_name (gimp_list, new_name, object));
 
       g_free (name);
 
@@ -586,6 +650,8 @@ static void
 gimp_list_object_renamed (GimpObject *object,
                           GimpList   *list)
 {
+  gimp_list_invalidate_names (list);
+
   if (list->unique_names)
     {
       g_signal_handlers_block_by_func (object,
@@ -597,6 +663,9 @@ gimp_list_object_renamed (GimpObject *object,
       g_signal_handlers_unblock_by_func (object,
                                          gimp_list_object_renamed,
                                          list);
+
+      /*  the names were looked up before the child got its final name  */
+      gimp_list_invalidate_names (list);
     }
 
   if (list->sort_func)
@@ -624,3 +693,116 @@ gimp_list_object_renamed (GimpObject *object,
         gimp_container_reorder (GIMP_CONTAINER (list), object, new_index);
     }
 }
+
+static GHashTable *
+gimp_list_get_name_table (GimpList *list)
+{
+  if (! list->name_table &&
+      gimp_container_get_n_children (GIMP_CONTAINER (list)) >=
+      MIN_CACHED_CHILDREN)
+    {
+      GList *glist;
+
+      list->name_table = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, NULL);
+
+      /*  walk backwards, so the first child of each name wins  */
+      for (glist = g_list_last (list->list);
+           glist;
+           glist = g_list_previous (glist))
+        {
+          const gchar *name = gimp_object_get_name (glist->data);
+
+          if (name)
+            g_hash_table_insert (list->name_table,
+                                 g_strdup (name), glist->data);
+        }
+    }
+
+  return list->name_table;
+}
+
+/*  Returns the first child named @name that is not @except  */
+static GimpObject *
+gimp_list_find_name (GimpList    *list,
+                     const gchar *name,
+                     GimpObject  *except)
+{
+  GHashTable *name_table = gimp_list_get_name_table (list);
+  GList      *glist;
+
+  if (name_table)
+    {
+      GimpObject *object = g_hash_table_lookup (name_table, name);
+
+      if (! object || object != except)
+        return object;
+
+      /*  @except is the first child of that name, fall back to
+       *  searching for another one
+       */
+    }
+
+  for (glist = list->list; glist; glist = g_list_next (glist))
+    {
+      GimpObject  *object = glist->data;
+      const gchar *name2  = gimp_object_get_name (object);
+
+      if (object != except &&
+          name2            &&
+          ! strcmp (name, name2))
+        return object;
+    }
+
+  return NULL;
+}
+
+static void
+gimp_list_invalidate_names (GimpList *list)
+{
+  if (list->name_table)
+    {
+      g_hash_table_unref (list->name_table);
+      list->name_table = NULL;
+    }
+}
+
+static gboolean
+gimp_list_validate_index (GimpList *list)
+{
+  if (! list->index_array)
+    {
+      GList *glist;
+      gint   n_children;
+
+      n_children = gimp_container_get_n_children (GIMP_CONTAINER (list));
+
+      if (n_children < MIN_CACHED_CHILDREN)
+        return FALSE;
+
+      list->index_array = g_ptr_array_sized_new (n_children);
+      list->index_table = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+      for (glist = list->list; glist; glist = g_list_next (glist))
+        {
+          g_ptr_array_add (list->index_array, glist->data);
+          g_hash_table_insert (list->index_table, glist->data,
+                               GINT_TO_POINTER (list->index_array->len));
+        }
+    }
+
+  return TRUE;
+}
+
+static void
+gimp_list_invalidate_index (GimpList *list)
+{
+  if (list->index_array)
+    {
+      g_ptr_array_free (list->index_array, TRUE);
+      list->index_array = NULL;
+
+      g_hash_table_unref (list->index_table);
+      list->index_table = NULL;
+    }
+}
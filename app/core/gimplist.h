@@ -43,6 +43,11 @@ struct _GimpList
   gboolean       unique_names;
   GCompareFunc   sort_func;
   gboolean       append;
+
+  /*  lookup caches, built on demand and NULL while invalid  */
+  GHashTable    *name_table;   /* name -> first child of that name     */
+  GPtrArray     *index_array;  /* index -> child                       */
+  GHashTable    *index_table;  /* child -> index + 1                   */
 };
 
 struct _GimpListClass
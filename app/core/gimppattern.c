@@ -55,6 +55,8 @@ static GimpData    * gimp_pattern_duplicate         (GimpData             *data)
 
 static gchar       * gimp_pattern_get_checksum      (GimpTagged           *tagged);
 
+static void          gimp_pattern_load_stub         (GimpPattern          *pattern);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpPattern, gimp_pattern, GIMP_TYPE_DATA,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_TAGGED,
@@ -107,6 +109,12 @@ gimp_pattern_finalize (GObject *object)
       pattern->mask = NULL;
     }
 
+  if (pattern->stub_checksum)
+    {
+      g_free (pattern->stub_checksum);
+      pattern->stub_checksum = NULL;
+    }
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -128,10 +136,20 @@ gimp_pattern_get_size (GimpViewable *viewable,
                        gint         *width,
                        gint         *height)
 {
-  GimpPattern *pattern = GIMP_PATTERN (viewable);
+  GimpPattern *pattern    = GIMP_PATTERN (viewable);
+  gint         stub_width = g_atomic_int_get (&pattern->stub_width);
 
-  *width  = gimp_temp_buf_get_width  (pattern->mask);
-  *height = gimp_temp_buf_get_height (pattern->mask);
+  /*  don't load a stub's pixels just to know its size  */
+  if (stub_width)
+    {
+      *width  = stub_width;
+      *height = pattern->stub_height;
+    }
+  else
+    {
+      *width  = gimp_temp_buf_get_width  (pattern->mask);
+      *height = gimp_temp_buf_get_height (pattern->mask);
+    }
 
   return TRUE;
 }
@@ -143,19 +161,20 @@ gimp_pattern_get_new_preview (GimpViewable *viewable,
                               gint          height)
 {
   GimpPattern *pattern = GIMP_PATTERN (viewable);
+  GimpTempBuf *mask    = gimp_pattern_get_mask (pattern);
   GimpTempBuf *temp_buf;
   GeglBuffer  *src_buffer;
   GeglBuffer  *dest_buffer;
   gint         copy_width;
   gint         copy_height;
 
-  copy_width  = MIN (width,  gimp_temp_buf_get_width  (pattern->mask));
-  copy_height = MIN (height, gimp_temp_buf_get_height (pattern->mask));
+  copy_width  = MIN (width,  gimp_temp_buf_get_width  (mask));
+  copy_height = MIN (height, gimp_temp_buf_get_height (mask));
 
   temp_buf = gimp_temp_buf_new (copy_width, copy_height,
-                                gimp_temp_buf_get_format (pattern->mask));
+                                gimp_temp_buf_get_format (mask));
 
-  src_buffer  = gimp_temp_buf_create_buffer (pattern->mask);
+  src_buffer  = gimp_temp_buf_create_buffer (mask);
   dest_buffer = gimp_temp_buf_create_buffer (temp_buf);
 
   gegl_buffer_copy (src_buffer,  GEGL_RECTANGLE (0, 0, copy_width, copy_height),
@@ -172,11 +191,14 @@ gimp_pattern_get_description (GimpViewable  *viewable,
                               gchar        **tooltip)
 {
   GimpPattern *pattern = GIMP_PATTERN (viewable);
+  gint         width;
+  gint         height;
+
+  gimp_viewable_get_size (viewable, &width, &height);
 
   return g_strdup_printf ("%s (%d × %d)",
                           gimp_object_get_name (pattern),
-                          gimp_temp_buf_get_width  (pattern->mask),
-                          gimp_temp_buf_get_height (pattern->mask));
+                          width, height);
 }
 
 static const gchar *
@@ -190,7 +212,7 @@ gimp_pattern_duplicate (GimpData *data)
 {
   GimpPattern *pattern = g_object_new (GIMP_TYPE_PATTERN, NULL);
 
-  pattern->mask = gimp_temp_buf_copy (GIMP_PATTERN (data)->mask);
+  pattern->mask = gimp_temp_buf_copy (gimp_pattern_get_mask (GIMP_PATTERN (data)));
 
   return GIMP_DATA (pattern);
 }
@@ -201,7 +223,12 @@ gimp_pattern_get_checksum (GimpTagged *tagged)
   GimpPattern *pattern         = GIMP_PATTERN (tagged);
   gchar       *checksum_string = NULL;
 
-  if (pattern->mask)
+  /*  the tag cache asks every pattern, answer it from the index  */
+  if (g_atomic_int_get (&pattern->stub_width))
+    {
+      checksum_string = g_strdup (pattern->stub_checksum);
+    }
+  else if (pattern->mask)
     {
       GChecksum *checksum = g_checksum_new (G_CHECKSUM_MD5);
 
@@ -216,6 +243,74 @@ gimp_pattern_get_checksum (GimpTagged *tagged)
   return checksum_string;
 }
 
+static void
+gimp_pattern_load_stub (GimpPattern *pattern)
+{
+  static GMutex mutex;
+
+  g_mutex_lock (&mutex);
+
+  /*  another thread may have loaded it while we were waiting  */
+  if (pattern->stub_width)
+    {
+      const gchar *filename = gimp_data_get_filename (GIMP_DATA (pattern));
+      GList       *list     = NULL;
+      GimpPattern *loaded   = NULL;
+      GError      *error    = NULL;
+
+      if (filename)
+        {
+          if (gimp_datafiles_check_extension (filename,
+                                              GIMP_PATTERN_FILE_EXTENSION))
+            list = gimp_pattern_load (NULL, filename, &error);
+          else
+            list = gimp_pattern_load_pixbuf (NULL, filename, &error);
+        }
+
+      if (list && ! list->next)
+        {
+          loaded = list->data;
+
+          if (gimp_temp_buf_get_width  (loaded->mask) != pattern->stub_width ||
+              gimp_temp_buf_get_height (loaded->mask) != pattern->stub_height)
+            loaded = NULL;
+        }
+
+      if (loaded)
+        {
+          pattern->mask = loaded->mask;
+          loaded->mask  = NULL;
+        }
+      else
+        {
+          /*  the file changed or vanished since it was indexed, use an
+           *  empty mask of the promised size until the next refresh
+           */
+          if (error)
+            g_message ("%s", error->message);
+          else
+            g_message (_("Pattern file '%s' changed since GIMP was started."),
+                       filename ? gimp_filename_to_utf8 (filename) : "???");
+
+          g_clear_error (&error);
+
+          pattern->mask = gimp_temp_buf_new (pattern->stub_width,
+                                             pattern->stub_height,
+                                             babl_format ("R'G'B' u8"));
+          gimp_temp_buf_data_clear (pattern->mask);
+        }
+
+      g_list_free_full (list, (GDestroyNotify) g_object_unref);
+
+      g_free (pattern->stub_checksum);
+      pattern->stub_checksum = NULL;
+
+      g_atomic_int_set (&pattern->stub_width, 0);
+    }
+
+  g_mutex_unlock (&mutex);
+}
+
 GimpData *
 gimp_pattern_new (GimpContext *context,
                   const gchar *name)
@@ -264,11 +359,47 @@ gimp_pattern_get_standard (GimpContext *context)
   return standard_pattern;
 }
 
+/*  creates a pattern from a data factory index entry, its pixels are
+ *  read from the pattern's file on first use, see gimp_pattern_get_mask()
+ */
+GimpData *
+gimp_pattern_new_stub (const gchar *filename,
+                       const gchar *name,
+                       gint         width,
+                       gint         height,
+                       const gchar *checksum)
+{
+  GimpPattern *pattern;
+  const gchar *mime_type = NULL;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  /*  same as gimp_pattern_load() and gimp_pattern_load_pixbuf()  */
+  if (gimp_datafiles_check_extension (filename, GIMP_PATTERN_FILE_EXTENSION))
+    mime_type = "image/x-gimp-pat";
+
+  pattern = g_object_new (GIMP_TYPE_PATTERN,
+                          "name",      name,
+                          "mime-type", mime_type,
+                          NULL);
+
+  pattern->stub_width    = width;
+  pattern->stub_height   = height;
+  pattern->stub_checksum = g_strdup (checksum);
+
+  return GIMP_DATA (pattern);
+}
+
 GimpTempBuf *
 gimp_pattern_get_mask (const GimpPattern *pattern)
 {
   g_return_val_if_fail (GIMP_IS_PATTERN (pattern), NULL);
 
+  if (G_UNLIKELY (g_atomic_int_get (&pattern->stub_width)))
+    gimp_pattern_load_stub ((GimpPattern *) pattern);
+
   return pattern->mask;
 }
 
@@ -277,5 +408,5 @@ gimp_pattern_create_buffer (const GimpPattern *pattern)
 {
   g_return_val_if_fail (GIMP_IS_PATTERN (pattern), NULL);
 
-  return gimp_temp_buf_create_buffer (pattern->mask);
+  return gimp_temp_buf_create_buffer (gimp_pattern_get_mask (pattern));
 }
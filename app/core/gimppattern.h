@@ -37,6 +37,10 @@ struct _GimpPattern
   GimpData     parent_instance;
 
   GimpTempBuf *mask;
+
+  gint         stub_width;    /*  set while the mask is not loaded  */
+  gint         stub_height;
+  gchar       *stub_checksum;
 };
 
 struct _GimpPatternClass
@@ -50,6 +54,11 @@ GType         gimp_pattern_get_type      (void) G_GNUC_CONST;
 GimpData    * gimp_pattern_new           (GimpContext       *context,
                                           const gchar       *name);
 GimpData    * gimp_pattern_get_standard  (GimpContext       *context);
+GimpData    * gimp_pattern_new_stub      (const gchar       *filename,
+                                          const gchar       *name,
+                                          gint               width,
+                                          gint               height,
+                                          const gchar       *checksum);
 
 GimpTempBuf * gimp_pattern_get_mask      (const GimpPattern *pattern);
 GeglBuffer  * gimp_pattern_create_buffer (const GimpPattern *pattern);
@@ -28,6 +28,7 @@
 #include "gegl/gimptilehandlerprojection.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimp-utils.h"
 #include "gimparea.h"
 #include "gimpimage.h"
@@ -49,6 +50,9 @@
 /*  how much time, in seconds, do we allow chunk rendering to take  */
 #define GIMP_PROJECTION_CHUNK_TIME 0.01
 
+/*  how many chunks per thread one round of the chunk renderer takes  */
+#define GIMP_PROJECTION_CHUNKS_PER_THREAD 2
+
 
 enum
 {
@@ -63,6 +67,25 @@ enum
 };
 
 
+typedef struct _GimpProjectionChunk GimpProjectionChunk;
+
+struct _GimpProjectionChunk
+{
+  GeglRectangle  rect;    /*  in tile-pyramid coordinates  */
+  guint          key;     /*  grid cell, see chunk_render_queue_area()  */
+  guint          serial;  /*  flush serial of the last invalidation     */
+};
+
+typedef struct
+{
+  GimpProjection       *proj;
+  GTimer               *timer;
+  GimpProjectionChunk **chunks;
+  gint                  n_chunks;
+  gint                  next;  /*  atomic  */
+} GimpProjectionChunkBatch;
+
+
 /*  local function prototypes  */
 
 static void   gimp_projection_pickable_iface_init (GimpPickableInterface  *iface);
@@ -105,8 +128,18 @@ static void        gimp_projection_chunk_render_start    (GimpProjection  *proj)
 static void        gimp_projection_chunk_render_stop     (GimpProjection  *proj);
 static gboolean    gimp_projection_chunk_render_callback (gpointer         data);
 static void        gimp_projection_chunk_render_init     (GimpProjection  *proj);
-static gboolean    gimp_projection_chunk_render_iteration(GimpProjection  *proj);
-static gboolean    gimp_projection_chunk_render_next_area(GimpProjection  *proj);
+static void        gimp_projection_chunk_render_clear    (GimpProjection  *proj);
+static void        gimp_projection_chunk_render_queue_area
+                                                         (GimpProjection  *proj,
+                                                          GimpArea        *area);
+static gboolean    gimp_projection_chunk_render_iteration(GimpProjection  *proj,
+                                                          GTimer          *timer);
+static void        gimp_projection_chunk_render_batch    (gint             i,
+                                                          gint             n,
+                                                          gpointer         data);
+static gint        gimp_projection_chunk_compare         (gconstpointer    a,
+                                                          gconstpointer    b,
+                                                          gpointer         data);
 static void        gimp_projection_paint_area            (GimpProjection  *proj,
                                                           gboolean         now,
                                                           gint             x,
@@ -168,6 +201,8 @@ gimp_projection_class_init (GimpProjectionClass *klass)
 static void
 gimp_projection_init (GimpProjection *proj)
 {
+  proj->chunk_render.chunks = g_hash_table_new (NULL, NULL);
+  proj->chunk_render.queue  = g_ptr_array_new ();
 }
 
 static void
@@ -193,8 +228,13 @@ gimp_projection_finalize (GObject *object)
   gimp_area_list_free (proj->update_areas);
   proj->update_areas = NULL;
 
-  gimp_area_list_free (proj->chunk_render.update_areas);
-  proj->chunk_render.update_areas = NULL;
+  gimp_projection_chunk_render_clear (proj);
+
+  g_hash_table_unref (proj->chunk_render.chunks);
+  proj->chunk_render.chunks = NULL;
+
+  g_ptr_array_free (proj->chunk_render.queue, TRUE);
+  proj->chunk_render.queue = NULL;
 
   gimp_projection_free_buffer (proj);
 
@@ -439,10 +479,44 @@ gimp_projection_finish_draw (GimpProjection *proj)
     {
       gimp_projection_chunk_render_stop (proj);
 
-      while (gimp_projection_chunk_render_iteration (proj));
+      while (gimp_projection_chunk_render_iteration (proj, NULL));
     }
 }
 
+/**
+ * gimp_projection_set_priority_rect:
+ * @proj:   a #GimpProjection
+ * @x:      x coordinate of the rectangle, in image coordinates
+ * @y:      y coordinate of the rectangle
+ * @width:  width of the rectangle
+ * @height: height of the rectangle
+ *
+ * Makes the chunk renderer render chunks inside and close to the
+ * given rectangle, usually the visible part of the image, before
+ * all others.
+ **/
+void
+gimp_projection_set_priority_rect (GimpProjection *proj,
+                                   gint            x,
+                                   gint            y,
+                                   gint            width,
+                                   gint            height)
+{
+  gint off_x, off_y;
+
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+
+  gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
+
+  /*  convert to tile-pyramid coordinates, like the chunks  */
+  proj->chunk_render.priority_rect.x      = x - off_x;
+  proj->chunk_render.priority_rect.y      = y - off_y;
+  proj->chunk_render.priority_rect.width  = MAX (width,  0);
+  proj->chunk_render.priority_rect.height = MAX (height, 0);
+
+  proj->chunk_render.queue_dirty = TRUE;
+}
+
 
 /*  private functions  */
 
@@ -569,12 +643,12 @@ gimp_projection_chunk_render_callback (gpointer data)
 {
   GimpProjection *proj   = data;
   GTimer         *timer  = g_timer_new ();
-  gint            chunks = 0;
+  gint            rounds = 0;
   gboolean        retval = TRUE;
 
   do
     {
-      if (! gimp_projection_chunk_render_iteration (proj))
+      if (! gimp_projection_chunk_render_iteration (proj, timer))
         {
           gimp_projection_chunk_render_stop (proj);
 
@@ -583,12 +657,13 @@ gimp_projection_chunk_render_callback (gpointer data)
           break;
         }
 
-      chunks++;
+      rounds++;
     }
   while (g_timer_elapsed (timer, NULL) < GIMP_PROJECTION_CHUNK_TIME);
 
-  GIMP_LOG (PROJECTION, "%d chunks in %f seconds\n",
-            chunks, g_timer_elapsed (timer, NULL));
+  GIMP_LOG (PROJECTION, "%d rounds on %d threads in %f seconds\n",
+            rounds, gimp_parallel_get_n_threads (),
+            g_timer_elapsed (timer, NULL));
   g_timer_destroy (timer);
 
   return retval;
@@ -599,52 +674,104 @@ gimp_projection_chunk_render_init (GimpProjection *proj)
 {
   GSList *list;
 
-  /* We need to merge the ChunkRender's and the GimpProjection's
-   * update_areas list to keep track of which of the updates have been
-   * flushed and hence need to be drawn.
+  /*  Each flush gets a new serial, so that chunks invalidated most
+   *  recently are rendered first among chunks at the same distance
+   *  from the priority rect.
    */
+  proj->chunk_render.serial++;
+
   for (list = proj->update_areas; list; list = g_slist_next (list))
     {
       GimpArea *area = list->data;
 
-      proj->chunk_render.update_areas =
-        gimp_area_list_process (proj->chunk_render.update_areas,
-                                gimp_area_new (area->x1, area->y1,
-                                               area->x2, area->y2));
+      if ((area->x1 != area->x2) && (area->y1 != area->y2))
+        gimp_projection_chunk_render_queue_area (proj, area);
     }
 
-  /* If a chunk renderer was already running, merge the remainder of
-   * its unrendered area with the update_areas list, and make it start
-   * work on the next unrendered area in the list.
-   */
-  if (proj->chunk_render.running)
-    {
-      GimpArea *area =
-        gimp_area_new (proj->chunk_render.base_x,
-                       proj->chunk_render.y,
-                       proj->chunk_render.base_x + proj->chunk_render.width,
-                       proj->chunk_render.y + (proj->chunk_render.height -
-                                               (proj->chunk_render.y -
-                                                proj->chunk_render.base_y)));
-
-      proj->chunk_render.update_areas =
-        gimp_area_list_process (proj->chunk_render.update_areas, area);
-
-      gimp_projection_chunk_render_next_area (proj);
-    }
-  else
+  if (proj->chunk_render.queue->len > 0 &&
+      ! proj->chunk_render.running)
+    gimp_projection_chunk_render_start (proj);
+}
+
+static void
+gimp_projection_chunk_render_clear (GimpProjection *proj)
+{
+  GimpProjectionChunkRender *chunk_render = &proj->chunk_render;
+  gint                       i;
+
+  for (i = 0; i < chunk_render->queue->len; i++)
+    g_slice_free (GimpProjectionChunk,
+                  g_ptr_array_index (chunk_render->queue, i));
+
+  g_ptr_array_set_size (chunk_render->queue, 0);
+  g_hash_table_remove_all (chunk_render->chunks);
+}
+
+/*  Splits @area along the chunk grid and merges the pieces into the
+ *  queue.  A grid cell is queued at most once; invalidating it again
+ *  grows its rectangle and refreshes its serial.
+ */
+static void
+gimp_projection_chunk_render_queue_area (GimpProjection *proj,
+                                         GimpArea       *area)
+{
+  GimpProjectionChunkRender *chunk_render = &proj->chunk_render;
+  GeglRectangle              area_rect;
+  gint                       x, y;
+
+  area_rect.x      = area->x1;
+  area_rect.y      = area->y1;
+  area_rect.width  = area->x2 - area->x1;
+  area_rect.height = area->y2 - area->y1;
+
+  for (y = area->y1 - area->y1 % GIMP_PROJECTION_CHUNK_HEIGHT;
+       y < area->y2;
+       y += GIMP_PROJECTION_CHUNK_HEIGHT)
     {
-      if (proj->chunk_render.update_areas == NULL)
+      for (x = area->x1 - area->x1 % GIMP_PROJECTION_CHUNK_WIDTH;
+           x < area->x2;
+           x += GIMP_PROJECTION_CHUNK_WIDTH)
         {
-          g_warning ("%s: wanted to start chunk render with no update_areas",
-                     G_STRFUNC);
-          return;
-        }
+          GimpProjectionChunk *chunk;
+          GeglRectangle        cell;
+          GeglRectangle        rect;
+          guint                key;
+
+          cell.x      = x;
+          cell.y      = y;
+          cell.width  = GIMP_PROJECTION_CHUNK_WIDTH;
+          cell.height = GIMP_PROJECTION_CHUNK_HEIGHT;
+
+          if (! gegl_rectangle_intersect (&rect, &cell, &area_rect))
+            continue;
+
+          key = (((guint) (y / GIMP_PROJECTION_CHUNK_HEIGHT)) << 16) |
+                 ((guint) (x / GIMP_PROJECTION_CHUNK_WIDTH) & 0xffff);
+
+          chunk = g_hash_table_lookup (chunk_render->chunks,
+                                       GUINT_TO_POINTER (key));
+
+          if (chunk)
+            {
+              gegl_rectangle_bounding_box (&chunk->rect, &chunk->rect, &rect);
+            }
+          else
+            {
+              chunk = g_slice_new (GimpProjectionChunk);
 
-      gimp_projection_chunk_render_next_area (proj);
+              chunk->rect = rect;
+              chunk->key  = key;
 
-      gimp_projection_chunk_render_start (proj);
+              g_hash_table_insert (chunk_render->chunks,
+                                   GUINT_TO_POINTER (key), chunk);
+              g_ptr_array_add (chunk_render->queue, chunk);
+            }
+
+          chunk->serial = chunk_render->serial;
+        }
     }
+
+  chunk_render->queue_dirty = TRUE;
 }
 
 /* Unless specified otherwise, projection re-rendering is organised by
@@ -652,82 +779,204 @@ gimp_projection_chunk_render_init (GimpProjection *proj)
  * them into bite-sized chunks which are chewed on in an idle
  * function. This greatly improves responsiveness for many GIMP
  * operations.  -- Adam
+ *
+ * Each iteration takes the best few chunks off the priority queue and
+ * renders them on all threads of the parallel pool at once.  The main
+ * loop is blocked while they render, so the graph can't change under
+ * the worker threads' feet; the update signals for the finished chunks
+ * are then emitted from the main thread.  The graph itself is processed
+ * by one thread at a time, what runs in parallel is storing the pixels
+ * in the projection buffer.
+ *
+ * If @timer is given, no new chunks are started once it exceeds
+ * GIMP_PROJECTION_CHUNK_TIME, and the chunks that were not started go
+ * back to the queue.
  */
 static gboolean
-gimp_projection_chunk_render_iteration (GimpProjection *proj)
+gimp_projection_chunk_render_iteration (GimpProjection *proj,
+                                        GTimer         *timer)
 {
-  gint workx = proj->chunk_render.x;
-  gint worky = proj->chunk_render.y;
-  gint workw = GIMP_PROJECTION_CHUNK_WIDTH;
-  gint workh = GIMP_PROJECTION_CHUNK_HEIGHT;
+  GimpProjectionChunkRender *chunk_render = &proj->chunk_render;
+  GimpProjectionChunkBatch   batch;
+  gint                       n_threads;
+  gint                       n_rendered;
+  gint                       i;
 
-  if (workx + workw > proj->chunk_render.base_x + proj->chunk_render.width)
+  if (chunk_render->queue->len == 0)
+    return FALSE;
+
+  if (chunk_render->queue_dirty)
     {
-      workw = proj->chunk_render.base_x + proj->chunk_render.width - workx;
+      g_ptr_array_sort_with_data (chunk_render->queue,
+                                  gimp_projection_chunk_compare,
+                                  &chunk_render->priority_rect);
+
+      chunk_render->queue_dirty = FALSE;
     }
 
-  if (worky + workh > proj->chunk_render.base_y + proj->chunk_render.height)
+  n_threads = gimp_parallel_get_n_threads ();
+
+  batch.proj     = proj;
+  batch.timer    = timer;
+  batch.n_chunks = MIN (chunk_render->queue->len,
+                        n_threads * GIMP_PROJECTION_CHUNKS_PER_THREAD);
+  batch.chunks   = g_new (GimpProjectionChunk *, batch.n_chunks);
+  batch.next     = 0;
+
+  /*  the best chunks are at the end of the queue  */
+  for (i = 0; i < batch.n_chunks; i++)
     {
-      workh = proj->chunk_render.base_y + proj->chunk_render.height - worky;
+      GimpProjectionChunk *chunk;
+
+      chunk = g_ptr_array_remove_index (chunk_render->queue,
+                                        chunk_render->queue->len - 1);
+
+      g_hash_table_remove (chunk_render->chunks,
+                           GUINT_TO_POINTER (chunk->key));
+
+      batch.chunks[i] = chunk;
     }
 
-  gimp_projection_paint_area (proj, TRUE /* sic! */,
-                              workx, worky, workw, workh);
+  gimp_parallel_distribute (MIN (n_threads, batch.n_chunks),
+                            gimp_projection_chunk_render_batch,
+                            &batch);
 
-  proj->chunk_render.x += GIMP_PROJECTION_CHUNK_WIDTH;
+  n_rendered = MIN (g_atomic_int_get (&batch.next), batch.n_chunks);
 
-  if (proj->chunk_render.x >=
-      proj->chunk_render.base_x + proj->chunk_render.width)
+  /*  put the chunks that were not started back, best one last  */
+  for (i = batch.n_chunks - 1; i >= n_rendered; i--)
     {
-      proj->chunk_render.x = proj->chunk_render.base_x;
-      proj->chunk_render.y += GIMP_PROJECTION_CHUNK_HEIGHT;
+      GimpProjectionChunk *chunk = batch.chunks[i];
 
-      if (proj->chunk_render.y >=
-          proj->chunk_render.base_y + proj->chunk_render.height)
-        {
-          if (! gimp_projection_chunk_render_next_area (proj))
-            {
-              if (proj->invalidate_preview)
-                {
-                  /* invalidate the preview here since it is constructed from
-                   * the projection
-                   */
-                  proj->invalidate_preview = FALSE;
+      g_ptr_array_add (chunk_render->queue, chunk);
+      g_hash_table_insert (chunk_render->chunks,
+                           GUINT_TO_POINTER (chunk->key), chunk);
+    }
 
-                  gimp_projectable_invalidate_preview (proj->projectable);
-                }
+  for (i = 0; i < n_rendered; i++)
+    {
+      GimpProjectionChunk *chunk = batch.chunks[i];
+      gint                 off_x, off_y;
 
-              /* FINISHED */
-              return FALSE;
-            }
+      gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
+
+      g_signal_emit (proj, projection_signals[UPDATE], 0,
+                     TRUE,
+                     chunk->rect.x + off_x,
+                     chunk->rect.y + off_y,
+                     chunk->rect.width,
+                     chunk->rect.height);
+
+      g_slice_free (GimpProjectionChunk, chunk);
+    }
+
+  g_free (batch.chunks);
+
+  if (chunk_render->queue->len == 0)
+    {
+      if (proj->invalidate_preview)
+        {
+          /* invalidate the preview here since it is constructed from
+           * the projection
+           */
+          proj->invalidate_preview = FALSE;
+
+          gimp_projectable_invalidate_preview (proj->projectable);
         }
+
+      /* FINISHED */
+      return FALSE;
     }
 
   /* Still work to do. */
   return TRUE;
 }
 
-static gboolean
-gimp_projection_chunk_render_next_area (GimpProjection *proj)
+/*  runs in the parallel pool, must not touch anything but pixels  */
+static void
+gimp_projection_chunk_render_batch (gint     i,
+                                    gint     n,
+                                    gpointer data)
 {
-  GimpArea *area;
+  GimpProjectionChunkBatch *batch  = data;
+  GimpProjection           *proj   = batch->proj;
+  const Babl               *format = gegl_buffer_get_format (proj->buffer);
+  gint                      bpp    = babl_format_get_bytes_per_pixel (format);
+  guchar                   *pixels = NULL;
+  gint                      index;
+
+  while ((! batch->timer ||
+          g_timer_elapsed (batch->timer, NULL) < GIMP_PROJECTION_CHUNK_TIME) &&
+         (index = g_atomic_int_add (&batch->next, 1)) < batch->n_chunks)
+    {
+      GeglRectangle *rect = &batch->chunks[index]->rect;
 
-  if (! proj->chunk_render.update_areas)
-    return FALSE;
+      if (! pixels)
+        pixels = gegl_malloc (GIMP_PROJECTION_CHUNK_WIDTH  *
+                              GIMP_PROJECTION_CHUNK_HEIGHT * bpp);
+
+      gimp_tile_handler_projection_render (proj->validate_handler, rect,
+                                           pixels, rect->width * bpp);
+
+      gimp_tile_handler_projection_undo_invalidate (proj->validate_handler,
+                                                    rect->x,
+                                                    rect->y,
+                                                    rect->width,
+                                                    rect->height);
 
-  area = proj->chunk_render.update_areas->data;
+      gegl_buffer_set (proj->buffer, rect, 0, format,
+                       pixels, rect->width * bpp);
+    }
+
+  if (pixels)
+    gegl_free (pixels);
+}
+
+/*  sorts the queue so that the most urgent chunk comes last: first by
+ *  distance from the priority rect, then by the flush serial
+ */
+static gint
+gimp_projection_chunk_compare (gconstpointer a,
+                               gconstpointer b,
+                               gpointer      data)
+{
+  const GimpProjectionChunk *chunk_a  = *(GimpProjectionChunk * const *) a;
+  const GimpProjectionChunk *chunk_b  = *(GimpProjectionChunk * const *) b;
+  const GeglRectangle       *priority = data;
+  gint64                     dist_a   = 0;
+  gint64                     dist_b   = 0;
 
-  proj->chunk_render.update_areas =
-    g_slist_remove (proj->chunk_render.update_areas, area);
+  if (priority->width > 0 && priority->height > 0)
+    {
+      gint dx, dy;
+
+      dx = MAX (MAX (priority->x - (chunk_a->rect.x + chunk_a->rect.width), 0),
+                chunk_a->rect.x - (priority->x + priority->width));
+      dy = MAX (MAX (priority->y - (chunk_a->rect.y + chunk_a->rect.height), 0),
+                chunk_a->rect.y - (priority->y + priority->height));
+      dist_a = (gint64) dx * dx + (gint64) dy * dy;
+
+      dx = MAX (MAX (priority->x - (chunk_b->rect.x + chunk_b->rect.width), 0),
+                chunk_b->rect.x - (priority->x + priority->width));
+      dy = MAX (MAX (priority->y - (chunk_b->rect.y + chunk_b->rect.height), 0),
+                chunk_b->rect.y - (priority->y + priority->height));
+      dist_b = (gint64) dx * dx + (gint64) dy * dy;
+    }
 
-  proj->chunk_render.x      = proj->chunk_render.base_x = area->x1;
-  proj->chunk_render.y      = proj->chunk_render.base_y = area->y1;
-  proj->chunk_render.width  = area->x2 - area->x1;
-  proj->chunk_render.height = area->y2 - area->y1;
+  if (dist_a != dist_b)
+    return dist_a > dist_b ? -1 : 1;
 
-  gimp_area_free (area);
+  if (chunk_a->serial != chunk_b->serial)
+    return chunk_a->serial < chunk_b->serial ? -1 : 1;
 
-  return TRUE;
+  /*  keep the old top-to-bottom, left-to-right order otherwise  */
+  if (chunk_a->rect.y != chunk_b->rect.y)
+    return chunk_a->rect.y > chunk_b->rect.y ? -1 : 1;
+
+  if (chunk_a->rect.x != chunk_b->rect.x)
+    return chunk_a->rect.x > chunk_b->rect.x ? -1 : 1;
+
+  return 0;
 }
 
 static void
@@ -816,6 +1065,8 @@ gimp_projection_projectable_changed (GimpProjectable *projectable,
   gimp_area_list_free (proj->update_areas);
   proj->update_areas = NULL;
 
+  gimp_projection_chunk_render_clear (proj);
+
   gimp_projection_free_buffer (proj);
 
   gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
@@ -26,14 +26,12 @@ typedef struct _GimpProjectionChunkRender GimpProjectionChunkRender;
 
 struct _GimpProjectionChunkRender
 {
-  gboolean running;
-  gint     width;
-  gint     height;
-  gint     x;
-  gint     y;
-  gint     base_x;
-  gint     base_y;
-  GSList  *update_areas;   /*  flushed update areas */
+  gboolean       running;
+  GHashTable    *chunks;         /*  queued chunks by grid cell         */
+  GPtrArray     *queue;          /*  queued chunks, best one last       */
+  gboolean       queue_dirty;    /*  queue needs to be sorted again     */
+  guint          serial;         /*  bumped on every flush              */
+  GeglRectangle  priority_rect;  /*  render chunks close to this first  */
 };
 
 
@@ -85,6 +83,13 @@ void             gimp_projection_flush            (GimpProjection    *proj);
 void             gimp_projection_flush_now        (GimpProjection    *proj);
 void             gimp_projection_finish_draw      (GimpProjection    *proj);
 
+void             gimp_projection_set_priority_rect
+                                                  (GimpProjection    *proj,
+                                                   gint               x,
+                                                   gint               y,
+                                                   gint               width,
+                                                   gint               height);
+
 gint64           gimp_projection_estimate_memsize (GimpImageBaseType  type,
                                                    GimpPrecision      precision,
                                                    gint               width,
@@ -59,6 +59,8 @@ struct _GimpUndo
   GimpUndoType      undo_type;      /* undo type                          */
   GimpDirtyMask     dirty_mask;     /* affected parts of the image        */
 
+  gint64            stack_memsize;  /* memsize accounted by its stack     */
+
   GimpTempBuf      *preview;
   guint             preview_idle_id;
 };
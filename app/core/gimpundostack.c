@@ -129,6 +129,8 @@ gimp_undo_stack_free (GimpUndo     *undo,
     }
 
   gimp_container_clear (stack->undos);
+
+  stack->undos_memsize = 0;
 }
 
 GimpUndoStack *
@@ -148,6 +150,9 @@ gimp_undo_stack_push_undo (GimpUndoStack *stack,
   g_return_if_fail (GIMP_IS_UNDO_STACK (stack));
   g_return_if_fail (GIMP_IS_UNDO (undo));
 
+  undo->stack_memsize = gimp_object_get_memsize (GIMP_OBJECT (undo), NULL);
+  stack->undos_memsize += undo->stack_memsize;
+
   gimp_container_add (stack->undos, GIMP_OBJECT (undo));
 }
 
@@ -166,6 +171,8 @@ gimp_undo_stack_pop_undo (GimpUndoStack       *stack,
   if (undo)
     {
       gimp_container_remove (stack->undos, GIMP_OBJECT (undo));
+      stack->undos_memsize -= undo->stack_memsize;
+
       gimp_undo_pop (undo, undo_mode, accum);
 
       return undo;
@@ -187,6 +194,8 @@ gimp_undo_stack_free_bottom (GimpUndoStack *stack,
   if (undo)
     {
       gimp_container_remove (stack->undos, GIMP_OBJECT (undo));
+      stack->undos_memsize -= undo->stack_memsize;
+
       gimp_undo_free (undo, undo_mode);
 
       return undo;
@@ -210,3 +219,31 @@ gimp_undo_stack_get_depth (GimpUndoStack *stack)
 
   return gimp_container_get_n_children (stack->undos);
 }
+
+/*  the memory used by the undos on the stack, as measured when they
+ *  were pushed, so it's cheap enough to check after each push
+ */
+gint64
+gimp_undo_stack_get_undos_memsize (GimpUndoStack *stack)
+{
+  g_return_val_if_fail (GIMP_IS_UNDO_STACK (stack), 0);
+
+  return stack->undos_memsize;
+}
+
+/*  measures an undo on the stack again, after it grew since it was
+ *  pushed, like an undo group that was open at the time
+ */
+void
+gimp_undo_stack_update_undo (GimpUndoStack *stack,
+                             GimpUndo      *undo)
+{
+  g_return_if_fail (GIMP_IS_UNDO_STACK (stack));
+  g_return_if_fail (GIMP_IS_UNDO (undo));
+  g_return_if_fail (gimp_container_have (stack->undos, GIMP_OBJECT (undo)));
+
+  stack->undos_memsize -= undo->stack_memsize;
+
+  undo->stack_memsize = gimp_object_get_memsize (GIMP_OBJECT (undo), NULL);
+  stack->undos_memsize += undo->stack_memsize;
+}
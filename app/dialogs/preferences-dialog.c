@@ -1334,28 +1334,31 @@ prefs_dialog_new (Gimp       *gimp,
                            GTK_CONTAINER (vbox), FALSE);
 
 #ifdef ENABLE_MP
-  table = prefs_table_new (5, GTK_CONTAINER (vbox2));
+  table = prefs_table_new (6, GTK_CONTAINER (vbox2));
 #else
-  table = prefs_table_new (4, GTK_CONTAINER (vbox2));
+  table = prefs_table_new (5, GTK_CONTAINER (vbox2));
 #endif /* ENABLE_MP */
 
   prefs_spin_button_add (object, "undo-levels", 1.0, 5.0, 0,
                          _("Minimal number of _undo levels:"),
                          GTK_TABLE (table), 0, size_group);
+  prefs_spin_button_add (object, "max-undo-levels", 1.0, 10.0, 0,
+                         _("Ma_ximal number of undo levels:"),
+                         GTK_TABLE (table), 1, size_group);
   prefs_memsize_entry_add (object, "undo-size",
                            _("Maximum undo _memory:"),
-                           GTK_TABLE (table), 1, size_group);
+                           GTK_TABLE (table), 2, size_group);
   prefs_memsize_entry_add (object, "tile-cache-size",
                            _("Tile cache _size:"),
-                           GTK_TABLE (table), 2, size_group);
+                           GTK_TABLE (table), 3, size_group);
   prefs_memsize_entry_add (object, "max-new-image-size",
                            _("Maximum _new image size:"),
-                           GTK_TABLE (table), 3, size_group);
+                           GTK_TABLE (table), 4, size_group);
 
 #ifdef ENABLE_MP
   prefs_spin_button_add (object, "num-processors", 1.0, 4.0, 0,
                          _("Number of _processors to use:"),
-                         GTK_TABLE (table), 4, size_group);
+                         GTK_TABLE (table), 5, size_group);
 #endif /* ENABLE_MP */
 
   /*  Hardware Acceleration  */
@@ -17,6 +17,9 @@
 
 #include "config.h"
 
+#include <math.h>
+#include <string.h>
+
 #include <gegl.h>
 #include <gtk/gtk.h>
 
@@ -29,6 +32,7 @@
 
 #include "gegl/gimp-gegl-utils.h"
 
+#include "core/gimp-parallel.h"
 #include "core/gimpdrawable.h"
 #include "core/gimpimage.h"
 #include "core/gimppickable.h"
@@ -44,6 +48,40 @@
 #include "gimpdisplayxfer.h"
 
 
+/*  don't bother splitting strips smaller than this many rows  */
+#define GIMP_DISPLAY_RENDER_MIN_ROWS 16
+
+
+typedef struct
+{
+  GimpDisplayShell *shell;
+  GeglBuffer       *buffer;
+  GeglRectangle     rect;
+  gdouble           scale;
+  const Babl       *filter_format;
+  const Babl       *filter_fish;
+  guchar           *data;
+  gint              stride;
+  guchar           *mask_data;
+  gint              mask_stride;
+} GimpDisplayShellRenderData;
+
+
+static void   gimp_display_shell_render_validate (GeglBuffer          *buffer,
+                                                  const GeglRectangle *rect,
+                                                  gdouble              scale);
+static void   gimp_display_shell_render_rows     (gsize                offset,
+                                                  gsize                size,
+                                                  gpointer             data);
+static void   gimp_display_shell_render_cairo    (gsize                offset,
+                                                  gsize                size,
+                                                  gpointer             data);
+static void   gimp_display_shell_render_invert   (guchar              *data,
+                                                  gint                 stride,
+                                                  gint                 width,
+                                                  gint                 height);
+
+
 void
 gimp_display_shell_render (GimpDisplayShell *shell,
                            cairo_t          *cr,
@@ -52,21 +90,22 @@ gimp_display_shell_render (GimpDisplayShell *shell,
                            gint              w,
                            gint              h)
 {
-  GimpImage       *image;
-  GimpProjection  *projection;
-  GeglBuffer      *buffer;
-  gdouble          window_scale = 1.0;
-  gint             viewport_offset_x;
-  gint             viewport_offset_y;
-  gint             viewport_width;
-  gint             viewport_height;
-  cairo_surface_t *xfer;
-  gint             xfer_src_x;
-  gint             xfer_src_y;
-  gint             mask_src_x = 0;
-  gint             mask_src_y = 0;
-  gint             stride;
-  guchar          *data;
+  GimpImage                  *image;
+  GimpProjection             *projection;
+  GeglBuffer                 *buffer;
+  gdouble                     window_scale = 1.0;
+  gint                        viewport_offset_x;
+  gint                        viewport_offset_y;
+  gint                        viewport_width;
+  gint                        viewport_height;
+  cairo_surface_t            *xfer;
+  gint                        xfer_src_x;
+  gint                        xfer_src_y;
+  gint                        mask_src_x = 0;
+  gint                        mask_src_y = 0;
+  gint                        stride;
+  guchar                     *data;
+  GimpDisplayShellRenderData  render;
 
   g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
   g_return_if_fail (cr != NULL);
@@ -111,6 +150,20 @@ gimp_display_shell_render (GimpDisplayShell *shell,
   data = cairo_image_surface_get_data (xfer);
   data += xfer_src_y * stride + xfer_src_x * 4;
 
+  render.shell         = shell;
+  render.buffer        = buffer;
+  render.rect.x        = (x + viewport_offset_x) * window_scale;
+  render.rect.y        = (y + viewport_offset_y) * window_scale;
+  render.rect.width    = w * window_scale;
+  render.rect.height   = h * window_scale;
+  render.scale         = shell->scale_x * window_scale;
+  render.filter_format = NULL;
+  render.filter_fish   = NULL;
+  render.data          = data;
+  render.stride        = stride;
+  render.mask_data     = NULL;
+  render.mask_stride   = 0;
+
   /*  apply filters to the rendered projection  */
   if (shell->filter_stack)
     {
@@ -135,48 +188,13 @@ gimp_display_shell_render (GimpDisplayShell *shell,
                                               shell->filter_data);
         }
 
-      gegl_buffer_get (buffer,
-                       GEGL_RECTANGLE ((x + viewport_offset_x) * window_scale,
-                                       (y + viewport_offset_y) * window_scale,
-                                       w * window_scale,
-                                       h * window_scale),
-                       shell->scale_x * window_scale,
-                       filter_format, shell->filter_data,
-                       shell->filter_stride, GEGL_ABYSS_CLAMP);
-
-
-      gimp_color_display_stack_convert_buffer (shell->filter_stack,
-                                               shell->filter_buffer,
-                                               GEGL_RECTANGLE (0, 0,
-                                                               w * window_scale,
-                                                               h * window_scale));
-
-      gegl_buffer_get (shell->filter_buffer,
-                       GEGL_RECTANGLE (0, 0,
-                                       w * window_scale,
-                                       h * window_scale),
-                       1.0,
-                       babl_format ("cairo-ARGB32"),
-                       data, stride,
-                       GEGL_ABYSS_CLAMP);
-    }
-  else
-    {
-      gegl_buffer_get (buffer,
-                       GEGL_RECTANGLE ((x + viewport_offset_x) * window_scale,
-                                       (y + viewport_offset_y) * window_scale,
-                                       w * window_scale,
-                                       h * window_scale),
-                       shell->scale_x * window_scale,
-                       babl_format ("cairo-ARGB32"),
-                       data, stride,
-                       GEGL_ABYSS_CLAMP);
+      render.filter_format = filter_format;
+      render.filter_fish   = babl_fish (filter_format,
+                                        babl_format ("cairo-ARGB32"));
     }
 
   if (shell->mask)
     {
-      gint mask_height;
-
       if (! shell->mask_surface)
         {
           shell->mask_surface =
@@ -189,36 +207,40 @@ gimp_display_shell_render (GimpDisplayShell *shell,
 
       cairo_surface_mark_dirty (shell->mask_surface);
 
-      stride = cairo_image_surface_get_stride (shell->mask_surface);
-      data = cairo_image_surface_get_data (shell->mask_surface);
-      data += mask_src_y * stride + mask_src_x * 4;
-
-      gegl_buffer_get (shell->mask,
-                       GEGL_RECTANGLE ((x + viewport_offset_x) * window_scale,
-                                       (y + viewport_offset_y) * window_scale,
-                                       w * window_scale,
-                                       h * window_scale),
-                       shell->scale_x * window_scale,
-                       babl_format ("Y u8"),
-                       data, stride,
-                       GEGL_ABYSS_CLAMP);
+      render.mask_stride = cairo_image_surface_get_stride (shell->mask_surface);
+      render.mask_data   = cairo_image_surface_get_data (shell->mask_surface);
+      render.mask_data  += mask_src_y * render.mask_stride + mask_src_x;
+    }
 
-      /* invert the mask so what is *not* the foreground object is masked */
-      mask_height = h * window_scale;
-      while (mask_height--)
-        {
-          gint    mask_width = w * window_scale;
-          guchar *d          = data;
+  /*  validate the exposed part of the projection here, so the strip
+   *  workers only read pixels that are already rendered
+   */
+  gimp_display_shell_render_validate (buffer, &render.rect, render.scale);
 
-          while (mask_width--)
-            {
-              guchar inv = 255 - *d;
+  /*  projection and mask are rendered strip by strip on all threads;
+   *  the main loop is blocked meanwhile, so the projection graph
+   *  doesn't change
+   */
+  gimp_parallel_distribute_range (render.rect.height,
+                                  GIMP_DISPLAY_RENDER_MIN_ROWS,
+                                  gimp_display_shell_render_rows,
+                                  &render);
 
-              *d++ = inv;
-            }
+  if (shell->filter_stack)
+    {
+      /*  display filters are modules, which can't be expected to be
+       *  thread-safe, so they run here, in the main thread
+       */
+      gimp_color_display_stack_convert_buffer (shell->filter_stack,
+                                               shell->filter_buffer,
+                                               GEGL_RECTANGLE (0, 0,
+                                                               render.rect.width,
+                                                               render.rect.height));
 
-          data += stride;
-        }
+      gimp_parallel_distribute_range (render.rect.height,
+                                      GIMP_DISPLAY_RENDER_MIN_ROWS,
+                                      gimp_display_shell_render_cairo,
+                                      &render);
     }
 
   /*  put it to the screen  */
@@ -258,3 +280,155 @@ gimp_display_shell_render (GimpDisplayShell *shell,
 
   cairo_restore (cr);
 }
+
+
+/*  private functions  */
+
+/*  reads the tiles that gegl_buffer_get() of @rect at @scale will use,
+ *  from the same mipmap level, which makes the projection render any
+ *  of them that are invalid, in the calling thread
+ */
+static void
+gimp_display_shell_render_validate (GeglBuffer          *buffer,
+                                    const GeglRectangle *rect,
+                                    gdouble              scale)
+{
+  GeglBufferIterator  *iter;
+  const GeglRectangle *extent = gegl_buffer_get_extent (buffer);
+  GeglRectangle        level_extent;
+  GeglRectangle        area;
+  gint                 level  = 0;
+
+  /*  pick the level the way gegl_buffer_get() does  */
+  while (scale <= 0.5)
+    {
+      scale *= 2.0;
+      level++;
+    }
+
+  level_extent.x      = extent->x >> level;
+  level_extent.y      = extent->y >> level;
+  level_extent.width  = ((extent->x + extent->width  - 1) >> level) -
+                        level_extent.x + 1;
+  level_extent.height = ((extent->y + extent->height - 1) >> level) -
+                        level_extent.y + 1;
+
+  /*  with a pixel of margin for the resampling  */
+  area.x      = floor (rect->x / scale) - 1;
+  area.y      = floor (rect->y / scale) - 1;
+  area.width  = ceil ((rect->x + rect->width)  / scale) + 1 - area.x;
+  area.height = ceil ((rect->y + rect->height) / scale) + 1 - area.y;
+
+  if (! gegl_rectangle_intersect (&area, &area, &level_extent))
+    return;
+
+  iter = gegl_buffer_iterator_new (buffer, &area, level, NULL,
+                                   GEGL_ACCESS_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter));
+}
+
+static void
+gimp_display_shell_render_rows (gsize    offset,
+                                gsize    size,
+                                gpointer data)
+{
+  GimpDisplayShellRenderData *render = data;
+  GimpDisplayShell           *shell  = render->shell;
+  GeglRectangle               rect;
+
+  rect.x      = render->rect.x;
+  rect.y      = render->rect.y + offset;
+  rect.width  = render->rect.width;
+  rect.height = size;
+
+  if (render->filter_format)
+    {
+      /*  the display filters are applied afterwards, in the main thread  */
+      gegl_buffer_get (render->buffer, &rect, render->scale,
+                       render->filter_format,
+                       shell->filter_data + offset * shell->filter_stride,
+                       shell->filter_stride,
+                       GEGL_ABYSS_CLAMP);
+    }
+  else
+    {
+      gegl_buffer_get (render->buffer, &rect, render->scale,
+                       babl_format ("cairo-ARGB32"),
+                       render->data + offset * render->stride,
+                       render->stride,
+                       GEGL_ABYSS_CLAMP);
+    }
+
+  if (render->mask_data)
+    {
+      guchar *mask_data = render->mask_data + offset * render->mask_stride;
+
+      gegl_buffer_get (shell->mask, &rect, render->scale,
+                       babl_format ("Y u8"),
+                       mask_data, render->mask_stride,
+                       GEGL_ABYSS_CLAMP);
+
+      /* invert the mask so what is *not* the foreground object is masked */
+      gimp_display_shell_render_invert (mask_data, render->mask_stride,
+                                        rect.width, rect.height);
+    }
+}
+
+/*  converts the filtered strip to cairo's format  */
+static void
+gimp_display_shell_render_cairo (gsize    offset,
+                                 gsize    size,
+                                 gpointer data)
+{
+  GimpDisplayShellRenderData *render = data;
+  GimpDisplayShell           *shell  = render->shell;
+  guchar                     *src;
+  guchar                     *dest;
+  gsize                       row;
+
+  src  = shell->filter_data + offset * shell->filter_stride;
+  dest = render->data       + offset * render->stride;
+
+  for (row = 0; row < size; row++)
+    {
+      babl_process (render->filter_fish, src, dest, render->rect.width);
+
+      src  += shell->filter_stride;
+      dest += render->stride;
+    }
+}
+
+/*  255 - v is v ^ 0xff for bytes, so invert a machine word at a time
+ *  and only do the tail of each row bytewise; the words go through
+ *  memcpy() to stay within the aliasing rules
+ */
+static void
+gimp_display_shell_render_invert (guchar *data,
+                                  gint    stride,
+                                  gint    width,
+                                  gint    height)
+{
+  while (height--)
+    {
+      guchar *d = data;
+      gint    n = width;
+
+      while (n >= (gint) sizeof (gulong))
+        {
+          gulong word;
+
+          memcpy (&word, d, sizeof (gulong));
+          word ^= ~0UL;
+          memcpy (d, &word, sizeof (gulong));
+
+          d += sizeof (gulong);
+          n -= sizeof (gulong);
+        }
+
+      while (n--)
+        *d++ ^= 0xff;
+
+      data += stride;
+    }
+}
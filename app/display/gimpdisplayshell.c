@@ -170,6 +170,8 @@ static void   gimp_display_shell_transform_overlay (GimpDisplayShell *shell,
                                                     GtkWidget        *child,
                                                     gdouble          *x,
                                                     gdouble          *y);
+static void   gimp_display_shell_update_priority_rect
+                                                   (GimpDisplayShell *shell);
 
 
 G_DEFINE_TYPE_WITH_CODE (GimpDisplayShell, gimp_display_shell,
@@ -1170,6 +1172,28 @@ gimp_display_shell_transform_overlay (GimpDisplayShell *shell,
     }
 }
 
+static void
+gimp_display_shell_update_priority_rect (GimpDisplayShell *shell)
+{
+  GimpImage *image;
+
+  if (! shell->display)
+    return;
+
+  image = gimp_display_get_image (shell->display);
+
+  if (image)
+    {
+      gint x, y;
+      gint width, height;
+
+      gimp_display_shell_untransform_viewport (shell, &x, &y, &width, &height);
+
+      gimp_projection_set_priority_rect (gimp_image_get_projection (image),
+                                         x, y, width, height);
+    }
+}
+
 
 /*  public functions  */
 
@@ -1494,6 +1518,8 @@ gimp_display_shell_scaled (GimpDisplayShell *shell)
                                            child, x, y);
     }
 
+  gimp_display_shell_update_priority_rect (shell);
+
   g_signal_emit (shell, display_shell_signals[SCALED], 0);
 }
 
@@ -1517,6 +1543,8 @@ gimp_display_shell_scrolled (GimpDisplayShell *shell)
                                            child, x, y);
     }
 
+  gimp_display_shell_update_priority_rect (shell);
+
   g_signal_emit (shell, display_shell_signals[SCROLLED], 0);
 }
 
@@ -51,6 +51,12 @@ static gpointer gimp_tile_handler_projection_command      (GeglTileSource  *sour
                                                            gint             z,
                                                            gpointer         data);
 
+static void     gimp_tile_handler_projection_void_pyramid (GimpTileHandlerProjection *projection,
+                                                           gint                       x,
+                                                           gint                       y,
+                                                           gint                       width,
+                                                           gint                       height);
+
 
 G_DEFINE_TYPE (GimpTileHandlerProjection, gimp_tile_handler_projection,
                GEGL_TYPE_TILE_HANDLER)
@@ -88,16 +94,24 @@ static void
 gimp_tile_handler_projection_init (GimpTileHandlerProjection *projection)
 {
   GeglTileSource *source = GEGL_TILE_SOURCE (projection);
+  gint            i;
 
   source->command = gimp_tile_handler_projection_command;
 
   projection->dirty_region = cairo_region_create ();
+
+  for (i = 0; i < GIMP_TILE_HANDLER_PROJECTION_MAX_LEVELS; i++)
+    projection->level_regions[i] = cairo_region_create ();
+
+  g_mutex_init (&projection->dirty_mutex);
+  g_mutex_init (&projection->graph_mutex);
 }
 
 static void
 gimp_tile_handler_projection_finalize (GObject *object)
 {
   GimpTileHandlerProjection *projection = GIMP_TILE_HANDLER_PROJECTION (object);
+  gint                       i;
 
   if (projection->graph)
     {
@@ -108,6 +122,15 @@ gimp_tile_handler_projection_finalize (GObject *object)
   cairo_region_destroy (projection->dirty_region);
   projection->dirty_region = NULL;
 
+  for (i = 0; i < GIMP_TILE_HANDLER_PROJECTION_MAX_LEVELS; i++)
+    {
+      cairo_region_destroy (projection->level_regions[i]);
+      projection->level_regions[i] = NULL;
+    }
+
+  g_mutex_clear (&projection->dirty_mutex);
+  g_mutex_clear (&projection->graph_mutex);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -175,8 +198,14 @@ gimp_tile_handler_projection_validate (GeglTileSource *source,
 
   projection = GIMP_TILE_HANDLER_PROJECTION (source);
 
+  g_mutex_lock (&projection->dirty_mutex);
+
   if (cairo_region_is_empty (projection->dirty_region))
-    return tile;
+    {
+      g_mutex_unlock (&projection->dirty_mutex);
+
+      return tile;
+    }
 
   tile_region = cairo_region_copy (projection->dirty_region);
 
@@ -187,6 +216,11 @@ gimp_tile_handler_projection_validate (GeglTileSource *source,
 
   cairo_region_intersect_rectangle (tile_region, &tile_rect);
 
+  if (! cairo_region_is_empty (tile_region))
+    cairo_region_subtract_rectangle (projection->dirty_region, &tile_rect);
+
+  g_mutex_unlock (&projection->dirty_mutex);
+
   if (! cairo_region_is_empty (tile_region))
     {
       gint tile_bpp;
@@ -198,12 +232,11 @@ gimp_tile_handler_projection_validate (GeglTileSource *source,
         tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (source),
                                               x, y, 0);
 
-      cairo_region_subtract_rectangle (projection->dirty_region, &tile_rect);
-
       tile_bpp    = babl_format_get_bytes_per_pixel (projection->format);
       tile_stride = tile_bpp * projection->tile_width;
 
       gegl_tile_lock (tile);
+      g_mutex_lock (&projection->graph_mutex);
 
       n_rects = cairo_region_num_rectangles (tile_region);
 
@@ -238,6 +271,127 @@ gimp_tile_handler_projection_validate (GeglTileSource *source,
                           GEGL_BLIT_DEFAULT);
         }
 
+      g_mutex_unlock (&projection->graph_mutex);
+      gegl_tile_unlock (tile);
+    }
+
+  cairo_region_destroy (tile_region);
+
+  return tile;
+}
+
+/*  Validates a tile of the mipmap pyramid.  If all of the full size
+ *  projection below the tile is valid, GEGL can derive it from the
+ *  lower levels as usual; otherwise the tile is rendered directly at
+ *  its level, instead of constructing the entire area of the full size
+ *  projection first just to scale it down.
+ */
+static GeglTile *
+gimp_tile_handler_projection_validate_level (GeglTileSource *source,
+                                             gint            x,
+                                             gint            y,
+                                             gint            z)
+{
+  GimpTileHandlerProjection *projection;
+  cairo_region_t            *level_region;
+  cairo_region_t            *tile_region;
+  cairo_rectangle_int_t      tile_rect;
+  cairo_rectangle_int_t      full_rect;
+  gboolean                   derive;
+  GeglTile                  *tile;
+
+  projection = GIMP_TILE_HANDLER_PROJECTION (source);
+
+  tile_rect.x      = x * projection->tile_width;
+  tile_rect.y      = y * projection->tile_height;
+  tile_rect.width  = projection->tile_width;
+  tile_rect.height = projection->tile_height;
+
+  g_mutex_lock (&projection->dirty_mutex);
+
+  level_region = projection->level_regions[z - 1];
+
+  if (cairo_region_contains_rectangle (level_region, &tile_rect) ==
+      CAIRO_REGION_OVERLAP_OUT)
+    {
+      g_mutex_unlock (&projection->dirty_mutex);
+
+      return gegl_tile_handler_source_command (source, GEGL_TILE_GET,
+                                               x, y, z, NULL);
+    }
+
+  tile_region = cairo_region_copy (level_region);
+  cairo_region_intersect_rectangle (tile_region, &tile_rect);
+  cairo_region_subtract_rectangle (level_region, &tile_rect);
+
+  full_rect.x      = tile_rect.x      << z;
+  full_rect.y      = tile_rect.y      << z;
+  full_rect.width  = tile_rect.width  << z;
+  full_rect.height = tile_rect.height << z;
+
+  derive = (cairo_region_contains_rectangle (projection->dirty_region,
+                                             &full_rect) ==
+            CAIRO_REGION_OVERLAP_OUT);
+
+  g_mutex_unlock (&projection->dirty_mutex);
+
+  if (derive)
+    {
+      cairo_region_destroy (tile_region);
+
+      return gegl_tile_handler_source_command (source, GEGL_TILE_GET,
+                                               x, y, z, NULL);
+    }
+
+  if (GPOINTER_TO_INT (gegl_tile_handler_source_command (source,
+                                                         GEGL_TILE_EXIST,
+                                                         x, y, z, NULL)))
+    {
+      tile = gegl_tile_handler_source_command (source, GEGL_TILE_GET,
+                                               x, y, z, NULL);
+    }
+  else
+    {
+      /*  the tile was voided as a whole, render all of it  */
+      cairo_region_union_rectangle (tile_region, &tile_rect);
+
+      tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (source),
+                                            x, y, z);
+    }
+
+  if (tile)
+    {
+      gdouble scale       = 1.0 / (1 << z);
+      gint    tile_bpp    = babl_format_get_bytes_per_pixel (projection->format);
+      gint    tile_stride = tile_bpp * projection->tile_width;
+      gint    n_rects;
+      gint    i;
+
+      gegl_tile_lock (tile);
+      g_mutex_lock (&projection->graph_mutex);
+
+      n_rects = cairo_region_num_rectangles (tile_region);
+
+      for (i = 0; i < n_rects; i++)
+        {
+          cairo_rectangle_int_t blit_rect;
+
+          cairo_region_get_rectangle (tile_region, i, &blit_rect);
+
+          gegl_node_blit (projection->graph, scale,
+                          GEGL_RECTANGLE (blit_rect.x,
+                                          blit_rect.y,
+                                          blit_rect.width,
+                                          blit_rect.height),
+                          projection->format,
+                          gegl_tile_get_data (tile) +
+                          (blit_rect.y - tile_rect.y) * tile_stride +
+                          (blit_rect.x - tile_rect.x) * tile_bpp,
+                          tile_stride,
+                          GEGL_BLIT_DEFAULT);
+        }
+
+      g_mutex_unlock (&projection->graph_mutex);
       gegl_tile_unlock (tile);
     }
 
@@ -261,6 +415,10 @@ gimp_tile_handler_projection_command (GeglTileSource  *source,
 
   projection->max_z = MAX (projection->max_z, z);
 
+  if (command == GEGL_TILE_GET &&
+      z > 0 && z <= GIMP_TILE_HANDLER_PROJECTION_MAX_LEVELS)
+    return gimp_tile_handler_projection_validate_level (source, x, y, z);
+
   retval = gegl_tile_handler_source_command (source, command, x, y, z, data);
 
   if (command == GEGL_TILE_GET && z == 0)
@@ -311,11 +469,40 @@ gimp_tile_handler_projection_invalidate (GimpTileHandlerProjection *projection,
                                          gint                       height)
 {
   cairo_rectangle_int_t rect = { x, y, width, height };
+  gint                  z;
 
   g_return_if_fail (GIMP_IS_TILE_HANDLER_PROJECTION (projection));
 
+  g_mutex_lock (&projection->dirty_mutex);
+
   cairo_region_union_rectangle (projection->dirty_region, &rect);
 
+  for (z = 1; z <= GIMP_TILE_HANDLER_PROJECTION_MAX_LEVELS; z++)
+    {
+      cairo_rectangle_int_t level_rect;
+
+      level_rect.x      = x >> z;
+      level_rect.y      = y >> z;
+      level_rect.width  = ((x + width  + (1 << z) - 1) >> z) - level_rect.x;
+      level_rect.height = ((y + height + (1 << z) - 1) >> z) - level_rect.y;
+
+      cairo_region_union_rectangle (projection->level_regions[z - 1],
+                                    &level_rect);
+    }
+
+  g_mutex_unlock (&projection->dirty_mutex);
+
+  gimp_tile_handler_projection_void_pyramid (projection,
+                                             x, y, width, height);
+}
+
+static void
+gimp_tile_handler_projection_void_pyramid (GimpTileHandlerProjection *projection,
+                                           gint                       x,
+                                           gint                       y,
+                                           gint                       width,
+                                           gint                       height)
+{
   if (projection->max_z > 0)
     {
       GeglTileSource *source = GEGL_TILE_SOURCE (projection);
@@ -352,5 +539,31 @@ gimp_tile_handler_projection_undo_invalidate (GimpTileHandlerProjection *project
 
   g_return_if_fail (GIMP_IS_TILE_HANDLER_PROJECTION (projection));
 
+  g_mutex_lock (&projection->dirty_mutex);
   cairo_region_subtract_rectangle (projection->dirty_region, &rect);
+  g_mutex_unlock (&projection->dirty_mutex);
+}
+
+/*  Renders @rect of the graph into @data, in the projection's format.
+ *  Only one thread at a time processes the graph, here or while
+ *  validating tiles, but the caller can store the result from any
+ *  thread.
+ */
+void
+gimp_tile_handler_projection_render (GimpTileHandlerProjection *projection,
+                                     const GeglRectangle       *rect,
+                                     gpointer                   data,
+                                     gint                       rowstride)
+{
+  g_return_if_fail (GIMP_IS_TILE_HANDLER_PROJECTION (projection));
+  g_return_if_fail (rect != NULL);
+  g_return_if_fail (data != NULL);
+
+  g_mutex_lock (&projection->graph_mutex);
+
+  gegl_node_blit (projection->graph, 1.0, rect,
+                  projection->format, data, rowstride,
+                  GEGL_BLIT_DEFAULT);
+
+  g_mutex_unlock (&projection->graph_mutex);
 }
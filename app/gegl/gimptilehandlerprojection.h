@@ -35,6 +35,12 @@ G_BEGIN_DECLS
 #define GIMP_TILE_HANDLER_PROJECTION_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_TILE_HANDLER_PROJECTION, GimpTileHandlerProjectionClass))
 
 
+/*  number of mipmap levels above the full size projection that are
+ *  validated separately, deeper levels are always derived by GEGL
+ */
+#define GIMP_TILE_HANDLER_PROJECTION_MAX_LEVELS 12
+
+
 typedef struct _GimpTileHandlerProjection      GimpTileHandlerProjection;
 typedef struct _GimpTileHandlerProjectionClass GimpTileHandlerProjectionClass;
 
@@ -44,6 +50,11 @@ struct _GimpTileHandlerProjection
 
   GeglNode        *graph;
   cairo_region_t  *dirty_region;
+  cairo_region_t  *level_regions[GIMP_TILE_HANDLER_PROJECTION_MAX_LEVELS];
+  GMutex           dirty_mutex;  /*  projection chunks render in threads  */
+  GMutex           graph_mutex;  /*  GEGL graphs can't be processed
+                                  *  by several threads at once
+                                  */
   const Babl      *format;
   gint             tile_width;
   gint             tile_height;
@@ -75,6 +86,10 @@ void         gimp_tile_handler_projection_undo_invalidate (GimpTileHandlerProjec
                                                            gint                       y,
                                                            gint                       width,
                                                            gint                       height);
+void              gimp_tile_handler_projection_render     (GimpTileHandlerProjection *projection,
+                                                           const GeglRectangle       *rect,
+                                                           gpointer                   data,
+                                                           gint                       rowstride);
 
 
 G_END_DECLS
@@ -29,6 +29,10 @@
 #include "gimp-debug.h"
 
 
+/*  data factories create objects on all threads, see
+ *  gimp_data_factory_data_load()
+ */
+static GMutex      class_hash_mutex;
 static GHashTable *class_hash = NULL;
 
 
@@ -54,6 +58,8 @@ gimp_debug_add_instance (GObject      *instance,
 
       type_name = g_type_name (G_TYPE_FROM_CLASS (klass));
 
+      g_mutex_lock (&class_hash_mutex);
+
       instance_hash = g_hash_table_lookup (class_hash, type_name);
 
       if (! instance_hash)
@@ -64,6 +70,8 @@ gimp_debug_add_instance (GObject      *instance,
         }
 
       g_hash_table_insert (instance_hash, instance, instance);
+
+      g_mutex_unlock (&class_hash_mutex);
     }
 }
 
@@ -77,6 +85,8 @@ gimp_debug_remove_instance (GObject *instance)
 
       type_name = g_type_name (G_OBJECT_TYPE (instance));
 
+      g_mutex_lock (&class_hash_mutex);
+
       instance_hash = g_hash_table_lookup (class_hash, type_name);
 
       if (instance_hash)
@@ -86,6 +96,8 @@ gimp_debug_remove_instance (GObject *instance)
           if (g_hash_table_size (instance_hash) == 0)
             g_hash_table_remove (class_hash, type_name);
         }
+
+      g_mutex_unlock (&class_hash_mutex);
     }
 }
 
@@ -115,8 +127,12 @@ gimp_debug_instances (void)
 {
   if (class_hash)
     {
+      g_mutex_lock (&class_hash_mutex);
+
       g_hash_table_foreach (class_hash,
                             (GHFunc) gimp_debug_class_foreach,
                             NULL);
+
+      g_mutex_unlock (&class_hash_mutex);
     }
 }
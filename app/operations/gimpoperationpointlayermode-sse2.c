@@ -0,0 +1,326 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpoperationpointlayermode-sse2.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl-plugin.h>
+
+#include "operations-types.h"
+
+#include "gimpoperationadditionmode.h"
+#include "gimpoperationburnmode.h"
+#include "gimpoperationdarkenonlymode.h"
+#include "gimpoperationdifferencemode.h"
+#include "gimpoperationdividemode.h"
+#include "gimpoperationdodgemode.h"
+#include "gimpoperationgrainextractmode.h"
+#include "gimpoperationgrainmergemode.h"
+#include "gimpoperationhardlightmode.h"
+#include "gimpoperationlightenonlymode.h"
+#include "gimpoperationmultiplymode.h"
+#include "gimpoperationoverlaymode.h"
+#include "gimpoperationscreenmode.h"
+#include "gimpoperationsoftlightmode.h"
+#include "gimpoperationsubtractmode.h"
+
+#if COMPILE_SSE2_INTRINISICS
+/* SSE2 */
+#include <emmintrin.h>
+
+
+/*  All of these modes composite the same way and only differ in how a
+ *  color component of the layer is combined with the one below it, so
+ *  the loop is shared and the per-mode part is an inline blend function
+ *  working on a whole pixel.  The blend functions follow the scalar
+ *  code operation by operation, including how MIN(), MAX() and CLAMP()
+ *  treat NaNs, but compute in single precision.
+ */
+
+typedef __v4sf (* BlendFunc) (__v4sf in,
+                              __v4sf layer);
+
+
+static inline __v4sf
+clamp_ps (__v4sf x,
+          __v4sf low,
+          __v4sf high)
+{
+  /*  CLAMP (x, low, high)  */
+  __v4sf above = _mm_cmpgt_ps (x, high);
+  __v4sf below = _mm_cmplt_ps (x, low);
+
+  x = _mm_or_ps (_mm_and_ps (below, low), _mm_andnot_ps (below, x));
+
+  return _mm_or_ps (_mm_and_ps (above, high), _mm_andnot_ps (above, x));
+}
+
+static inline __v4sf
+min_ps (__v4sf a,
+        __v4sf b)
+{
+  /*  MIN (a, b), which is b unless a < b, like _mm_min_ps()  */
+  return _mm_min_ps (a, b);
+}
+
+static inline __v4sf
+max_ps (__v4sf a,
+        __v4sf b)
+{
+  /*  MAX (a, b), which is b unless a > b, like _mm_max_ps()  */
+  return _mm_max_ps (a, b);
+}
+
+static inline gboolean __attribute__((always_inline))
+process_separable (gfloat    *in,
+                   gfloat    *layer,
+                   gfloat    *mask,
+                   gfloat    *out,
+                   gfloat     opacity,
+                   glong      samples,
+                   BlendFunc  blend)
+{
+  const __v4sf *v_in      = (const __v4sf *) in;
+  const __v4sf *v_layer   = (const __v4sf *) layer;
+        __v4sf *v_out     = (      __v4sf *) out;
+  const __v4sf  one       = _mm_set1_ps (1.0f);
+  const __v4sf  v_opacity = _mm_set1_ps (opacity);
+  const __v4sf  alpha_sel = (__v4sf) _mm_set_epi32 (-1, 0, 0, 0);
+
+  while (samples--)
+    {
+      __v4sf rgba_in    = *v_in++;
+      __v4sf rgba_layer = *v_layer++;
+      __v4sf in_alpha, comp_alpha, new_alpha;
+
+      /* expand alpha */
+      in_alpha   = (__v4sf) _mm_shuffle_epi32 ((__m128i) rgba_in,
+                                               _MM_SHUFFLE (3, 3, 3, 3));
+      comp_alpha = (__v4sf) _mm_shuffle_epi32 ((__m128i) rgba_layer,
+                                               _MM_SHUFFLE (3, 3, 3, 3));
+
+      comp_alpha = min_ps (in_alpha, comp_alpha) * v_opacity;
+
+      if (mask)
+        comp_alpha = comp_alpha * _mm_set1_ps (*mask++);
+
+      new_alpha = in_alpha + (one - in_alpha) * comp_alpha;
+
+      if (_mm_cvtss_f32 (comp_alpha) && _mm_cvtss_f32 (new_alpha))
+        {
+          __v4sf ratio = comp_alpha / new_alpha;
+          __v4sf comp  = blend (rgba_in, rgba_layer);
+          __v4sf out_pixel;
+
+          out_pixel = comp * ratio + rgba_in * (one - ratio);
+
+          /* keep the alpha of the input */
+          *v_out++ = _mm_or_ps (_mm_and_ps    (alpha_sel, rgba_in),
+                                _mm_andnot_ps (alpha_sel, out_pixel));
+        }
+      else
+        {
+          *v_out++ = rgba_in;
+        }
+    }
+
+  return TRUE;
+}
+
+#define ALIGNED(in, layer, out) \
+  (! ((((uintptr_t) (in)) | ((uintptr_t) (layer)) | ((uintptr_t) (out))) & 0x0F))
+
+#define DEFINE_SEPARABLE_MODE(name, blend_func)                               \
+gboolean                                                                      \
+gimp_operation_##name##_mode_process_pixels_sse2 (gfloat              *in,    \
+                                                  gfloat              *layer, \
+                                                  gfloat              *mask,  \
+                                                  gfloat              *out,   \
+                                                  gfloat               opacity, \
+                                                  glong                samples, \
+                                                  const GeglRectangle *roi,   \
+                                                  gint                 level) \
+{                                                                             \
+  if (! ALIGNED (in, layer, out))                                             \
+    return gimp_operation_##name##_mode_process_pixels_core (in, layer, mask, \
+                                                             out, opacity,    \
+                                                             samples,         \
+                                                             roi, level);     \
+                                                                              \
+  return process_separable (in, layer, mask, out, opacity, samples,           \
+                            blend_func);                                      \
+}
+
+
+static inline __v4sf
+blend_multiply (__v4sf in,
+                __v4sf layer)
+{
+  return clamp_ps (layer * in, _mm_setzero_ps (), _mm_set1_ps (1.0f));
+}
+
+static inline __v4sf
+blend_screen (__v4sf in,
+              __v4sf layer)
+{
+  const __v4sf one = _mm_set1_ps (1.0f);
+
+  return one - (one - in) * (one - layer);
+}
+
+static inline __v4sf
+blend_overlay (__v4sf in,
+               __v4sf layer)
+{
+  const __v4sf one = _mm_set1_ps (1.0f);
+  const __v4sf two = _mm_set1_ps (2.0f);
+
+  return in * (in + (two * layer) * (one - in));
+}
+
+static inline __v4sf
+blend_difference (__v4sf in,
+                  __v4sf layer)
+{
+  const __v4sf sign = (__v4sf) _mm_set1_epi32 (0x80000000);
+
+  return _mm_andnot_ps (sign, in - layer);
+}
+
+static inline __v4sf
+blend_addition (__v4sf in,
+                __v4sf layer)
+{
+  return clamp_ps (in + layer, _mm_setzero_ps (), _mm_set1_ps (1.0f));
+}
+
+static inline __v4sf
+blend_subtract (__v4sf in,
+                __v4sf layer)
+{
+  __v4sf comp = in - layer;
+
+  /*  (comp < 0) ? 0 : comp  */
+  return _mm_andnot_ps (_mm_cmplt_ps (comp, _mm_setzero_ps ()), comp);
+}
+
+static inline __v4sf
+blend_darken_only (__v4sf in,
+                   __v4sf layer)
+{
+  return min_ps (in, layer);
+}
+
+static inline __v4sf
+blend_lighten_only (__v4sf in,
+                    __v4sf layer)
+{
+  return max_ps (layer, in);
+}
+
+static inline __v4sf
+blend_divide (__v4sf in,
+              __v4sf layer)
+{
+  __v4sf comp = ((_mm_set1_ps (256.0f / 255.0f) * in) /
+                 (_mm_set1_ps (1.0f / 255.0f) + layer));
+
+  return min_ps (comp, _mm_set1_ps (1.0f));
+}
+
+static inline __v4sf
+blend_dodge (__v4sf in,
+             __v4sf layer)
+{
+  const __v4sf one = _mm_set1_ps (1.0f);
+
+  return min_ps (in / (one - layer), one);
+}
+
+static inline __v4sf
+blend_burn (__v4sf in,
+            __v4sf layer)
+{
+  const __v4sf one = _mm_set1_ps (1.0f);
+
+  return clamp_ps (one - (one - in) / layer, _mm_setzero_ps (), one);
+}
+
+static inline __v4sf
+blend_hardlight (__v4sf in,
+                 __v4sf layer)
+{
+  const __v4sf one  = _mm_set1_ps (1.0f);
+  const __v4sf two  = _mm_set1_ps (2.0f);
+  const __v4sf half = _mm_set1_ps (0.5f);
+  __v4sf       light, dark, sel;
+
+  light = min_ps (one - (one - in) * (one - (layer - half) * two), one);
+  dark  = min_ps (in * (layer * two), one);
+
+  /*  layer > 0.5 ? light : dark  */
+  sel = _mm_cmpgt_ps (layer, half);
+
+  return _mm_or_ps (_mm_and_ps (sel, light), _mm_andnot_ps (sel, dark));
+}
+
+static inline __v4sf
+blend_softlight (__v4sf in,
+                 __v4sf layer)
+{
+  const __v4sf one      = _mm_set1_ps (1.0f);
+  __v4sf       multiply = in * layer;
+  __v4sf       screen   = one - (one - in) * (one - layer);
+
+  return (one - in) * multiply + in * screen;
+}
+
+static inline __v4sf
+blend_grain_extract (__v4sf in,
+                     __v4sf layer)
+{
+  return clamp_ps (in - layer + _mm_set1_ps (0.5f),
+                   _mm_setzero_ps (), _mm_set1_ps (1.0f));
+}
+
+static inline __v4sf
+blend_grain_merge (__v4sf in,
+                   __v4sf layer)
+{
+  return clamp_ps (in + layer - _mm_set1_ps (0.5f),
+                   _mm_setzero_ps (), _mm_set1_ps (1.0f));
+}
+
+
+DEFINE_SEPARABLE_MODE (multiply,      blend_multiply)
+DEFINE_SEPARABLE_MODE (screen,        blend_screen)
+DEFINE_SEPARABLE_MODE (overlay,       blend_overlay)
+DEFINE_SEPARABLE_MODE (difference,    blend_difference)
+DEFINE_SEPARABLE_MODE (addition,      blend_addition)
+DEFINE_SEPARABLE_MODE (subtract,      blend_subtract)
+DEFINE_SEPARABLE_MODE (darken_only,   blend_darken_only)
+DEFINE_SEPARABLE_MODE (lighten_only,  blend_lighten_only)
+DEFINE_SEPARABLE_MODE (divide,        blend_divide)
+DEFINE_SEPARABLE_MODE (dodge,         blend_dodge)
+DEFINE_SEPARABLE_MODE (burn,          blend_burn)
+DEFINE_SEPARABLE_MODE (hardlight,     blend_hardlight)
+DEFINE_SEPARABLE_MODE (softlight,     blend_softlight)
+DEFINE_SEPARABLE_MODE (grain_extract, blend_grain_extract)
+DEFINE_SEPARABLE_MODE (grain_merge,   blend_grain_merge)
+
+#endif /* COMPILE_SSE2_INTRINISICS */
@@ -0,0 +1,197 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <math.h>
+
+#include <gio/gio.h>
+#include <gegl.h>
+#include <gegl-plugin.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "operations/operations-types.h"
+
+#include "operations/gimpoperationadditionmode.h"
+#include "operations/gimpoperationburnmode.h"
+#include "operations/gimpoperationdarkenonlymode.h"
+#include "operations/gimpoperationdifferencemode.h"
+#include "operations/gimpoperationdividemode.h"
+#include "operations/gimpoperationdodgemode.h"
+#include "operations/gimpoperationgrainextractmode.h"
+#include "operations/gimpoperationgrainmergemode.h"
+#include "operations/gimpoperationhardlightmode.h"
+#include "operations/gimpoperationlightenonlymode.h"
+#include "operations/gimpoperationmultiplymode.h"
+#include "operations/gimpoperationoverlaymode.h"
+#include "operations/gimpoperationscreenmode.h"
+#include "operations/gimpoperationsoftlightmode.h"
+#include "operations/gimpoperationsubtractmode.h"
+
+
+/*  the SIMD code follows the generic code operation by operation, but
+ *  computes in single precision where the generic code uses doubles.
+ *  Results may differ by EPSILON near zero, which is still below what
+ *  a 16 bit integer image can represent, and by EPSILON relative to
+ *  their size for the large values divide and dodge produce.
+ */
+#define EPSILON 1e-5
+
+#define N_PIXELS 4096
+
+
+typedef struct
+{
+  const gchar           *name;
+  GimpLayerModeFunction  core;
+  GimpLayerModeFunction  simd;
+} LayerMode;
+
+
+#define MODE(name) \
+  { #name, \
+    gimp_operation_##name##_mode_process_pixels_core, \
+    gimp_operation_##name##_mode_process_pixels_sse2 }
+
+#if COMPILE_SSE2_INTRINISICS
+static const LayerMode sse2_modes[] =
+{
+  MODE (multiply),
+  MODE (screen),
+  MODE (overlay),
+  MODE (difference),
+  MODE (addition),
+  MODE (subtract),
+  MODE (darken_only),
+  MODE (lighten_only),
+  MODE (divide),
+  MODE (dodge),
+  MODE (burn),
+  MODE (hardlight),
+  MODE (softlight),
+  MODE (grain_extract),
+  MODE (grain_merge)
+};
+#endif
+
+
+/*  Fills @pixels with random colors, mixed with the values the modes
+ *  special-case: 0.0, 0.5 and 1.0 in any component
+ */
+static void
+fill_pixels (GRand  *rand,
+             gfloat *pixels,
+             gint    n_floats)
+{
+  static const gfloat special[] = { 0.0, 0.5, 1.0 };
+  gint                i;
+
+  for (i = 0; i < n_floats; i++)
+    {
+      if (g_rand_int_range (rand, 0, 8) == 0)
+        pixels[i] = special[g_rand_int_range (rand, 0, G_N_ELEMENTS (special))];
+      else
+        pixels[i] = g_rand_double (rand);
+    }
+}
+
+static void
+compare_mode (gconstpointer data)
+{
+  const LayerMode *mode = data;
+  GRand           *rand = g_rand_new_with_seed (1234);
+  gfloat          *in;
+  gfloat          *layer;
+  gfloat          *mask;
+  gfloat          *core_out;
+  gfloat          *simd_out;
+  gint             use_mask;
+
+  /*  gegl_malloc() aligns to 16 bytes, the SIMD path falls back to
+   *  the generic code for anything less
+   */
+  in       = gegl_malloc (N_PIXELS * 4 * sizeof (gfloat));
+  layer    = gegl_malloc (N_PIXELS * 4 * sizeof (gfloat));
+  mask     = gegl_malloc (N_PIXELS * sizeof (gfloat));
+  core_out = gegl_malloc (N_PIXELS * 4 * sizeof (gfloat));
+  simd_out = gegl_malloc (N_PIXELS * 4 * sizeof (gfloat));
+
+  fill_pixels (rand, in,    N_PIXELS * 4);
+  fill_pixels (rand, layer, N_PIXELS * 4);
+  fill_pixels (rand, mask,  N_PIXELS);
+
+  for (use_mask = 0; use_mask < 2; use_mask++)
+    {
+      const GeglRectangle roi = { 0, 0, N_PIXELS, 1 };
+      gint                i;
+
+      mode->core (in, layer, use_mask ? mask : NULL, core_out,
+                  0.75, N_PIXELS, &roi, 0);
+      mode->simd (in, layer, use_mask ? mask : NULL, simd_out,
+                  0.75, N_PIXELS, &roi, 0);
+
+      for (i = 0; i < N_PIXELS * 4; i++)
+        {
+          gfloat a = core_out[i];
+          gfloat b = simd_out[i];
+
+          if (isnan (a) && isnan (b))
+            continue;
+
+          if (! (fabs (a - b) <= EPSILON * MAX (1.0, MAX (fabs (a),
+                                                          fabs (b)))))
+            g_error ("%s mode%s differs at pixel %d, component %d: "
+                     "in %g layer %g core %g simd %g",
+                     mode->name, use_mask ? " (masked)" : "",
+                     i / 4, i % 4, in[i], layer[i], a, b);
+        }
+    }
+
+  gegl_free (simd_out);
+  gegl_free (core_out);
+  gegl_free (mask);
+  gegl_free (layer);
+  gegl_free (in);
+  g_rand_free (rand);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+#if COMPILE_SSE2_INTRINISICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2)
+    {
+      gint i;
+
+      for (i = 0; i < G_N_ELEMENTS (sse2_modes); i++)
+        {
+          gchar *path = g_strdup_printf ("/layer-modes/sse2/%s",
+                                         sse2_modes[i].name);
+
+          g_test_add_data_func (path, &sse2_modes[i], compare_mode);
+
+          g_free (path);
+        }
+    }
+#endif
+
+  return g_test_run ();
+}
@@ -114,6 +114,10 @@ static const GimpTempBuf *
                  gimp_brush_core_transform_pixmap   (GimpBrushCore     *core,
                                                      GimpBrush         *brush);
 
+static void      gimp_brush_core_quantize_transform (GimpBrushCore     *core);
+static gdouble   gimp_brush_core_quantize           (gdouble            value,
+                                                     gdouble            max_step);
+
 static void      gimp_brush_core_invalidate_cache   (GimpBrush         *brush,
                                                      GimpBrushCore     *core);
 
@@ -327,8 +331,8 @@ gimp_brush_core_pre_paint (GimpPaintCore    *paint_core,
                                                         paint_core->pixel_dist);
 
               scale = paint_options->brush_size /
-                      MAX (gimp_temp_buf_get_width  (core->main_brush->mask),
-                           gimp_temp_buf_get_height (core->main_brush->mask)) *
+                      MAX (gimp_temp_buf_get_width  (gimp_brush_get_mask (core->main_brush)),
+                           gimp_temp_buf_get_height (gimp_brush_get_mask (core->main_brush))) *
                       gimp_dynamics_get_linear_value (core->dynamics,
                                                       GIMP_DYNAMICS_OUTPUT_SIZE,
                                                       &current_coords,
@@ -1011,6 +1015,57 @@ gimp_brush_core_replace_canvas (GimpBrushCore            *core,
 }
 
 
+/*  Dynamics produce a slightly different transform for almost every
+ *  dab, snap it to a grid that is fine enough for the dab's outline to
+ *  move by no more than half a pixel, so the brush's transform caches
+ *  actually get hits during a stroke.
+ */
+static void
+gimp_brush_core_quantize_transform (GimpBrushCore *core)
+{
+  gdouble size;
+  gdouble dab_size;
+
+  if (! core->main_brush || core->scale <= 0.0)
+    return;
+
+  size = MAX (gimp_temp_buf_get_width  (gimp_brush_get_mask (core->main_brush)),
+              gimp_temp_buf_get_height (gimp_brush_get_mask (core->main_brush)));
+
+  core->scale = MAX (gimp_brush_core_quantize (core->scale, 0.5 / size),
+                     0.5 / size);
+
+  dab_size = MAX (core->scale * size, 1.0);
+
+  /*  the angle is in turns, and the aspect ratio shrinks one side by
+   *  1/20 of the dab size per unit
+   */
+  core->angle        = gimp_brush_core_quantize (core->angle,
+                                                 0.5 / (G_PI * dab_size));
+  core->aspect_ratio = gimp_brush_core_quantize (core->aspect_ratio,
+                                                 10.0 / dab_size);
+  core->hardness     = gimp_brush_core_quantize (core->hardness,
+                                                 1.0 / 256.0);
+}
+
+/*  Rounds @value to a multiple of the largest power of two not larger
+ *  than @max_step, so values like 0.0, 0.5 and 1.0 map onto themselves
+ *  and keep their special-cased fast paths.
+ */
+static gdouble
+gimp_brush_core_quantize (gdouble value,
+                          gdouble max_step)
+{
+  gdouble step;
+  gint    exponent;
+
+  frexp (max_step, &exponent);
+
+  step = ldexp (1.0, exponent - 1);
+
+  return RINT (value / step) * step;
+}
+
 static void
 gimp_brush_core_invalidate_cache (GimpBrush     *brush,
                                   GimpBrushCore *core)
@@ -1476,8 +1531,8 @@ gimp_brush_core_eval_transform_dynamics (GimpBrushCore     *core,
 {
   if (core->main_brush)
     core->scale = paint_options->brush_size /
-                  MAX (gimp_temp_buf_get_width  (core->main_brush->mask),
-                       gimp_temp_buf_get_height (core->main_brush->mask));
+                  MAX (gimp_temp_buf_get_width  (gimp_brush_get_mask (core->main_brush)),
+                       gimp_temp_buf_get_height (gimp_brush_get_mask (core->main_brush)));
   else
     core->scale = -1;
 
@@ -1538,6 +1593,8 @@ gimp_brush_core_eval_transform_dynamics (GimpBrushCore     *core,
           else
             core->aspect_ratio *= dyn_aspect_ratio;
         }
+
+      gimp_brush_core_quantize_transform (core);
     }
 }
 
@@ -1565,7 +1622,7 @@ gimp_brush_core_color_area_with_pixmap (GimpBrushCore            *core,
   const GimpTempBuf  *brush_mask;
 
   g_return_if_fail (GIMP_IS_BRUSH (core->brush));
-  g_return_if_fail (core->brush->pixmap != NULL);
+  g_return_if_fail (gimp_brush_get_pixmap (core->brush) != NULL);
 
   /*  scale the brushes  */
   pixmap_mask = gimp_brush_core_transform_pixmap (core, core->brush);
@@ -22,37 +22,153 @@
 
 #include "paint-types.h"
 
+#include "core/gimp-parallel.h"
 #include "core/gimptempbuf.h"
 #include "gimppaintcore-loops.h"
 #include "operations/gimplayermodefunctions.h"
 
+/*  the smallest part of a dab that is processed on its own thread  */
+#define MIN_SUB_AREA (64 * 64)
+
+
+typedef struct
+{
+  const GimpPaintCoreLoopsParams *params;
+  GimpPaintCoreLoopsAlgorithm     algorithms;
+} ProcessData;
+
+
+static void   combine_paint_mask_to_canvas_mask  (const GimpPaintCoreLoopsParams *params,
+                                                  const GeglRectangle            *area);
+static void   canvas_buffer_to_paint_buf_alpha   (const GimpPaintCoreLoopsParams *params,
+                                                  const GeglRectangle            *area);
+static void   paint_mask_to_paint_buffer         (const GimpPaintCoreLoopsParams *params,
+                                                  const GeglRectangle            *area);
+static void   do_layer_blend                     (const GimpPaintCoreLoopsParams *params,
+                                                  const GeglRectangle            *area);
+
+static void   gimp_paint_core_loops_process_area (const GeglRectangle            *area,
+                                                  gpointer                        data);
+
+
+/*  Runs @algorithms, in the order they are declared in, over the whole
+ *  paint area.  The area is split into parts which go through all of
+ *  the algorithms on one thread each, so each part stays in cache
+ *  between the steps.
+ */
 void
-combine_paint_mask_to_canvas_mask (const GimpTempBuf *paint_mask,
-                                   gint               mask_x_offset,
-                                   gint               mask_y_offset,
-                                   GeglBuffer        *canvas_buffer,
-                                   gint               x_offset,
-                                   gint               y_offset,
-                                   gfloat             opacity,
-                                   gboolean           stipple)
+gimp_paint_core_loops_process (const GimpPaintCoreLoopsParams *params,
+                               GimpPaintCoreLoopsAlgorithm     algorithms)
+{
+  ProcessData   data;
+  GeglRectangle area;
+
+  g_return_if_fail (params != NULL);
+
+  area.x = 0;
+  area.y = 0;
+
+  if (params->paint_buf)
+    {
+      area.width  = gimp_temp_buf_get_width  (params->paint_buf);
+      area.height = gimp_temp_buf_get_height (params->paint_buf);
+    }
+  else
+    {
+      g_return_if_fail (params->paint_mask != NULL);
+
+      area.width  = (gimp_temp_buf_get_width  (params->paint_mask) -
+                     params->paint_mask_offset_x);
+      area.height = (gimp_temp_buf_get_height (params->paint_mask) -
+                     params->paint_mask_offset_y);
+    }
+
+  if (algorithms & GIMP_PAINT_CORE_LOOPS_ALGORITHM_PAINT_MASK_TO_PAINT_BUFFER)
+    {
+      /* Validate that the paint buffer is withing the bounds of the paint mask */
+      g_return_if_fail (area.width <= gimp_temp_buf_get_width (params->paint_mask) -
+                                      params->paint_mask_offset_x);
+      g_return_if_fail (area.height <= gimp_temp_buf_get_height (params->paint_mask) -
+                                       params->paint_mask_offset_y);
+    }
+
+  if (algorithms & GIMP_PAINT_CORE_LOOPS_ALGORITHM_DO_LAYER_BLEND)
+    {
+      const Babl *iterator_format;
+
+      if (params->linear_mode)
+        iterator_format = babl_format ("RGBA float");
+      else
+        iterator_format = babl_format ("R'G'B'A float");
+
+      g_return_if_fail (gimp_temp_buf_get_format (params->paint_buf) ==
+                        iterator_format);
+    }
+
+  data.params     = params;
+  data.algorithms = algorithms;
+
+  gimp_parallel_distribute_area (&area, MIN_SUB_AREA,
+                                 gimp_paint_core_loops_process_area,
+                                 &data);
+}
+
+static void
+gimp_paint_core_loops_process_area (const GeglRectangle *area,
+                                    gpointer             data)
+{
+  ProcessData *process = data;
+
+  if (process->algorithms &
+      GIMP_PAINT_CORE_LOOPS_ALGORITHM_COMBINE_PAINT_MASK_TO_CANVAS_MASK)
+    {
+      combine_paint_mask_to_canvas_mask (process->params, area);
+    }
+
+  if (process->algorithms &
+      GIMP_PAINT_CORE_LOOPS_ALGORITHM_CANVAS_BUFFER_TO_PAINT_BUF_ALPHA)
+    {
+      canvas_buffer_to_paint_buf_alpha (process->params, area);
+    }
+
+  if (process->algorithms &
+      GIMP_PAINT_CORE_LOOPS_ALGORITHM_PAINT_MASK_TO_PAINT_BUFFER)
+    {
+      paint_mask_to_paint_buffer (process->params, area);
+    }
+
+  if (process->algorithms &
+      GIMP_PAINT_CORE_LOOPS_ALGORITHM_DO_LAYER_BLEND)
+    {
+      do_layer_blend (process->params, area);
+    }
+}
+
+static void
+combine_paint_mask_to_canvas_mask (const GimpPaintCoreLoopsParams *params,
+                                   const GeglRectangle            *area)
 {
   GeglRectangle roi;
   GeglBufferIterator *iter;
 
+  const GimpTempBuf *paint_mask = params->paint_mask;
+  const gfloat       opacity    = params->paint_opacity;
+
   const gint mask_stride       = gimp_temp_buf_get_width (paint_mask);
-  const gint mask_start_offset = mask_y_offset * mask_stride + mask_x_offset;
+  const gint mask_start_offset = ((params->paint_mask_offset_y + area->y) * mask_stride +
+                                  params->paint_mask_offset_x + area->x);
   const Babl *mask_format      = gimp_temp_buf_get_format (paint_mask);
 
-  roi.x = x_offset;
-  roi.y = y_offset;
-  roi.width  = gimp_temp_buf_get_width (paint_mask) - mask_x_offset;
-  roi.height = gimp_temp_buf_get_height (paint_mask) - mask_y_offset;
+  roi.x = params->paint_buf_offset_x + area->x;
+  roi.y = params->paint_buf_offset_y + area->y;
+  roi.width  = area->width;
+  roi.height = area->height;
 
-  iter = gegl_buffer_iterator_new (canvas_buffer, &roi, 0,
+  iter = gegl_buffer_iterator_new (params->canvas_buffer, &roi, 0,
                                    babl_format ("Y float"),
                                    GEGL_BUFFER_READWRITE, GEGL_ABYSS_NONE);
 
-  if (stipple)
+  if (params->stipple)
     {
       if (mask_format == babl_format ("Y u8"))
         {
@@ -170,25 +286,25 @@ combine_paint_mask_to_canvas_mask (const GimpTempBuf *paint_mask,
     }
 }
 
-void
-canvas_buffer_to_paint_buf_alpha (GimpTempBuf  *paint_buf,
-                                  GeglBuffer   *canvas_buffer,
-                                  gint          x_offset,
-                                  gint          y_offset)
+static void
+canvas_buffer_to_paint_buf_alpha (const GimpPaintCoreLoopsParams *params,
+                                  const GeglRectangle            *area)
 {
   /* Copy the canvas buffer in rect to the paint buffer's alpha channel */
   GeglRectangle roi;
   GeglBufferIterator *iter;
 
-  const guint paint_stride = gimp_temp_buf_get_width (paint_buf);
-  gfloat *paint_data       = (gfloat *) gimp_temp_buf_get_data (paint_buf);
+  const guint paint_stride = gimp_temp_buf_get_width (params->paint_buf);
+  gfloat *paint_data       = (gfloat *) gimp_temp_buf_get_data (params->paint_buf);
+
+  roi.x = params->paint_buf_offset_x + area->x;
+  roi.y = params->paint_buf_offset_y + area->y;
+  roi.width  = area->width;
+  roi.height = area->height;
 
-  roi.x = x_offset;
-  roi.y = y_offset;
-  roi.width  = gimp_temp_buf_get_width (paint_buf);
-  roi.height = gimp_temp_buf_get_height (paint_buf);
+  paint_data += (area->y * paint_stride + area->x) * 4;
 
-  iter = gegl_buffer_iterator_new (canvas_buffer, &roi, 0,
+  iter = gegl_buffer_iterator_new (params->canvas_buffer, &roi, 0,
                                    babl_format ("Y float"),
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   while (gegl_buffer_iterator_next (iter))
@@ -212,38 +328,35 @@ canvas_buffer_to_paint_buf_alpha (GimpTempBuf  *paint_buf,
     }
 }
 
-void
-paint_mask_to_paint_buffer (const GimpTempBuf  *paint_mask,
-                            gint                mask_x_offset,
-                            gint                mask_y_offset,
-                            GimpTempBuf        *paint_buf,
-                            gfloat              paint_opacity)
+static void
+paint_mask_to_paint_buffer (const GimpPaintCoreLoopsParams *params,
+                            const GeglRectangle            *area)
 {
-  gint width  = gimp_temp_buf_get_width (paint_buf);
-  gint height = gimp_temp_buf_get_height (paint_buf);
+  const GimpTempBuf *paint_mask    = params->paint_mask;
+  const gfloat       paint_opacity = params->paint_opacity;
 
+  const gint paint_stride      = gimp_temp_buf_get_width (params->paint_buf);
   const gint mask_stride       = gimp_temp_buf_get_width (paint_mask);
-  const gint mask_start_offset = mask_y_offset * mask_stride + mask_x_offset;
+  const gint mask_start_offset = ((params->paint_mask_offset_y + area->y) * mask_stride +
+                                  params->paint_mask_offset_x + area->x);
   const Babl *mask_format      = gimp_temp_buf_get_format (paint_mask);
 
   int iy, ix;
-  gfloat *paint_pixel = (gfloat *)gimp_temp_buf_get_data (paint_buf);
-
-  /* Validate that the paint buffer is withing the bounds of the paint mask */
-  g_return_if_fail (width <= gimp_temp_buf_get_width (paint_mask) - mask_x_offset);
-  g_return_if_fail (height <= gimp_temp_buf_get_height (paint_mask) - mask_y_offset);
+  gfloat *paint_data = ((gfloat *) gimp_temp_buf_get_data (params->paint_buf) +
+                        (area->y * paint_stride + area->x) * 4);
 
   if (mask_format == babl_format ("Y u8"))
     {
       const guint8 *mask_data = (const guint8 *) gimp_temp_buf_get_data (paint_mask);
       mask_data += mask_start_offset;
 
-      for (iy = 0; iy < height; iy++)
+      for (iy = 0; iy < area->height; iy++)
         {
           int mask_offset = iy * mask_stride;
           const guint8 *mask_pixel = &mask_data[mask_offset];
+          gfloat *paint_pixel = &paint_data[iy * paint_stride * 4];
 
-          for (ix = 0; ix < width; ix++)
+          for (ix = 0; ix < area->width; ix++)
             {
               paint_pixel[3] *= (((gfloat)*mask_pixel) / 255.0f) * paint_opacity;
 
@@ -257,12 +370,13 @@ paint_mask_to_paint_buffer (const GimpTempBuf  *paint_mask,
       const gfloat *mask_data = (const gfloat *) gimp_temp_buf_get_data (paint_mask);
       mask_data += mask_start_offset;
 
-      for (iy = 0; iy < height; iy++)
+      for (iy = 0; iy < area->height; iy++)
         {
           int mask_offset = iy * mask_stride;
           const gfloat *mask_pixel = &mask_data[mask_offset];
+          gfloat *paint_pixel = &paint_data[iy * paint_stride * 4];
 
-          for (ix = 0; ix < width; ix++)
+          for (ix = 0; ix < area->width; ix++)
             {
               paint_pixel[3] *= (*mask_pixel) * paint_opacity;
 
@@ -273,18 +387,9 @@ paint_mask_to_paint_buffer (const GimpTempBuf  *paint_mask,
     }
 }
 
-void
-do_layer_blend (GeglBuffer  *src_buffer,
-                GeglBuffer  *dst_buffer,
-                GimpTempBuf *paint_buf,
-                GeglBuffer  *mask_buffer,
-                gfloat       opacity,
-                gint         x_offset,
-                gint         y_offset,
-                gint         mask_x_offset,
-                gint         mask_y_offset,
-                gboolean     linear_mode,
-                GimpLayerModeEffects paint_mode)
+static void
+do_layer_blend (const GimpPaintCoreLoopsParams *params,
+                const GeglRectangle            *area)
 {
   GeglRectangle       roi;
   GeglRectangle       mask_roi;
@@ -292,39 +397,39 @@ do_layer_blend (GeglBuffer  *src_buffer,
   const Babl         *iterator_format;
   GeglBufferIterator *iter;
 
-  const guint         paint_stride = gimp_temp_buf_get_width (paint_buf);
-  gfloat             *paint_data   = (gfloat *) gimp_temp_buf_get_data (paint_buf);
+  const guint         paint_stride = gimp_temp_buf_get_width (params->paint_buf);
+  gfloat             *paint_data   = (gfloat *) gimp_temp_buf_get_data (params->paint_buf);
 
-  GimpLayerModeFunction apply_func = get_layer_mode_function (paint_mode);
+  GimpLayerModeFunction apply_func = get_layer_mode_function (params->paint_mode);
 
-  if (linear_mode)
+  if (params->linear_mode)
     iterator_format = babl_format ("RGBA float");
   else
     iterator_format = babl_format ("R'G'B'A float");
 
-  roi.x = x_offset;
-  roi.y = y_offset;
-  roi.width  = gimp_temp_buf_get_width (paint_buf);
-  roi.height = gimp_temp_buf_get_height (paint_buf);
+  roi.x = params->paint_buf_offset_x + area->x;
+  roi.y = params->paint_buf_offset_y + area->y;
+  roi.width  = area->width;
+  roi.height = area->height;
 
-  mask_roi.x = roi.x + mask_x_offset;
-  mask_roi.y = roi.y + mask_y_offset;
+  mask_roi.x = roi.x + params->mask_offset_x;
+  mask_roi.y = roi.y + params->mask_offset_y;
   mask_roi.width  = roi.width;
   mask_roi.height = roi.height;
 
-  g_return_if_fail (gimp_temp_buf_get_format (paint_buf) == iterator_format);
+  paint_data += (area->y * paint_stride + area->x) * 4;
 
-  iter = gegl_buffer_iterator_new (dst_buffer, &roi, 0,
+  iter = gegl_buffer_iterator_new (params->dest_buffer, &roi, 0,
                                    iterator_format,
                                    GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
-  gegl_buffer_iterator_add (iter, src_buffer, &roi, 0,
+  gegl_buffer_iterator_add (iter, params->src_buffer, &roi, 0,
                             iterator_format,
                             GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
 
-  if (mask_buffer)
+  if (params->mask_buffer)
     {
-      gegl_buffer_iterator_add (iter, mask_buffer, &mask_roi, 0,
+      gegl_buffer_iterator_add (iter, params->mask_buffer, &mask_roi, 0,
                                 babl_format ("Y float"),
                                 GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
     }
@@ -337,7 +442,7 @@ do_layer_blend (GeglBuffer  *src_buffer,
       gfloat *paint_pixel = paint_data + ((iter->roi[0].y - roi.y) * paint_stride + iter->roi[0].x - roi.x) * 4;
       int iy;
 
-      if (mask_buffer)
+      if (params->mask_buffer)
         mask_pixel  = (gfloat *)iter->data[2];
 
       process_roi.x = iter->roi[0].x;
@@ -352,14 +457,14 @@ do_layer_blend (GeglBuffer  *src_buffer,
                          paint_pixel,
                          mask_pixel,
                          out_pixel,
-                         opacity,
+                         params->image_opacity,
                          iter->roi[0].width,
                          &process_roi,
                          0);
 
           in_pixel    += iter->roi[0].width * 4;
           out_pixel   += iter->roi[0].width * 4;
-          if (mask_buffer)
+          if (params->mask_buffer)
             mask_pixel  += iter->roi[0].width;
           paint_pixel += paint_stride * 4;
         }
@@ -138,7 +138,6 @@ image_convert_indexed_invoker (GimpProcedure         *procedure,
       GimpPalette *pal = NULL;
 
       if (gimp_pdb_image_is_not_base_type (image, GIMP_INDEXED, error) &&
-          gimp_pdb_image_is_precision (image, GIMP_PRECISION_U8_GAMMA, error) &&
           gimp_item_stack_is_flat (GIMP_ITEM_STACK (gimp_image_get_layers (image))))
         {
           switch (palette_type)
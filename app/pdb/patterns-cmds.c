@@ -109,8 +109,7 @@ patterns_get_pattern_invoker (GimpProcedure         *procedure,
   if (pattern)
     {
       name   = g_strdup (gimp_object_get_name (pattern));
-      width  = gimp_temp_buf_get_width  (pattern->mask);
-      height = gimp_temp_buf_get_height (pattern->mask);
+      gimp_viewable_get_size (GIMP_VIEWABLE (pattern), &width, &height);
     }
   else
     success = FALSE;
@@ -159,12 +158,14 @@ patterns_get_pattern_data_invoker (GimpProcedure         *procedure,
 
       if (pattern)
         {
+          GimpTempBuf *mask = gimp_pattern_get_mask (pattern);
+
           actual_name = g_strdup (gimp_object_get_name (pattern));
-          width       = gimp_temp_buf_get_width  (pattern->mask);
-          height      = gimp_temp_buf_get_height (pattern->mask);
-          mask_bpp    = babl_format_get_bytes_per_pixel (gimp_temp_buf_get_format (pattern->mask));
-          length      = gimp_temp_buf_get_data_size (pattern->mask);
-          mask_data   = g_memdup (gimp_temp_buf_get_data (pattern->mask), length);
+          width       = gimp_temp_buf_get_width  (mask);
+          height      = gimp_temp_buf_get_height (mask);
+          mask_bpp    = babl_format_get_bytes_per_pixel (gimp_temp_buf_get_format (mask));
+          length      = gimp_temp_buf_get_data_size (mask);
+          mask_data   = g_memdup (gimp_temp_buf_get_data (mask), length);
         }
       else
         success = FALSE;
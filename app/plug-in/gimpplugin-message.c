@@ -63,6 +63,10 @@ static void gimp_plug_in_handle_tile_put         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
 static void gimp_plug_in_handle_tile_get         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
+static void gimp_plug_in_handle_region_request   (GimpPlugIn      *plug_in,
+                                                  GPRegionReq     *request);
+static gboolean
+            gimp_plug_in_region_handshake        (GimpPlugIn      *plug_in);
 static void gimp_plug_in_handle_proc_run         (GimpPlugIn      *plug_in,
                                                   GPProcRun       *proc_run);
 static void gimp_plug_in_handle_proc_return      (GimpPlugIn      *plug_in,
@@ -160,6 +164,10 @@ gimp_plug_in_handle_message (GimpPlugIn      *plug_in,
     case GP_HAS_INIT:
       gimp_plug_in_handle_has_init (plug_in);
       break;
+
+    case GP_REGION_REQ:
+      gimp_plug_in_handle_region_request (plug_in, msg->data);
+      break;
     }
 }
 
@@ -469,6 +477,191 @@ gimp_plug_in_handle_tile_get (GimpPlugIn *plug_in,
   gimp_wire_destroy (&msg);
 }
 
+/*  A region request moves a whole rectangle of pixels through the
+ *  shared memory segment at once.  For reading, the core copies the
+ *  rectangle into the segment and answers with a tile ack, the plug-in
+ *  copies it out and acks back.  For writing, the core acks the request,
+ *  the plug-in fills the segment and acks back, the core copies the
+ *  rectangle to the drawable and acks again.  The core does not read
+ *  other plug-ins' messages in between, so the shared segment is only
+ *  ever used by one plug-in at a time.
+ */
+static void
+gimp_plug_in_handle_region_request (GimpPlugIn  *plug_in,
+                                    GPRegionReq *request)
+{
+  GimpDrawable  *drawable;
+  GeglBuffer    *buffer;
+  const Babl    *format;
+  GeglRectangle  rect;
+  guchar        *shm_addr;
+
+  g_return_if_fail (request != NULL);
+
+  if (! plug_in->manager->shm)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a REGION_REQ message without shared memory "
+                    "(killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  drawable = (GimpDrawable *) gimp_item_get_by_ID (plug_in->manager->gimp,
+                                                   request->drawable_ID);
+
+  if (! GIMP_IS_DRAWABLE (drawable))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried accessing invalid drawable %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    request->drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+  else if (gimp_item_is_removed (GIMP_ITEM (drawable)))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried accessing drawable %d which was removed "
+                    "from the image (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    request->drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (request->shadow)
+    {
+      /*  see gimp_plug_in_handle_tile_put()  */
+      buffer = gimp_drawable_get_shadow_buffer (drawable);
+
+      gimp_plug_in_cleanup_add_shadow (plug_in, drawable);
+    }
+  else
+    {
+      if (request->write &&
+          gimp_item_is_content_locked (GIMP_ITEM (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a locked drawable %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog),
+                        request->drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return;
+        }
+      else if (request->write &&
+               gimp_viewable_get_children (GIMP_VIEWABLE (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a group layer %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog),
+                        request->drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return;
+        }
+
+      buffer = gimp_drawable_get_buffer (drawable);
+    }
+
+  format = gegl_buffer_get_format (buffer);
+
+  if (! gimp_plug_in_precision_enabled (plug_in))
+    {
+      format = gimp_babl_compat_u8_format (format);
+    }
+
+  rect.x      = request->x;
+  rect.y      = request->y;
+  rect.width  = request->width;
+  rect.height = request->height;
+
+  if (rect.width <= 0 || rect.height <= 0                              ||
+      ! gegl_rectangle_contains (gegl_buffer_get_extent (buffer), &rect) ||
+      (gsize) rect.width * rect.height *
+      babl_format_get_bytes_per_pixel (format) >
+      gimp_plug_in_shm_get_size (plug_in->manager->shm))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "requested invalid region (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  shm_addr = gimp_plug_in_shm_get_addr (plug_in->manager->shm);
+
+  if (request->write)
+    {
+      /*  hand the segment to the plug-in and wait until it is filled  */
+      if (! gimp_plug_in_region_handshake (plug_in))
+        return;
+
+      gegl_buffer_set (buffer, &rect, 0, format,
+                       shm_addr, GEGL_AUTO_ROWSTRIDE);
+
+      if (! gp_tile_ack_write (plug_in->my_write, plug_in))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "%s: ERROR", G_STRFUNC);
+          gimp_plug_in_close (plug_in, TRUE);
+        }
+    }
+  else
+    {
+      gegl_buffer_get (buffer, &rect, 1.0, format,
+                       shm_addr, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      /*  wait until the plug-in copied the pixels out of the segment  */
+      gimp_plug_in_region_handshake (plug_in);
+    }
+}
+
+/*  The shared memory segment is used by all plug-ins, so like
+ *  gimp_plug_in_handle_tile_get() we block on this plug-in's channel
+ *  while it accesses the segment: send a tile ack and wait for the
+ *  plug-in's tile ack, which it sends when it is done with the segment.
+ */
+static gboolean
+gimp_plug_in_region_handshake (GimpPlugIn *plug_in)
+{
+  GimpWireMessage msg;
+
+  if (! gp_tile_ack_write (plug_in->my_write, plug_in) ||
+      ! gimp_wire_read_msg (plug_in->my_read, &msg, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return FALSE;
+    }
+
+  if (msg.type != GP_TILE_ACK)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "expected tile ack and received: %d", msg.type);
+      gimp_wire_destroy (&msg);
+      gimp_plug_in_close (plug_in, TRUE);
+      return FALSE;
+    }
+
+  gimp_wire_destroy (&msg);
+
+  return TRUE;
+}
+
 static void
 gimp_plug_in_handle_proc_error (GimpPlugIn          *plug_in,
                                 GimpPlugInProcFrame *proc_frame,
@@ -67,6 +67,10 @@ gimp_plug_in_def_finalize (GObject *object)
   g_free (plug_in_def->locale_domain_path);
   g_free (plug_in_def->help_domain_name);
   g_free (plug_in_def->help_domain_uri);
+  g_free (plug_in_def->checksum);
+
+  if (plug_in_def->cached_procedures)
+    g_bytes_unref (plug_in_def->cached_procedures);
 
   g_slist_free_full (plug_in_def->procedures, (GDestroyNotify) g_object_unref);
 
@@ -85,6 +89,7 @@ gimp_plug_in_def_get_memsize (GimpObject *object,
   memsize += gimp_string_get_memsize (plug_in_def->locale_domain_path);
   memsize += gimp_string_get_memsize (plug_in_def->help_domain_name);
   memsize += gimp_string_get_memsize (plug_in_def->help_domain_uri);
+  memsize += gimp_string_get_memsize (plug_in_def->checksum);
 
   memsize += gimp_g_slist_get_memsize (plug_in_def->procedures, 0);
 
@@ -216,6 +221,46 @@ gimp_plug_in_def_set_mtime (GimpPlugInDef *plug_in_def,
     }
 }
 
+void
+gimp_plug_in_def_set_checksum (GimpPlugInDef *plug_in_def,
+                               const gchar   *checksum)
+{
+  g_return_if_fail (GIMP_IS_PLUG_IN_DEF (plug_in_def));
+
+  if (checksum != plug_in_def->checksum)
+    {
+      g_free (plug_in_def->checksum);
+      plug_in_def->checksum = g_strdup (checksum);
+    }
+}
+
+/*  Returns a checksum of the plug-in executable's contents, which lets
+ *  us tell a plug-in that was merely touched or reinstalled from one
+ *  that actually changed, or NULL if the file can't be read.
+ */
+gchar *
+gimp_plug_in_def_compute_checksum (GimpPlugInDef *plug_in_def)
+{
+  GMappedFile *file;
+  gchar       *checksum;
+
+  g_return_val_if_fail (GIMP_IS_PLUG_IN_DEF (plug_in_def), NULL);
+
+  file = g_mapped_file_new (plug_in_def->prog, FALSE, NULL);
+
+  if (! file)
+    return NULL;
+
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                          (const guchar *)
+                                          g_mapped_file_get_contents (file),
+                                          g_mapped_file_get_length (file));
+
+  g_mapped_file_unref (file);
+
+  return checksum;
+}
+
 void
 gimp_plug_in_def_set_needs_query (GimpPlugInDef *plug_in_def,
                                   gboolean       needs_query)
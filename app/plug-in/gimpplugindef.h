@@ -44,8 +44,10 @@ struct _GimpPlugInDef
   gchar      *help_domain_name;
   gchar      *help_domain_uri;
   gint64      mtime;
-  gboolean    needs_query;  /* Does the plug-in need to be queried ?     */
-  gboolean    has_init;     /* Does the plug-in need to be initialized ? */
+  gchar      *checksum;          /* Checksum of the executable's contents     */
+  GBytes     *cached_procedures; /* Procedures not read from the cache yet    */
+  gboolean    needs_query;       /* Does the plug-in need to be queried ?     */
+  gboolean    has_init;          /* Does the plug-in need to be initialized ? */
 };
 
 struct _GimpPlugInDefClass
@@ -73,6 +75,9 @@ void   gimp_plug_in_def_set_help_domain   (GimpPlugInDef       *plug_in_def,
 
 void   gimp_plug_in_def_set_mtime         (GimpPlugInDef       *plug_in_def,
                                            gint64               mtime);
+void   gimp_plug_in_def_set_checksum      (GimpPlugInDef       *plug_in_def,
+                                           const gchar         *checksum);
+gchar * gimp_plug_in_def_compute_checksum (GimpPlugInDef       *plug_in_def);
 void   gimp_plug_in_def_set_needs_query   (GimpPlugInDef       *plug_in_def,
                                            gboolean             needs_query);
 void   gimp_plug_in_def_set_has_init      (GimpPlugInDef       *plug_in_def,
@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <errno.h>
+
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <gegl.h>
 
@@ -52,83 +54,163 @@
 /*  public functions  */
 
 void
-gimp_plug_in_manager_call_query (GimpPlugInManager *manager,
-                                 GimpContext       *context,
-                                 GimpPlugInDef     *plug_in_def)
+gimp_plug_in_manager_call_many (GimpPlugInManager  *manager,
+                                GimpContext        *context,
+                                GimpPlugInCallMode  call_mode,
+                                GList              *plug_in_defs,
+                                gint                max_running,
+                                GimpInitStatusFunc  status_callback)
 {
-  GimpPlugIn *plug_in;
+  GimpPlugIn **running;
+  GPollFD     *fds;
+  GList       *next;
+  gint         n_defs;
+  gint         n_done    = 0;
+  gint         n_running = 0;
 
   g_return_if_fail (GIMP_IS_PLUG_IN_MANAGER (manager));
   g_return_if_fail (GIMP_IS_PDB_CONTEXT (context));
-  g_return_if_fail (GIMP_IS_PLUG_IN_DEF (plug_in_def));
-
-  plug_in = gimp_plug_in_new (manager, context, NULL,
-                              NULL, plug_in_def->prog);
-
-  if (plug_in)
+  g_return_if_fail (call_mode == GIMP_PLUG_IN_CALL_QUERY ||
+                    call_mode == GIMP_PLUG_IN_CALL_INIT);
+  g_return_if_fail (status_callback != NULL);
+
+#ifdef G_OS_WIN32
+  /*  g_poll() can't wait on pipes on win32  */
+  max_running = 1;
+#endif
+
+  /*  a debugger wrapping the plug-in wants the terminal for itself  */
+  if (manager->debug)
+    max_running = 1;
+
+  max_running = MAX (max_running, 1);
+
+  running = g_new0 (GimpPlugIn *, max_running);
+  fds     = g_new0 (GPollFD, max_running);
+
+  n_defs = g_list_length (plug_in_defs);
+  next   = plug_in_defs;
+
+  /*  All messages are handled here, in the main thread, one at a time,
+   *  so running several plug-ins at once only overlaps their startup
+   *  and the time they spend on their own.  Everything a query or
+   *  init records ends up in the plug-in's own GimpPlugInDef, which
+   *  is merged into the PDB later in the order of the plug-in list,
+   *  so the result doesn't depend on which plug-in finished first.
+   */
+  while (next || n_running)
     {
-      plug_in->plug_in_def = plug_in_def;
+      gint i;
 
-      if (gimp_plug_in_open (plug_in, GIMP_PLUG_IN_CALL_QUERY, TRUE))
+      while (next && n_running < max_running)
         {
-          while (plug_in->open)
+          GimpPlugInDef *plug_in_def = next->data;
+          GimpPlugIn    *plug_in;
+          gchar         *basename;
+
+          next = g_list_next (next);
+
+          basename = g_filename_display_basename (plug_in_def->prog);
+          status_callback (NULL, basename,
+                           (gdouble) n_done / (gdouble) n_defs);
+          g_free (basename);
+
+          if (manager->gimp->be_verbose)
+            g_print ("%s plug-in: '%s'\n",
+                     call_mode == GIMP_PLUG_IN_CALL_QUERY ?
+                     "Querying" : "Initializing",
+                     gimp_filename_to_utf8 (plug_in_def->prog));
+
+          plug_in = gimp_plug_in_new (manager, context, NULL,
+                                      NULL, plug_in_def->prog);
+
+          if (plug_in)
             {
-              GimpWireMessage msg;
+              plug_in->plug_in_def = plug_in_def;
 
-              if (! gimp_wire_read_msg (plug_in->my_read, &msg, plug_in))
+              if (gimp_plug_in_open (plug_in, call_mode, TRUE))
                 {
-                  gimp_plug_in_close (plug_in, TRUE);
-                }
-              else
-                {
-                  gimp_plug_in_handle_message (plug_in, &msg);
-                  gimp_wire_destroy (&msg);
+                  running[n_running++] = plug_in;
+                  continue;
                 }
+
+              g_object_unref (plug_in);
             }
+
+          n_done++;
         }
 
-      g_object_unref (plug_in);
-    }
-}
+      if (! n_running)
+        continue;
 
-void
-gimp_plug_in_manager_call_init (GimpPlugInManager *manager,
-                                GimpContext       *context,
-                                GimpPlugInDef     *plug_in_def)
-{
-  GimpPlugIn *plug_in;
+      for (i = 0; i < n_running; i++)
+        {
+          fds[i].fd      = g_io_channel_unix_get_fd (running[i]->my_read);
+          fds[i].events  = G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP;
+          fds[i].revents = 0;
+        }
 
-  g_return_if_fail (GIMP_IS_PLUG_IN_MANAGER (manager));
-  g_return_if_fail (GIMP_IS_PDB_CONTEXT (context));
-  g_return_if_fail (GIMP_IS_PLUG_IN_DEF (plug_in_def));
+      /*  with a single plug-in, simply block in reading from it  */
+      if (n_running > 1 &&
+          g_poll (fds, n_running, -1) < 0)
+        {
+          gint errsv = errno;
 
-  plug_in = gimp_plug_in_new (manager, context, NULL,
-                              NULL, plug_in_def->prog);
+          if (errsv == EINTR)
+            continue;
 
-  if (plug_in)
-    {
-      plug_in->plug_in_def = plug_in_def;
+          /*  we can't wait on them, so give up on the running ones  */
+          gimp_message (manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "g_poll() failed while starting plug-ins: %s",
+                        g_strerror (errsv));
 
-      if (gimp_plug_in_open (plug_in, GIMP_PLUG_IN_CALL_INIT, TRUE))
-        {
-          while (plug_in->open)
+          for (i = 0; i < n_running; i++)
             {
-              GimpWireMessage msg;
+              gimp_plug_in_close (running[i], TRUE);
+              g_object_unref (running[i]);
 
-              if (! gimp_wire_read_msg (plug_in->my_read, &msg, plug_in))
-                {
-                  gimp_plug_in_close (plug_in, TRUE);
-                }
-              else
-                {
-                  gimp_plug_in_handle_message (plug_in, &msg);
-                  gimp_wire_destroy (&msg);
-                }
+              n_done++;
             }
+
+          n_running = 0;
+
+          continue;
         }
 
-      g_object_unref (plug_in);
+      /*  iterate backwards, so finished plug-ins can be replaced by
+       *  the last running one, which has already been handled
+       */
+      for (i = n_running - 1; i >= 0; i--)
+        {
+          GimpPlugIn      *plug_in = running[i];
+          GimpWireMessage  msg;
+
+          if (n_running > 1 && ! fds[i].revents)
+            continue;
+
+          if (! gimp_wire_read_msg (plug_in->my_read, &msg, plug_in))
+            {
+              gimp_plug_in_close (plug_in, TRUE);
+            }
+          else
+            {
+              gimp_plug_in_handle_message (plug_in, &msg);
+              gimp_wire_destroy (&msg);
+            }
+
+          if (! plug_in->open)
+            {
+              g_object_unref (plug_in);
+
+              running[i] = running[--n_running];
+
+              n_done++;
+            }
+        }
     }
+
+  g_free (fds);
+  g_free (running);
 }
 
 GimpValueArray *
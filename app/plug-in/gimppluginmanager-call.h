@@ -25,17 +25,15 @@
 #endif
 
 
-/*  Call the plug-in's query() function
+/*  Call the query() or init() function of a list of plug-ins, keeping
+ *  up to @max_running of them running at the same time
  */
-void             gimp_plug_in_manager_call_query    (GimpPlugInManager      *manager,
+void             gimp_plug_in_manager_call_many     (GimpPlugInManager      *manager,
                                                      GimpContext            *context,
-                                                     GimpPlugInDef          *plug_in_def);
-
-/*  Call the plug-in's init() function
- */
-void             gimp_plug_in_manager_call_init     (GimpPlugInManager      *manager,
-                                                     GimpContext            *context,
-                                                     GimpPlugInDef          *plug_in_def);
+                                                     GimpPlugInCallMode      call_mode,
+                                                     GList                  *plug_in_defs,
+                                                     gint                    max_running,
+                                                     GimpInitStatusFunc      status_callback);
 
 /*  Run a plug-in as if it were a procedure database procedure
  */
@@ -32,6 +32,7 @@
 #include "config/gimpcoreconfig.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 
 #include "pdb/gimppdb.h"
 #include "pdb/gimppdbcontext.h"
@@ -46,6 +47,7 @@
 #include "gimppluginmanager-restore.h"
 #include "gimppluginprocedure.h"
 #include "plug-in-rc.h"
+#include "plug-in-rc-cache.h"
 
 #include "gimp-intl.h"
 
@@ -55,6 +57,7 @@ static void    gimp_plug_in_manager_search            (GimpPlugInManager      *m
 static gchar * gimp_plug_in_manager_get_pluginrc      (GimpPlugInManager      *manager);
 static void    gimp_plug_in_manager_read_pluginrc     (GimpPlugInManager      *manager,
                                                        const gchar            *pluginrc,
+                                                       const gchar            *pluginrc_cache,
                                                        GimpInitStatusFunc      status_callback);
 static void    gimp_plug_in_manager_query_new         (GimpPlugInManager      *manager,
                                                        GimpContext            *context,
@@ -62,6 +65,9 @@ static void    gimp_plug_in_manager_query_new         (GimpPlugInManager      *m
 static void    gimp_plug_in_manager_init_plug_ins     (GimpPlugInManager      *manager,
                                                        GimpContext            *context,
                                                        GimpInitStatusFunc      status_callback);
+static void    gimp_plug_in_manager_compute_checksums (gint                    i,
+                                                       gint                    n,
+                                                       GPtrArray              *defs);
 static void    gimp_plug_in_manager_run_extensions    (GimpPlugInManager      *manager,
                                                        GimpContext            *context,
                                                        GimpInitStatusFunc      status_callback);
@@ -70,6 +76,9 @@ static void    gimp_plug_in_manager_add_from_file     (const GimpDatafileData *f
                                                        gpointer                data);
 static void    gimp_plug_in_manager_add_from_rc       (GimpPlugInManager      *manager,
                                                        GimpPlugInDef          *plug_in_def);
+static gboolean gimp_plug_in_manager_rc_def_is_current (GimpPlugInManager      *manager,
+                                                        GimpPlugInDef          *rc_plug_in_def,
+                                                        GimpPlugInDef          *ondisk_plug_in_def);
 static void     gimp_plug_in_manager_add_to_db         (GimpPlugInManager      *manager,
                                                         GimpContext            *context,
                                                         GimpPlugInProcedure    *proc);
@@ -86,6 +95,7 @@ gimp_plug_in_manager_restore (GimpPlugInManager  *manager,
 {
   Gimp   *gimp;
   gchar  *pluginrc;
+  gchar  *pluginrc_cache;
   GSList *list;
   GError *error = NULL;
 
@@ -102,9 +112,11 @@ gimp_plug_in_manager_restore (GimpPlugInManager  *manager,
   gimp_plug_in_manager_search (manager, status_callback);
 
   /* read the pluginrc file for cached data */
-  pluginrc = gimp_plug_in_manager_get_pluginrc (manager);
+  pluginrc       = gimp_plug_in_manager_get_pluginrc (manager);
+  pluginrc_cache = g_strconcat (pluginrc, ".cache", NULL);
 
-  gimp_plug_in_manager_read_pluginrc (manager, pluginrc, status_callback);
+  gimp_plug_in_manager_read_pluginrc (manager, pluginrc, pluginrc_cache,
+                                      status_callback);
 
   /* query any plug-ins that changed since we last wrote out pluginrc */
   gimp_plug_in_manager_query_new (manager, context, status_callback);
@@ -136,10 +148,26 @@ gimp_plug_in_manager_restore (GimpPlugInManager  *manager,
                                 NULL, GIMP_MESSAGE_ERROR, error->message);
           g_clear_error (&error);
         }
+      else
+        {
+          /* the cache is stamped with the pluginrc just written */
+          if (gimp->be_verbose)
+            g_print ("Writing '%s'\n",
+                     gimp_filename_to_utf8 (pluginrc_cache));
+
+          if (! plug_in_rc_cache_write (manager->plug_in_defs, pluginrc_cache,
+                                        pluginrc, &error))
+            {
+              gimp_message_literal (gimp,
+                                    NULL, GIMP_MESSAGE_ERROR, error->message);
+              g_clear_error (&error);
+            }
+        }
 
       manager->write_pluginrc = FALSE;
     }
 
+  g_free (pluginrc_cache);
   g_free (pluginrc);
 
   /* create locale and help domain lists */
@@ -273,10 +301,13 @@ gimp_plug_in_manager_get_pluginrc (GimpPlugInManager *manager)
   return pluginrc;
 }
 
-/* read the pluginrc file for cached data */
+/* read the pluginrc cache, or the pluginrc file if there is no usable
+ * cache, for cached data
+ */
 static void
 gimp_plug_in_manager_read_pluginrc (GimpPlugInManager  *manager,
                                     const gchar        *pluginrc,
+                                    const gchar        *pluginrc_cache,
                                     GimpInitStatusFunc  status_callback)
 {
   GSList *rc_defs;
@@ -286,9 +317,26 @@ gimp_plug_in_manager_read_pluginrc (GimpPlugInManager  *manager,
                    gimp_filename_to_utf8 (pluginrc), 0.0);
 
   if (manager->gimp->be_verbose)
-    g_print ("Parsing '%s'\n", gimp_filename_to_utf8 (pluginrc));
+    g_print ("Parsing '%s'\n", gimp_filename_to_utf8 (pluginrc_cache));
+
+  rc_defs = plug_in_rc_cache_parse (manager->gimp, pluginrc_cache, pluginrc,
+                                    &error);
+
+  if (error)
+    {
+      if (manager->gimp->be_verbose)
+        g_print ("%s\n", error->message);
+
+      g_clear_error (&error);
+
+      /* make sure there is a usable cache next time */
+      manager->write_pluginrc = TRUE;
 
-  rc_defs = plug_in_rc_parse (manager->gimp, pluginrc, &error);
+      if (manager->gimp->be_verbose)
+        g_print ("Parsing '%s'\n", gimp_filename_to_utf8 (pluginrc));
+
+      rc_defs = plug_in_rc_parse (manager->gimp, pluginrc, &error);
+    }
 
   if (rc_defs)
     {
@@ -316,44 +364,46 @@ gimp_plug_in_manager_query_new (GimpPlugInManager  *manager,
                                 GimpInitStatusFunc  status_callback)
 {
   GSList *list;
-  gint    n_plugins;
+  GList  *query_defs = NULL;
 
   status_callback (_("Querying new Plug-ins"), "", 0.0);
 
-  for (list = manager->plug_in_defs, n_plugins = 0; list; list = list->next)
+  for (list = manager->plug_in_defs; list; list = list->next)
     {
       GimpPlugInDef *plug_in_def = list->data;
 
       if (plug_in_def->needs_query)
-        n_plugins++;
+        query_defs = g_list_prepend (query_defs, plug_in_def);
     }
 
-  if (n_plugins)
+  if (query_defs)
     {
-      gint nth;
+      GPtrArray *defs = g_ptr_array_new ();
+      GList     *iter;
+
+      query_defs = g_list_reverse (query_defs);
 
       manager->write_pluginrc = TRUE;
 
-      for (list = manager->plug_in_defs, nth = 0; list; list = list->next)
-        {
-          GimpPlugInDef *plug_in_def = list->data;
+      /* remember the contents of what we query, so merely touching
+       * the plug-ins doesn't make us query them again next time
+       */
+      for (iter = query_defs; iter; iter = g_list_next (iter))
+        g_ptr_array_add (defs, iter->data);
 
-          if (plug_in_def->needs_query)
-            {
-              gchar *basename;
+      gimp_parallel_distribute (defs->len,
+                                (GimpParallelDistributeFunc)
+                                gimp_plug_in_manager_compute_checksums,
+                                defs);
 
-              basename = g_filename_display_basename (plug_in_def->prog);
-              status_callback (NULL, basename,
-                               (gdouble) nth++ / (gdouble) n_plugins);
-              g_free (basename);
+      g_ptr_array_free (defs, TRUE);
 
-              if (manager->gimp->be_verbose)
-                g_print ("Querying plug-in: '%s'\n",
-                         gimp_filename_to_utf8 (plug_in_def->prog));
+      gimp_plug_in_manager_call_many (manager, context,
+                                      GIMP_PLUG_IN_CALL_QUERY, query_defs,
+                                      gimp_parallel_get_n_threads (),
+                                      status_callback);
 
-              gimp_plug_in_manager_call_query (manager, context, plug_in_def);
-            }
-        }
+      g_list_free (query_defs);
     }
 
   status_callback (NULL, "", 1.0);
@@ -366,45 +416,49 @@ gimp_plug_in_manager_init_plug_ins (GimpPlugInManager  *manager,
                                     GimpInitStatusFunc  status_callback)
 {
   GSList *list;
-  gint    n_plugins;
+  GList  *init_defs = NULL;
 
   status_callback (_("Initializing Plug-ins"), "", 0.0);
 
-  for (list = manager->plug_in_defs, n_plugins = 0; list; list = list->next)
+  for (list = manager->plug_in_defs; list; list = list->next)
     {
       GimpPlugInDef *plug_in_def = list->data;
 
       if (plug_in_def->has_init)
-        n_plugins++;
+        init_defs = g_list_prepend (init_defs, plug_in_def);
     }
 
-  if (n_plugins)
+  if (init_defs)
     {
-      gint nth;
+      init_defs = g_list_reverse (init_defs);
 
-      for (list = manager->plug_in_defs, nth = 0; list; list = list->next)
-        {
-          GimpPlugInDef *plug_in_def = list->data;
+      gimp_plug_in_manager_call_many (manager, context,
+                                      GIMP_PLUG_IN_CALL_INIT, init_defs,
+                                      gimp_parallel_get_n_threads (),
+                                      status_callback);
 
-          if (plug_in_def->has_init)
-            {
-              gchar *basename;
+      g_list_free (init_defs);
+    }
 
-              basename = g_filename_display_basename (plug_in_def->prog);
-              status_callback (NULL, basename,
-                               (gdouble) nth++ / (gdouble) n_plugins);
-              g_free (basename);
+  status_callback (NULL, "", 1.0);
+}
 
-              if (manager->gimp->be_verbose)
-                g_print ("Initializing plug-in: '%s'\n",
-                         gimp_filename_to_utf8 (plug_in_def->prog));
+static void
+gimp_plug_in_manager_compute_checksums (gint       i,
+                                        gint       n,
+                                        GPtrArray *defs)
+{
+  gint j;
 
-              gimp_plug_in_manager_call_init (manager, context, plug_in_def);
-            }
-        }
-    }
+  for (j = i; j < defs->len; j += n)
+    {
+      GimpPlugInDef *plug_in_def = g_ptr_array_index (defs, j);
+      gchar         *checksum;
 
-  status_callback (NULL, "", 1.0);
+      checksum = gimp_plug_in_def_compute_checksum (plug_in_def);
+      gimp_plug_in_def_set_checksum (plug_in_def, checksum);
+      g_free (checksum);
+    }
 }
 
 /* run automatically started extensions */
@@ -603,27 +657,6 @@ gimp_plug_in_manager_add_from_rc (GimpPlugInManager *manager,
 
   basename1 = g_path_get_basename (plug_in_def->prog);
 
-  /*  If this is a file load or save plugin, make sure we have
-   *  something for one of the extensions, prefixes, or magic number.
-   *  Other bits of code rely on detecting file plugins by the
-   *  presence of one of these things, but the raw plug-in needs to be
-   *  able to register no extensions, prefixes or magics.
-   */
-  for (list = plug_in_def->procedures; list; list = list->next)
-    {
-      GimpPlugInProcedure *proc = list->data;
-
-      if (! proc->extensions &&
-          ! proc->prefixes   &&
-          ! proc->magics     &&
-          proc->menu_paths   &&
-          (g_str_has_prefix (proc->menu_paths->data, "<Load>") ||
-           g_str_has_prefix (proc->menu_paths->data, "<Save>")))
-        {
-          proc->extensions = g_strdup ("");
-        }
-    }
-
   /*  Check if the entry mentioned in pluginrc matches an executable
    *  found in the plug_in_path.
    */
@@ -638,8 +671,35 @@ gimp_plug_in_manager_add_from_rc (GimpPlugInManager *manager,
         {
           if (! g_ascii_strcasecmp (plug_in_def->prog,
                                     ondisk_plug_in_def->prog) &&
-              (plug_in_def->mtime == ondisk_plug_in_def->mtime))
+              gimp_plug_in_manager_rc_def_is_current (manager,
+                                                      plug_in_def,
+                                                      ondisk_plug_in_def) &&
+              plug_in_rc_cache_load_procedures (manager->gimp, plug_in_def))
             {
+              GSList *list2;
+
+              /*  If this is a file load or save plugin, make sure we
+               *  have something for one of the extensions, prefixes,
+               *  or magic number.  Other bits of code rely on
+               *  detecting file plugins by the presence of one of
+               *  these things, but the raw plug-in needs to be able to
+               *  register no extensions, prefixes or magics.
+               */
+              for (list2 = plug_in_def->procedures; list2; list2 = list2->next)
+                {
+                  GimpPlugInProcedure *proc = list2->data;
+
+                  if (! proc->extensions &&
+                      ! proc->prefixes   &&
+                      ! proc->magics     &&
+                      proc->menu_paths   &&
+                      (g_str_has_prefix (proc->menu_paths->data, "<Load>") ||
+                       g_str_has_prefix (proc->menu_paths->data, "<Save>")))
+                    {
+                      proc->extensions = g_strdup ("");
+                    }
+                }
+
               /* Use pluginrc entry, deleting on-disk entry */
               list->data = plug_in_def;
               g_object_unref (ondisk_plug_in_def);
@@ -672,6 +732,44 @@ gimp_plug_in_manager_add_from_rc (GimpPlugInManager *manager,
   g_object_unref (plug_in_def);
 }
 
+/*  Returns TRUE if the pluginrc entry still describes the executable
+ *  found on disk.  If only the modification time differs, the contents
+ *  are compared before deciding that the plug-in needs to be queried
+ *  again.
+ */
+static gboolean
+gimp_plug_in_manager_rc_def_is_current (GimpPlugInManager *manager,
+                                        GimpPlugInDef     *rc_plug_in_def,
+                                        GimpPlugInDef     *ondisk_plug_in_def)
+{
+  gchar    *checksum;
+  gboolean  current;
+
+  if (rc_plug_in_def->mtime == ondisk_plug_in_def->mtime)
+    return TRUE;
+
+  if (! rc_plug_in_def->checksum)
+    return FALSE;
+
+  checksum = gimp_plug_in_def_compute_checksum (ondisk_plug_in_def);
+
+  current = (checksum && ! strcmp (checksum, rc_plug_in_def->checksum));
+
+  g_free (checksum);
+
+  if (current)
+    {
+      if (manager->gimp->be_verbose)
+        g_print ("Plug-in '%s' was touched, but its contents didn't change\n",
+                 gimp_filename_to_utf8 (ondisk_plug_in_def->prog));
+
+      gimp_plug_in_def_set_mtime (rc_plug_in_def, ondisk_plug_in_def->mtime);
+
+      manager->write_pluginrc = TRUE;
+    }
+
+  return current;
+}
 
 static void
 gimp_plug_in_manager_add_to_db (GimpPlugInManager   *manager,
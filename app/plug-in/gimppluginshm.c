@@ -61,6 +61,9 @@
 
 #endif /* G_OS_WIN32 || G_WITH_CYGWIN */
 
+#include "libgimpbase/gimpbase.h"
+#include "libgimpbase/gimpprotocol.h"
+
 #include "plug-in-types.h"
 
 #include "core/gimp-utils.h"
@@ -70,7 +73,8 @@
 #include "gimp-log.h"
 
 
-#define TILE_MAP_SIZE (GIMP_PLUG_IN_TILE_WIDTH * GIMP_PLUG_IN_TILE_HEIGHT * 32)
+#define TILE_MAP_SIZE (GIMP_PLUG_IN_TILE_WIDTH * GIMP_PLUG_IN_TILE_HEIGHT * \
+                       GP_SHM_MAX_BPP * GP_SHM_N_TILES)
 
 #define ERRMSG_SHM_DISABLE "Disabling shared memory tile transport"
 
@@ -298,3 +302,11 @@ gimp_plug_in_shm_get_addr (GimpPlugInShm *shm)
 
   return shm->shm_addr;
 }
+
+gsize
+gimp_plug_in_shm_get_size (GimpPlugInShm *shm)
+{
+  g_return_val_if_fail (shm != NULL, 0);
+
+  return TILE_MAP_SIZE;
+}
@@ -0,0 +1,817 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * plug-in-rc-cache.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpbase/gimpprotocol.h"
+#include "libgimpconfig/gimpconfig.h"
+
+#include "plug-in-types.h"
+
+#include "core/gimp.h"
+
+#include "pdb/gimp-pdb-compat.h"
+
+#include "gimpplugindef.h"
+#include "gimppluginprocedure.h"
+#include "plug-in-rc-cache.h"
+
+#include "gimp-intl.h"
+
+
+/*  The pluginrc cache holds the same information as the pluginrc text
+ *  file, in a form that can be mapped into memory and read without a
+ *  tokenizer.  It is written in the machine's native byte order, the
+ *  magic number doubles as byte order mark.
+ *
+ *  Every plug-in-def is a header, holding what is needed to decide
+ *  whether the entry is still valid, followed by a block holding its
+ *  procedures.  The procedures are only decoded, by
+ *  plug_in_rc_cache_load_procedures(), for entries that are actually
+ *  used.
+ *
+ *  The file header records the modification time and size of the
+ *  pluginrc it was written with, the cache is only used as long as
+ *  pluginrc is unchanged.
+ *
+ *  Integers are 32 bits unless noted otherwise, strings are a length
+ *  followed by the string's bytes, with G_MAXUINT32 as length of NULL.
+ */
+
+#define PLUG_IN_RC_CACHE_MAGIC   0x47505243  /* "GPRC" */
+#define PLUG_IN_RC_CACHE_VERSION 2
+
+#define NULL_STRING_LENGTH       G_MAXUINT32
+
+
+typedef struct
+{
+  const guint8 *data;
+  gsize         size;
+  gsize         offset;
+} CacheReader;
+
+
+static gboolean              cache_get_stamp      (const gchar         *pluginrc,
+                                                   gint64              *mtime,
+                                                   gint64              *size,
+                                                   GError             **error);
+
+static gboolean              cache_read           (CacheReader         *reader,
+                                                   gpointer             dest,
+                                                   gsize                size);
+static gboolean              cache_read_uint32    (CacheReader         *reader,
+                                                   guint32             *value);
+static gboolean              cache_read_int64     (CacheReader         *reader,
+                                                   gint64              *value);
+static gboolean              cache_read_string    (CacheReader         *reader,
+                                                   gchar              **value);
+static gboolean              cache_read_data      (CacheReader         *reader,
+                                                   gsize                size,
+                                                   guint8             **value);
+
+static void                  cache_write_uint32   (GString             *buf,
+                                                   guint32              value);
+static void                  cache_write_int64    (GString             *buf,
+                                                   gint64               value);
+static void                  cache_write_string   (GString             *buf,
+                                                   const gchar         *value);
+
+static GimpPlugInDef       * cache_read_plug_in_def (CacheReader         *reader,
+                                                     GBytes              *bytes);
+static GimpPlugInProcedure * cache_read_procedure   (CacheReader         *reader,
+                                                     Gimp                *gimp,
+                                                     const gchar         *prog);
+static void                  cache_write_procedure  (GString             *buf,
+                                                     GimpPlugInProcedure *proc);
+
+
+GSList *
+plug_in_rc_cache_parse (Gimp         *gimp,
+                        const gchar  *filename,
+                        const gchar  *pluginrc,
+                        GError      **error)
+{
+  GMappedFile *file;
+  GBytes      *bytes;
+  CacheReader  reader;
+  GSList      *plug_in_defs = NULL;
+  guint32      magic;
+  guint32      file_version;
+  guint32      protocol_version;
+  gint64       pluginrc_mtime;
+  gint64       pluginrc_size;
+  gint64       mtime;
+  gint64       size;
+  guint32      n_plug_in_defs;
+  guint32      i;
+  GError      *my_error = NULL;
+
+  g_return_val_if_fail (GIMP_IS_GIMP (gimp), NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (pluginrc != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  file = g_mapped_file_new (filename, FALSE, &my_error);
+
+  if (! file)
+    {
+      g_set_error (error, GIMP_CONFIG_ERROR,
+                   g_error_matches (my_error, G_FILE_ERROR, G_FILE_ERROR_NOENT) ?
+                   GIMP_CONFIG_ERROR_OPEN_ENOENT : GIMP_CONFIG_ERROR_OPEN,
+                   _("Could not open '%s' for reading: %s"),
+                   gimp_filename_to_utf8 (filename), my_error->message);
+      g_clear_error (&my_error);
+
+      return NULL;
+    }
+
+  bytes = g_mapped_file_get_bytes (file);
+  g_mapped_file_unref (file);
+
+  reader.data   = g_bytes_get_data (bytes, &reader.size);
+  reader.offset = 0;
+
+  if (! cache_read_uint32 (&reader, &magic)            ||
+      magic != PLUG_IN_RC_CACHE_MAGIC                  ||
+      ! cache_read_uint32 (&reader, &file_version)     ||
+      file_version != PLUG_IN_RC_CACHE_VERSION         ||
+      ! cache_read_uint32 (&reader, &protocol_version) ||
+      protocol_version != GIMP_PROTOCOL_VERSION)
+    {
+      g_set_error (error,
+                   GIMP_CONFIG_ERROR, GIMP_CONFIG_ERROR_VERSION,
+                   _("Skipping '%s': wrong pluginrc cache version."),
+                   gimp_filename_to_utf8 (filename));
+      g_bytes_unref (bytes);
+
+      return NULL;
+    }
+
+  if (! cache_read_int64 (&reader, &pluginrc_mtime) ||
+      ! cache_read_int64 (&reader, &pluginrc_size))
+    goto parse_error;
+
+  /*  a missing or edited pluginrc invalidates the cache  */
+  if (! cache_get_stamp (pluginrc, &mtime, &size, NULL) ||
+      mtime != pluginrc_mtime                          ||
+      size  != pluginrc_size)
+    {
+      g_set_error (error,
+                   GIMP_CONFIG_ERROR, GIMP_CONFIG_ERROR_VERSION,
+                   _("Skipping '%s': it doesn't match '%s'."),
+                   gimp_filename_to_utf8 (filename),
+                   gimp_filename_to_utf8 (pluginrc));
+      g_bytes_unref (bytes);
+
+      return NULL;
+    }
+
+  if (! cache_read_uint32 (&reader, &n_plug_in_defs))
+    goto parse_error;
+
+  for (i = 0; i < n_plug_in_defs; i++)
+    {
+      GimpPlugInDef *plug_in_def = cache_read_plug_in_def (&reader, bytes);
+
+      if (! plug_in_def)
+        goto parse_error;
+
+      plug_in_defs = g_slist_prepend (plug_in_defs, plug_in_def);
+    }
+
+  g_bytes_unref (bytes);
+
+  return g_slist_reverse (plug_in_defs);
+
+ parse_error:
+
+  g_set_error (error,
+               GIMP_CONFIG_ERROR, GIMP_CONFIG_ERROR_PARSE,
+               _("Skipping '%s': the pluginrc cache is corrupt."),
+               gimp_filename_to_utf8 (filename));
+
+  g_slist_free_full (plug_in_defs, (GDestroyNotify) g_object_unref);
+  g_bytes_unref (bytes);
+
+  return NULL;
+}
+
+gboolean
+plug_in_rc_cache_write (GSList       *plug_in_defs,
+                        const gchar  *filename,
+                        const gchar  *pluginrc,
+                        GError      **error)
+{
+  GString  *buf;
+  GSList   *list;
+  gint64    pluginrc_mtime;
+  gint64    pluginrc_size;
+  gsize     count_offset;
+  guint32   n_plug_in_defs = 0;
+  gboolean  success;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (pluginrc != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  /*  pluginrc has to be written first, the cache is only valid
+   *  together with it
+   */
+  if (! cache_get_stamp (pluginrc, &pluginrc_mtime, &pluginrc_size, error))
+    return FALSE;
+
+  buf = g_string_new (NULL);
+
+  cache_write_uint32 (buf, PLUG_IN_RC_CACHE_MAGIC);
+  cache_write_uint32 (buf, PLUG_IN_RC_CACHE_VERSION);
+  cache_write_uint32 (buf, GIMP_PROTOCOL_VERSION);
+  cache_write_int64  (buf, pluginrc_mtime);
+  cache_write_int64  (buf, pluginrc_size);
+
+  /*  filled in below  */
+  count_offset = buf->len;
+  cache_write_uint32 (buf, 0);
+
+  for (list = plug_in_defs; list; list = list->next)
+    {
+      GimpPlugInDef *plug_in_def = list->data;
+      GSList        *list2;
+      gsize          size_offset;
+      guint32        size;
+      guint32        n_procedures = 0;
+
+      if (! plug_in_def->procedures)
+        continue;
+
+      cache_write_string (buf, plug_in_def->prog);
+      cache_write_int64  (buf, plug_in_def->mtime);
+      cache_write_string (buf, plug_in_def->checksum);
+      cache_write_string (buf, plug_in_def->locale_domain_name);
+      cache_write_string (buf, plug_in_def->locale_domain_path);
+      cache_write_string (buf, plug_in_def->help_domain_name);
+      cache_write_string (buf, plug_in_def->help_domain_uri);
+      cache_write_uint32 (buf, plug_in_def->has_init);
+
+      /*  the size of the procedures block and the number of
+       *  procedures, both filled in below
+       */
+      size_offset = buf->len;
+      cache_write_uint32 (buf, 0);
+      cache_write_uint32 (buf, 0);
+
+      for (list2 = plug_in_def->procedures; list2; list2 = list2->next)
+        {
+          GimpPlugInProcedure *proc = list2->data;
+
+          if (proc->installed_during_init)
+            continue;
+
+          cache_write_procedure (buf, proc);
+          n_procedures++;
+        }
+
+      size = buf->len - size_offset - sizeof (guint32);
+
+      memcpy (buf->str + size_offset, &size, sizeof (guint32));
+      memcpy (buf->str + size_offset + sizeof (guint32),
+              &n_procedures, sizeof (guint32));
+
+      n_plug_in_defs++;
+    }
+
+  memcpy (buf->str + count_offset, &n_plug_in_defs, sizeof (guint32));
+
+  success = g_file_set_contents (filename, buf->str, buf->len, error);
+
+  g_string_free (buf, TRUE);
+
+  return success;
+}
+
+/**
+ * plug_in_rc_cache_load_procedures:
+ * @gimp:        a #Gimp
+ * @plug_in_def: a #GimpPlugInDef read by plug_in_rc_cache_parse()
+ *
+ * Decodes the procedures of @plug_in_def, which are left in the
+ * mapped cache file until the entry is known to be used.  Does
+ * nothing if they were decoded already, or if @plug_in_def didn't
+ * come from the cache.
+ *
+ * Returns: %FALSE if the procedures couldn't be decoded, in which
+ *          case the plug-in has to be queried again.
+ **/
+gboolean
+plug_in_rc_cache_load_procedures (Gimp          *gimp,
+                                  GimpPlugInDef *plug_in_def)
+{
+  CacheReader reader;
+  guint32     n_procedures;
+  guint32     i;
+  gboolean    success = TRUE;
+
+  g_return_val_if_fail (GIMP_IS_GIMP (gimp), FALSE);
+  g_return_val_if_fail (GIMP_IS_PLUG_IN_DEF (plug_in_def), FALSE);
+
+  if (! plug_in_def->cached_procedures)
+    return TRUE;
+
+  reader.data   = g_bytes_get_data (plug_in_def->cached_procedures,
+                                    &reader.size);
+  reader.offset = 0;
+
+  if (! cache_read_uint32 (&reader, &n_procedures))
+    success = FALSE;
+
+  for (i = 0; success && i < n_procedures; i++)
+    {
+      GimpPlugInProcedure *proc;
+
+      proc = cache_read_procedure (&reader, gimp, plug_in_def->prog);
+
+      if (proc)
+        {
+          gimp_plug_in_def_add_procedure (plug_in_def, proc);
+          g_object_unref (proc);
+        }
+      else
+        {
+          success = FALSE;
+        }
+    }
+
+  g_bytes_unref (plug_in_def->cached_procedures);
+  plug_in_def->cached_procedures = NULL;
+
+  return success;
+}
+
+
+/*  private functions  */
+
+static gboolean
+cache_get_stamp (const gchar  *pluginrc,
+                 gint64       *mtime,
+                 gint64       *size,
+                 GError      **error)
+{
+  GFile     *file;
+  GFileInfo *info;
+
+  file = g_file_new_for_path (pluginrc);
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NONE,
+                            NULL, error);
+  g_object_unref (file);
+
+  if (! info)
+    return FALSE;
+
+  *mtime = (g_file_info_get_attribute_uint64 (info,
+                                              G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+            G_USEC_PER_SEC +
+            g_file_info_get_attribute_uint32 (info,
+                                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+  *size  = g_file_info_get_size (info);
+
+  g_object_unref (info);
+
+  return TRUE;
+}
+
+static gboolean
+cache_read (CacheReader *reader,
+            gpointer     dest,
+            gsize        size)
+{
+  if (size > reader->size - reader->offset)
+    return FALSE;
+
+  memcpy (dest, reader->data + reader->offset, size);
+  reader->offset += size;
+
+  return TRUE;
+}
+
+static gboolean
+cache_read_uint32 (CacheReader *reader,
+                   guint32     *value)
+{
+  return cache_read (reader, value, sizeof (guint32));
+}
+
+static gboolean
+cache_read_int64 (CacheReader *reader,
+                  gint64      *value)
+{
+  return cache_read (reader, value, sizeof (gint64));
+}
+
+static gboolean
+cache_read_string (CacheReader  *reader,
+                   gchar       **value)
+{
+  guint32 length;
+
+  if (! cache_read_uint32 (reader, &length))
+    return FALSE;
+
+  if (length == NULL_STRING_LENGTH)
+    {
+      *value = NULL;
+
+      return TRUE;
+    }
+
+  if (length > reader->size - reader->offset)
+    return FALSE;
+
+  *value = g_strndup ((const gchar *) reader->data + reader->offset, length);
+  reader->offset += length;
+
+  return TRUE;
+}
+
+static gboolean
+cache_read_data (CacheReader  *reader,
+                 gsize         size,
+                 guint8      **value)
+{
+  if (size > reader->size - reader->offset)
+    return FALSE;
+
+  *value = g_memdup (reader->data + reader->offset, size);
+  reader->offset += size;
+
+  return TRUE;
+}
+
+static void
+cache_write_uint32 (GString *buf,
+                    guint32  value)
+{
+  g_string_append_len (buf, (const gchar *) &value, sizeof (guint32));
+}
+
+static void
+cache_write_int64 (GString *buf,
+                   gint64   value)
+{
+  g_string_append_len (buf, (const gchar *) &value, sizeof (gint64));
+}
+
+static void
+cache_write_string (GString     *buf,
+                    const gchar *value)
+{
+  if (value)
+    {
+      guint32 length = strlen (value);
+
+      cache_write_uint32 (buf, length);
+      g_string_append_len (buf, value, length);
+    }
+  else
+    {
+      cache_write_uint32 (buf, NULL_STRING_LENGTH);
+    }
+}
+
+static GimpPlugInDef *
+cache_read_plug_in_def (CacheReader *reader,
+                        GBytes      *bytes)
+{
+  GimpPlugInDef *plug_in_def;
+  gchar         *prog;
+  gchar         *domain_name;
+  gchar         *domain_path;
+  gint64         mtime;
+  guint32        has_init;
+  guint32        size;
+
+  if (! cache_read_string (reader, &prog) || ! prog)
+    return NULL;
+
+  plug_in_def = gimp_plug_in_def_new (prog);
+  g_free (prog);
+
+  if (! cache_read_int64 (reader, &mtime) ||
+      ! cache_read_string (reader, &plug_in_def->checksum))
+    goto error;
+
+  plug_in_def->mtime = mtime;
+
+  if (! cache_read_string (reader, &domain_name))
+    goto error;
+
+  if (! cache_read_string (reader, &domain_path))
+    {
+      g_free (domain_name);
+      goto error;
+    }
+
+  if (domain_name)
+    gimp_plug_in_def_set_locale_domain (plug_in_def, domain_name, domain_path);
+
+  g_free (domain_name);
+  g_free (domain_path);
+
+  if (! cache_read_string (reader, &domain_name))
+    goto error;
+
+  if (! cache_read_string (reader, &domain_path))
+    {
+      g_free (domain_name);
+      goto error;
+    }
+
+  if (domain_name)
+    gimp_plug_in_def_set_help_domain (plug_in_def, domain_name, domain_path);
+
+  g_free (domain_name);
+  g_free (domain_path);
+
+  if (! cache_read_uint32 (reader, &has_init) ||
+      ! cache_read_uint32 (reader, &size)     ||
+      size > reader->size - reader->offset)
+    goto error;
+
+  gimp_plug_in_def_set_has_init (plug_in_def, has_init);
+
+  /*  keep the procedures in the mapped file for now  */
+  plug_in_def->cached_procedures = g_bytes_new_from_bytes (bytes,
+                                                           reader->offset,
+                                                           size);
+  reader->offset += size;
+
+  return plug_in_def;
+
+ error:
+
+  g_object_unref (plug_in_def);
+
+  return NULL;
+}
+
+static GimpPlugInProcedure *
+cache_read_procedure (CacheReader *reader,
+                      Gimp        *gimp,
+                      const gchar *prog)
+{
+  GimpProcedure       *procedure;
+  GimpPlugInProcedure *proc;
+  gchar               *name;
+  gchar               *str;
+  guint32              proc_type;
+  guint32              n_menu_paths;
+  guint32              icon_type;
+  guint32              icon_data_length;
+  guint32              file_proc;
+  guint32              handles_uri;
+  guint32              n_args;
+  guint32              n_return_vals;
+  guint32              i;
+
+  if (! cache_read_string (reader, &name) || ! name)
+    return NULL;
+
+  if (! cache_read_uint32 (reader, &proc_type))
+    {
+      g_free (name);
+      return NULL;
+    }
+
+  procedure = gimp_plug_in_procedure_new (proc_type, prog);
+  proc      = GIMP_PLUG_IN_PROCEDURE (procedure);
+
+  gimp_object_take_name (GIMP_OBJECT (procedure),
+                         gimp_canonicalize_identifier (name));
+
+  procedure->original_name = name;
+
+  if (! cache_read_string (reader, &procedure->blurb)     ||
+      ! cache_read_string (reader, &procedure->help)      ||
+      ! cache_read_string (reader, &procedure->author)    ||
+      ! cache_read_string (reader, &procedure->copyright) ||
+      ! cache_read_string (reader, &procedure->date)      ||
+      ! cache_read_string (reader, &proc->menu_label)     ||
+      ! cache_read_uint32 (reader, &n_menu_paths))
+    goto error;
+
+  for (i = 0; i < n_menu_paths; i++)
+    {
+      if (! cache_read_string (reader, &str) || ! str)
+        goto error;
+
+      proc->menu_paths = g_list_append (proc->menu_paths, str);
+    }
+
+  if (! cache_read_uint32 (reader, &icon_type) ||
+      ! cache_read_uint32 (reader, &icon_data_length))
+    goto error;
+
+  switch (icon_type)
+    {
+    case GIMP_ICON_TYPE_STOCK_ID:
+    case GIMP_ICON_TYPE_IMAGE_FILE:
+      if (! cache_read_string (reader, &str))
+        goto error;
+
+      proc->icon_data_length = -1;
+      proc->icon_data        = (guint8 *) str;
+      break;
+
+    case GIMP_ICON_TYPE_INLINE_PIXBUF:
+      if (! cache_read_data (reader, icon_data_length, &proc->icon_data))
+        goto error;
+
+      proc->icon_data_length = icon_data_length;
+      break;
+
+    default:
+      goto error;
+    }
+
+  proc->icon_type = icon_type;
+
+  if (! cache_read_uint32 (reader, &file_proc))
+    goto error;
+
+  if (file_proc)
+    {
+      proc->file_proc = TRUE;
+
+      if (! cache_read_string (reader, &proc->extensions) ||
+          ! cache_read_string (reader, &proc->prefixes)   ||
+          ! cache_read_string (reader, &proc->magics))
+        goto error;
+
+      if (! cache_read_string (reader, &str))
+        goto error;
+
+      if (str)
+        gimp_plug_in_procedure_set_mime_type (proc, str);
+      g_free (str);
+
+      if (! cache_read_uint32 (reader, &handles_uri))
+        goto error;
+
+      if (handles_uri)
+        gimp_plug_in_procedure_set_handles_uri (proc);
+
+      if (! cache_read_string (reader, &str))
+        goto error;
+
+      if (str)
+        gimp_plug_in_procedure_set_thumb_loader (proc, str);
+      g_free (str);
+    }
+
+  if (! cache_read_string (reader, &str))
+    goto error;
+
+  gimp_plug_in_procedure_set_image_types (proc, str);
+  g_free (str);
+
+  if (! cache_read_uint32 (reader, &n_args) ||
+      ! cache_read_uint32 (reader, &n_return_vals))
+    goto error;
+
+  for (i = 0; i < n_args + n_return_vals; i++)
+    {
+      GParamSpec *pspec;
+      guint32     arg_type;
+      gchar      *desc;
+
+      if (! cache_read_uint32 (reader, &arg_type) ||
+          ! cache_read_string (reader, &name)     ||
+          ! name)
+        goto error;
+
+      if (! cache_read_string (reader, &desc))
+        {
+          g_free (name);
+          goto error;
+        }
+
+      pspec = gimp_pdb_compat_param_spec (gimp, arg_type, name, desc);
+
+      if (i < n_args)
+        gimp_procedure_add_argument (procedure, pspec);
+      else
+        gimp_procedure_add_return_value (procedure, pspec);
+
+      g_free (name);
+      g_free (desc);
+    }
+
+  return proc;
+
+ error:
+
+  g_object_unref (procedure);
+
+  return NULL;
+}
+
+static void
+cache_write_procedure (GString             *buf,
+                       GimpPlugInProcedure *proc)
+{
+  GimpProcedure *procedure = GIMP_PROCEDURE (proc);
+  GList         *list;
+  gint           i;
+
+  cache_write_string (buf, procedure->original_name);
+  cache_write_uint32 (buf, procedure->proc_type);
+  cache_write_string (buf, procedure->blurb);
+  cache_write_string (buf, procedure->help);
+  cache_write_string (buf, procedure->author);
+  cache_write_string (buf, procedure->copyright);
+  cache_write_string (buf, procedure->date);
+  cache_write_string (buf, proc->menu_label);
+
+  cache_write_uint32 (buf, g_list_length (proc->menu_paths));
+
+  for (list = proc->menu_paths; list; list = list->next)
+    cache_write_string (buf, list->data);
+
+  cache_write_uint32 (buf, proc->icon_type);
+  cache_write_uint32 (buf, proc->icon_data_length);
+
+  switch (proc->icon_type)
+    {
+    case GIMP_ICON_TYPE_STOCK_ID:
+    case GIMP_ICON_TYPE_IMAGE_FILE:
+      cache_write_string (buf, (const gchar *) proc->icon_data);
+      break;
+
+    case GIMP_ICON_TYPE_INLINE_PIXBUF:
+      g_string_append_len (buf,
+                           (const gchar *) proc->icon_data,
+                           proc->icon_data_length);
+      break;
+    }
+
+  cache_write_uint32 (buf, proc->file_proc);
+
+  if (proc->file_proc)
+    {
+      cache_write_string (buf, proc->extensions);
+      cache_write_string (buf, proc->prefixes);
+      cache_write_string (buf, proc->magics);
+      cache_write_string (buf, proc->mime_type);
+      cache_write_uint32 (buf, proc->handles_uri);
+      cache_write_string (buf, proc->thumb_loader);
+    }
+
+  cache_write_string (buf, proc->image_types);
+
+  cache_write_uint32 (buf, procedure->num_args);
+  cache_write_uint32 (buf, procedure->num_values);
+
+  for (i = 0; i < procedure->num_args; i++)
+    {
+      GParamSpec *pspec = procedure->args[i];
+
+      cache_write_uint32 (buf,
+                          gimp_pdb_compat_arg_type_from_gtype (G_PARAM_SPEC_VALUE_TYPE (pspec)));
+      cache_write_string (buf, g_param_spec_get_name (pspec));
+      cache_write_string (buf, g_param_spec_get_blurb (pspec));
+    }
+
+  for (i = 0; i < procedure->num_values; i++)
+    {
+      GParamSpec *pspec = procedure->values[i];
+
+      cache_write_uint32 (buf,
+                          gimp_pdb_compat_arg_type_from_gtype (G_PARAM_SPEC_VALUE_TYPE (pspec)));
+      cache_write_string (buf, g_param_spec_get_name (pspec));
+      cache_write_string (buf, g_param_spec_get_blurb (pspec));
+    }
+}
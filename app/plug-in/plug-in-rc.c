@@ -39,7 +39,7 @@
 #include "gimp-intl.h"
 
 
-#define PLUG_IN_RC_FILE_VERSION 2
+#define PLUG_IN_RC_FILE_VERSION 3
 
 
 /*
@@ -70,6 +70,8 @@ static GTokenType plug_in_help_def_deserialize   (GScanner             *scanner,
                                                   GimpPlugInDef        *plug_in_def);
 static GTokenType plug_in_has_init_deserialize   (GScanner             *scanner,
                                                   GimpPlugInDef        *plug_in_def);
+static GTokenType plug_in_checksum_deserialize   (GScanner             *scanner,
+                                                  GimpPlugInDef        *plug_in_def);
 
 
 enum
@@ -81,6 +83,7 @@ enum
   LOCALE_DEF,
   HELP_DEF,
   HAS_INIT,
+  CHECKSUM,
   PROC_ARG,
   MENU_PATH,
   ICON,
@@ -135,6 +138,8 @@ plug_in_rc_parse (Gimp         *gimp,
                               "help-def", GINT_TO_POINTER (HELP_DEF));
   g_scanner_scope_add_symbol (scanner, PLUG_IN_DEF,
                               "has-init", GINT_TO_POINTER (HAS_INIT));
+  g_scanner_scope_add_symbol (scanner, PLUG_IN_DEF,
+                              "checksum", GINT_TO_POINTER (CHECKSUM));
   g_scanner_scope_add_symbol (scanner, PLUG_IN_DEF,
                               "proc-arg", GINT_TO_POINTER (PROC_ARG));
   g_scanner_scope_add_symbol (scanner, PLUG_IN_DEF,
@@ -320,6 +325,10 @@ plug_in_def_deserialize (Gimp      *gimp,
               token = plug_in_has_init_deserialize (scanner, plug_in_def);
               break;
 
+            case CHECKSUM:
+              token = plug_in_checksum_deserialize (scanner, plug_in_def);
+              break;
+
             default:
               break;
             }
@@ -779,6 +788,25 @@ plug_in_has_init_deserialize (GScanner      *scanner,
   return G_TOKEN_LEFT_PAREN;
 }
 
+static GTokenType
+plug_in_checksum_deserialize (GScanner      *scanner,
+                              GimpPlugInDef *plug_in_def)
+{
+  gchar *checksum;
+
+  if (! gimp_scanner_parse_string (scanner, &checksum))
+    return G_TOKEN_STRING;
+
+  gimp_plug_in_def_set_checksum (plug_in_def, checksum);
+
+  g_free (checksum);
+
+  if (! gimp_scanner_parse_token (scanner, G_TOKEN_RIGHT_PAREN))
+    return G_TOKEN_RIGHT_PAREN;
+
+  return G_TOKEN_LEFT_PAREN;
+}
+
 
 /* serialize functions */
 
@@ -1019,6 +1047,13 @@ plug_in_rc_write (GSList       *plug_in_defs,
               gimp_config_writer_close (writer);
             }
 
+          if (plug_in_def->checksum)
+            {
+              gimp_config_writer_open (writer, "checksum");
+              gimp_config_writer_string (writer, plug_in_def->checksum);
+              gimp_config_writer_close (writer);
+            }
+
           gimp_config_writer_close (writer);
         }
     }
@@ -0,0 +1,246 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gegl.h>
+
+#include "libgimpconfig/gimpconfig.h"
+
+#include "plug-in/plug-in-types.h"
+
+#include "core/gimp.h"
+
+#include "pdb/gimpprocedure.h"
+
+#include "plug-in/gimpplugindef.h"
+#include "plug-in/gimppluginprocedure.h"
+#include "plug-in/plug-in-rc-cache.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define TEST_PROG      "/nonexistent/test-plug-in"
+#define TEST_PROCEDURE "test-procedure"
+#define TEST_MTIME     1234567
+
+#define ADD_TEST(function) \
+  g_test_add ("/gimp-plug-in-rc-cache/" #function, \
+              GimpTestFixture, \
+              gimp, \
+              gimp_test_cache_setup, \
+              function, \
+              gimp_test_cache_teardown);
+
+
+typedef struct
+{
+  gchar *dir;
+  gchar *pluginrc;
+  gchar *cache;
+} GimpTestFixture;
+
+
+static void
+gimp_test_cache_setup (GimpTestFixture *fixture,
+                       gconstpointer    data)
+{
+  GimpPlugInDef       *plug_in_def;
+  GimpPlugInProcedure *proc;
+  GSList              *plug_in_defs;
+  GError              *error = NULL;
+
+  fixture->dir      = g_dir_make_tmp ("gimp-test-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  fixture->pluginrc = g_build_filename (fixture->dir, "pluginrc", NULL);
+  fixture->cache    = g_build_filename (fixture->dir, "pluginrc.cache", NULL);
+
+  /*  the cache doesn't care about the contents of pluginrc, only
+   *  that it is unchanged
+   */
+  g_file_set_contents (fixture->pluginrc, "(protocol-version 0)\n", -1,
+                       &error);
+  g_assert_no_error (error);
+
+  plug_in_def = gimp_plug_in_def_new (TEST_PROG);
+  gimp_plug_in_def_set_mtime (plug_in_def, TEST_MTIME);
+
+  proc = GIMP_PLUG_IN_PROCEDURE (gimp_plug_in_procedure_new (GIMP_PLUGIN,
+                                                             TEST_PROG));
+  gimp_object_set_name (GIMP_OBJECT (proc), TEST_PROCEDURE);
+  gimp_procedure_set_strings (GIMP_PROCEDURE (proc),
+                              TEST_PROCEDURE,
+                              "blurb", "help", "author", "copyright", "date",
+                              NULL);
+
+  gimp_plug_in_def_add_procedure (plug_in_def, proc);
+  g_object_unref (proc);
+
+  plug_in_defs = g_slist_prepend (NULL, plug_in_def);
+
+  g_assert (plug_in_rc_cache_write (plug_in_defs,
+                                    fixture->cache, fixture->pluginrc,
+                                    &error));
+  g_assert_no_error (error);
+
+  g_slist_free_full (plug_in_defs, (GDestroyNotify) g_object_unref);
+}
+
+static void
+gimp_test_cache_teardown (GimpTestFixture *fixture,
+                          gconstpointer    data)
+{
+  g_unlink (fixture->pluginrc);
+  g_unlink (fixture->cache);
+  g_rmdir (fixture->dir);
+
+  g_free (fixture->pluginrc);
+  g_free (fixture->cache);
+  g_free (fixture->dir);
+}
+
+/**
+ * read_back:
+ *
+ * Test that a cache written together with pluginrc is read back with
+ * the same plug-in and procedure.
+ **/
+static void
+read_back (GimpTestFixture *fixture,
+           gconstpointer    data)
+{
+  Gimp          *gimp = GIMP (data);
+  GimpPlugInDef *plug_in_def;
+  GimpProcedure *procedure;
+  GSList        *plug_in_defs;
+  GError        *error = NULL;
+
+  plug_in_defs = plug_in_rc_cache_parse (gimp,
+                                         fixture->cache, fixture->pluginrc,
+                                         &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (g_slist_length (plug_in_defs), ==, 1);
+
+  plug_in_def = plug_in_defs->data;
+
+  g_assert_cmpstr (plug_in_def->prog, ==, TEST_PROG);
+  g_assert_cmpint (plug_in_def->mtime, ==, TEST_MTIME);
+
+  /*  the procedures are only decoded on demand  */
+  g_assert (plug_in_def->procedures == NULL);
+  g_assert (plug_in_rc_cache_load_procedures (gimp, plug_in_def));
+  g_assert_cmpint (g_slist_length (plug_in_def->procedures), ==, 1);
+
+  procedure = plug_in_def->procedures->data;
+
+  g_assert_cmpstr (gimp_object_get_name (procedure), ==, TEST_PROCEDURE);
+  g_assert_cmpstr (procedure->blurb, ==, "blurb");
+
+  g_slist_free_full (plug_in_defs, (GDestroyNotify) g_object_unref);
+}
+
+/**
+ * changed_pluginrc:
+ *
+ * Test that the cache is rejected when pluginrc was edited after the
+ * cache was written.
+ **/
+static void
+changed_pluginrc (GimpTestFixture *fixture,
+                  gconstpointer    data)
+{
+  Gimp   *gimp = GIMP (data);
+  GSList *plug_in_defs;
+  GError *error = NULL;
+
+  g_file_set_contents (fixture->pluginrc,
+                       "(protocol-version 0)\n"
+                       "# edited by hand\n", -1,
+                       &error);
+  g_assert_no_error (error);
+
+  plug_in_defs = plug_in_rc_cache_parse (gimp,
+                                         fixture->cache, fixture->pluginrc,
+                                         &error);
+  g_assert (plug_in_defs == NULL);
+  g_assert_error (error, GIMP_CONFIG_ERROR, GIMP_CONFIG_ERROR_VERSION);
+
+  g_clear_error (&error);
+}
+
+/**
+ * missing_pluginrc:
+ *
+ * Test that the cache is rejected when pluginrc was removed.
+ **/
+static void
+missing_pluginrc (GimpTestFixture *fixture,
+                  gconstpointer    data)
+{
+  Gimp   *gimp = GIMP (data);
+  GSList *plug_in_defs;
+  GError *error = NULL;
+
+  g_unlink (fixture->pluginrc);
+
+  plug_in_defs = plug_in_rc_cache_parse (gimp,
+                                         fixture->cache, fixture->pluginrc,
+                                         &error);
+  g_assert (plug_in_defs == NULL);
+  g_assert_error (error, GIMP_CONFIG_ERROR, GIMP_CONFIG_ERROR_VERSION);
+
+  g_clear_error (&error);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  /* We share the same application instance across all tests */
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (read_back);
+  ADD_TEST (changed_pluginrc);
+  ADD_TEST (missing_pluginrc);
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Exit so we don't break script-fu plug-in wire */
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
@@ -103,11 +103,12 @@ gimp_pattern_select_run_callback (GimpPdbDialog  *dialog,
                                   GError        **error)
 {
   GimpPattern    *pattern = GIMP_PATTERN (object);
+  GimpTempBuf    *mask    = gimp_pattern_get_mask (pattern);
   GimpArray      *array;
   GimpValueArray *return_vals;
 
-  array = gimp_array_new (gimp_temp_buf_get_data (pattern->mask),
-                          gimp_temp_buf_get_data_size (pattern->mask),
+  array = gimp_array_new (gimp_temp_buf_get_data (mask),
+                          gimp_temp_buf_get_data_size (mask),
                           TRUE);
 
   return_vals =
@@ -116,9 +117,9 @@ gimp_pattern_select_run_callback (GimpPdbDialog  *dialog,
                                         NULL, error,
                                         dialog->callback_name,
                                         G_TYPE_STRING,        gimp_object_get_name (object),
-                                        GIMP_TYPE_INT32,      gimp_temp_buf_get_width  (pattern->mask),
-                                        GIMP_TYPE_INT32,      gimp_temp_buf_get_height (pattern->mask),
-                                        GIMP_TYPE_INT32,      babl_format_get_bytes_per_pixel (gimp_temp_buf_get_format (pattern->mask)),
+                                        GIMP_TYPE_INT32,      gimp_temp_buf_get_width  (mask),
+                                        GIMP_TYPE_INT32,      gimp_temp_buf_get_height (mask),
+                                        GIMP_TYPE_INT32,      babl_format_get_bytes_per_pixel (gimp_temp_buf_get_format (mask)),
                                         GIMP_TYPE_INT32,      array->length,
                                         GIMP_TYPE_INT8_ARRAY, array,
                                         GIMP_TYPE_INT32,      closing,
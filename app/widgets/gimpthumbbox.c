@@ -682,6 +682,11 @@ gimp_thumb_box_create_thumbnail (GimpThumbBox      *box,
     {
       GError *error = NULL;
 
+      /*  this stays blocking: creating thumbnails for a selection is
+       *  a modal operation the user asked for, with a "Thumbnail n of
+       *  m" progress and Cancel that need each thumbnail to be done
+       *  before the next one is started
+       */
       if (! gimp_imagefile_create_thumbnail (box->imagefile, box->context,
                                              progress,
                                              size, ! force, &error))
@@ -735,10 +740,14 @@ gimp_thumb_box_auto_thumbnail (GimpThumbBox *box)
                                   _("Creating preview..."));
             }
 
-          gimp_imagefile_create_thumbnail_weak (box->imagefile, box->context,
-                                                GIMP_PROGRESS (box),
-                                                gimp->config->thumbnail_size,
-                                                TRUE);
+          /*  this is the file the user is looking at, let it jump
+           *  ahead of any other queued thumbnails
+           */
+          gimp_imagefile_create_thumbnail_async (box->imagefile, box->context,
+                                                 GIMP_PROGRESS (box),
+                                                 gimp->config->thumbnail_size,
+                                                 TRUE,
+                                                 GIMP_IMAGEFILE_PRIORITY_VISIBLE);
         }
       break;
 
@@ -19,6 +19,8 @@
 
 #include <string.h>
 
+#include <zlib.h>
+
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -112,7 +114,12 @@ static gboolean        xcf_load_tile_rle      (XcfInfo       *info,
                                                GeglBuffer    *buffer,
                                                GeglRectangle *tile_rect,
                                                const Babl    *format,
-                                               gint           data_length);
+                                               goffset        data_length);
+static gboolean        xcf_load_tile_zlib     (XcfInfo       *info,
+                                               GeglBuffer    *buffer,
+                                               GeglRectangle *tile_rect,
+                                               const Babl    *format,
+                                               goffset        data_length);
 static GimpParasite  * xcf_load_parasite      (XcfInfo       *info);
 static gboolean        xcf_load_old_paths     (XcfInfo       *info,
                                                GimpImage     *image);
@@ -123,6 +130,9 @@ static gboolean        xcf_load_vectors       (XcfInfo       *info,
 static gboolean        xcf_load_vector        (XcfInfo       *info,
                                                GimpImage     *image);
 
+static guint           xcf_read_offset        (XcfInfo       *info,
+                                               goffset       *data,
+                                               gint           count);
 static gboolean        xcf_skip_unknown_prop  (XcfInfo       *info,
                                                gsize          size);
 
@@ -142,8 +152,8 @@ xcf_load_image (Gimp     *gimp,
   GimpImage          *image = NULL;
   const GimpParasite *parasite;
   gboolean            has_metadata = FALSE;
-  guint32             saved_pos;
-  guint32             offset;
+  goffset             saved_pos;
+  goffset             offset;
   gint                width;
   gint                height;
   gint                image_type;
@@ -355,7 +365,7 @@ xcf_load_image (Gimp     *gimp,
       GList     *item_path = NULL;
 
       /* read in the offset of the next layer */
-      info->cp += xcf_read_int32 (info->input, &offset, 1);
+      info->cp += xcf_read_offset (info, &offset, 1);
 
       /* if the offset is 0 then we are at the end
        *  of the layer list.
@@ -439,7 +449,7 @@ xcf_load_image (Gimp     *gimp,
       GimpChannel *channel;
 
       /* read in the offset of the next channel */
-      info->cp += xcf_read_int32 (info->input, &offset, 1);
+      info->cp += xcf_read_offset (info, &offset, 1);
 
       /* if the offset is 0 then we are at the end
        *  of the channel list.
@@ -749,7 +759,7 @@ xcf_load_image_props (XcfInfo   *info,
 
         case PROP_PARASITES:
           {
-            glong base = info->cp;
+            goffset base = info->cp;
 
             while (info->cp - base < prop_size)
               {
@@ -858,7 +868,7 @@ xcf_load_image_props (XcfInfo   *info,
 
         case PROP_VECTORS:
           {
-            guint32 base = info->cp;
+            goffset base = info->cp;
 
             if (xcf_load_vectors (info, image))
               {
@@ -866,7 +876,7 @@ xcf_load_image_props (XcfInfo   *info,
                   {
                     g_printerr ("Mismatch in PROP_VECTORS size: "
                                 "skipping %d bytes.\n",
-                                base + prop_size - info->cp);
+                                (gint) (base + prop_size - info->cp));
                     xcf_seek_pos (info, base + prop_size, NULL);
                   }
               }
@@ -924,9 +934,7 @@ xcf_load_layer_props (XcfInfo    *info,
 
         case PROP_FLOATING_SELECTION:
           info->floating_sel = *layer;
-          info->cp +=
-            xcf_read_int32 (info->input,
-                            (guint32 *) &info->floating_sel_offset, 1);
+          info->cp += xcf_read_offset (info, &info->floating_sel_offset, 1);
           break;
 
         case PROP_OPACITY:
@@ -1035,7 +1043,7 @@ xcf_load_layer_props (XcfInfo    *info,
 
         case PROP_PARASITES:
           {
-            glong base = info->cp;
+            goffset base = info->cp;
 
             while (info->cp - base < prop_size)
               {
@@ -1089,8 +1097,8 @@ xcf_load_layer_props (XcfInfo    *info,
 
         case PROP_ITEM_PATH:
           {
-            glong  base = info->cp;
-            GList *path = NULL;
+            goffset  base = info->cp;
+            GList   *path = NULL;
 
             while (info->cp - base < prop_size)
               {
@@ -1244,7 +1252,7 @@ xcf_load_channel_props (XcfInfo      *info,
 
         case PROP_PARASITES:
           {
-            glong base = info->cp;
+            goffset base = info->cp;
 
             while ((info->cp - base) < prop_size)
               {
@@ -1317,8 +1325,8 @@ xcf_load_layer (XcfInfo    *info,
 {
   GimpLayer         *layer;
   GimpLayerMask     *layer_mask;
-  guint32            hierarchy_offset;
-  guint32            layer_mask_offset;
+  goffset            hierarchy_offset;
+  goffset            layer_mask_offset;
   gboolean           apply_mask = TRUE;
   gboolean           edit_mask  = FALSE;
   gboolean           show_mask  = FALSE;
@@ -1420,8 +1428,8 @@ xcf_load_layer (XcfInfo    *info,
     }
 
   /* read the hierarchy and layer mask offsets */
-  info->cp += xcf_read_int32 (info->input, &hierarchy_offset, 1);
-  info->cp += xcf_read_int32 (info->input, &layer_mask_offset, 1);
+  info->cp += xcf_read_offset (info, &hierarchy_offset, 1);
+  info->cp += xcf_read_offset (info, &layer_mask_offset, 1);
 
   /* read in the hierarchy (ignore it for group layers, both as an
    * optimization and because the hierarchy's extents don't match
@@ -1488,7 +1496,7 @@ xcf_load_channel (XcfInfo   *info,
                   GimpImage *image)
 {
   GimpChannel *channel;
-  guint32      hierarchy_offset;
+  goffset      hierarchy_offset;
   gint         width;
   gint         height;
   gboolean     is_fs_drawable;
@@ -1518,7 +1526,7 @@ xcf_load_channel (XcfInfo   *info,
   xcf_progress_update (info);
 
   /* read the hierarchy and layer mask offsets */
-  info->cp += xcf_read_int32 (info->input, &hierarchy_offset, 1);
+  info->cp += xcf_read_offset (info, &hierarchy_offset, 1);
 
   /* read in the hierarchy */
   if (!xcf_seek_pos (info, hierarchy_offset, NULL))
@@ -1546,7 +1554,7 @@ xcf_load_layer_mask (XcfInfo   *info,
 {
   GimpLayerMask *layer_mask;
   GimpChannel   *channel;
-  guint32        hierarchy_offset;
+  goffset        hierarchy_offset;
   gint           width;
   gint           height;
   gboolean       is_fs_drawable;
@@ -1577,7 +1585,7 @@ xcf_load_layer_mask (XcfInfo   *info,
   xcf_progress_update (info);
 
   /* read the hierarchy and layer mask offsets */
-  info->cp += xcf_read_int32 (info->input, &hierarchy_offset, 1);
+  info->cp += xcf_read_offset (info, &hierarchy_offset, 1);
 
   /* read in the hierarchy */
   if (! xcf_seek_pos (info, hierarchy_offset, NULL))
@@ -1605,9 +1613,9 @@ xcf_load_buffer (XcfInfo    *info,
                  GeglBuffer *buffer)
 {
   const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
-  guint32     junk;
+  goffset     saved_pos;
+  goffset     offset;
+  goffset     junk;
   gint        width;
   gint        height;
   gint        bpp;
@@ -1631,13 +1639,13 @@ xcf_load_buffer (XcfInfo    *info,
    *  as the number of levels found in the file.
    */
 
-  info->cp += xcf_read_int32 (info->input, &offset, 1); /* top level */
+  info->cp += xcf_read_offset (info, &offset, 1); /* top level */
 
   /* discard offsets for layers below first, if any.
    */
   do
     {
-      info->cp += xcf_read_int32 (info->input, &junk, 1);
+      info->cp += xcf_read_offset (info, &junk, 1);
     }
   while (junk != 0);
 
@@ -1670,8 +1678,8 @@ xcf_load_level (XcfInfo    *info,
 {
   const Babl *format;
   gint        bpp;
-  guint32     saved_pos;
-  guint32     offset, offset2;
+  goffset     saved_pos;
+  goffset     offset, offset2;
   gint        n_tile_rows;
   gint        n_tile_cols;
   guint       ntiles;
@@ -1694,7 +1702,7 @@ xcf_load_level (XcfInfo    *info,
    *  if it is '0', then this tile level is empty
    *  and we can simply return.
    */
-  info->cp += xcf_read_int32 (info->input, &offset, 1);
+  info->cp += xcf_read_offset (info, &offset, 1);
   if (offset == 0)
     return TRUE;
 
@@ -1723,7 +1731,7 @@ xcf_load_level (XcfInfo    *info,
 
       /* read in the offset of the next tile so we can calculate the amount
          of data needed for this tile*/
-      info->cp += xcf_read_int32 (info->input, &offset2, 1);
+      info->cp += xcf_read_offset (info, &offset2, 1);
 
       /* if the offset is 0 then we need to read in the maximum possible
          allowing for negative compression */
@@ -1754,8 +1762,9 @@ xcf_load_level (XcfInfo    *info,
             fail = TRUE;
           break;
         case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
-          fail = TRUE;
+          if (!xcf_load_tile_zlib (info, buffer, &rect, format,
+                                   offset2 - offset))
+            fail = TRUE;
           break;
         case COMPRESS_FRACTAL:
           g_error ("xcf: fractal compression unimplemented");
@@ -1773,13 +1782,14 @@ xcf_load_level (XcfInfo    *info,
         return FALSE;
 
       /* read in the offset of the next tile */
-      info->cp += xcf_read_int32 (info->input, &offset, 1);
+      info->cp += xcf_read_offset (info, &offset, 1);
     }
 
   if (offset != 0)
     {
       gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
-                    "encountered garbage after reading level: %d", offset);
+                    "encountered garbage after reading level: %"
+                    G_GOFFSET_FORMAT, offset);
       return FALSE;
     }
 
@@ -1809,7 +1819,7 @@ xcf_load_tile_rle (XcfInfo       *info,
                    GeglBuffer    *buffer,
                    GeglRectangle *tile_rect,
                    const Babl    *format,
-                   gint           data_length)
+                   goffset        data_length)
 {
   gint    bpp       = babl_format_get_bytes_per_pixel (format);
   gint    tile_size = bpp * tile_rect->width * tile_rect->height;
@@ -1829,7 +1839,13 @@ xcf_load_tile_rle (XcfInfo       *info,
   if (data_length <= 0)
     return TRUE;
 
-  xcfdata = xcfodata = g_alloca (data_length);
+  /* the length comes from the file, don't read more than the RLE data
+   * of a whole tile can take, see xcf_load_level()
+   */
+  data_length = MIN (data_length,
+                     XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5);
+
+  xcfdata = xcfodata = g_malloc (data_length);
 
   /* we have to read directly instead of xcf_read_* because we may be
    * reading past the end of the file here
@@ -1838,7 +1854,10 @@ xcf_load_tile_rle (XcfInfo       *info,
                            &nmemb_read_successfully, NULL, NULL);
 
   if (nmemb_read_successfully == 0)
-    return TRUE;
+    {
+      g_free (xcfodata);
+      return TRUE;
+    }
 
   info->cp += nmemb_read_successfully;
 
@@ -1934,15 +1953,76 @@ xcf_load_tile_rle (XcfInfo       *info,
         }
     }
 
+  g_free (xcfodata);
+
   gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
                    GEGL_AUTO_ROWSTRIDE);
 
   return TRUE;
 
  bogus_rle:
+  g_free (xcfodata);
   return FALSE;
 }
 
+static gboolean
+xcf_load_tile_zlib (XcfInfo       *info,
+                    GeglBuffer    *buffer,
+                    GeglRectangle *tile_rect,
+                    const Babl    *format,
+                    goffset        data_length)
+{
+  gint    bpp       = babl_format_get_bytes_per_pixel (format);
+  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
+  guchar *tile_data = g_alloca (tile_size);
+  gsize   nmemb_read_successfully;
+  guchar *xcfdata;
+  uLongf  len       = tile_size;
+
+  /* see xcf_load_tile_rle() */
+  if (data_length <= 0)
+    return TRUE;
+
+  /* the length comes from the file, a valid zlib stream of the tile
+   * can't be longer than this
+   */
+  data_length = MIN (data_length, compressBound (tile_size));
+
+  xcfdata = g_malloc (data_length);
+
+  /* we have to read directly instead of xcf_read_* because we may be
+   * reading past the end of the file here
+   */
+  g_input_stream_read_all (info->input, xcfdata, data_length,
+                           &nmemb_read_successfully, NULL, NULL);
+
+  if (nmemb_read_successfully == 0)
+    {
+      g_free (xcfdata);
+      return TRUE;
+    }
+
+  info->cp += nmemb_read_successfully;
+
+  /* uncompress() stops at the end of the zlib stream, so it doesn't
+   * matter that we may have read a bit of the next tile, too
+   */
+  if (uncompress (tile_data, &len,
+                  xcfdata, nmemb_read_successfully) != Z_OK ||
+      len != tile_size)
+    {
+      g_free (xcfdata);
+      return FALSE;
+    }
+
+  g_free (xcfdata);
+
+  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  return TRUE;
+}
+
 static GimpParasite *
 xcf_load_parasite (XcfInfo *info)
 {
@@ -2324,3 +2404,36 @@ xcf_skip_unknown_prop (XcfInfo *info,
 
   return TRUE;
 }
+
+/*  Reads file offsets, which are 32-bit in files before version 9
+ *  and 64-bit from then on.
+ */
+static guint
+xcf_read_offset (XcfInfo *info,
+                 goffset *data,
+                 gint     count)
+{
+  guint total = 0;
+
+  while (count--)
+    {
+      if (info->bytes_per_offset == 8)
+        {
+          guint64 value;
+
+          total += xcf_read_int64 (info->input, &value, 1);
+          *data = value;
+        }
+      else
+        {
+          guint32 value;
+
+          total += xcf_read_int32 (info->input, &value, 1);
+          *data = value;
+        }
+
+      data++;
+    }
+
+  return total;
+}
@@ -63,7 +63,7 @@ typedef enum
 {
   COMPRESS_NONE              =  0,
   COMPRESS_RLE               =  1,
-  COMPRESS_ZLIB              =  2,  /* unused */
+  COMPRESS_ZLIB              =  2,  /* XCF version 8 and up */
   COMPRESS_FRACTAL           =  3   /* unused */
 } XcfCompressionType;
 
@@ -93,18 +93,19 @@ struct _XcfInfo
   GInputStream       *input;
   GOutputStream      *output;
   GSeekable          *seekable;
-  guint               cp;
+  goffset             cp;
   const gchar        *filename;
   GimpTattoo          tattoo_state;
   GimpLayer          *active_layer;
   GimpChannel        *active_channel;
   GimpDrawable       *floating_sel_drawable;
   GimpLayer          *floating_sel;
-  guint               floating_sel_offset;
+  goffset             floating_sel_offset;
   gint                swap_num;
   gint               *ref_count;
   XcfCompressionType  compression;
   gint                file_version;
+  gint                bytes_per_offset;
 };
 
 
@@ -19,6 +19,8 @@
 
 #include <string.h>
 
+#include <zlib.h>
+
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -32,6 +34,7 @@
 #include "gegl/gimp-gegl-tile-compat.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 #include "core/gimpcontainer.h"
 #include "core/gimpchannel.h"
 #include "core/gimpdrawable.h"
@@ -98,17 +101,23 @@ static gboolean xcf_save_buffer        (XcfInfo           *info,
 static gboolean xcf_save_level         (XcfInfo           *info,
                                         GeglBuffer        *buffer,
                                         GError           **error);
-static gboolean xcf_save_tile          (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        GError           **error);
-static gboolean xcf_save_tile_rle      (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        guchar            *rlebuf,
+static void     xcf_save_tile_batch    (gint               i,
+                                        gint               n,
+                                        gpointer           data);
+static gint     xcf_save_tile_rle      (const guchar      *tile_data,
+                                        gint               n_pixels,
+                                        gint               bpp,
+                                        guchar            *rlebuf);
+static gint     xcf_save_tile_zlib     (const guchar      *tile_data,
+                                        gint               tile_size,
+                                        guchar            *zbuf,
+                                        gint               zbuf_size);
+static guint    xcf_write_offset       (XcfInfo           *info,
+                                        const goffset     *data,
+                                        gint               count,
                                         GError           **error);
+static guint64  xcf_save_estimate_size (XcfInfo           *info,
+                                        GimpImage         *image);
 static gboolean xcf_save_parasite      (XcfInfo           *info,
                                         GimpParasite      *parasite,
                                         GError           **error);
@@ -133,6 +142,15 @@ static gboolean xcf_save_vectors       (XcfInfo           *info,
     }                                                                  \
   } G_STMT_END
 
+#define xcf_write_offset_check_error(info, data, count) G_STMT_START { \
+  info->cp += xcf_write_offset (info, data, count, &tmp_error);       \
+  if (tmp_error)                                                      \
+    {                                                                 \
+      g_propagate_error (error, tmp_error);                           \
+      return FALSE;                                                   \
+    }                                                                 \
+  } G_STMT_END
+
 #define xcf_write_int8_check_error(info, data, count) G_STMT_START {  \
   info->cp += xcf_write_int8 (info->output, data, count, &tmp_error); \
   if (tmp_error)                                                      \
@@ -179,6 +197,31 @@ static gboolean xcf_save_vectors       (XcfInfo           *info,
   } G_STMT_END
 
 
+/*  how many tiles per thread xcf_save_level() encodes in one batch  */
+#define XCF_SAVE_TILES_PER_THREAD 16
+
+/*  the largest encoded size of a tile, allowing for negative
+ *  compression; the loader makes the same assumption
+ */
+#define XCF_TILE_MAX_DATA_LENGTH(bpp) \
+  ((gint) (XCF_TILE_WIDTH * XCF_TILE_HEIGHT * (bpp) * 1.5))
+
+
+typedef struct
+{
+  GeglBuffer         *buffer;
+  const Babl         *format;
+  gint                bpp;
+  XcfCompressionType  compression;
+  gint                first_tile;
+  gint                n_tiles;
+  gint                max_data_length;
+  guchar             *data;        /*  n_tiles * max_data_length bytes  */
+  gint               *data_length; /*  encoded size of each tile, or -1 */
+  gint                next;        /*  atomic  */
+} XcfSaveTileBatch;
+
+
 void
 xcf_save_choose_format (XcfInfo   *info,
                         GimpImage *image)
@@ -223,7 +266,24 @@ xcf_save_choose_format (XcfInfo   *info,
   if (gimp_image_get_precision (image) != GIMP_PRECISION_U8_GAMMA)
     save_version = MAX (7, save_version);
 
-  info->file_version = save_version;
+  /* high bit depth files can't be read by GIMP 2.8 anyway, so use
+   * zlib for them, which compresses their tiles much better than RLE
+   */
+  if (save_version >= 7 && info->compression == COMPRESS_RLE)
+    info->compression = COMPRESS_ZLIB;
+
+  /* need version 8 for zlib compressed tiles */
+  if (info->compression == COMPRESS_ZLIB)
+    save_version = MAX (8, save_version);
+
+  /* need version 9 for 64-bit offsets, but only if the file could
+   * grow beyond what 32-bit offsets can address
+   */
+  if (xcf_save_estimate_size (info, image) > G_MAXUINT32)
+    save_version = MAX (9, save_version);
+
+  info->file_version     = save_version;
+  info->bytes_per_offset = (save_version >= 9) ? 8 : 4;
 }
 
 gint
@@ -234,8 +294,8 @@ xcf_save_image (XcfInfo    *info,
   GList   *all_layers;
   GList   *all_channels;
   GList   *list;
-  guint32  saved_pos;
-  guint32  offset;
+  goffset  saved_pos;
+  goffset  offset;
   guint32  value;
   guint    n_layers;
   guint    n_channels;
@@ -303,7 +363,8 @@ xcf_save_image (XcfInfo    *info,
 
   /* seek to after the offset lists */
   xcf_check_error (xcf_seek_pos (info,
-                                 info->cp + (n_layers + n_channels + 2) * 4,
+                                 info->cp + (n_layers + n_channels + 2) *
+                                 info->bytes_per_offset,
                                  error));
 
   for (list = all_layers; list; list = g_list_next (list))
@@ -324,7 +385,7 @@ xcf_save_image (XcfInfo    *info,
        *  layer offset and write it out.
        */
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+      xcf_write_offset_check_error (info, &offset, 1);
 
       /* increment the location we are to write out the
        *  next offset.
@@ -342,7 +403,7 @@ xcf_save_image (XcfInfo    *info,
    */
   offset = 0;
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
   saved_pos = info->cp;
   xcf_check_error (xcf_seek_end (info, error));
 
@@ -364,7 +425,7 @@ xcf_save_image (XcfInfo    *info,
        *  channel offset and write it out.
        */
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+      xcf_write_offset_check_error (info, &offset, 1);
 
       /* increment the location we are to write out the
        *  next offset.
@@ -385,7 +446,7 @@ xcf_save_image (XcfInfo    *info,
    */
   offset = 0;
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
   saved_pos = info->cp;
 
   return ! g_output_stream_is_closed (info->output);
@@ -704,15 +765,15 @@ xcf_save_prop (XcfInfo    *info,
 
     case PROP_FLOATING_SELECTION:
       {
-        guint32 dummy;
+        goffset dummy;
 
         dummy = 0;
-        size = 4;
+        size = info->bytes_per_offset;
 
         xcf_write_prop_type_check_error (info, prop_type);
         xcf_write_int32_check_error (info, &size, 1);
         info->floating_sel_offset = info->cp;
-        xcf_write_int32_check_error (info, &dummy, 1);
+        xcf_write_offset_check_error (info, &dummy, 1);
       }
       break;
 
@@ -1011,8 +1072,9 @@ xcf_save_prop (XcfInfo    *info,
 
         if (gimp_parasite_list_persistent_length (list) > 0)
           {
-            guint32 base, length = 0;
-            long    pos;
+            goffset base;
+            guint32 length = 0;
+            goffset pos;
 
             xcf_write_prop_type_check_error (info, prop_type);
 
@@ -1056,8 +1118,9 @@ xcf_save_prop (XcfInfo    *info,
 
     case PROP_PATHS:
       {
-        guint32 base, length = 0;
-        glong   pos;
+        goffset base;
+        guint32 length = 0;
+        goffset pos;
 
         xcf_write_prop_type_check_error (info, prop_type);
 
@@ -1122,8 +1185,9 @@ xcf_save_prop (XcfInfo    *info,
 
     case PROP_VECTORS:
       {
-        guint32 base, length = 0;
-        glong   pos;
+        goffset base;
+        guint32 length = 0;
+        goffset pos;
 
         xcf_write_prop_type_check_error (info, prop_type);
 
@@ -1211,8 +1275,8 @@ xcf_save_layer (XcfInfo    *info,
                 GimpLayer  *layer,
                 GError    **error)
 {
-  guint32      saved_pos;
-  guint32      offset;
+  goffset      saved_pos;
+  goffset      offset;
   guint32      value;
   const gchar *string;
   GError      *tmp_error = NULL;
@@ -1224,7 +1288,7 @@ xcf_save_layer (XcfInfo    *info,
     {
       saved_pos = info->cp;
       xcf_check_error (xcf_seek_pos (info, info->floating_sel_offset, error));
-      xcf_write_int32_check_error (info, &saved_pos, 1);
+      xcf_write_offset_check_error (info, &saved_pos, 1);
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
     }
 
@@ -1251,7 +1315,9 @@ xcf_save_layer (XcfInfo    *info,
   saved_pos = info->cp;
 
   /*  write out the layer tile hierarchy  */
-  xcf_check_error (xcf_seek_pos (info, info->cp + 8, error));
+  xcf_check_error (xcf_seek_pos (info,
+                                 info->cp + 2 * info->bytes_per_offset,
+                                 error));
   offset = info->cp;
 
   xcf_check_error (xcf_save_buffer (info,
@@ -1259,7 +1325,7 @@ xcf_save_layer (XcfInfo    *info,
                                     error));
 
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
 
   /*  save the current position which is where the layer mask offset
    *  will be stored.
@@ -1281,7 +1347,7 @@ xcf_save_layer (XcfInfo    *info,
     offset = 0;
 
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
 
   return TRUE;
 }
@@ -1292,8 +1358,8 @@ xcf_save_channel (XcfInfo      *info,
                   GimpChannel  *channel,
                   GError      **error)
 {
-  guint32      saved_pos;
-  guint32      offset;
+  goffset      saved_pos;
+  goffset      offset;
   guint32      value;
   const gchar *string;
   GError      *tmp_error = NULL;
@@ -1305,7 +1371,7 @@ xcf_save_channel (XcfInfo      *info,
     {
       saved_pos = info->cp;
       xcf_check_error (xcf_seek_pos (info, info->floating_sel_offset, error));
-      xcf_write_int32_check_error (info, &saved_pos, 1);
+      xcf_write_offset_check_error (info, &saved_pos, 1);
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
     }
 
@@ -1329,7 +1395,9 @@ xcf_save_channel (XcfInfo      *info,
   saved_pos = info->cp;
 
   /* write out the channel tile hierarchy */
-  xcf_check_error (xcf_seek_pos (info, info->cp + 4, error));
+  xcf_check_error (xcf_seek_pos (info,
+                                 info->cp + info->bytes_per_offset,
+                                 error));
   offset = info->cp;
 
   xcf_check_error (xcf_save_buffer (info,
@@ -1337,7 +1405,7 @@ xcf_save_channel (XcfInfo      *info,
                                     error));
 
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
   saved_pos = info->cp;
 
   return TRUE;
@@ -1366,8 +1434,8 @@ xcf_save_buffer (XcfInfo     *info,
                  GError     **error)
 {
   const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
+  goffset     saved_pos;
+  goffset     offset;
   guint32     width;
   guint32     height;
   guint32     bpp;
@@ -1392,7 +1460,9 @@ xcf_save_buffer (XcfInfo     *info,
   tmp2 = xcf_calc_levels (height, XCF_TILE_HEIGHT);
   nlevels = MAX (tmp1, tmp2);
 
-  xcf_check_error (xcf_seek_pos (info, info->cp + (1 + nlevels) * 4, error));
+  xcf_check_error (xcf_seek_pos (info,
+                                 info->cp + (1 + nlevels) * info->bytes_per_offset,
+                                 error));
 
   for (i = 0; i < nlevels; i++)
     {
@@ -1418,7 +1488,7 @@ xcf_save_buffer (XcfInfo     *info,
        *  level offset and write it out.
        */
       xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+      xcf_write_offset_check_error (info, &offset, 1);
 
       /* increment the location we are to write out the
        *  next offset.
@@ -1436,28 +1506,33 @@ xcf_save_buffer (XcfInfo     *info,
    */
   offset = 0;
   xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  xcf_write_offset_check_error (info, &offset, 1);
 
   return TRUE;
 }
 
+/*  Tiles are read and encoded in batches on all threads of the
+ *  parallel pool, and then written in order as one stream.  The
+ *  tile offset table is only written once, at the end.
+ */
 static gboolean
 xcf_save_level (XcfInfo     *info,
                 GeglBuffer  *buffer,
                 GError     **error)
 {
-  const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
-  guint32     width;
-  guint32     height;
-  gint        bpp;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        i;
-  guchar     *rlebuf;
-  GError     *tmp_error = NULL;
+  const Babl       *format;
+  XcfSaveTileBatch  batch;
+  goffset           saved_pos;
+  goffset          *offsets;
+  guint32           width;
+  guint32           height;
+  gint              bpp;
+  gint              n_tile_rows;
+  gint              n_tile_cols;
+  guint             ntiles;
+  gint              batch_size;
+  gint              i;
+  GError           *tmp_error = NULL;
 
   format = gegl_buffer_get_format (buffer);
 
@@ -1470,114 +1545,178 @@ xcf_save_level (XcfInfo     *info,
 
   saved_pos = info->cp;
 
-  /* allocate a temporary buffer to store the rle data before it is
-   * written to disk
-   */
-  rlebuf = g_alloca (XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5);
+  switch (info->compression)
+    {
+    case COMPRESS_NONE:
+    case COMPRESS_RLE:
+    case COMPRESS_ZLIB:
+      break;
+    case COMPRESS_FRACTAL:
+      g_error ("xcf: fractal compression unimplemented");
+      break;
+    }
 
   n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
   ntiles = n_tile_rows * n_tile_cols;
-  xcf_check_error (xcf_seek_pos (info, info->cp + (ntiles + 1) * 4, error));
+  xcf_check_error (xcf_seek_pos (info,
+                                 info->cp + (ntiles + 1) * info->bytes_per_offset,
+                                 error));
+
+  /* the offset table, including the terminating '0' */
+  offsets = g_new0 (goffset, ntiles + 1);
+
+  batch_size = gimp_parallel_get_n_threads () * XCF_SAVE_TILES_PER_THREAD;
+  batch_size = MIN (batch_size, ntiles);
+
+  batch.buffer          = buffer;
+  batch.format          = format;
+  batch.bpp             = bpp;
+  batch.compression     = info->compression;
+  batch.max_data_length = XCF_TILE_MAX_DATA_LENGTH (bpp);
+  batch.data            = g_malloc ((gsize) batch_size *
+                                    batch.max_data_length);
+  batch.data_length     = g_new (gint, batch_size);
 
-  for (i = 0; i < ntiles; i++)
+  for (i = 0; i < ntiles; i += batch.n_tiles)
     {
-      GeglRectangle rect;
+      gint j;
 
-      /* save the start offset of where we are writing
-       *  out the next tile.
-       */
-      offset = info->cp;
+      batch.first_tile = i;
+      batch.n_tiles    = MIN (batch_size, ntiles - i);
+      batch.next       = 0;
 
-      gimp_gegl_buffer_get_tile_rect (buffer,
-                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
+      gimp_parallel_distribute (batch.n_tiles, xcf_save_tile_batch, &batch);
 
-      /* write out the tile. */
-      switch (info->compression)
+      for (j = 0; j < batch.n_tiles; j++)
         {
-        case COMPRESS_NONE:
-          xcf_check_error (xcf_save_tile (info, buffer, &rect, format,
-                                          error));
-          break;
-        case COMPRESS_RLE:
-          xcf_check_error (xcf_save_tile_rle (info, buffer, &rect, format,
-                                              rlebuf, error));
-          break;
-        case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
-          break;
-        case COMPRESS_FRACTAL:
-          g_error ("xcf: fractal compression unimplemented");
-          break;
+          if (batch.data_length[j] < 0)
+            {
+              g_set_error (&tmp_error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                           _("Error compressing tile data"));
+              break;
+            }
+
+          /* save the start offset of where we are writing
+           *  out the tile.
+           */
+          offsets[i + j] = info->cp;
+
+          info->cp += xcf_write_int8 (info->output,
+                                      batch.data + j * batch.max_data_length,
+                                      batch.data_length[j],
+                                      &tmp_error);
+          if (tmp_error)
+            break;
         }
 
-      /* seek back to where we are to write out the next
-       *  tile offset and write it out.
-       */
-      xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-      xcf_write_int32_check_error (info, &offset, 1);
+      if (tmp_error)
+        break;
+    }
 
-      /* increment the location we are to write out the
-       *  next offset.
-       */
-      saved_pos = info->cp;
+  g_free (batch.data_length);
+  g_free (batch.data);
 
-      /* seek to the end of the file which is where
-       *  we will write out the next tile.
+  if (! tmp_error)
+    {
+      /* seek back once and write out all tile offsets, followed by
+       *  a '0' offset position to indicate the end of the tile offsets.
        */
-      xcf_check_error (xcf_seek_end (info, error));
+      if (xcf_seek_pos (info, saved_pos, error))
+        {
+          info->cp += xcf_write_offset (info, offsets, ntiles + 1,
+                                        &tmp_error);
+
+          if (! tmp_error)
+            {
+              g_free (offsets);
+
+              return xcf_seek_end (info, error);
+            }
+        }
     }
 
-  /* write out a '0' offset position to indicate the end
-   *  of the level offsets.
-   */
-  offset = 0;
-  xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
+  g_free (offsets);
 
-  return TRUE;
+  if (tmp_error)
+    g_propagate_error (error, tmp_error);
 
+  return FALSE;
 }
 
-static gboolean
-xcf_save_tile (XcfInfo        *info,
-               GeglBuffer     *buffer,
-               GeglRectangle  *tile_rect,
-               const Babl     *format,
-               GError        **error)
+/*  runs in the parallel pool  */
+static void
+xcf_save_tile_batch (gint     i,
+                     gint     n,
+                     gpointer data)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  GError *tmp_error = NULL;
+  XcfSaveTileBatch *batch     = data;
+  gint              tile_size = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * batch->bpp;
+  guchar           *tile_data = NULL;
+  gint              index;
 
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  if (batch->compression != COMPRESS_NONE)
+    tile_data = g_malloc (tile_size);
 
-  xcf_write_int8_check_error (info, tile_data, tile_size);
+  while ((index = g_atomic_int_add (&batch->next, 1)) < batch->n_tiles)
+    {
+      GeglRectangle  rect;
+      guchar        *dest = batch->data + index * batch->max_data_length;
+      gint           size;
 
-  return TRUE;
+      gimp_gegl_buffer_get_tile_rect (batch->buffer,
+                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                      batch->first_tile + index, &rect);
+
+      size = batch->bpp * rect.width * rect.height;
+
+      switch (batch->compression)
+        {
+        case COMPRESS_NONE:
+          gegl_buffer_get (batch->buffer, &rect, 1.0, batch->format, dest,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          batch->data_length[index] = size;
+          break;
+
+        case COMPRESS_RLE:
+          gegl_buffer_get (batch->buffer, &rect, 1.0, batch->format,
+                           tile_data,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          batch->data_length[index] =
+            xcf_save_tile_rle (tile_data, rect.width * rect.height,
+                               batch->bpp, dest);
+          break;
+
+        case COMPRESS_ZLIB:
+          gegl_buffer_get (batch->buffer, &rect, 1.0, batch->format,
+                           tile_data,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          batch->data_length[index] =
+            xcf_save_tile_zlib (tile_data, size,
+                                dest, batch->max_data_length);
+          break;
+
+        case COMPRESS_FRACTAL:
+          batch->data_length[index] = -1;
+          break;
+        }
+    }
+
+  g_free (tile_data);
 }
 
-static gboolean
-xcf_save_tile_rle (XcfInfo        *info,
-                   GeglBuffer     *buffer,
-                   GeglRectangle  *tile_rect,
-                   const Babl     *format,
-                   guchar         *rlebuf,
-                   GError        **error)
+static gint
+xcf_save_tile_rle (const guchar *tile_data,
+                   gint          n_pixels,
+                   gint          bpp,
+                   guchar       *rlebuf)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    len       = 0;
-  gint    i, j;
-  GError *tmp_error  = NULL;
-
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gint len = 0;
+  gint i, j;
 
   for (i = 0; i < bpp; i++)
     {
@@ -1585,7 +1724,7 @@ xcf_save_tile_rle (XcfInfo        *info,
       gint          state  = 0;
       gint          length = 0;
       gint          count  = 0;
-      gint          size   = tile_rect->width * tile_rect->height;
+      gint          size   = n_pixels;
       guint         last   = -1;
 
       while (size > 0)
@@ -1671,13 +1810,122 @@ xcf_save_tile_rle (XcfInfo        *info,
             }
         }
 
-      if (count != (tile_rect->width * tile_rect->height))
-        g_message ("xcf: uh oh! xcf rle tile saving error: %d", count);
+      /* not g_message(), we are not in the main thread */
+      if (count != n_pixels)
+        g_printerr ("xcf: uh oh! xcf rle tile saving error: %d\n", count);
     }
 
-  xcf_write_int8_check_error (info, rlebuf, len);
+  return len;
+}
 
-  return TRUE;
+static gint
+xcf_save_tile_zlib (const guchar *tile_data,
+                    gint          tile_size,
+                    guchar       *zbuf,
+                    gint          zbuf_size)
+{
+  uLongf len = zbuf_size;
+
+  if (compress2 (zbuf, &len, tile_data, tile_size,
+                 Z_DEFAULT_COMPRESSION) != Z_OK)
+    return -1;
+
+  return len;
+}
+
+/*  Writes file offsets with the width the file version calls for,
+ *  and fails instead of truncating them in files with 32-bit offsets.
+ */
+static guint
+xcf_write_offset (XcfInfo        *info,
+                  const goffset  *data,
+                  gint            count,
+                  GError        **error)
+{
+  GError *tmp_error = NULL;
+  gint    i;
+
+  for (i = 0; i < count; i++)
+    {
+      if (info->bytes_per_offset == 8)
+        {
+          guint64 value = data[i];
+
+          xcf_write_int64 (info->output, &value, 1, &tmp_error);
+        }
+      else if (data[i] <= G_MAXUINT32)
+        {
+          guint32 value = data[i];
+
+          xcf_write_int32 (info->output, &value, 1, &tmp_error);
+        }
+      else
+        {
+          g_set_error (&tmp_error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                       _("XCF file is too large for its file version"));
+        }
+
+      if (tmp_error)
+        {
+          g_propagate_error (error, tmp_error);
+
+          return i * info->bytes_per_offset;
+        }
+    }
+
+  return count * info->bytes_per_offset;
+}
+
+/*  A generous upper bound of the size of the file, which is all
+ *  xcf_save_choose_format() needs to decide on the offset width.
+ */
+static guint64
+xcf_save_estimate_size (XcfInfo   *info,
+                        GimpImage *image)
+{
+  GimpImagePrivate *private = GIMP_IMAGE_GET_PRIVATE (image);
+  GList            *drawables;
+  GList            *list;
+  guint64           size    = 0;
+
+  drawables = g_list_concat (gimp_image_get_layer_list (image),
+                             gimp_image_get_channel_list (image));
+
+  drawables = g_list_prepend (drawables, gimp_image_get_mask (image));
+
+  for (list = drawables; list; list = g_list_next (list))
+    {
+      GimpDrawable *drawable = list->data;
+
+      while (drawable)
+        {
+          GeglBuffer *buffer = gimp_drawable_get_buffer (drawable);
+          const Babl *format = gegl_buffer_get_format (buffer);
+          gint        n_tiles;
+
+          n_tiles = (gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT) *
+                     gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH));
+
+          /*  tile data, tile offset table, and some room for the rest  */
+          size += ((guint64) n_tiles *
+                   XCF_TILE_MAX_DATA_LENGTH (babl_format_get_bytes_per_pixel (format)));
+          size += (guint64) (n_tiles + 1) * 8;
+          size += 1024;
+
+          if (GIMP_IS_LAYER (drawable))
+            drawable = GIMP_DRAWABLE (gimp_layer_get_mask (GIMP_LAYER (drawable)));
+          else
+            drawable = NULL;
+        }
+    }
+
+  g_list_free (drawables);
+
+  /*  and for the parasites, paths, and other image properties  */
+  size += gimp_object_get_memsize (GIMP_OBJECT (private->parasites), NULL);
+  size += 1024 * 1024;
+
+  return size;
 }
 
 static gboolean
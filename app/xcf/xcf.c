@@ -74,7 +74,9 @@ static GimpXcfLoaderFunc * const xcf_loaders[] =
   xcf_load_image,   /* version 4 */
   xcf_load_image,   /* version 5 */
   xcf_load_image,   /* version 6 */
-  xcf_load_image    /* version 7 */
+  xcf_load_image,   /* version 7 */
+  xcf_load_image,   /* version 8 */
+  xcf_load_image    /* version 9 */
 };
 
 
@@ -311,6 +313,9 @@ xcf_load_invoker (GimpProcedure         *procedure,
 
       if (success)
         {
+          /* version 9 and up use 64-bit file offsets */
+          info.bytes_per_offset = (info.file_version >= 9) ? 8 : 4;
+
           if (info.file_version >= 0 &&
               info.file_version < G_N_ELEMENTS (xcf_loaders))
             {
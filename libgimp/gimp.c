@@ -119,7 +119,8 @@
  **/
 
 
-#define TILE_MAP_SIZE (_tile_width * _tile_height * 32)
+#define TILE_MAP_SIZE (_tile_width * _tile_height * \
+                       GP_SHM_MAX_BPP * GP_SHM_N_TILES)
 
 #define ERRMSG_SHM_FAILED "Could not attach to gimp shared memory segment"
 
@@ -1906,6 +1907,10 @@ gimp_loop (void)
         case GP_HAS_INIT:
           g_warning ("unexpected has init message received (should not happen)");
           break;
+
+        case GP_REGION_REQ:
+          g_warning ("unexpected region request received (should not happen)");
+          break;
         }
 
       gimp_wire_destroy (&msg);
@@ -2134,6 +2139,9 @@ gimp_process_message (GimpWireMessage *msg)
     case GP_HAS_INIT:
       g_warning ("unexpected has init message received (should not happen)");
       break;
+    case GP_REGION_REQ:
+      g_warning ("unexpected region request received (should not happen)");
+      break;
     }
 }
 
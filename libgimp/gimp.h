@@ -35,6 +35,7 @@
 #include <libgimp/gimpenums.h>
 #include <libgimp/gimptypes.h>
 
+#include <libgimp/gimpbandtransfer.h>
 #include <libgimp/gimpbrushes.h>
 #include <libgimp/gimpbrushselect.h>
 #include <libgimp/gimpchannel.h>
@@ -0,0 +1,310 @@
+/* LIBGIMP - The GIMP Library
+ * Copyright (C) 1995-1997 Peter Mattis and Spencer Kimball
+ *
+ * gimpbandtransfer.c
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gimp.h"
+
+#include "gimpbandtransfer.h"
+
+
+/**
+ * SECTION: gimpbandtransfer
+ * @title: gimpbandtransfer
+ * @short_description: Double buffered band transfers between a
+ *                     drawable's buffer and a file codec.
+ *
+ * A #GimpBandTransfer owns two bands of pixels. While the plug-in
+ * works on the current band, a helper thread reads the next band
+ * from, or writes the previous band to, the drawable's buffer.
+ *
+ * Reading or writing a drawable's buffer talks to the core over the
+ * same connection as every other libgimp call, which must never be
+ * used from two threads at once. Call gimp_band_transfer_sync()
+ * before any other libgimp call, such as gimp_progress_update(), as
+ * long as a transfer may be in flight.
+ **/
+
+
+struct _GimpBandTransfer
+{
+  GeglBuffer  *buffer;
+  const Babl  *format;
+  gint         width;
+  guchar      *data[2];
+  gint         current;   /* band owned by the plug-in */
+
+  GThreadPool *pool;
+  GMutex       mutex;
+  GCond        cond;
+  gboolean     busy;
+
+  /* the transfer in flight */
+  gboolean     write;
+  gint         band;
+  gint         y;
+  gint         rows;
+};
+
+
+static void   gimp_band_transfer_run   (GimpBandTransfer *transfer);
+static void   gimp_band_transfer_func  (gpointer          data,
+                                        gpointer          user_data);
+static void   gimp_band_transfer_start (GimpBandTransfer *transfer,
+                                        gboolean          write,
+                                        gint              band,
+                                        gint              y,
+                                        gint              rows);
+
+
+/**
+ * gimp_band_transfer_new:
+ * @buffer:      the drawable's #GeglBuffer
+ * @format:      the pixel format of the bands
+ * @band_height: the number of rows in a band
+ * @bpp:         the bytes per pixel the plug-in needs in a band, the
+ *               bands are made large enough for @bpp or @format,
+ *               whichever is larger
+ *
+ * Creates two bands of @band_height rows as wide as @buffer.
+ *
+ * Return value: a new #GimpBandTransfer, free it with
+ *               gimp_band_transfer_free().
+ *
+ * Since: 2.10
+ **/
+GimpBandTransfer *
+gimp_band_transfer_new (GeglBuffer *buffer,
+                        const Babl *format,
+                        gint        band_height,
+                        gint        bpp)
+{
+  GimpBandTransfer *transfer;
+  gsize             size;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (band_height > 0, NULL);
+
+  transfer = g_slice_new0 (GimpBandTransfer);
+
+  transfer->buffer = buffer;
+  transfer->format = format;
+  transfer->width  = gegl_buffer_get_width (buffer);
+
+  size = ((gsize) transfer->width * band_height *
+          MAX (bpp, babl_format_get_bytes_per_pixel (format)));
+
+  transfer->data[0] = g_malloc0 (size);
+  transfer->data[1] = g_malloc0 (size);
+
+  g_mutex_init (&transfer->mutex);
+  g_cond_init (&transfer->cond);
+
+  /*  on a single core the transfers are simply done in place  */
+  if (g_get_num_processors () > 1)
+    transfer->pool = g_thread_pool_new (gimp_band_transfer_func, transfer,
+                                        1, FALSE, NULL);
+
+  return transfer;
+}
+
+/**
+ * gimp_band_transfer_free:
+ * @transfer: a #GimpBandTransfer
+ *
+ * Waits for the transfer in flight, if any, and frees @transfer.
+ *
+ * Since: 2.10
+ **/
+void
+gimp_band_transfer_free (GimpBandTransfer *transfer)
+{
+  g_return_if_fail (transfer != NULL);
+
+  gimp_band_transfer_sync (transfer);
+
+  if (transfer->pool)
+    g_thread_pool_free (transfer->pool, FALSE, TRUE);
+
+  g_mutex_clear (&transfer->mutex);
+  g_cond_clear (&transfer->cond);
+
+  g_free (transfer->data[0]);
+  g_free (transfer->data[1]);
+
+  g_slice_free (GimpBandTransfer, transfer);
+}
+
+/**
+ * gimp_band_transfer_read:
+ * @transfer: a #GimpBandTransfer
+ * @y:        the first row to read
+ * @rows:     the number of rows to read
+ *
+ * Waits for the transfer in flight and starts reading @rows rows
+ * into the band the plug-in doesn't own. That band becomes the
+ * current one with the next gimp_band_transfer_wait().
+ *
+ * Since: 2.10
+ **/
+void
+gimp_band_transfer_read (GimpBandTransfer *transfer,
+                         gint              y,
+                         gint              rows)
+{
+  g_return_if_fail (transfer != NULL);
+
+  gimp_band_transfer_sync (transfer);
+
+  gimp_band_transfer_start (transfer, FALSE, 1 - transfer->current, y, rows);
+}
+
+/**
+ * gimp_band_transfer_write:
+ * @transfer: a #GimpBandTransfer
+ * @y:        the row to write the current band to
+ * @rows:     the number of rows to write
+ *
+ * Waits for the transfer in flight, starts writing @rows rows of the
+ * current band and hands the other band to the plug-in.
+ *
+ * Return value: the new current band.
+ *
+ * Since: 2.10
+ **/
+guchar *
+gimp_band_transfer_write (GimpBandTransfer *transfer,
+                          gint              y,
+                          gint              rows)
+{
+  g_return_val_if_fail (transfer != NULL, NULL);
+
+  gimp_band_transfer_sync (transfer);
+
+  gimp_band_transfer_start (transfer, TRUE, transfer->current, y, rows);
+
+  transfer->current = 1 - transfer->current;
+
+  return transfer->data[transfer->current];
+}
+
+/**
+ * gimp_band_transfer_wait:
+ * @transfer: a #GimpBandTransfer
+ *
+ * Waits for the transfer in flight. If it was a read, the band it
+ * read into becomes the current band.
+ *
+ * Return value: the current band.
+ *
+ * Since: 2.10
+ **/
+guchar *
+gimp_band_transfer_wait (GimpBandTransfer *transfer)
+{
+  g_return_val_if_fail (transfer != NULL, NULL);
+
+  gimp_band_transfer_sync (transfer);
+
+  if (! transfer->write)
+    transfer->current = transfer->band;
+
+  return transfer->data[transfer->current];
+}
+
+/**
+ * gimp_band_transfer_sync:
+ * @transfer: a #GimpBandTransfer
+ *
+ * Waits for the transfer in flight without changing the current
+ * band. Call this before any other libgimp call.
+ *
+ * Since: 2.10
+ **/
+void
+gimp_band_transfer_sync (GimpBandTransfer *transfer)
+{
+  g_return_if_fail (transfer != NULL);
+
+  g_mutex_lock (&transfer->mutex);
+
+  while (transfer->busy)
+    g_cond_wait (&transfer->cond, &transfer->mutex);
+
+  g_mutex_unlock (&transfer->mutex);
+}
+
+
+/*  private functions  */
+
+static void
+gimp_band_transfer_run (GimpBandTransfer *transfer)
+{
+  GeglRectangle rect = { 0, transfer->y, transfer->width, transfer->rows };
+
+  if (transfer->write)
+    gegl_buffer_set (transfer->buffer, &rect, 0, transfer->format,
+                     transfer->data[transfer->band], GEGL_AUTO_ROWSTRIDE);
+  else
+    gegl_buffer_get (transfer->buffer, &rect, 1.0, transfer->format,
+                     transfer->data[transfer->band], GEGL_AUTO_ROWSTRIDE,
+                     GEGL_ABYSS_NONE);
+}
+
+static void
+gimp_band_transfer_func (gpointer data,
+                         gpointer user_data)
+{
+  GimpBandTransfer *transfer = user_data;
+
+  gimp_band_transfer_run (transfer);
+
+  g_mutex_lock (&transfer->mutex);
+
+  transfer->busy = FALSE;
+  g_cond_signal (&transfer->cond);
+
+  g_mutex_unlock (&transfer->mutex);
+}
+
+static void
+gimp_band_transfer_start (GimpBandTransfer *transfer,
+                          gboolean          write,
+                          gint              band,
+                          gint              y,
+                          gint              rows)
+{
+  transfer->write = write;
+  transfer->band  = band;
+  transfer->y     = y;
+  transfer->rows  = rows;
+
+  if (transfer->pool)
+    {
+      transfer->busy = TRUE;
+
+      g_thread_pool_push (transfer->pool, transfer, NULL);
+    }
+  else
+    {
+      gimp_band_transfer_run (transfer);
+    }
+}
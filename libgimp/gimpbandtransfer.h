@@ -0,0 +1,53 @@
+/* LIBGIMP - The GIMP Library
+ * Copyright (C) 1995-1997 Peter Mattis and Spencer Kimball
+ *
+ * gimpbandtransfer.h
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined (__GIMP_H_INSIDE__) && !defined (GIMP_COMPILATION)
+#error "Only <libgimp/gimp.h> can be included directly."
+#endif
+
+#ifndef __GIMP_BAND_TRANSFER_H__
+#define __GIMP_BAND_TRANSFER_H__
+
+G_BEGIN_DECLS
+
+/* For information look into the C source or the html documentation */
+
+
+typedef struct _GimpBandTransfer GimpBandTransfer;
+
+
+GimpBandTransfer * gimp_band_transfer_new   (GeglBuffer       *buffer,
+                                             const Babl       *format,
+                                             gint              band_height,
+                                             gint              bpp);
+void               gimp_band_transfer_free  (GimpBandTransfer *transfer);
+
+void               gimp_band_transfer_read  (GimpBandTransfer *transfer,
+                                             gint              y,
+                                             gint              rows);
+guchar           * gimp_band_transfer_write (GimpBandTransfer *transfer,
+                                             gint              y,
+                                             gint              rows);
+guchar           * gimp_band_transfer_wait  (GimpBandTransfer *transfer);
+void               gimp_band_transfer_sync  (GimpBandTransfer *transfer);
+
+G_END_DECLS
+
+#endif /* __GIMP_BAND_TRANSFER_H__ */
@@ -24,6 +24,10 @@
 
 #define GIMP_DISABLE_DEPRECATION_WARNINGS
 
+#include "libgimpbase/gimpbase.h"
+#include "libgimpbase/gimpprotocol.h"
+#include "libgimpbase/gimpwire.h"
+
 #include "gimp.h"
 #include "gimptilebackendplugin.h"
 
@@ -37,9 +41,15 @@ struct _GimpTileBackendPluginPrivate
   GimpDrawable *drawable;
   gboolean      shadow;
   gint          mul;
+  gint          bpp;
+  gboolean      use_region;
 };
 
 
+void         gimp_read_expect_msg (GimpWireMessage *msg,
+                                   gint             type);
+
+
 static gint
 gimp_gegl_tile_mul (void)
 {
@@ -51,6 +61,12 @@ gimp_gegl_tile_mul (void)
 
   inited = TRUE;
 
+  /*  with shared memory, a whole 4x4 block of tiles is transferred
+   *  with a single region request
+   */
+  if (gimp_shm_addr ())
+    mul = 4;
+
   if (g_getenv ("GIMP_GEGL_TILE_MUL"))
     mul = atoi (g_getenv ("GIMP_GEGL_TILE_MUL"));
 
@@ -77,6 +93,12 @@ static GeglTile * gimp_tile_read_mul (GimpTileBackendPlugin *backend_plugin,
                                       gint                   x,
                                       gint                   y);
 
+static void       gimp_tile_region   (GimpTileBackendPlugin *backend_plugin,
+                                      gint                   x,
+                                      gint                   y,
+                                      guchar                *data,
+                                      gboolean               write);
+
 
 G_DEFINE_TYPE (GimpTileBackendPlugin, _gimp_tile_backend_plugin,
                GEGL_TYPE_TILE_BACKEND)
@@ -132,10 +154,27 @@ gimp_tile_backend_plugin_command (GeglTileSource  *tile_store,
   switch (command)
     {
     case GEGL_TILE_GET:
+      if (backend_plugin->priv->use_region)
+        {
+          GeglTileBackend *backend = GEGL_TILE_BACKEND (tile_store);
+          GeglTile        *tile;
+
+          tile = gegl_tile_new (gegl_tile_backend_get_tile_size (backend));
+
+          gimp_tile_region (backend_plugin, x, y,
+                            gegl_tile_get_data (tile), FALSE);
+
+          return tile;
+        }
+
       return gimp_tile_read_mul (backend_plugin, x, y);
 
     case GEGL_TILE_SET:
-      gimp_tile_write_mul (backend_plugin, x, y, gegl_tile_get_data (data));
+      if (backend_plugin->priv->use_region)
+        gimp_tile_region (backend_plugin, x, y,
+                          gegl_tile_get_data (data), TRUE);
+      else
+        gimp_tile_write_mul (backend_plugin, x, y, gegl_tile_get_data (data));
       gegl_tile_mark_as_stored (data);
       break;
 
@@ -257,6 +296,80 @@ gimp_tile_write_mul (GimpTileBackendPlugin *backend_plugin,
     }
 }
 
+/*  transfers the drawable's part of a whole GEGL tile through the
+ *  shared memory segment, using a single region request
+ */
+static void
+gimp_tile_region (GimpTileBackendPlugin *backend_plugin,
+                  gint                   x,
+                  gint                   y,
+                  guchar                *data,
+                  gboolean               write)
+{
+  extern GIOChannel *_writechannel;
+
+  GimpTileBackendPluginPrivate *priv   = backend_plugin->priv;
+  gint                          size   = priv->mul * TILE_WIDTH;
+  gint                          stride = size * priv->bpp;
+  GPRegionReq                   region_req;
+  GimpWireMessage               msg;
+  guchar                       *shm    = gimp_shm_addr ();
+  gint                          region_stride;
+  gint                          row;
+
+  region_req.drawable_ID = priv->drawable->drawable_id;
+  region_req.shadow      = priv->shadow;
+  region_req.x           = x * size;
+  region_req.y           = y * size;
+  region_req.width       = MIN (size, (gint) priv->drawable->width  -
+                                      region_req.x);
+  region_req.height      = MIN (size, (gint) priv->drawable->height -
+                                      region_req.y);
+  region_req.write       = write;
+
+  if ((gint) region_req.width <= 0 || (gint) region_req.height <= 0)
+    return;
+
+  region_stride = region_req.width * priv->bpp;
+
+  if (! gp_region_req_write (_writechannel, &region_req, NULL))
+    gimp_quit ();
+
+  /*  the segment is shared by all plug-ins, the core's tile ack hands
+   *  it to us until we ack back
+   */
+  gimp_read_expect_msg (&msg, GP_TILE_ACK);
+  gimp_wire_destroy (&msg);
+
+  if (write)
+    {
+      if (region_stride == stride)
+        memcpy (shm, data, stride * region_req.height);
+      else
+        for (row = 0; row < (gint) region_req.height; row++)
+          memcpy (shm + row * region_stride, data + row * stride,
+                  region_stride);
+    }
+  else
+    {
+      if (region_stride == stride)
+        memcpy (data, shm, stride * region_req.height);
+      else
+        for (row = 0; row < (gint) region_req.height; row++)
+          memcpy (data + row * stride, shm + row * region_stride,
+                  region_stride);
+    }
+
+  if (! gp_tile_ack_write (_writechannel, NULL))
+    gimp_quit ();
+
+  if (write)
+    {
+      gimp_read_expect_msg (&msg, GP_TILE_ACK);
+      gimp_wire_destroy (&msg);
+    }
+}
+
 GeglTileBackend *
 _gimp_tile_backend_plugin_new (GimpDrawable *drawable,
                                gint          shadow)
@@ -281,6 +394,12 @@ _gimp_tile_backend_plugin_new (GimpDrawable *drawable,
   backend_plugin->priv->drawable = drawable;
   backend_plugin->priv->mul      = mul;
   backend_plugin->priv->shadow   = shadow;
+  backend_plugin->priv->bpp      = babl_format_get_bytes_per_pixel (format);
+
+  backend_plugin->priv->use_region =
+    (gimp_shm_addr () != NULL &&
+     backend_plugin->priv->bpp <= GP_SHM_MAX_BPP &&
+     mul * mul <= GP_SHM_N_TILES);
 
   gegl_tile_backend_set_extent (backend,
                                 GEGL_RECTANGLE (0, 0, width, height));
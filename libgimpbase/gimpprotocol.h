@@ -26,7 +26,7 @@ G_BEGIN_DECLS
 
 /* Increment every time the protocol changes
  */
-#define GIMP_PROTOCOL_VERSION  0x0015
+#define GIMP_PROTOCOL_VERSION  0x0016
 
 
 enum
@@ -43,14 +43,24 @@ enum
   GP_PROC_INSTALL,
   GP_PROC_UNINSTALL,
   GP_EXTENSION_ACK,
-  GP_HAS_INIT
+  GP_HAS_INIT,
+  GP_REGION_REQ
 };
 
 
+/* The shared memory segment has room for this many tiles of the
+ * largest pixel size, so a GP_REGION_REQ can move a whole block of
+ * tiles at once
+ */
+#define GP_SHM_N_TILES  16
+#define GP_SHM_MAX_BPP  32
+
+
 typedef struct _GPConfig        GPConfig;
 typedef struct _GPTileReq       GPTileReq;
 typedef struct _GPTileAck       GPTileAck;
 typedef struct _GPTileData      GPTileData;
+typedef struct _GPRegionReq     GPRegionReq;
 typedef struct _GPParam         GPParam;
 typedef struct _GPParamDef      GPParamDef;
 typedef struct _GPProcRun       GPProcRun;
@@ -103,6 +113,17 @@ struct _GPTileData
   guchar  *data;
 };
 
+struct _GPRegionReq
+{
+  gint32   drawable_ID;
+  guint32  shadow;
+  gint32   x;
+  gint32   y;
+  guint32  width;
+  guint32  height;
+  guint32  write;
+};
+
 struct _GPParam
 {
   guint32 type;
@@ -202,6 +223,9 @@ gboolean  gp_tile_ack_write         (GIOChannel      *channel,
 gboolean  gp_tile_data_write        (GIOChannel      *channel,
                                      GPTileData      *tile_data,
                                      gpointer         user_data);
+gboolean  gp_region_req_write       (GIOChannel      *channel,
+                                     GPRegionReq     *region_req,
+                                     gpointer         user_data);
 gboolean  gp_proc_run_write         (GIOChannel      *channel,
                                      GPProcRun       *proc_run,
                                      gpointer         user_data);
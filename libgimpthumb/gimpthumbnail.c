@@ -121,6 +121,12 @@ static gboolean  gimp_thumbnail_save         (GimpThumbnail  *thumbnail,
                                               GdkPixbuf      *pixbuf,
                                               const gchar    *software,
                                               GError        **error);
+static gboolean  gimp_thumbnail_save_png     (GimpThumbnail  *thumbnail,
+                                              const gchar    *filename,
+                                              GdkPixbuf      *pixbuf,
+                                              const gchar   **keys,
+                                              gchar         **values,
+                                              GError        **error);
 #ifdef GIMP_THUMB_DEBUG
 static void      gimp_thumbnail_debug_notify (GObject        *object,
                                               GParamSpec     *pspec);
@@ -132,6 +138,9 @@ G_DEFINE_TYPE (GimpThumbnail, gimp_thumbnail, G_TYPE_OBJECT)
 #define parent_class gimp_thumbnail_parent_class
 
 
+static gint gimp_thumbnail_tmp_serial = 0;
+
+
 static void
 gimp_thumbnail_class_init (GimpThumbnailClass *klass)
 {
@@ -812,9 +821,6 @@ gimp_thumbnail_save (GimpThumbnail  *thumbnail,
 {
   const gchar  *keys[12];
   gchar        *values[12];
-  gchar        *basename;
-  gchar        *dirname;
-  gchar        *tmpname;
   gboolean      success;
   gint          i = 0;
 
@@ -876,11 +882,55 @@ gimp_thumbnail_save (GimpThumbnail  *thumbnail,
   keys[i]   = NULL;
   values[i] = NULL;
 
+  success = gimp_thumbnail_save_png (thumbnail, filename, pixbuf,
+                                     keys, values, error);
+
+  for (i = 0; keys[i]; i++)
+    g_free (values[i]);
+
+  if (success)
+    {
+      g_object_freeze_notify (G_OBJECT (thumbnail));
+
+      gimp_thumbnail_update_thumb (thumbnail, size);
+
+      if (thumbnail->thumb_state == GIMP_THUMB_STATE_EXISTS &&
+          strcmp (filename, thumbnail->thumb_filename) == 0)
+        {
+          thumbnail->thumb_state = GIMP_THUMB_STATE_OK;
+        }
+
+      g_object_thaw_notify (G_OBJECT (thumbnail));
+    }
+
+  return success;
+}
+
+/*  Writes @pixbuf to a temporary file next to @filename and renames it
+ *  into place, so that readers never see a partially written thumbnail.
+ *  The temporary name is unique within the process, which allows
+ *  thumbnails to be saved from several threads at once.
+ */
+static gboolean
+gimp_thumbnail_save_png (GimpThumbnail  *thumbnail,
+                         const gchar    *filename,
+                         GdkPixbuf      *pixbuf,
+                         const gchar   **keys,
+                         gchar         **values,
+                         GError        **error)
+{
+  gchar    *basename;
+  gchar    *dirname;
+  gchar    *tmpname;
+  gboolean  success;
+
   basename = g_path_get_basename (filename);
   dirname  = g_path_get_dirname (filename);
 
-  tmpname = g_strdup_printf ("%s%cgimp-thumb-%d-%.8s",
-                             dirname, G_DIR_SEPARATOR, getpid (), basename);
+  tmpname = g_strdup_printf ("%s%cgimp-thumb-%d-%d-%s",
+                             dirname, G_DIR_SEPARATOR, getpid (),
+                             g_atomic_int_add (&gimp_thumbnail_tmp_serial, 1),
+                             basename);
 
   g_free (dirname);
   g_free (basename);
@@ -889,51 +939,38 @@ gimp_thumbnail_save (GimpThumbnail  *thumbnail,
                               (gchar **) keys, values,
                               error);
 
-  for (i = 0; keys[i]; i++)
-    g_free (values[i]);
-
   if (success)
     {
 #ifdef GIMP_THUMB_DEBUG
       g_printerr ("thumbnail saved to temporary file %s\n", tmpname);
 #endif
 
-      success = (g_rename (tmpname, filename) == 0);
+      success = (g_chmod (tmpname, 0600) == 0);
 
       if (! success)
         g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
-                     _("Could not create thumbnail for %s: %s"),
+                     "Could not set permissions of thumbnail for %s: %s",
                      thumbnail->image_uri, g_strerror (errno));
     }
 
   if (success)
     {
-#ifdef GIMP_THUMB_DEBUG
-      g_printerr ("temporary thumbnail file renamed to %s\n", filename);
-#endif
-
-      success = (g_chmod (filename, 0600) == 0);
+      success = (g_rename (tmpname, filename) == 0);
 
       if (! success)
         g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
-                     "Could not set permissions of thumbnail for %s: %s",
+                     _("Could not create thumbnail for %s: %s"),
                      thumbnail->image_uri, g_strerror (errno));
+    }
 
-      g_object_freeze_notify (G_OBJECT (thumbnail));
-
-      gimp_thumbnail_update_thumb (thumbnail, size);
-
-      if (success &&
-          thumbnail->thumb_state == GIMP_THUMB_STATE_EXISTS &&
-          strcmp (filename, thumbnail->thumb_filename) == 0)
-        {
-          thumbnail->thumb_state = GIMP_THUMB_STATE_OK;
-        }
+#ifdef GIMP_THUMB_DEBUG
+  if (success)
+    g_printerr ("temporary thumbnail file renamed to %s\n", filename);
+#endif
 
-      g_object_thaw_notify (G_OBJECT (thumbnail));
-    }
+  if (! success)
+    g_unlink (tmpname);
 
-  g_unlink (tmpname);
   g_free (tmpname);
 
   return success;
@@ -1245,12 +1282,12 @@ gimp_thumbnail_save_failure (GimpThumbnail  *thumbnail,
                              const gchar    *software,
                              GError        **error)
 {
-  GdkPixbuf *pixbuf;
-  gchar     *name;
-  gchar     *desc;
-  gchar     *time_str;
-  gchar     *size_str;
-  gboolean   success;
+  GdkPixbuf   *pixbuf;
+  gchar       *name;
+  const gchar *keys[6];
+  gchar       *values[6];
+  gboolean     success;
+  gint         i = 0;
 
   g_return_val_if_fail (GIMP_IS_THUMBNAIL (thumbnail), FALSE);
   g_return_val_if_fail (thumbnail->image_uri != NULL, FALSE);
@@ -1270,34 +1307,40 @@ gimp_thumbnail_save_failure (GimpThumbnail  *thumbnail,
 
   pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 1, 1);
 
-  desc = g_strdup_printf ("Thumbnail failure for %s", thumbnail->image_uri);
-  time_str = g_strdup_printf ("%" G_GINT64_FORMAT, thumbnail->image_mtime);
-  size_str = g_strdup_printf ("%" G_GINT64_FORMAT, thumbnail->image_filesize);
-
-  success = gdk_pixbuf_save (pixbuf, name, "png", error,
-                             TAG_DESCRIPTION,    desc,
-                             TAG_SOFTWARE,       software,
-                             TAG_THUMB_URI,      thumbnail->image_uri,
-                             TAG_THUMB_MTIME,    time_str,
-                             TAG_THUMB_FILESIZE, size_str,
-                             NULL);
-  if (success)
-    {
-      success = (g_chmod (name, 0600) == 0);
+  keys[i]   = TAG_DESCRIPTION;
+  values[i] = g_strdup_printf ("Thumbnail failure for %s",
+                               thumbnail->image_uri);
+  i++;
 
-      if (success)
-        gimp_thumbnail_update_thumb (thumbnail, GIMP_THUMB_SIZE_NORMAL);
-      else
-        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
-                     "Could not set permissions of thumbnail '%s': %s",
-                     name, g_strerror (errno));
-    }
+  keys[i]   = TAG_SOFTWARE;
+  values[i] = g_strdup (software);
+  i++;
 
-  g_object_unref (pixbuf);
+  keys[i]   = TAG_THUMB_URI;
+  values[i] = g_strdup (thumbnail->image_uri);
+  i++;
+
+  keys[i]   = TAG_THUMB_MTIME;
+  values[i] = g_strdup_printf ("%" G_GINT64_FORMAT, thumbnail->image_mtime);
+  i++;
+
+  keys[i]   = TAG_THUMB_FILESIZE;
+  values[i] = g_strdup_printf ("%" G_GINT64_FORMAT, thumbnail->image_filesize);
+  i++;
+
+  keys[i]   = NULL;
+  values[i] = NULL;
+
+  success = gimp_thumbnail_save_png (thumbnail, name, pixbuf,
+                                     keys, values, error);
 
-  g_free (size_str);
-  g_free (time_str);
-  g_free (desc);
+  for (i = 0; keys[i]; i++)
+    g_free (values[i]);
+
+  if (success)
+    gimp_thumbnail_update_thumb (thumbnail, GIMP_THUMB_SIZE_NORMAL);
+
+  g_object_unref (pixbuf);
   g_free (name);
 
   return success;
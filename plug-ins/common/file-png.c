@@ -41,6 +41,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include <glib/gstdio.h>
@@ -49,6 +50,7 @@
 #include <libgimp/gimpui.h>
 
 #include <png.h>                /* PNG library definitions */
+#include <zlib.h>
 
 #include "libgimp/stdplugins-intl.h"
 
@@ -73,6 +75,8 @@
 
 #define PNG_DEFAULTS_PARASITE  "png-save-defaults"
 
+#define IDAT_SEGMENT_SIZE      (128 * 1024)
+
 /*
  * Structures...
  */
@@ -92,6 +96,7 @@ typedef struct
   gboolean  save_xmp;
   gboolean  save_iptc;
   gboolean  save_thumbnail;
+  gboolean  parallel_deflate;
 }
 PngSaveVals;
 
@@ -112,6 +117,7 @@ typedef struct
   GtkWidget *save_xmp;
   GtkWidget *save_iptc;
   GtkWidget *save_thumbnail;
+  GtkWidget *parallel_deflate;
 }
 PngSaveGui;
 
@@ -127,6 +133,46 @@ typedef struct
 }
 PngGlobals;
 
+/* Writes the image data as a zlib stream of independently compressed
+ * segments, so that the segments can be deflated in parallel.
+ */
+typedef struct
+{
+  GMutex       mutex;
+  GCond        cond;
+  GThreadPool *pool;
+  GQueue       segments;        /* Segments in file order */
+  gint         max_segments;
+  gint         level;
+  gint         width;
+  gint         bpp;             /* Bytes per pixel in the band */
+  gint         rowbytes;        /* Bytes per row in the file */
+  gint         filter_bpp;      /* Bytes per complete pixel */
+  gint         bit_depth;
+  gboolean     palette;
+  guchar      *prev_row;        /* Last row of the previous segment */
+  gboolean     first;
+  guint32      adler;
+}
+IdatWriter;
+
+typedef struct
+{
+  IdatWriter  *writer;
+  guchar      *rows;            /* Rows as in the file, unfiltered */
+  guchar      *prev_row;        /* Row above the first one, or NULL */
+  gint         n_rows;
+  gboolean     first;
+  gboolean     last;
+  guchar      *out;
+  gsize        out_size;
+  gsize        in_size;
+  guint32      adler;
+  gboolean     done;
+  gboolean     failed;
+}
+IdatSegment;
+
 
 /*
  * Local functions...
@@ -174,6 +220,19 @@ static void      load_defaults             (void);
 static void      save_defaults             (void);
 static void      load_gui_defaults         (PngSaveGui       *pg);
 
+static IdatWriter * idat_writer_new        (gint              width,
+                                            gint              bpp,
+                                            gint              bit_depth,
+                                            gboolean          palette,
+                                            gint              level);
+static gboolean  idat_writer_push          (IdatWriter       *writer,
+                                            png_structp       pp,
+                                            guchar          **rows,
+                                            gint              n_rows,
+                                            gboolean          last);
+static void      idat_writer_free          (IdatWriter       *writer);
+static void      idat_segment_encode       (IdatSegment      *segment);
+
 
 /*
  * Globals...
@@ -201,7 +260,8 @@ static const PngSaveVals defaults =
   TRUE,                /* save exif       */
   TRUE,                /* save xmp        */
   TRUE,                /* save iptc        */
-  TRUE                 /* save thumbnail  */
+  TRUE,                /* save thumbnail  */
+  FALSE                /* parallel deflate */
 };
 
 static PngSaveVals pngvals;
@@ -706,6 +766,7 @@ run (const gchar      *name,
 struct read_error_data
 {
   guchar       *pixel;           /* Pixel data */
+  GimpBandTransfer *transfer;    /* Band transfers, or NULL */
   GeglBuffer   *buffer;          /* GEGL buffer for layer */
   const Babl   *file_format;
   guint32       width;           /* png_infop->width */
@@ -727,6 +788,10 @@ on_read_error (png_structp png_ptr, png_const_charp error_msg)
 
   g_warning (_("Error loading PNG file: %s"), error_msg);
 
+  /* Let the previous row of tiles be stored first */
+  if (error_data->transfer)
+    gimp_band_transfer_wait (error_data->transfer);
+
   /* Flush the current half-read row of tiles */
 
   gegl_buffer_set (error_data->buffer,
@@ -749,6 +814,9 @@ on_read_error (png_structp png_ptr, png_const_charp error_msg)
                          GEGL_RECTANGLE (0, begin, error_data->width, num));
     }
 
+  if (error_data->transfer)
+    gimp_band_transfer_free (error_data->transfer);
+
   longjmp (png_jmpbuf (png_ptr), 1);
 }
 
@@ -1128,15 +1196,25 @@ load_image (const gchar  *filename,
    */
 
   tile_height = gimp_tile_height ();
-  pixel = g_new0 (guchar, tile_height * width * bpp);
   pixels = g_new (guchar *, tile_height);
 
-  for (i = 0; i < tile_height; i++)
-    pixels[i] = pixel + width * bpp * i;
+  /* Non-interlaced files are decoded into one band while the previous
+   * one is stored, interlaced ones need to read back earlier passes.
+   */
+  if (num_passes == 1)
+    {
+      error_data.transfer = gimp_band_transfer_new (buffer, file_format,
+                                                    tile_height, bpp);
+      pixel = gimp_band_transfer_wait (error_data.transfer);
+    }
+  else
+    {
+      error_data.transfer = NULL;
+      pixel = g_new0 (guchar, tile_height * width * bpp);
+    }
 
   /* Install our own error handler to handle incomplete PNG files better */
   error_data.buffer      = buffer;
-  error_data.pixel       = pixel;
   error_data.file_format = file_format;
   error_data.tile_height = tile_height;
   error_data.width       = width;
@@ -1165,26 +1243,49 @@ load_image (const gchar  *filename,
                              GEGL_AUTO_ROWSTRIDE,
                              GEGL_ABYSS_NONE);
 
+          for (i = 0; i < num; i++)
+            pixels[i] = pixel + width * bpp * i;
+
+          error_data.pixel = pixel;
           error_data.begin = begin;
           error_data.end   = end;
           error_data.num   = num;
 
           png_read_rows (pp, pixels, NULL, num);
 
-          gegl_buffer_set (buffer,
-                           GEGL_RECTANGLE (0, begin, width, num),
-                           0,
-                           file_format,
-                           pixel,
-                           GEGL_AUTO_ROWSTRIDE);
+          if (error_data.transfer)
+            {
+              /* The previous row of tiles must be stored before
+               * talking to the core
+               */
+              gimp_band_transfer_sync (error_data.transfer);
+            }
+          else
+            {
+              gegl_buffer_set (buffer,
+                               GEGL_RECTANGLE (0, begin, width, num),
+                               0,
+                               file_format,
+                               pixel,
+                               GEGL_AUTO_ROWSTRIDE);
+            }
 
           gimp_progress_update
             (((gdouble) pass +
               (gdouble) end / (gdouble) height) /
              (gdouble) num_passes);
+
+          if (error_data.transfer)
+            pixel = gimp_band_transfer_write (error_data.transfer, begin, num);
         }
     }
 
+  /* Wait for the last row of tiles to be stored */
+  if (error_data.transfer)
+    gimp_band_transfer_free (error_data.transfer);
+  else
+    g_free (pixel);
+
   /* Switch back to default error handler */
   png_set_error_fn (pp, NULL, NULL, NULL);
 
@@ -1276,7 +1377,6 @@ load_image (const gchar  *filename,
 
   png_destroy_read_struct (&pp, &info, NULL);
 
-  g_free (pixel);
   g_free (pixels);
   g_object_unref (buffer);
   free (pp);
@@ -1413,6 +1513,9 @@ save_image (const gchar  *filename,
   guchar **pixels,              /* Pixel rows */
    *fixed,                      /* Fixed-up pixel data */
    *pixel;                      /* Pixel data */
+  gint band_height;             /* Rows per band */
+  GimpBandTransfer * volatile transfer = NULL; /* Band transfers */
+  IdatWriter * volatile writer = NULL; /* Parallel IDAT compression */
   gdouble xres, yres;           /* GIMP resolution (dpi) */
   png_color_16 background;      /* Background color */
   png_time mod_time;            /* Modification time (ie NOW) */
@@ -1449,6 +1552,13 @@ save_image (const gchar  *filename,
       g_set_error (error, 0, 0,
                    _("Error while saving '%s'. Could not save image."),
                    gimp_filename_to_utf8 (filename));
+
+      if (writer)
+        idat_writer_free (writer);
+
+      if (transfer)
+        gimp_band_transfer_free (transfer);
+
       return FALSE;
     }
 
@@ -1783,30 +1893,52 @@ save_image (const gchar  *filename,
    */
 
   tile_height = gimp_tile_height ();
-  pixel = g_new (guchar, tile_height * width * bpp);
-  pixels = g_new (guchar *, tile_height);
+  band_height = tile_height;
+
+  /* Parallel compression needs segments which are worth compressing
+   * on their own.
+   */
+  if (pngvals.parallel_deflate && ! pngvals.interlaced)
+    {
+      writer = idat_writer_new (width, bpp, bit_depth,
+                                color_type == PNG_COLOR_TYPE_PALETTE,
+                                pngvals.compression_level);
+
+      while (band_height < height &&
+             (gsize) band_height * width * bpp < IDAT_SEGMENT_SIZE)
+        band_height += tile_height;
+    }
 
-  for (i = 0; i < tile_height; i++)
-    pixels[i] = pixel + width * bpp * i;
+  /* Fetch the next band while the current one is compressed */
+  transfer = gimp_band_transfer_new (buffer, file_format, band_height, 0);
+  pixels = g_new (guchar *, band_height);
 
   for (pass = 0; pass < num_passes; pass++)
     {
+      gimp_band_transfer_read (transfer, 0, MIN (band_height, height));
+
       /* This works if you are only writing one row at a time... */
-      for (begin = 0, end = tile_height;
-           begin < height; begin += tile_height, end += tile_height)
+      for (begin = 0, end = band_height;
+           begin < height; begin += band_height, end += band_height)
         {
           if (end > height)
             end = height;
 
           num = end - begin;
 
-          gegl_buffer_get (buffer,
-                           GEGL_RECTANGLE (0, begin, width, num),
-                           1.0,
-                           file_format,
-                           pixel,
-                           GEGL_AUTO_ROWSTRIDE,
-                           GEGL_ABYSS_NONE);
+          pixel = gimp_band_transfer_wait (transfer);
+
+          /* No transfer is in flight, so we may talk to the core */
+          gimp_progress_update (((double) pass + (double) begin /
+                                 (double) height) /
+                                (double) num_passes);
+
+          if (end < height)
+            gimp_band_transfer_read (transfer, end,
+                                     MIN (band_height, height - end));
+
+          for (i = 0; i < num; i++)
+            pixels[i] = pixel + width * bpp * i;
 
           /* If we are with a RGBA image and have to pre-multiply the
              alpha channel */
@@ -1875,20 +2007,37 @@ save_image (const gchar  *filename,
                 }
             }
 
-          png_write_rows (pp, pixels, num);
-
-          gimp_progress_update (((double) pass + (double) end /
-                                 (double) height) /
-                                (double) num_passes);
+          if (writer)
+            {
+              if (! idat_writer_push (writer, pp, pixels, num, end == height))
+                png_error (pp, "Could not compress the image data");
+            }
+          else
+            {
+              png_write_rows (pp, pixels, num);
+            }
         }
     }
 
   gimp_progress_update (1.0);
 
-  png_write_end (pp, info);
+  if (writer)
+    {
+      /* png_write_end() insists on IDATs written by libpng, the
+       * ancillary chunks have all been written by png_write_info().
+       */
+      png_write_chunk (pp, (png_bytep) "IEND", NULL, 0);
+
+      idat_writer_free (writer);
+    }
+  else
+    {
+      png_write_end (pp, info);
+    }
+
   png_destroy_write_struct (&pp, &info);
 
-  g_free (pixel);
+  gimp_band_transfer_free (transfer);
   g_free (pixels);
 
   /*
@@ -1909,6 +2058,414 @@ save_image (const gchar  *filename,
   return TRUE;
 }
 
+/*
+ * Parallel IDAT compression...
+ */
+
+static inline gint
+paeth_predictor (gint a,
+                 gint b,
+                 gint c)
+{
+  gint p  = a + b - c;
+  gint pa = ABS (p - a);
+  gint pb = ABS (p - b);
+  gint pc = ABS (p - c);
+
+  if (pa <= pb && pa <= pc)
+    return a;
+  else if (pb <= pc)
+    return b;
+
+  return c;
+}
+
+/* Picks the filter with the smallest sum of absolute differences,
+ * the same heuristic libpng uses.
+ */
+static void
+idat_filter_row (IdatWriter   *writer,
+                 const guchar *row,
+                 const guchar *prev,
+                 guchar       *out,
+                 guchar       *scratch)
+{
+  gint    n   = writer->rowbytes;
+  gint    bpp = writer->filter_bpp;
+  guint64 best_sum = G_MAXUINT64;
+  gint    type;
+  gint    i;
+
+  /* Like libpng, don't filter palette and low bit depth images */
+  if (writer->palette || writer->bit_depth < 8)
+    {
+      out[0] = PNG_FILTER_VALUE_NONE;
+      memcpy (out + 1, row, n);
+
+      return;
+    }
+
+  for (type = PNG_FILTER_VALUE_NONE; type <= PNG_FILTER_VALUE_PAETH; type++)
+    {
+      guchar  *d   = scratch + 1;
+      guint64  sum = 0;
+
+      scratch[0] = type;
+
+      switch (type)
+        {
+        case PNG_FILTER_VALUE_NONE:
+          memcpy (d, row, n);
+          break;
+
+        case PNG_FILTER_VALUE_SUB:
+          for (i = 0; i < n; i++)
+            d[i] = row[i] - (i >= bpp ? row[i - bpp] : 0);
+          break;
+
+        case PNG_FILTER_VALUE_UP:
+          for (i = 0; i < n; i++)
+            d[i] = row[i] - prev[i];
+          break;
+
+        case PNG_FILTER_VALUE_AVG:
+          for (i = 0; i < n; i++)
+            d[i] = row[i] - (((i >= bpp ? row[i - bpp] : 0) + prev[i]) >> 1);
+          break;
+
+        case PNG_FILTER_VALUE_PAETH:
+          for (i = 0; i < n; i++)
+            d[i] = row[i] - paeth_predictor (i >= bpp ? row[i - bpp]  : 0,
+                                             prev[i],
+                                             i >= bpp ? prev[i - bpp] : 0);
+          break;
+        }
+
+      for (i = 0; i < n; i++)
+        sum += d[i] < 128 ? d[i] : 256 - d[i];
+
+      if (sum < best_sum)
+        {
+          best_sum = sum;
+          memcpy (out, scratch, n + 1);
+        }
+    }
+}
+
+static void
+idat_segment_encode (IdatSegment *segment)
+{
+  IdatWriter   *writer = segment->writer;
+  gint          stride = writer->rowbytes + 1;
+  guchar       *filtered;
+  guchar       *scratch;
+  guchar       *zero_row = NULL;
+  const guchar *prev;
+  z_stream      zs     = { 0, };
+  gsize         offset = 0;
+  gsize         size;
+  gint          ret;
+  gint          i;
+
+  filtered = g_malloc ((gsize) segment->n_rows * stride);
+  scratch  = g_malloc (stride);
+
+  /* The row above the first row of the image is all zeros */
+  prev = segment->prev_row;
+  if (! prev)
+    prev = zero_row = g_malloc0 (writer->rowbytes);
+
+  for (i = 0; i < segment->n_rows; i++)
+    {
+      const guchar *row = segment->rows + (gsize) i * writer->rowbytes;
+
+      idat_filter_row (writer, row, prev, filtered + (gsize) i * stride,
+                       scratch);
+      prev = row;
+    }
+
+  segment->in_size = (gsize) segment->n_rows * stride;
+  segment->adler   = adler32 (adler32 (0L, Z_NULL, 0),
+                              filtered, segment->in_size);
+
+  /* Raw deflate, the zlib header and trailer are written around the
+   * segments; all but the last one end on a byte boundary.
+   */
+  if (deflateInit2 (&zs, writer->level, Z_DEFLATED, -MAX_WBITS, 8,
+                    writer->palette ?
+                    Z_DEFAULT_STRATEGY : Z_FILTERED) == Z_OK)
+    {
+      size = deflateBound (&zs, segment->in_size) + 16;
+      segment->out = g_malloc (size);
+
+      if (segment->first)
+        {
+          guint cmf   = 0x78;
+          guint level = (writer->level < 2 ? 0 :
+                         writer->level < 6 ? 1 :
+                         writer->level == 6 ? 2 : 3);
+          guint flg   = level << 6;
+
+          flg += 31 - (cmf * 256 + flg) % 31;
+
+          segment->out[offset++] = cmf;
+          segment->out[offset++] = flg;
+        }
+
+      zs.next_in   = filtered;
+      zs.avail_in  = segment->in_size;
+      zs.next_out  = segment->out + offset;
+      zs.avail_out = size - offset - 4;
+
+      ret = deflate (&zs, segment->last ? Z_FINISH : Z_SYNC_FLUSH);
+
+      if (segment->last)
+        segment->failed = (ret != Z_STREAM_END);
+      else
+        segment->failed = (ret != Z_OK || zs.avail_in != 0);
+
+      segment->out_size = offset + zs.total_out;
+
+      deflateEnd (&zs);
+    }
+  else
+    {
+      segment->failed = TRUE;
+    }
+
+  g_free (filtered);
+  g_free (scratch);
+  g_free (zero_row);
+
+  g_free (segment->rows);
+  g_free (segment->prev_row);
+  segment->rows     = NULL;
+  segment->prev_row = NULL;
+}
+
+static void
+idat_segment_func (gpointer data,
+                   gpointer user_data)
+{
+  IdatSegment *segment = data;
+  IdatWriter  *writer  = segment->writer;
+
+  idat_segment_encode (segment);
+
+  g_mutex_lock (&writer->mutex);
+
+  segment->done = TRUE;
+  g_cond_broadcast (&writer->cond);
+
+  g_mutex_unlock (&writer->mutex);
+}
+
+static void
+idat_segment_free (IdatSegment *segment)
+{
+  g_free (segment->rows);
+  g_free (segment->prev_row);
+  g_free (segment->out);
+
+  g_slice_free (IdatSegment, segment);
+}
+
+static IdatWriter *
+idat_writer_new (gint     width,
+                 gint     bpp,
+                 gint     bit_depth,
+                 gboolean palette,
+                 gint     level)
+{
+  IdatWriter *writer    = g_slice_new0 (IdatWriter);
+  gint        n_threads = g_get_num_processors ();
+
+  g_mutex_init (&writer->mutex);
+  g_cond_init (&writer->cond);
+  g_queue_init (&writer->segments);
+
+  writer->max_segments = 2 * n_threads;
+  writer->level        = level;
+  writer->width        = width;
+  writer->bpp          = bpp;
+  writer->bit_depth    = bit_depth;
+  writer->palette      = palette;
+  writer->first        = TRUE;
+  writer->adler        = adler32 (0L, Z_NULL, 0);
+
+  if (palette)
+    {
+      writer->rowbytes   = (width * bit_depth + 7) / 8;
+      writer->filter_bpp = 1;
+    }
+  else
+    {
+      writer->rowbytes   = width * bpp;
+      writer->filter_bpp = bpp;
+    }
+
+  if (n_threads > 1)
+    writer->pool = g_thread_pool_new (idat_segment_func, NULL,
+                                      n_threads, FALSE, NULL);
+
+  return writer;
+}
+
+/* Converts a row of the band to the file's sample layout */
+static void
+idat_writer_pack_row (IdatWriter   *writer,
+                      const guchar *src,
+                      guchar       *dest)
+{
+  gint i;
+
+  if (writer->palette && writer->bit_depth < 8)
+    {
+      gint per_byte = 8 / writer->bit_depth;
+
+      memset (dest, 0, writer->rowbytes);
+
+      for (i = 0; i < writer->width; i++)
+        dest[i / per_byte] |= (src[i] << (8 - writer->bit_depth *
+                                              (i % per_byte + 1)));
+    }
+  else if (writer->bit_depth == 16 && G_BYTE_ORDER == G_LITTLE_ENDIAN)
+    {
+      for (i = 0; i < writer->rowbytes; i += 2)
+        {
+          dest[i]     = src[i + 1];
+          dest[i + 1] = src[i];
+        }
+    }
+  else
+    {
+      memcpy (dest, src, writer->rowbytes);
+    }
+}
+
+/* Writes finished segments in order, waiting until at most @keep
+ * segments are left in the queue.
+ */
+static gboolean
+idat_writer_flush (IdatWriter  *writer,
+                   png_structp  pp,
+                   guint        keep)
+{
+  while (! g_queue_is_empty (&writer->segments))
+    {
+      IdatSegment *segment = g_queue_peek_head (&writer->segments);
+      gboolean     done;
+      gboolean     success;
+
+      g_mutex_lock (&writer->mutex);
+
+      if (g_queue_get_length (&writer->segments) > keep)
+        {
+          while (! segment->done)
+            g_cond_wait (&writer->cond, &writer->mutex);
+        }
+
+      done = segment->done;
+
+      g_mutex_unlock (&writer->mutex);
+
+      if (! done)
+        break;
+
+      g_queue_pop_head (&writer->segments);
+
+      success = ! segment->failed;
+
+      if (success)
+        {
+          writer->adler = adler32_combine (writer->adler, segment->adler,
+                                           segment->in_size);
+
+          if (segment->last)
+            {
+              guchar *trailer = segment->out + segment->out_size;
+
+              trailer[0] = (writer->adler >> 24) & 0xff;
+              trailer[1] = (writer->adler >> 16) & 0xff;
+              trailer[2] = (writer->adler >>  8) & 0xff;
+              trailer[3] = (writer->adler >>  0) & 0xff;
+
+              segment->out_size += 4;
+            }
+
+          png_write_chunk (pp, (png_bytep) "IDAT",
+                           segment->out, segment->out_size);
+        }
+
+      idat_segment_free (segment);
+
+      if (! success)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+idat_writer_push (IdatWriter  *writer,
+                  png_structp  pp,
+                  guchar     **rows,
+                  gint         n_rows,
+                  gboolean     last)
+{
+  IdatSegment *segment = g_slice_new0 (IdatSegment);
+  gint         i;
+
+  segment->writer = writer;
+  segment->n_rows = n_rows;
+  segment->first  = writer->first;
+  segment->last   = last;
+
+  writer->first = FALSE;
+
+  segment->rows = g_malloc ((gsize) n_rows * writer->rowbytes);
+
+  for (i = 0; i < n_rows; i++)
+    idat_writer_pack_row (writer, rows[i],
+                          segment->rows + (gsize) i * writer->rowbytes);
+
+  segment->prev_row = writer->prev_row;
+  writer->prev_row  = g_memdup (segment->rows +
+                                (gsize) (n_rows - 1) * writer->rowbytes,
+                                writer->rowbytes);
+
+  g_queue_push_tail (&writer->segments, segment);
+
+  if (writer->pool)
+    {
+      g_thread_pool_push (writer->pool, segment, NULL);
+    }
+  else
+    {
+      idat_segment_encode (segment);
+      segment->done = TRUE;
+    }
+
+  return idat_writer_flush (writer, pp, last ? 0 : writer->max_segments);
+}
+
+static void
+idat_writer_free (IdatWriter *writer)
+{
+  if (writer->pool)
+    g_thread_pool_free (writer->pool, FALSE, TRUE);
+
+  g_queue_foreach (&writer->segments, (GFunc) idat_segment_free, NULL);
+  g_queue_clear (&writer->segments);
+
+  g_free (writer->prev_row);
+
+  g_mutex_clear (&writer->mutex);
+  g_cond_clear (&writer->cond);
+
+  g_slice_free (IdatWriter, writer);
+}
+
 static gboolean
 ia_has_transparent_pixels (GeglBuffer *buffer)
 {
@@ -2191,6 +2748,9 @@ save_dialog (gint32    image_ID,
   pg.save_thumbnail = toggle_button_init (builder, "sv_thumbnail",
                                           pngvals.save_thumbnail,
                                           &pngvals.save_thumbnail);
+  pg.parallel_deflate = toggle_button_init (builder, "parallel-deflate",
+                                            pngvals.parallel_deflate,
+                                            &pngvals.parallel_deflate);
 
   /* Comment toggle */
   parasite = gimp_image_get_parasite (image_ID, "gimp-comment");
@@ -2277,7 +2837,8 @@ load_defaults (void)
 
       gimp_parasite_free (parasite);
 
-      num_fields = sscanf (def_str, "%d %d %d %d %d %d %d %d %d %d %d %d %d",
+      num_fields = sscanf (def_str,
+                           "%d %d %d %d %d %d %d %d %d %d %d %d %d %d",
                            &tmpvals.interlaced,
                            &tmpvals.bkgd,
                            &tmpvals.gama,
@@ -2290,11 +2851,12 @@ load_defaults (void)
                            &tmpvals.save_exif,
                            &tmpvals.save_xmp,
                            &tmpvals.save_iptc,
-                           &tmpvals.save_thumbnail);
+                           &tmpvals.save_thumbnail,
+                           &tmpvals.parallel_deflate);
 
       g_free (def_str);
 
-      if (num_fields == 9 || num_fields == 13)
+      if (num_fields == 9 || num_fields == 13 || num_fields == 14)
         pngvals = tmpvals;
     }
 }
@@ -2305,7 +2867,7 @@ save_defaults (void)
   GimpParasite *parasite;
   gchar        *def_str;
 
-  def_str = g_strdup_printf ("%d %d %d %d %d %d %d %d %d %d %d %d %d",
+  def_str = g_strdup_printf ("%d %d %d %d %d %d %d %d %d %d %d %d %d %d",
                              pngvals.interlaced,
                              pngvals.bkgd,
                              pngvals.gama,
@@ -2318,7 +2880,8 @@ save_defaults (void)
                              pngvals.save_exif,
                              pngvals.save_xmp,
                              pngvals.save_iptc,
-                             pngvals.save_thumbnail);
+                             pngvals.save_thumbnail,
+                             pngvals.parallel_deflate);
 
   parasite = gimp_parasite_new (PNG_DEFAULTS_PARASITE,
                                 GIMP_PARASITE_PERSISTENT,
@@ -2351,6 +2914,7 @@ load_gui_defaults (PngSaveGui *pg)
   SET_ACTIVE (save_xmp);
   SET_ACTIVE (save_iptc);
   SET_ACTIVE (save_thumbnail);
+  SET_ACTIVE (parallel_deflate);
 
 #undef SET_ACTIVE
 
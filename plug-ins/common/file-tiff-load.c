@@ -64,6 +64,7 @@
 #endif
 
 #include <tiffio.h>
+#include <zlib.h>
 
 #include <libgimp/gimp.h>
 #include <libgimp/gimpui.h>
@@ -99,6 +100,31 @@ typedef struct
   gint *pages;
 } TiffSelectedPages;
 
+typedef struct
+{
+  GMutex  mutex;
+  GCond   cond;
+  gint    n_pending;
+  uint16  compression;
+  uint16  predictor;
+  gushort bps;
+  gushort spp;
+  gboolean swab;
+} TiffDecodeInfo;
+
+/* A tile or strip which is read raw and decoded on a worker thread */
+typedef struct
+{
+  TiffDecodeInfo *info;
+  guchar         *raw;
+  gsize           raw_size;
+  guchar         *data;        /* Decoded chunk */
+  gsize           data_size;
+  gint            rowstride;
+  uint32          x, y;
+  uint32          cols, rows;
+} TiffChunk;
+
 /* Declare some local functions.
  */
 static void   query     (void);
@@ -124,6 +150,21 @@ static void      load_contiguous  (TIFF         *tif,
                                    gushort       bps,
                                    gushort       spp,
                                    gint          extra);
+static void      load_contiguous_chunk
+                                  (channel_data *channel,
+                                   gint          extra,
+                                   const Babl   *src_format,
+                                   guchar       *data,
+                                   gint          rowstride,
+                                   uint32        x,
+                                   uint32        y,
+                                   uint32        cols,
+                                   uint32        rows);
+static gboolean  can_decode_chunks (TIFF         *tif,
+                                   gushort       bps);
+static void      decode_chunk     (TiffChunk    *chunk);
+static void      decode_chunk_func (gpointer     data,
+                                   gpointer      user_data);
 static void      load_separate    (TIFF         *tif,
                                    channel_data *channel,
                                    gushort       bps,
@@ -1459,12 +1500,17 @@ load_contiguous (TIFF         *tif,
 {
   uint32  imageWidth, imageLength;
   uint32  tileWidth, tileLength;
+  uint32  bandLength;
   uint32  x, y, rows, cols;
   int bytes_per_pixel;
-  GeglBuffer *src_buf;
   const Babl *src_format;
-  GeglBufferIterator *iter;
-  guchar *buffer;
+  guchar *buffer = NULL;
+  TiffDecodeInfo info;
+  TiffChunk *chunks = NULL;
+  GThreadPool *pool = NULL;
+  gboolean parallel;
+  gint    n_strips = 1;
+  gint    src_bpp;
   gdouble progress = 0.0, one_row;
   gint    i;
 
@@ -1473,102 +1519,372 @@ load_contiguous (TIFF         *tif,
   TIFFGetField (tif, TIFFTAG_IMAGEWIDTH, &imageWidth);
   TIFFGetField (tif, TIFFTAG_IMAGELENGTH, &imageLength);
 
+  /* Uncompressed and deflate compressed tiles or strips are read raw
+   * and decoded on all cores, everything else is left to libtiff.
+   */
+  parallel = can_decode_chunks (tif, bps);
+
   tileWidth = imageWidth;
 
   if (TIFFIsTiled (tif))
     {
       TIFFGetField (tif, TIFFTAG_TILEWIDTH, &tileWidth);
       TIFFGetField (tif, TIFFTAG_TILELENGTH, &tileLength);
-      buffer = g_malloc (TIFFTileSize (tif));
+      bandLength = tileLength;
+    }
+  else if (parallel)
+    {
+      TIFFGetFieldDefaulted (tif, TIFFTAG_ROWSPERSTRIP, &tileLength);
+      tileLength = MIN (tileLength, imageLength);
+      n_strips = g_get_num_processors ();
+      bandLength = tileLength * n_strips;
     }
   else
     {
       tileWidth = imageWidth;
       tileLength = 1;
+      bandLength = 1;
+    }
+
+  if (parallel)
+    {
+      g_mutex_init (&info.mutex);
+      g_cond_init (&info.cond);
+      TIFFGetFieldDefaulted (tif, TIFFTAG_COMPRESSION, &info.compression);
+
+      /* The predictor only exists for codecs which support it */
+      if (info.compression == COMPRESSION_NONE ||
+          ! TIFFGetField (tif, TIFFTAG_PREDICTOR, &info.predictor))
+        info.predictor = PREDICTOR_NONE;
+      info.bps  = bps;
+      info.spp  = spp;
+      info.swab = TIFFIsByteSwapped (tif);
+
+      chunks = g_new0 (TiffChunk,
+                       MAX (n_strips,
+                            (imageWidth + tileWidth - 1) / tileWidth));
+
+      if (g_get_num_processors () > 1)
+        pool = g_thread_pool_new (decode_chunk_func, NULL,
+                                  g_get_num_processors (), FALSE, NULL);
+    }
+  else if (TIFFIsTiled (tif))
+    {
+      buffer = g_malloc (TIFFTileSize (tif));
+    }
+  else
+    {
       buffer = g_malloc (TIFFScanlineSize (tif));
     }
 
-  one_row = (gdouble) tileLength / (gdouble) imageLength;
+  one_row = (gdouble) bandLength / (gdouble) imageLength;
 
   if (bps <= 8)
     src_format = babl_format_n (babl_type ("u8"), spp);
   else
     src_format = babl_format_n (babl_type ("u16"), spp);
 
+  src_bpp = babl_format_get_bytes_per_pixel (src_format);
+
   /* consistency check */
   bytes_per_pixel = 0;
   for (i = 0; i <= extra; i++)
     bytes_per_pixel += babl_format_get_bytes_per_pixel (channel[i].format);
 
   g_printerr ("bytes_per_pixel: %d, format: %d\n", bytes_per_pixel,
-              babl_format_get_bytes_per_pixel (src_format));
+              src_bpp);
 
-  for (y = 0; y < imageLength; y += tileLength)
+  for (y = 0; y < imageLength; y += bandLength)
     {
-      for (x = 0; x < imageWidth; x += tileWidth)
+      if (parallel)
         {
-          int offset;
-
-          gimp_progress_update (progress + one_row *
-                                ( (gdouble) x / (gdouble) imageWidth));
+          gint n_chunks = 0;
 
-          if (TIFFIsTiled (tif))
-            TIFFReadTile (tif, buffer, x, y, 0, 0);
-          else
-            TIFFReadScanline (tif, buffer, y, 0);
+          gimp_progress_update (progress);
 
-          cols = MIN (imageWidth - x, tileWidth);
-          rows = MIN (imageLength - y, tileLength);
+          /* Read the raw chunks of this band in file order */
+          for (x = 0; x < imageWidth; x += tileWidth)
+            {
+              uint32 ys;
 
-          src_buf = gegl_buffer_linear_new_from_data (buffer,
-                                                      src_format,
-                                                      GEGL_RECTANGLE (0, 0, cols, rows),
-                                                      GEGL_AUTO_ROWSTRIDE,
-                                                      NULL, NULL);
+              for (ys = y;
+                   ys < MIN (y + bandLength, imageLength);
+                   ys += tileLength)
+                {
+                  TiffChunk *chunk = &chunks[n_chunks++];
+                  tstrip_t   index;
 
-          offset = 0;
+                  chunk->info = &info;
+                  chunk->x    = x;
+                  chunk->y    = ys;
+                  chunk->cols = MIN (imageWidth - x, tileWidth);
+                  chunk->rows = MIN (imageLength - ys, tileLength);
 
-          for (i = 0; i <= extra; i++)
-            {
-              gint src_bpp, dest_bpp;
-
-              src_bpp = babl_format_get_bytes_per_pixel (src_format);
-              dest_bpp = babl_format_get_bytes_per_pixel (channel[i].format);
-
-              iter = gegl_buffer_iterator_new (src_buf,
-                                               GEGL_RECTANGLE (0, 0, cols, rows),
-                                               0, NULL,
-                                               GEGL_BUFFER_READ,
-                                               GEGL_ABYSS_NONE);
-              gegl_buffer_iterator_add (iter, channel[i].buffer,
-                                        GEGL_RECTANGLE (x, y, cols, rows),
-                                        0, channel[i].format,
-                                        GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
-
-              while (gegl_buffer_iterator_next (iter))
-                {
-                  guchar *s = iter->data[0];
-                  guchar *d = iter->data[1];
-                  gint length = iter->length;
+                  if (TIFFIsTiled (tif))
+                    {
+                      index = TIFFComputeTile (tif, x, ys, 0, 0);
+                      chunk->data_size = TIFFTileSize (tif);
+                      chunk->rowstride = TIFFTileRowSize (tif);
+                    }
+                  else
+                    {
+                      index = TIFFComputeStrip (tif, ys, 0);
+                      chunk->data_size = TIFFVStripSize (tif, chunk->rows);
+                      chunk->rowstride = TIFFScanlineSize (tif);
+                    }
 
-                  s += offset;
+                  chunk->raw_size = TIFFRawStripSize (tif, index);
+                  chunk->raw = g_malloc (chunk->raw_size);
 
-                  while (length--)
+                  if (TIFFIsTiled (tif))
+                    {
+                      if (TIFFReadRawTile (tif, index, chunk->raw,
+                                           chunk->raw_size) < 0)
+                        chunk->raw_size = 0;
+                    }
+                  else
                     {
-                      memcpy (d, s, dest_bpp);
-                      d += dest_bpp;
-                      s += src_bpp;
+                      if (TIFFReadRawStrip (tif, index, chunk->raw,
+                                            chunk->raw_size) < 0)
+                        chunk->raw_size = 0;
                     }
                 }
+            }
+
+          if (pool && n_chunks > 1)
+            {
+              info.n_pending = n_chunks;
+
+              for (i = 0; i < n_chunks; i++)
+                g_thread_pool_push (pool, &chunks[i], NULL);
 
-              offset += dest_bpp;
+              g_mutex_lock (&info.mutex);
+
+              while (info.n_pending > 0)
+                g_cond_wait (&info.cond, &info.mutex);
+
+              g_mutex_unlock (&info.mutex);
+            }
+          else
+            {
+              for (i = 0; i < n_chunks; i++)
+                decode_chunk (&chunks[i]);
             }
 
-          g_object_unref (src_buf);
+          for (i = 0; i < n_chunks; i++)
+            {
+              TiffChunk *chunk = &chunks[i];
+
+              load_contiguous_chunk (channel, extra, src_format,
+                                     chunk->data, chunk->rowstride,
+                                     chunk->x, chunk->y,
+                                     chunk->cols, chunk->rows);
+
+              g_free (chunk->raw);
+              g_free (chunk->data);
+            }
+        }
+      else
+        {
+          for (x = 0; x < imageWidth; x += tileWidth)
+            {
+              gimp_progress_update (progress + one_row *
+                                    ( (gdouble) x / (gdouble) imageWidth));
+
+              if (TIFFIsTiled (tif))
+                TIFFReadTile (tif, buffer, x, y, 0, 0);
+              else
+                TIFFReadScanline (tif, buffer, y, 0);
+
+              cols = MIN (imageWidth - x, tileWidth);
+              rows = MIN (imageLength - y, tileLength);
+
+              load_contiguous_chunk (channel, extra, src_format,
+                                     buffer, tileWidth * src_bpp,
+                                     x, y, cols, rows);
+            }
         }
 
       progress += one_row;
     }
+
+  if (pool)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  if (parallel)
+    {
+      g_mutex_clear (&info.mutex);
+      g_cond_clear (&info.cond);
+    }
+
+  g_free (chunks);
+  g_free (buffer);
+}
+
+static void
+load_contiguous_chunk (channel_data *channel,
+                       gint          extra,
+                       const Babl   *src_format,
+                       guchar       *data,
+                       gint          rowstride,
+                       uint32        x,
+                       uint32        y,
+                       uint32        cols,
+                       uint32        rows)
+{
+  GeglBuffer         *src_buf;
+  GeglBufferIterator *iter;
+  gint                offset;
+  gint                i;
+
+  src_buf = gegl_buffer_linear_new_from_data (data,
+                                              src_format,
+                                              GEGL_RECTANGLE (0, 0, cols, rows),
+                                              rowstride,
+                                              NULL, NULL);
+
+  offset = 0;
+
+  for (i = 0; i <= extra; i++)
+    {
+      gint src_bpp, dest_bpp;
+
+      src_bpp = babl_format_get_bytes_per_pixel (src_format);
+      dest_bpp = babl_format_get_bytes_per_pixel (channel[i].format);
+
+      iter = gegl_buffer_iterator_new (src_buf,
+                                       GEGL_RECTANGLE (0, 0, cols, rows),
+                                       0, NULL,
+                                       GEGL_BUFFER_READ,
+                                       GEGL_ABYSS_NONE);
+      gegl_buffer_iterator_add (iter, channel[i].buffer,
+                                GEGL_RECTANGLE (x, y, cols, rows),
+                                0, channel[i].format,
+                                GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+      while (gegl_buffer_iterator_next (iter))
+        {
+          guchar *s = iter->data[0];
+          guchar *d = iter->data[1];
+          gint length = iter->length;
+
+          s += offset;
+
+          while (length--)
+            {
+              memcpy (d, s, dest_bpp);
+              d += dest_bpp;
+              s += src_bpp;
+            }
+        }
+
+      offset += dest_bpp;
+    }
+
+  g_object_unref (src_buf);
+}
+
+static gboolean
+can_decode_chunks (TIFF    *tif,
+                   gushort  bps)
+{
+  uint16 compression;
+  uint16 predictor   = PREDICTOR_NONE;
+  uint16 photometric;
+
+  TIFFGetFieldDefaulted (tif, TIFFTAG_COMPRESSION, &compression);
+
+  if (compression != COMPRESSION_NONE     &&
+      compression != COMPRESSION_DEFLATE  &&
+      compression != COMPRESSION_ADOBE_DEFLATE)
+    return FALSE;
+
+  if (compression != COMPRESSION_NONE)
+    TIFFGetField (tif, TIFFTAG_PREDICTOR, &predictor);
+
+  if (! TIFFGetField (tif, TIFFTAG_PHOTOMETRIC, &photometric))
+    photometric = PHOTOMETRIC_MINISBLACK;
+
+  if (predictor != PREDICTOR_NONE && predictor != PREDICTOR_HORIZONTAL)
+    return FALSE;
+
+  if (photometric == PHOTOMETRIC_YCBCR)
+    return FALSE;
+
+  return (bps == 8 || bps == 16);
+}
+
+static void
+decode_chunk (TiffChunk *chunk)
+{
+  TiffDecodeInfo *info = chunk->info;
+
+  chunk->data = g_malloc0 (chunk->data_size);
+
+  if (info->compression == COMPRESSION_NONE)
+    {
+      memcpy (chunk->data, chunk->raw, MIN (chunk->raw_size, chunk->data_size));
+    }
+  else
+    {
+      z_stream zs = { 0, };
+
+      /* Damaged data leaves the rest of the chunk empty, like libtiff */
+      if (inflateInit (&zs) == Z_OK)
+        {
+          zs.next_in   = chunk->raw;
+          zs.avail_in  = chunk->raw_size;
+          zs.next_out  = chunk->data;
+          zs.avail_out = chunk->data_size;
+
+          inflate (&zs, Z_FINISH);
+          inflateEnd (&zs);
+        }
+    }
+
+  if (info->swab && info->bps == 16)
+    TIFFSwabArrayOfShort ((uint16 *) chunk->data, chunk->data_size / 2);
+
+  if (info->predictor == PREDICTOR_HORIZONTAL)
+    {
+      guchar *row;
+      gint    i;
+
+      for (row = chunk->data;
+           row + chunk->rowstride <= chunk->data + chunk->data_size;
+           row += chunk->rowstride)
+        {
+          if (info->bps == 16)
+            {
+              uint16 *p = (uint16 *) row;
+
+              for (i = info->spp; i < chunk->rowstride / 2; i++)
+                p[i] += p[i - info->spp];
+            }
+          else
+            {
+              for (i = info->spp; i < chunk->rowstride; i++)
+                row[i] += row[i - info->spp];
+            }
+        }
+    }
+}
+
+static void
+decode_chunk_func (gpointer data,
+                   gpointer user_data)
+{
+  TiffChunk      *chunk = data;
+  TiffDecodeInfo *info  = chunk->info;
+
+  decode_chunk (chunk);
+
+  g_mutex_lock (&info->mutex);
+
+  if (--info->n_pending == 0)
+    g_cond_signal (&info->cond);
+
+  g_mutex_unlock (&info->mutex);
 }
 
 
@@ -64,6 +64,7 @@
 #endif
 
 #include <tiffio.h>
+#include <zlib.h>
 
 #include <libgimp/gimp.h>
 #include <libgimp/gimpui.h>
@@ -76,6 +77,8 @@
 #define PLUG_IN_BINARY "file-tiff-save"
 #define PLUG_IN_ROLE   "gimp-file-tiff-save"
 
+#define SAVE_TILE_SIZE 256
+
 
 typedef struct
 {
@@ -86,8 +89,42 @@ typedef struct
   gboolean  save_xmp;
   gboolean  save_iptc;
   gboolean  save_thumbnail;
+  gboolean  save_tiled;
+  gboolean  save_bigtiff;
 } TiffSaveVals;
 
+typedef struct
+{
+  GMutex    mutex;
+  GCond     cond;
+  gint      n_pending;
+  gushort   compression;
+  gboolean  encode;           /* Compress in the job, write raw */
+  gshort    predictor;
+  gshort    bitspersample;
+  gshort    samplesperpixel;
+  gint      bytesperpixel;
+  gboolean  is_bw;
+  gboolean  invert;
+} TiffEncodeInfo;
+
+/* A tile or strip which is packed and compressed on a worker thread */
+typedef struct
+{
+  TiffEncodeInfo *info;
+  const guchar   *src;        /* First pixel of the chunk in the band */
+  gint            src_stride;
+  gint            x, y;
+  gint            cols, rows; /* Image area covered by the chunk */
+  gint            width;      /* Chunk size in the file */
+  gint            height;
+  guchar         *data;       /* Packed chunk */
+  gsize           data_size;
+  guchar         *raw;        /* Encoded chunk */
+  gsize           raw_size;
+  gboolean        failed;
+} TiffChunk;
+
 typedef struct
 {
   gint32        ID;
@@ -123,6 +160,10 @@ static gboolean  save_dialog            (gboolean      has_alpha,
 static void      comment_entry_callback (GtkWidget    *widget,
                                          gpointer      data);
 
+static void      encode_chunk           (TiffChunk    *chunk);
+static void      encode_chunk_func      (gpointer      data,
+                                         gpointer      user_data);
+
 static void      byte2bit               (const guchar *byteline,
                                          gint          width,
                                          guchar       *bitline,
@@ -154,7 +195,9 @@ static TiffSaveVals tsvals =
   TRUE,                /*  save exif           */
   TRUE,                /*  save xmp            */
   TRUE,                /*  save iptc           */
-  TRUE                 /*  save thumbnail      */
+  TRUE,                /*  save thumbnail      */
+  FALSE,               /*  save tiled          */
+  FALSE                /*  save BigTIFF        */
 };
 
 static gchar       *image_comment = NULL;
@@ -716,16 +759,23 @@ save_image (const gchar  *filename,
   gshort         samplesperpixel;
   gshort         bitspersample;
   gint           bytesperrow;
-  guchar        *t;
   guchar        *src = NULL;
-  guchar        *data = NULL;
   guchar        *cmap;
   gint           num_colors;
   gint           success;
   GimpImageType  drawable_type;
   GeglBuffer    *buffer = NULL;
   const Babl    *format;
+  const gchar   *mode;
   gint           tile_height;
+  gint           chunk_width;
+  gint           chunk_height;
+  gint           band_height;
+  gint           n_chunks;
+  gint           n_threads;
+  TiffEncodeInfo info;
+  TiffChunk     *chunks = NULL;
+  GThreadPool   *pool   = NULL;
   gint           y, yend;
   gboolean       is_bw    = FALSE;
   gboolean       invert   = TRUE;
@@ -745,7 +795,14 @@ save_image (const gchar  *filename,
   tile_height = gimp_tile_height ();
   rowsperstrip = tile_height;
 
-  tif = tiff_open (filename, "w", error);
+  mode = "w";
+
+#ifdef TIFF_BIGTIFF_VERSION
+  if (tsvals.save_bigtiff)
+    mode = "w8";
+#endif
+
+  tif = tiff_open (filename, mode, error);
 
   if (! tif)
     {
@@ -929,8 +986,28 @@ save_image (const gchar  *filename,
   TIFFSetField (tif, TIFFTAG_PHOTOMETRIC, photometric);
   TIFFSetField (tif, TIFFTAG_DOCUMENTNAME, filename);
   TIFFSetField (tif, TIFFTAG_SAMPLESPERPIXEL, samplesperpixel);
-  TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
-  /* TIFFSetField( tif, TIFFTAG_STRIPBYTECOUNTS, rows / rowsperstrip ); */
+
+  n_threads = g_get_num_processors ();
+
+  if (tsvals.save_tiled)
+    {
+      TIFFSetField (tif, TIFFTAG_TILEWIDTH, SAVE_TILE_SIZE);
+      TIFFSetField (tif, TIFFTAG_TILELENGTH, SAVE_TILE_SIZE);
+
+      chunk_width  = SAVE_TILE_SIZE;
+      chunk_height = SAVE_TILE_SIZE;
+      band_height  = SAVE_TILE_SIZE;
+    }
+  else
+    {
+      TIFFSetField (tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
+      /* TIFFSetField( tif, TIFFTAG_STRIPBYTECOUNTS, rows / rowsperstrip ); */
+
+      chunk_width  = cols;
+      chunk_height = rowsperstrip;
+      band_height  = rowsperstrip * n_threads;
+    }
+
   TIFFSetField (tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 
   /* resolution fields */
@@ -1031,14 +1108,43 @@ save_image (const gchar  *filename,
   if (!is_bw && drawable_type == GIMP_INDEXED_IMAGE)
     TIFFSetField (tif, TIFFTAG_COLORMAP, red, grn, blu);
 
+  /* Uncompressed and deflate compressed chunks are encoded by the
+   * workers and written raw, the other codecs are left to libtiff
+   * and only get their pixels packed in parallel.
+   */
+  info.compression     = compression;
+  info.encode          = (compression == COMPRESSION_NONE ||
+                          compression == COMPRESSION_ADOBE_DEFLATE);
+  info.predictor       = 0;
+  info.bitspersample   = bitspersample;
+  info.samplesperpixel = samplesperpixel;
+  info.bytesperpixel   = babl_format_get_bytes_per_pixel (format);
+  info.is_bw           = is_bw;
+  info.invert          = invert;
+
+  if (compression == COMPRESSION_ADOBE_DEFLATE)
+    info.predictor = predictor;
+
+  g_mutex_init (&info.mutex);
+  g_cond_init (&info.cond);
+
+  if (n_threads > 1)
+    pool = g_thread_pool_new (encode_chunk_func, NULL,
+                              n_threads, FALSE, NULL);
+
+  n_chunks = (cols + chunk_width - 1) / chunk_width *
+             (band_height / chunk_height);
+  chunks = g_new0 (TiffChunk, n_chunks);
+
   /* array to rearrange data */
-  src = g_new (guchar, bytesperrow * tile_height);
-  data = g_new (guchar, bytesperrow);
+  src = g_new (guchar, (gsize) bytesperrow * band_height);
 
   /* Now write the TIFF data. */
   for (y = 0; y < rows; y = yend)
     {
-      yend = y + tile_height;
+      gint x, cy;
+
+      yend = y + band_height;
       yend = MIN (yend, rows);
 
       gegl_buffer_get (buffer,
@@ -1049,45 +1155,104 @@ save_image (const gchar  *filename,
                        GEGL_AUTO_ROWSTRIDE,
                        GEGL_ABYSS_NONE);
 
-      for (row = y; row < yend; row++)
+      n_chunks = 0;
+
+      for (cy = y; cy < yend; cy += chunk_height)
         {
-          t = src + bytesperrow * (row - y);
+          for (x = 0; x < cols; x += chunk_width)
+            {
+              TiffChunk *chunk = &chunks[n_chunks++];
+
+              chunk->info       = &info;
+              chunk->src        = (src + bytesperrow * (cy - y) +
+                                   info.bytesperpixel * x);
+              chunk->src_stride = bytesperrow;
+              chunk->x          = x;
+              chunk->y          = cy;
+              chunk->cols       = MIN (cols - x, chunk_width);
+              chunk->rows       = MIN (yend - cy, chunk_height);
+              chunk->width      = chunk_width;
+              chunk->height     = tsvals.save_tiled ? chunk_height : chunk->rows;
+              chunk->failed     = FALSE;
+            }
+        }
+
+      if (pool && n_chunks > 1)
+        {
+          info.n_pending = n_chunks;
+
+          for (i = 0; i < n_chunks; i++)
+            g_thread_pool_push (pool, &chunks[i], NULL);
 
-          switch (drawable_type)
+          g_mutex_lock (&info.mutex);
+
+          while (info.n_pending > 0)
+            g_cond_wait (&info.cond, &info.mutex);
+
+          g_mutex_unlock (&info.mutex);
+        }
+      else
+        {
+          for (i = 0; i < n_chunks; i++)
+            encode_chunk (&chunks[i]);
+        }
+
+      /* Write the chunks in file order */
+      success = TRUE;
+
+      for (i = 0; i < n_chunks; i++)
+        {
+          TiffChunk *chunk = &chunks[i];
+
+          if (success && ! chunk->failed)
             {
-            case GIMP_INDEXED_IMAGE:
-              if (is_bw)
+              if (tsvals.save_tiled)
                 {
-                  byte2bit (t, bytesperrow, data, invert);
-                  success = (TIFFWriteScanline (tif, data, row, 0) >= 0);
+                  ttile_t tile = TIFFComputeTile (tif, chunk->x, chunk->y,
+                                                  0, 0);
+
+                  if (info.encode)
+                    success = (TIFFWriteRawTile (tif, tile, chunk->raw,
+                                                 chunk->raw_size) >= 0);
+                  else
+                    success = (TIFFWriteEncodedTile (tif, tile, chunk->data,
+                                                     chunk->data_size) >= 0);
                 }
               else
                 {
-                  success = (TIFFWriteScanline (tif, t, row, 0) >= 0);
+                  tstrip_t strip = TIFFComputeStrip (tif, chunk->y, 0);
+
+                  if (info.encode)
+                    success = (TIFFWriteRawStrip (tif, strip, chunk->raw,
+                                                  chunk->raw_size) >= 0);
+                  else
+                    success = (TIFFWriteEncodedStrip (tif, strip, chunk->data,
+                                                      chunk->data_size) >= 0);
                 }
-              break;
-
-            case GIMP_GRAY_IMAGE:
-            case GIMP_GRAYA_IMAGE:
-            case GIMP_RGB_IMAGE:
-            case GIMP_RGBA_IMAGE:
-              success = (TIFFWriteScanline (tif, t, row, 0) >= 0);
-              break;
 
-            default:
-              success = FALSE;
-              break;
+              if (! success)
+                row = chunk->y;
             }
-
-          if (!success)
+          else if (success)
             {
-              g_message (_("Failed a scanline write on row %d"), row);
-              goto out;
+              success = FALSE;
+              row = chunk->y;
             }
+
+          g_free (chunk->data);
+          g_free (chunk->raw);
+
+          chunk->data = NULL;
+          chunk->raw  = NULL;
+        }
+
+      if (! success)
+        {
+          g_message (_("Failed a scanline write on row %d"), row);
+          goto out;
         }
 
-      if ((row % 32) == 0)
-        gimp_progress_update ((gdouble) row / (gdouble) rows);
+      gimp_progress_update ((gdouble) yend / (gdouble) rows);
     }
 
   TIFFFlushData (tif);
@@ -1098,15 +1263,122 @@ save_image (const gchar  *filename,
   status = TRUE;
 
  out:
+  if (pool)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  if (chunks)
+    {
+      g_mutex_clear (&info.mutex);
+      g_cond_clear (&info.cond);
+    }
+
   if (buffer)
     g_object_unref (buffer);
 
-  g_free (data);
+  g_free (chunks);
   g_free (src);
 
   return status;
 }
 
+static void
+encode_chunk (TiffChunk *chunk)
+{
+  TiffEncodeInfo *info = chunk->info;
+  gint            rowstride;
+  gint            y;
+
+  if (info->is_bw)
+    rowstride = (chunk->width + 7) / 8;
+  else
+    rowstride = chunk->width * info->bytesperpixel;
+
+  chunk->data_size = (gsize) rowstride * chunk->height;
+  chunk->data      = g_malloc0 (chunk->data_size);
+
+  /* Pack the pixels, padding edge tiles with zeros */
+  for (y = 0; y < chunk->rows; y++)
+    {
+      const guchar *s = chunk->src + y * chunk->src_stride;
+      guchar       *d = chunk->data + y * rowstride;
+
+      if (info->is_bw)
+        byte2bit (s, chunk->cols, d, info->invert);
+      else
+        memcpy (d, s, chunk->cols * info->bytesperpixel);
+    }
+
+  if (! info->encode)
+    return;
+
+  /* Horizontal differencing, right to left so it can be done in place */
+  if (info->predictor == 2)
+    {
+      gint n = chunk->width * info->samplesperpixel;
+      gint i;
+
+      for (y = 0; y < chunk->height; y++)
+        {
+          if (info->bitspersample == 16)
+            {
+              guint16 *p = (guint16 *) (chunk->data + y * rowstride);
+
+              for (i = n - 1; i >= info->samplesperpixel; i--)
+                p[i] -= p[i - info->samplesperpixel];
+            }
+          else
+            {
+              guchar *p = chunk->data + y * rowstride;
+
+              for (i = n - 1; i >= info->samplesperpixel; i--)
+                p[i] -= p[i - info->samplesperpixel];
+            }
+        }
+    }
+
+  if (info->compression == COMPRESSION_ADOBE_DEFLATE)
+    {
+      uLongf size = compressBound (chunk->data_size);
+
+      chunk->raw = g_malloc (size);
+
+      if (compress2 (chunk->raw, &size,
+                     chunk->data, chunk->data_size,
+                     Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+          chunk->failed = TRUE;
+        }
+
+      chunk->raw_size = size;
+
+      g_free (chunk->data);
+      chunk->data = NULL;
+    }
+  else
+    {
+      chunk->raw      = chunk->data;
+      chunk->raw_size = chunk->data_size;
+      chunk->data     = NULL;
+    }
+}
+
+static void
+encode_chunk_func (gpointer data,
+                   gpointer user_data)
+{
+  TiffChunk      *chunk = data;
+  TiffEncodeInfo *info  = chunk->info;
+
+  encode_chunk (chunk);
+
+  g_mutex_lock (&info->mutex);
+
+  if (--info->n_pending == 0)
+    g_cond_signal (&info->cond);
+
+  g_mutex_unlock (&info->mutex);
+}
+
 static gboolean
 save_dialog (gboolean has_alpha,
              gboolean is_monochrome)
@@ -1187,6 +1459,24 @@ save_dialog (gboolean has_alpha,
                     G_CALLBACK (gimp_toggle_button_update),
                     &tsvals.save_transp_pixels);
 
+  toggle = GTK_WIDGET (gtk_builder_get_object (builder, "sv_tiled"));
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (toggle),
+                                tsvals.save_tiled);
+  g_signal_connect (toggle, "toggled",
+                    G_CALLBACK (gimp_toggle_button_update),
+                    &tsvals.save_tiled);
+
+  toggle = GTK_WIDGET (gtk_builder_get_object (builder, "sv_bigtiff"));
+#ifdef TIFF_BIGTIFF_VERSION
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (toggle),
+                                tsvals.save_bigtiff);
+  g_signal_connect (toggle, "toggled",
+                    G_CALLBACK (gimp_toggle_button_update),
+                    &tsvals.save_bigtiff);
+#else
+  gtk_widget_hide (toggle);
+#endif
+
   entry = GTK_WIDGET (gtk_builder_get_object (builder, "commentfield"));
   gtk_entry_set_text (GTK_ENTRY (entry), image_comment ? image_comment : "");
 
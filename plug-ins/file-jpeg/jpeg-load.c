@@ -69,10 +69,10 @@ load_image (const gchar  *filename,
   jpeg_saved_marker_ptr         marker;
   FILE            *infile;
   guchar          *buf;
-  guchar         **rowbuf;
   GimpImageBaseType image_type;
   GimpImageType    layer_type;
   GeglBuffer      *buffer = NULL;
+  GimpBandTransfer * volatile transfer = NULL;
   const Babl      *format;
   gint             tile_height;
   gint             scanlines;
@@ -82,6 +82,7 @@ load_image (const gchar  *filename,
   /* We set up the normal JPEG error routines. */
   cinfo.err = jpeg_std_error (&jerr.pub);
   jerr.pub.error_exit = my_error_exit;
+  jerr.transfer       = NULL;
 
   if (!preview)
     {
@@ -112,6 +113,9 @@ load_image (const gchar  *filename,
       if (infile)
         fclose (infile);
 
+      if (transfer)
+        gimp_band_transfer_free (transfer);
+
       if (image_ID != -1 && !preview)
         gimp_image_delete (image_ID);
 
@@ -169,15 +173,7 @@ load_image (const gchar  *filename,
    * if we asked for color quantization.
    */
 
-  /* temporary buffer */
   tile_height = gimp_tile_height ();
-  buf = g_new (guchar,
-               tile_height * cinfo.output_width * cinfo.output_components);
-
-  rowbuf = g_new (guchar *, tile_height);
-
-  for (i = 0; i < tile_height; i++)
-    rowbuf[i] = buf + cinfo.output_width * cinfo.output_components * i;
 
   switch (cinfo.output_components)
     {
@@ -342,6 +338,13 @@ load_image (const gchar  *filename,
   buffer = gimp_drawable_get_buffer (layer_ID);
   format = babl_format (image_type == GIMP_RGB ? "R'G'B' u8" : "Y' u8");
 
+  /* Decode into one band while the previous one is stored */
+  transfer = gimp_band_transfer_new (buffer, format, tile_height,
+                                     cinfo.output_components);
+  jerr.transfer = transfer;
+
+  buf = gimp_band_transfer_wait (transfer);
+
   while (cinfo.output_scanline < cinfo.output_height)
     {
       start = cinfo.output_scanline;
@@ -351,22 +354,27 @@ load_image (const gchar  *filename,
       scanlines = end - start;
 
       for (i = 0; i < scanlines; i++)
-        jpeg_read_scanlines (&cinfo, (JSAMPARRAY) &rowbuf[i], 1);
+        {
+          JSAMPROW row = (buf +
+                          cinfo.output_width * cinfo.output_components * i);
+
+          jpeg_read_scanlines (&cinfo, &row, 1);
+        }
 
       if (cinfo.out_color_space == JCS_CMYK)
         jpeg_load_cmyk_to_rgb (buf, cinfo.output_width * scanlines,
                                cmyk_transform);
 
-      gegl_buffer_set (buffer,
-                       GEGL_RECTANGLE (0, start, cinfo.output_width, scanlines),
-                       0,
-                       format,
-                       buf,
-                       GEGL_AUTO_ROWSTRIDE);
+      /* the previous band must be stored before talking to the core */
+      if (! preview)
+        {
+          gimp_band_transfer_sync (transfer);
+
+          gimp_progress_update ((gdouble) start /
+                                (gdouble) cinfo.output_height);
+        }
 
-      if (! preview && (cinfo.output_scanline % 32) == 0)
-        gimp_progress_update ((gdouble) cinfo.output_scanline /
-                              (gdouble) cinfo.output_height);
+      buf = gimp_band_transfer_write (transfer, start, scanlines);
     }
 
   /* Step 7: Finish decompression */
@@ -384,11 +392,11 @@ load_image (const gchar  *filename,
   /* This is an important step since it will release a good deal of memory. */
   jpeg_destroy_decompress (&cinfo);
 
-  g_object_unref (buffer);
+  /* wait for the last band and free the temporary buffers */
+  jerr.transfer = NULL;
+  gimp_band_transfer_free (transfer);
 
-  /* free up the temporary buffers */
-  g_free (rowbuf);
-  g_free (buf);
+  g_object_unref (buffer);
 
   /* After finish_decompress, we can close the input file.
    * Here we postpone it until after no more JPEG errors are possible,
@@ -504,6 +512,7 @@ load_thumbnail_image (GFile         *file,
   cinfo.err = jpeg_std_error (&jerr.pub);
   jerr.pub.error_exit     = my_error_exit;
   jerr.pub.output_message = my_output_message;
+  jerr.transfer           = NULL;
 
   if ((infile = g_fopen (g_file_get_path (file), "rb")) == NULL)
     {
@@ -264,10 +264,12 @@ save_image (const gchar  *filename,
   static struct my_error_mgr         jerr;
   JpegSubsampling             subsampling;
   FILE     * volatile outfile;
+  GimpBandTransfer * volatile transfer = NULL;
   guchar   *data;
   guchar   *src;
   gboolean  has_alpha;
   gint      rowstride, yend;
+  gint      tile_height;
 
   drawable_type = gimp_drawable_type (drawable_ID);
   buffer = gimp_drawable_get_buffer (drawable_ID);
@@ -296,6 +298,8 @@ save_image (const gchar  *filename,
       jpeg_destroy_compress (&cinfo);
       if (outfile)
         fclose (outfile);
+      if (transfer)
+        gimp_band_transfer_free (transfer);
       if (buffer)
         g_object_unref (buffer);
 
@@ -543,7 +547,7 @@ save_image (const gchar  *filename,
    */
   /* JSAMPLEs per row in image_buffer */
   rowstride = cinfo.input_components * cinfo.image_width;
-  data = g_new (guchar, rowstride * gimp_tile_height ());
+  tile_height = gimp_tile_height ();
 
   /* fault if cinfo.next_scanline isn't initially a multiple of
    * gimp_tile_height */
@@ -558,9 +562,11 @@ save_image (const gchar  *filename,
     {
       PreviewPersistent *pp = g_new (PreviewPersistent, 1);
 
+      data = g_new (guchar, rowstride * tile_height);
+
       /* pass all the information we need */
       pp->cinfo       = cinfo;
-      pp->tile_height = gimp_tile_height();
+      pp->tile_height = tile_height;
       pp->data        = data;
       pp->outfile     = outfile;
       pp->has_alpha   = has_alpha;
@@ -587,30 +593,31 @@ save_image (const gchar  *filename,
       return TRUE;
     }
 
+  /* Fetch the next band while the current one is compressed */
+  transfer = gimp_band_transfer_new (buffer, format, tile_height, 0);
+  gimp_band_transfer_read (transfer, 0, MIN (tile_height, cinfo.image_height));
+
   while (cinfo.next_scanline < cinfo.image_height)
     {
-      if ((cinfo.next_scanline % gimp_tile_height ()) == 0)
+      if ((cinfo.next_scanline % tile_height) == 0)
         {
-          yend = cinfo.next_scanline + gimp_tile_height ();
+          yend = cinfo.next_scanline + tile_height;
           yend = MIN (yend, cinfo.image_height);
-          gegl_buffer_get (buffer,
-                           GEGL_RECTANGLE (0, cinfo.next_scanline,
-                                           cinfo.image_width,
-                                           (yend - cinfo.next_scanline)),
-                           1.0,
-                           format,
-                           data,
-                           GEGL_AUTO_ROWSTRIDE,
-                           GEGL_ABYSS_NONE);
-          src = data;
+
+          src = gimp_band_transfer_wait (transfer);
+
+          /* no transfer is in flight, so we may talk to the core */
+          gimp_progress_update ((gdouble) cinfo.next_scanline /
+                                (gdouble) cinfo.image_height);
+
+          if (yend < cinfo.image_height)
+            gimp_band_transfer_read (transfer, yend,
+                                     MIN (tile_height,
+                                          cinfo.image_height - yend));
         }
 
       jpeg_write_scanlines (&cinfo, (JSAMPARRAY) &src, 1);
       src += rowstride;
-
-      if ((cinfo.next_scanline % 32) == 0)
-        gimp_progress_update ((gdouble) cinfo.next_scanline /
-                              (gdouble) cinfo.image_height);
     }
 
   /* Step 6: Finish compression */
@@ -623,8 +630,8 @@ save_image (const gchar  *filename,
   /* This is an important step since it will release a good deal of memory. */
   jpeg_destroy_compress (&cinfo);
 
-  /* free the temporary buffer */
-  g_free (data);
+  /* free the temporary buffers */
+  gimp_band_transfer_free (transfer);
 
   /* And we're done! */
   gimp_progress_update (1.0);
@@ -586,9 +586,16 @@ my_error_exit (j_common_ptr cinfo)
 void
 my_output_message (j_common_ptr cinfo)
 {
-  gchar  buffer[JMSG_LENGTH_MAX + 1];
+  my_error_ptr myerr = (my_error_ptr) cinfo->err;
+  gchar        buffer[JMSG_LENGTH_MAX + 1];
 
   (*cinfo->err->format_message)(cinfo, buffer);
 
+  /* g_message() talks to the core, which a band transfer must not do
+   * at the same time
+   */
+  if (myerr->transfer)
+    gimp_band_transfer_sync (myerr->transfer);
+
   g_message ("%s", buffer);
 }
@@ -41,6 +41,9 @@ typedef struct my_error_mgr
 #endif
 
   jmp_buf               setjmp_buffer;  /* for return to caller */
+
+  /* band transfer to finish before a message is sent to the core */
+  GimpBandTransfer     *transfer;
 } *my_error_ptr;
 
 typedef enum
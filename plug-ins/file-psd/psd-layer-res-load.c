@@ -178,26 +178,52 @@ static gint     load_resource_lrfx    (const PSDlayerres     *res_a,
 				       FILE                  *f,
 				       GError               **error);
 
+static gboolean psd_layer_resource_has_long_len
+                                      (const PSDlayerres     *res_a);
+
 /* Public Functions */
+
+/* Returns the size of the resource header, or -1 on error */
 gint
 get_layer_resource_header (PSDlayerres  *res_a,
+                           PSDimage     *img_a,
                            FILE         *f,
                            GError      **error)
 {
+  guint16 len_version = PSD_VERSION;
+  guint64 data_len;
+
   if (fread (res_a->sig, 4, 1, f) < 1
-      || fread (res_a->key, 4, 1, f) < 1
-      || fread (&res_a->data_len, 4, 1, f) < 1)
+      || fread (res_a->key, 4, 1, f) < 1)
+    {
+      psd_set_error (feof (f), errno, error);
+      return -1;
+    }
+
+  if (img_a->version == PSB_VERSION
+      && psd_layer_resource_has_long_len (res_a))
+    len_version = PSB_VERSION;
+
+  if (psd_read_len (f, &data_len, len_version) < 1)
     {
       psd_set_error (feof (f), errno, error);
       return -1;
     }
-  res_a->data_len = GUINT32_FROM_BE (res_a->data_len);
+
+  if (data_len > G_MAXINT32)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   _("The file is corrupt!"));
+      return -1;
+    }
+
+  res_a->data_len = data_len;
   res_a->data_start = ftell (f);
 
   IFDBG(2) g_debug ("Sig: %.4s, key: %.4s, start: %d, len: %d",
 		     res_a->sig, res_a->key, res_a->data_start, res_a->data_len);
 
-  return 0;
+  return len_version == PSB_VERSION ? 16 : 12;
 }
 
 gint
@@ -277,6 +303,26 @@ load_layer_resource (PSDlayerres  *res_a,
 
 /* Private Functions */
 
+/* PSB files use an 8 byte length for these keys only */
+static gboolean
+psd_layer_resource_has_long_len (const PSDlayerres *res_a)
+{
+  static const gchar *long_keys[] =
+  {
+    PSD_LOTH_USER_MASK, "Lr16", "Lr32", "Layr", PSD_LMT_MERGE_TRANS,
+    PSD_LMT_MERGE_TRANS_16, PSD_LMT_MERGE_TRANS_32, "Alph",
+    PSD_LOTH_FILTER_MASK, PSD_LLL_LINKED_LAYER_2, PSD_LFFX_FILTER_FX,
+    PSD_LFFX_FILTER_FX_2, "PxSD"
+  };
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (long_keys); i++)
+    if (memcmp (res_a->key, long_keys[i], 4) == 0)
+      return TRUE;
+
+  return FALSE;
+}
+
 static gint
 load_resource_unknown (const PSDlayerres  *res_a,
                        PSDlayer           *lyr_a,
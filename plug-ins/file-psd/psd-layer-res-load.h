@@ -23,6 +23,7 @@
 
 
 gint  get_layer_resource_header (PSDlayerres  *res_a,
+                                 PSDimage     *img_a,
                                  FILE         *f,
                                  GError      **error);
 
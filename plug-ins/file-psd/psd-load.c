@@ -26,6 +26,8 @@
 #include <glib/gstdio.h>
 #include <libgimp/gimp.h>
 
+#include <zlib.h>
+
 #include "psd.h"
 #include "psd-util.h"
 #include "psd-image-res-load.h"
@@ -37,6 +39,52 @@
 
 #define COMP_MODE_SIZE sizeof(guint16)
 
+#define DECODE_BAND_ROWS 256    /* Rows decoded before each buffer write */
+#define DECODE_JOB_ROWS   32    /* Rows per RAW or RLE decode job */
+#define DECODE_BAND_SIZE (16 << 20) /* Maximum size of a decoded band */
+
+
+/* Channel data decoder.
+ * The compressed data of a channel is read into memory and decoded a
+ * band of rows at a time, straight into the interleaved pixel band
+ * that is written to the drawable.
+ */
+typedef struct
+{
+  guint16       compression;    /* PSD_COMP_RAW, PSD_COMP_RLE or PSD_COMP_ZIP */
+  gboolean      predict;        /* Undo ZIP prediction */
+  guint16       bps;            /* Bits per sample */
+  guint32       rows;
+  guint32       columns;
+  guint32       readline_len;   /* Length of one row of raw data */
+  gchar        *data;           /* Compressed data owned by the decoder */
+  const gchar  *src;            /* Compressed data, NULL for empty channels */
+  guint64       src_len;
+  guint64      *row_offset;     /* RLE row offsets, rows + 1 entries */
+  z_stream      zs;             /* ZIP inflate state */
+  gboolean      zs_init;
+  guint64       zip_pos;        /* ZIP data handed to the inflate state */
+  gint          failed;
+} PSDdecoder;
+
+typedef struct
+{
+  GMutex        mutex;
+  GCond         cond;
+  gint          n_pending;
+} PSDdecodeBatch;
+
+typedef struct
+{
+  PSDdecoder     *dec;
+  guint32         row;          /* First row to decode */
+  guint32         n_rows;
+  guchar         *dest;         /* First sample of the first row */
+  gint            dest_stride;  /* Bytes between samples */
+  gint            dest_rowstride;
+  PSDdecodeBatch *batch;
+} PSDdecodeJob;
+
 
 /*  Local function prototypes  */
 static gint             read_header_block          (PSDimage     *img_a,
@@ -90,19 +138,57 @@ static void             psd_to_gimp_color_map      (guchar       *map256);
 static GimpImageType    get_gimp_image_type        (GimpImageBaseType image_base_type,
                                                     gboolean          alpha);
 
-static gint             read_channel_data          (PSDchannel     *channel,
-                                                    guint16         bps,
+static gint             decoder_init               (PSDdecoder     *dec,
+                                                    PSDimage       *img_a,
                                                     guint16         compression,
-                                                    const guint16  *rle_pack_len,
+                                                    guint32         rows,
+                                                    guint32         columns,
+                                                    GError        **error);
+
+static gint             decoder_read_rle_len       (PSDdecoder     *dec,
+                                                    PSDimage       *img_a,
+                                                    guint64        *packed_len,
                                                     FILE           *f,
                                                     GError        **error);
 
-static void             convert_1_bit              (const gchar *src,
-                                                    gchar       *dst,
-                                                    guint32      rows,
-                                                    guint32      columns);
+static gint             decoder_read_data          (PSDdecoder     *dec,
+                                                    guint64         data_len,
+                                                    FILE           *f,
+                                                    GError        **error);
+
+static void             decoder_clear              (PSDdecoder     *dec);
+
+static gboolean         decoder_inflate_row        (PSDdecoder     *dec,
+                                                    guchar         *line);
+
+static void             decode_job_run             (PSDdecodeJob   *job);
 
-static const Babl*      get_pixel_format           (PSDimage    *img_a);
+static void             decode_job_func            (gpointer        data,
+                                                    gpointer        user_data);
+
+static void             undo_prediction            (guchar         *line,
+                                                    guchar         *tmp,
+                                                    guint32         columns,
+                                                    guint16         bps);
+
+static gint             draw_channels              (gint32          drawable_id,
+                                                    PSDdecoder    **decoders,
+                                                    gint            n_decoders,
+                                                    gint            x,
+                                                    gint            y,
+                                                    GError        **error);
+
+static gint             read_channel_data          (PSDdecoder     *dec,
+                                                    PSDimage       *img_a,
+                                                    guint16         compression,
+                                                    guint32         rows,
+                                                    guint32         columns,
+                                                    guint64         data_len,
+                                                    FILE           *f,
+                                                    GError        **error);
+
+
+static GThreadPool *decode_pool = NULL;
 
 
 /* Main file load function */
@@ -135,6 +221,10 @@ load_image (const gchar  *filename,
   gimp_progress_init_printf (_("Opening '%s'"),
                              gimp_filename_to_utf8 (filename));
 
+  if (g_get_num_processors () > 1)
+    decode_pool = g_thread_pool_new (decode_job_func, NULL,
+                                     g_get_num_processors (), FALSE, NULL);
+
   /* ----- Read the PSD file Header block ----- */
   IFDBG(2) g_debug ("Read header block");
   if (read_header_block (&img_a, f, &error) < 0)
@@ -204,6 +294,13 @@ load_image (const gchar  *filename,
   gimp_image_clean_all (image_id);
   gimp_image_undo_enable (image_id);
   fclose (f);
+
+  if (decode_pool)
+    {
+      g_thread_pool_free (decode_pool, FALSE, TRUE);
+      decode_pool = NULL;
+    }
+
   return image_id;
 
   /* ----- Process load errors ----- */
@@ -223,6 +320,12 @@ load_image (const gchar  *filename,
   if (! (f == NULL))
     fclose (f);
 
+  if (decode_pool)
+    {
+      g_thread_pool_free (decode_pool, FALSE, TRUE);
+      decode_pool = NULL;
+    }
+
   return -1;
 }
 
@@ -250,7 +353,7 @@ read_header_block (PSDimage  *img_a,
       psd_set_error (feof (f), errno, error);
       return -1;
     }
-  version = GUINT16_FROM_BE (version);
+  img_a->version = version = GUINT16_FROM_BE (version);
   img_a->channels = GUINT16_FROM_BE (img_a->channels);
   img_a->rows = GUINT32_FROM_BE (img_a->rows);
   img_a->columns = GUINT32_FROM_BE (img_a->columns);
@@ -270,7 +373,7 @@ read_header_block (PSDimage  *img_a,
       return -1;
     }
 
-  if (version != 1)
+  if (version != PSD_VERSION && version != PSB_VERSION)
     {
       g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
                   _("Unsupported file format version: %d"), version);
@@ -467,24 +570,25 @@ read_layer_block (PSDimage  *img_a,
                   GError   **error)
 {
   PSDlayer **lyr_a;
+  guint64    layer_info_len;
   guint32    block_len;
-  guint32    block_end;
+  guint64    block_end;
   guint32    block_rem;
   gint32     read_len;
   gint32     write_len;
+  gint       res_hdr_len;
   gint       lidx;                  /* Layer index */
   gint       cidx;                  /* Channel index */
 
-  if (fread (&block_len, 4, 1, f) < 1)
+  if (psd_read_len (f, &img_a->mask_layer_len, img_a->version) < 1)
     {
       psd_set_error (feof (f), errno, error);
       img_a->num_layers = -1;
       return NULL;
     }
 
-  img_a->mask_layer_len = GUINT32_FROM_BE (block_len);
-
-  IFDBG(1) g_debug ("Layer and mask block size = %d", img_a->mask_layer_len);
+  IFDBG(1) g_debug ("Layer and mask block size = %" G_GUINT64_FORMAT,
+                    img_a->mask_layer_len);
 
   img_a->transparency = FALSE;
   img_a->layer_data_len = 0;
@@ -500,7 +604,7 @@ read_layer_block (PSDimage  *img_a,
       block_end = img_a->mask_layer_start + img_a->mask_layer_len;
 
       /* Get number of layers */
-      if (fread (&block_len, 4, 1, f) < 1
+      if (psd_read_len (f, &layer_info_len, img_a->version) < 1
           || fread (&img_a->num_layers, 2, 1, f) < 1)
         {
           psd_set_error (feof (f), errno, error);
@@ -594,17 +698,16 @@ read_layer_block (PSDimage  *img_a,
               for (cidx = 0; cidx < lyr_a[lidx]->num_channels; ++cidx)
                 {
                   if (fread (&lyr_a[lidx]->chn_info[cidx].channel_id, 2, 1, f) < 1
-                      || fread (&lyr_a[lidx]->chn_info[cidx].data_len, 4, 1, f) < 1)
+                      || psd_read_len (f, &lyr_a[lidx]->chn_info[cidx].data_len,
+                                       img_a->version) < 1)
                     {
                       psd_set_error (feof (f), errno, error);
                       return NULL;
                     }
                   lyr_a[lidx]->chn_info[cidx].channel_id =
                     GINT16_FROM_BE (lyr_a[lidx]->chn_info[cidx].channel_id);
-                  lyr_a[lidx]->chn_info[cidx].data_len =
-                    GUINT32_FROM_BE (lyr_a[lidx]->chn_info[cidx].data_len);
                   img_a->layer_data_len += lyr_a[lidx]->chn_info[cidx].data_len;
-                  IFDBG(3) g_debug ("Channel ID %d, data len %d",
+                  IFDBG(3) g_debug ("Channel ID %d, data len %" G_GUINT64_FORMAT,
                                      lyr_a[lidx]->chn_info[cidx].channel_id,
                                      lyr_a[lidx]->chn_info[cidx].data_len);
                 }
@@ -830,10 +933,12 @@ read_layer_block (PSDimage  *img_a,
 
               while (block_rem > 7)
                 {
-                  if (get_layer_resource_header (&res_a, f, error) < 0)
+                  res_hdr_len = get_layer_resource_header (&res_a, img_a,
+                                                           f, error);
+                  if (res_hdr_len < 0)
                     return NULL;
 
-                  block_rem -= 12;
+                  block_rem -= res_hdr_len;
 
 		  //Round up to the nearest even byte
 		  while (res_a.data_len % 4 != 0)
@@ -868,7 +973,7 @@ read_layer_block (PSDimage  *img_a,
               return NULL;
             }
 
-          IFDBG(1) g_debug ("Layer image data block size %d",
+          IFDBG(1) g_debug ("Layer image data block size %" G_GUINT64_FORMAT,
                              img_a->layer_data_len);
         }
       else
@@ -901,7 +1006,8 @@ read_merged_image_block (PSDimage  *img_a,
 
   img_a->merged_image_len = ftell(f) - img_a->merged_image_start;
 
-  IFDBG(1) g_debug ("Merged image data block: Start: %d, len: %d",
+  IFDBG(1) g_debug ("Merged image data block: Start: %" G_GUINT64_FORMAT
+                    ", len: %" G_GUINT64_FORMAT,
                      img_a->merged_image_start, img_a->merged_image_len);
 
   return 0;
@@ -1049,16 +1155,14 @@ add_layers (gint32     image_id,
             FILE      *f,
             GError   **error)
 {
-  PSDchannel          **lyr_chn;
+  PSDdecoder           *lyr_chn;
+  PSDdecoder           *decoders[MAX_CHANNELS];
   GArray               *parent_group_stack;
   gint32                parent_group_id = -1;
-  guchar               *pixels;
   guint16               alpha_chn;
   guint16               user_mask_chn;
   guint16               layer_channels;
   guint16               channel_idx[MAX_CHANNELS];
-  guint16              *rle_pack_len;
-  guint16               bps;
   gint32                l_x;                   /* Layer x */
   gint32                l_y;                   /* Layer y */
   gint32                l_w;                   /* Layer width */
@@ -1067,19 +1171,14 @@ add_layers (gint32     image_id,
   gint32                lm_y;                  /* Layer mask y */
   gint32                lm_w;                  /* Layer mask width */
   gint32                lm_h;                  /* Layer mask height */
-  gint32                layer_size;
   gint32                layer_id = -1;
   gint32                mask_id = -1;
   gint                  lidx;                  /* Layer index */
   gint                  cidx;                  /* Channel index */
-  gint                  rowi;                  /* Row index */
-  gint                  coli;                  /* Column index */
-  gint                  i;
   gboolean              alpha;
   gboolean              user_mask;
   gboolean              empty;
   gboolean              empty_mask;
-  GeglBuffer           *buffer;
   GimpImageType         image_type;
   GimpLayerModeEffects  layer_mode;
 
@@ -1165,20 +1264,20 @@ add_layers (gint32     image_id,
 
           /* Load layer channel data */
           IFDBG(2) g_debug ("Number of channels: %d", lyr_a[lidx]->num_channels);
-          /* Create pointer array for the channel records */
-          lyr_chn = g_new (PSDchannel *, lyr_a[lidx]->num_channels);
+          /* Create decoders for the channel records */
+          lyr_chn = g_new0 (PSDdecoder, lyr_a[lidx]->num_channels);
           for (cidx = 0; cidx < lyr_a[lidx]->num_channels; ++cidx)
             {
               guint16 comp_mode = PSD_COMP_RAW;
+              gint16  chn_id;
+              guint32 chn_rows;
+              guint32 chn_columns;
 
-              /* Allocate channel record */
-              lyr_chn[cidx] = g_malloc (sizeof (PSDchannel) );
-
-              lyr_chn[cidx]->id = lyr_a[lidx]->chn_info[cidx].channel_id;
-              lyr_chn[cidx]->rows = lyr_a[lidx]->bottom - lyr_a[lidx]->top;
-              lyr_chn[cidx]->columns = lyr_a[lidx]->right - lyr_a[lidx]->left;
+              chn_id = lyr_a[lidx]->chn_info[cidx].channel_id;
+              chn_rows = lyr_a[lidx]->bottom - lyr_a[lidx]->top;
+              chn_columns = lyr_a[lidx]->right - lyr_a[lidx]->left;
 
-              if (lyr_chn[cidx]->id == PSD_CHANNEL_MASK)
+              if (chn_id == PSD_CHANNEL_MASK)
                 {
                   /* Works around a bug in panotools psd files where the layer mask
                      size is given as 0 but data exists. Set mask size to layer size.
@@ -1197,16 +1296,19 @@ add_layers (gint32     image_id,
                           lyr_a[lidx]->layer_mask.left = lyr_a[lidx]->left;
                         }
                     }
-                  lyr_chn[cidx]->rows = (lyr_a[lidx]->layer_mask.bottom -
-                                        lyr_a[lidx]->layer_mask.top);
-                  lyr_chn[cidx]->columns = (lyr_a[lidx]->layer_mask.right -
-                                           lyr_a[lidx]->layer_mask.left);
+                  chn_rows = (lyr_a[lidx]->layer_mask.bottom -
+                              lyr_a[lidx]->layer_mask.top);
+                  chn_columns = (lyr_a[lidx]->layer_mask.right -
+                                 lyr_a[lidx]->layer_mask.left);
                 }
 
               IFDBG(3) g_debug ("Channel id %d, %dx%d",
-                                lyr_chn[cidx]->id,
-                                lyr_chn[cidx]->columns,
-                                lyr_chn[cidx]->rows);
+                                chn_id, chn_columns, chn_rows);
+
+              /* A channel without data is drawn as zeros */
+              lyr_chn[cidx].bps = img_a->bps;
+              lyr_chn[cidx].rows = chn_rows;
+              lyr_chn[cidx].columns = chn_columns;
 
               /* Only read channel data if there is any channel
                * data. Note that the channel data can contain a
@@ -1224,54 +1326,14 @@ add_layers (gint32     image_id,
                 }
               if (lyr_a[lidx]->chn_info[cidx].data_len > COMP_MODE_SIZE)
                 {
-                  switch (comp_mode)
-                    {
-                      case PSD_COMP_RAW:        /* Planar raw data */
-                        IFDBG(3) g_debug ("Raw data length: %d",
-                                          lyr_a[lidx]->chn_info[cidx].data_len - 2);
-                        if (read_channel_data (lyr_chn[cidx], img_a->bps,
-                            PSD_COMP_RAW, NULL, f, error) < 1)
-                          return -1;
-                        break;
-
-                      case PSD_COMP_RLE:        /* Packbits */
-                        IFDBG(3) g_debug ("RLE channel length %d, RLE length data: %d, "
-                                          "RLE data block: %d",
-                                          lyr_a[lidx]->chn_info[cidx].data_len - 2,
-                                          lyr_chn[cidx]->rows * 2,
-                                          (lyr_a[lidx]->chn_info[cidx].data_len - 2 -
-                                           lyr_chn[cidx]->rows * 2));
-                        rle_pack_len = g_malloc (lyr_chn[cidx]->rows * 2);
-                        for (rowi = 0; rowi < lyr_chn[cidx]->rows; ++rowi)
-                          {
-                            if (fread (&rle_pack_len[rowi], 2, 1, f) < 1)
-                              {
-                                psd_set_error (feof (f), errno, error);
-                                g_free (rle_pack_len);
-                                return -1;
-                              }
-                            rle_pack_len[rowi] = GUINT16_FROM_BE (rle_pack_len[rowi]);
-                          }
-
-                        IFDBG(3) g_debug ("RLE decode - data");
-                        if (read_channel_data (lyr_chn[cidx], img_a->bps,
-                            PSD_COMP_RLE, rle_pack_len, f, error) < 1)
-                          return -1;
-
-                        g_free (rle_pack_len);
-                        break;
-
-		      case PSD_COMP_ZIP:                 /* ? */
-                      case PSD_COMP_ZIP_PRED:
-                      default:
-                        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
-                                    _("Unsupported compression mode: %d"), comp_mode);
-                        return -1;
-                        break;
-                    }
+                  if (read_channel_data (&lyr_chn[cidx], img_a, comp_mode,
+                                         chn_rows, chn_columns,
+                                         lyr_a[lidx]->chn_info[cidx].data_len -
+                                         COMP_MODE_SIZE,
+                                         f, error) < 0)
+                    return -1;
                 }
             }
-          g_free (lyr_a[lidx]->chn_info);
 
           /* Draw layer */
 
@@ -1290,12 +1352,12 @@ add_layers (gint32     image_id,
           IFDBG(3) g_debug ("Re-hash channel indices");
           for (cidx = 0; cidx < lyr_a[lidx]->num_channels; ++cidx)
             {
-              if (lyr_chn[cidx]->id == PSD_CHANNEL_MASK)
+              if (lyr_a[lidx]->chn_info[cidx].channel_id == PSD_CHANNEL_MASK)
                 {
                   user_mask = TRUE;
                   user_mask_chn = cidx;
                 }
-              else if (lyr_chn[cidx]->id == PSD_CHANNEL_ALPHA)
+              else if (lyr_a[lidx]->chn_info[cidx].channel_id == PSD_CHANNEL_ALPHA)
                 {
                   alpha = TRUE;
                   alpha_chn = cidx;
@@ -1362,19 +1424,6 @@ add_layers (gint32     image_id,
               IFDBG(3) g_debug ("Draw layer");
               image_type = get_gimp_image_type (img_a->base_type, alpha);
               IFDBG(3) g_debug ("Layer type %d", image_type);
-              layer_size = l_w * l_h;
-	      bps = img_a->bps / 8;
-	      if (bps == 0)
-		bps++;
-              pixels = g_malloc (layer_size * layer_channels * bps);
-              for (cidx = 0; cidx < layer_channels; ++cidx)
-                {
-                  IFDBG(3) g_debug ("Start channel %d", channel_idx[cidx]);
-                  for (i = 0; i < layer_size; ++i)
-		    memcpy (&pixels[((i * layer_channels) + cidx) * bps],
-			    &lyr_chn[channel_idx[cidx]]->data[i * bps], bps);
-                  g_free (lyr_chn[channel_idx[cidx]]->data);
-                }
 
               layer_mode = psd_to_gimp_blend_mode (lyr_a[lidx]->blend_mode);
               layer_id = gimp_layer_new (image_id, lyr_a[lidx]->name, l_w, l_h,
@@ -1385,14 +1434,17 @@ add_layers (gint32     image_id,
               gimp_image_insert_layer (image_id, layer_id, parent_group_id, -1);
               gimp_layer_set_offsets (layer_id, l_x, l_y);
               gimp_layer_set_lock_alpha  (layer_id, lyr_a[lidx]->layer_flags.trans_prot);
-	      buffer = gimp_drawable_get_buffer (layer_id);
-	      gegl_buffer_set (buffer, GEGL_RECTANGLE (0, 0, gegl_buffer_get_width (buffer), gegl_buffer_get_height (buffer)),
-			       0, get_pixel_format (img_a), pixels, GEGL_AUTO_ROWSTRIDE);
+
+              for (cidx = 0; cidx < layer_channels; ++cidx)
+                decoders[cidx] = &lyr_chn[channel_idx[cidx]];
+
+              if (draw_channels (layer_id, decoders, layer_channels,
+                                 0, 0, error) < 0)
+                return -1;
+
               gimp_item_set_visible (layer_id, lyr_a[lidx]->layer_flags.visible);
               if (lyr_a[lidx]->id)
                 gimp_item_set_tattoo (layer_id, lyr_a[lidx]->id);
-              g_object_unref (buffer);
-              g_free (pixels);
             }
 
           /* Layer mask */
@@ -1429,10 +1481,7 @@ add_layers (gint32     image_id,
                   IFDBG(3) g_debug ("Mask channel index %d", user_mask_chn);
                   IFDBG(3) g_debug ("Relative pos %d",
                                     lyr_a[lidx]->layer_mask.mask_flags.relative_pos);
-                  layer_size = lm_w * lm_h;
-                  pixels = g_malloc (layer_size);
-                  IFDBG(3) g_debug ("Allocate Pixels %d", layer_size);
-                  /* Crop mask at layer boundary */
+                  /* The mask is cropped at the layer boundary when drawn */
                   IFDBG(3) g_debug ("Original Mask %d %d %d %d", lm_x, lm_y, lm_w, lm_h);
                   if (lm_x < 0
                       || lm_y < 0
@@ -1444,40 +1493,7 @@ add_layers (gint32     image_id,
                                    "The layer mask is partly outside the "
                                    "layer boundary. The mask will be "
                                    "cropped which may result in data loss.");
-                      i = 0;
-                      for (rowi = 0; rowi < lm_h; ++rowi)
-                        {
-                          if (rowi + lm_y >= 0 && rowi + lm_y < l_h)
-                            {
-                              for (coli = 0; coli < lm_w; ++coli)
-                                {
-                                  if (coli + lm_x >= 0 && coli + lm_x < l_w)
-                                    {
-                                      pixels[i] =
-                                        lyr_chn[user_mask_chn]->data[(rowi * lm_w) + coli];
-                                      i++;
-                                    }
-                                }
-                            }
-                        }
-                      if (lm_x < 0)
-                        {
-                          lm_w += lm_x;
-                          lm_x = 0;
-                        }
-                      if (lm_y < 0)
-                        {
-                          lm_h += lm_y;
-                          lm_y = 0;
-                        }
-                      if (lm_w + lm_x > l_w)
-                        lm_w = l_w - lm_x;
-                      if (lm_h + lm_y > l_h)
-                        lm_h = l_h - lm_y;
                     }
-                  else
-                    memcpy (pixels, lyr_chn[user_mask_chn]->data, layer_size);
-                  g_free (lyr_chn[user_mask_chn]->data);
                   /* Draw layer mask data */
                   IFDBG(3) g_debug ("Layer %d %d %d %d", l_x, l_y, l_w, l_h);
                   IFDBG(3) g_debug ("Mask %d %d %d %d", lm_x, lm_y, lm_w, lm_h);
@@ -1489,19 +1505,20 @@ add_layers (gint32     image_id,
 
                   IFDBG(3) g_debug ("New layer mask %d", mask_id);
                   gimp_layer_add_mask (layer_id, mask_id);
-		  buffer = gimp_drawable_get_buffer (mask_id);
-		  gegl_buffer_set (buffer, GEGL_RECTANGLE (lm_x, lm_y, lm_w, lm_h), 0,
-				   get_pixel_format (img_a), pixels, GEGL_AUTO_ROWSTRIDE);
-                  g_object_unref (buffer);
+
+                  decoders[0] = &lyr_chn[user_mask_chn];
+                  if (draw_channels (mask_id, decoders, 1,
+                                     lm_x, lm_y, error) < 0)
+                    return -1;
+
                   gimp_layer_set_apply_mask (layer_id,
                     ! lyr_a[lidx]->layer_mask.mask_flags.disabled);
-                  g_free (pixels);
                 }
             }
           for (cidx = 0; cidx < lyr_a[lidx]->num_channels; ++cidx)
-            if (lyr_chn[cidx])
-              g_free (lyr_chn[cidx]);
+            decoder_clear (&lyr_chn[cidx]);
           g_free (lyr_chn);
+          g_free (lyr_a[lidx]->chn_info);
         }
       g_free (lyr_a[lidx]);
     }
@@ -1517,17 +1534,16 @@ add_merged_image (gint32     image_id,
                   FILE      *f,
                   GError   **error)
 {
-  PSDchannel            chn_a[MAX_CHANNELS];
+  PSDdecoder            chn_a[MAX_CHANNELS];
+  PSDdecoder           *decoders[MAX_CHANNELS];
   gchar                *alpha_name;
-  guchar               *pixels;
+  gchar                *planar_data = NULL;
   guint16               comp_mode;
   guint16               base_channels;
   guint16               extra_channels;
   guint16               total_channels;
-  guint16               bps;
-  guint16              *rle_pack_len[MAX_CHANNELS];
+  guint64               packed_len[MAX_CHANNELS];
   guint32               alpha_id;
-  gint32                layer_size;
   gint32                layer_id = -1;
   gint32                channel_id = -1;
   gint32                active_layer;
@@ -1539,15 +1555,13 @@ add_merged_image (gint32     image_id,
   gint                  offset;
   gint                  i;
   gboolean              alpha_visible;
-  GeglBuffer           *buffer;
   GimpImageType         image_type;
   GimpRGB               alpha_rgb;
 
+  memset (chn_a, 0, sizeof (chn_a));
+
   total_channels = img_a->channels;
   extra_channels = 0;
-  bps = img_a->bps / 8;
-  if (bps == 0)
-    bps++;
 
   if ((img_a->color_mode == PSD_BITMAP ||
        img_a->color_mode == PSD_GRAYSCALE ||
@@ -1576,8 +1590,8 @@ add_merged_image (gint32     image_id,
   if (img_a->num_layers == 0
       || extra_channels > 0)
     {
-      guint32 block_len;
-      guint32 block_start;
+      guint64 block_len;
+      guint64 block_start;
 
       block_start = img_a->merged_image_start;
       block_len = img_a->merged_image_len;
@@ -1594,13 +1608,15 @@ add_merged_image (gint32     image_id,
       switch (comp_mode)
         {
           case PSD_COMP_RAW:        /* Planar raw data */
-            IFDBG(3) g_debug ("Raw data length: %d", block_len);
+            IFDBG(3) g_debug ("Raw data length: %" G_GUINT64_FORMAT, block_len);
             for (cidx = 0; cidx < total_channels; ++cidx)
               {
-                chn_a[cidx].columns = img_a->columns;
-                chn_a[cidx].rows = img_a->rows;
-                if (read_channel_data (&chn_a[cidx], img_a->bps,
-                    PSD_COMP_RAW, NULL, f, error) < 1)
+                if (decoder_init (&chn_a[cidx], img_a, PSD_COMP_RAW,
+                                  img_a->rows, img_a->columns, error) < 0
+                    || decoder_read_data (&chn_a[cidx],
+                                          (guint64) chn_a[cidx].readline_len *
+                                          img_a->rows,
+                                          f, error) < 0)
                   return -1;
               }
             break;
@@ -1608,37 +1624,77 @@ add_merged_image (gint32     image_id,
           case PSD_COMP_RLE:        /* Packbits */
             /* Image data is stored as packed scanlines in planar order
                with all compressed length counters stored first */
-            IFDBG(3) g_debug ("RLE length data: %d, RLE data block: %d",
-                               total_channels * img_a->rows * 2,
-                               block_len - (total_channels * img_a->rows * 2));
             for (cidx = 0; cidx < total_channels; ++cidx)
               {
-                chn_a[cidx].columns = img_a->columns;
-                chn_a[cidx].rows = img_a->rows;
-                rle_pack_len[cidx] = g_malloc (img_a->rows * 2);
-                for (rowi = 0; rowi < img_a->rows; ++rowi)
-                  {
-                    if (fread (&rle_pack_len[cidx][rowi], 2, 1, f) < 1)
-                      {
-                        psd_set_error (feof (f), errno, error);
-                        return -1;
-                      }
-                    rle_pack_len[cidx][rowi] = GUINT16_FROM_BE (rle_pack_len[cidx][rowi]);
-                  }
+                if (decoder_init (&chn_a[cidx], img_a, PSD_COMP_RLE,
+                                  img_a->rows, img_a->columns, error) < 0
+                    || decoder_read_rle_len (&chn_a[cidx], img_a,
+                                             &packed_len[cidx], f, error) < 0)
+                  return -1;
               }
 
             IFDBG(3) g_debug ("RLE decode - data");
             for (cidx = 0; cidx < total_channels; ++cidx)
               {
-                if (read_channel_data (&chn_a[cidx], img_a->bps,
-                    PSD_COMP_RLE, rle_pack_len[cidx], f, error) < 1)
+                if (decoder_read_data (&chn_a[cidx], packed_len[cidx],
+                                       f, error) < 0)
                   return -1;
-                g_free (rle_pack_len[cidx]);
               }
             break;
 
-          case PSD_COMP_ZIP:                 /* ? */
+          case PSD_COMP_ZIP:
           case PSD_COMP_ZIP_PRED:
+            {
+              /* All channels are compressed as a single stream, which
+                 has to be inflated completely before the planes can be
+                 interleaved */
+              PSDdecoder zip_dec;
+              guint64    channel_len;
+
+              if (read_channel_data (&zip_dec, img_a, comp_mode,
+                                     img_a->rows, img_a->columns,
+                                     block_len - COMP_MODE_SIZE,
+                                     f, error) < 0)
+                return -1;
+
+              channel_len = (guint64) zip_dec.readline_len * img_a->rows;
+
+              planar_data = g_try_malloc (channel_len * total_channels);
+              if (! planar_data)
+                {
+                  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                               _("Unsupported or invalid channel size"));
+                  decoder_clear (&zip_dec);
+                  return -1;
+                }
+
+              for (rowi = 0; rowi < total_channels * img_a->rows; ++rowi)
+                {
+                  if (! decoder_inflate_row (&zip_dec,
+                                             (guchar *) planar_data +
+                                             (guint64) rowi * zip_dec.readline_len))
+                    {
+                      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                                   _("The file is corrupt!"));
+                      decoder_clear (&zip_dec);
+                      g_free (planar_data);
+                      return -1;
+                    }
+                }
+
+              decoder_clear (&zip_dec);
+
+              for (cidx = 0; cidx < total_channels; ++cidx)
+                {
+                  decoder_init (&chn_a[cidx], img_a, PSD_COMP_RAW,
+                                img_a->rows, img_a->columns, NULL);
+                  chn_a[cidx].predict = (comp_mode == PSD_COMP_ZIP_PRED);
+                  chn_a[cidx].src = planar_data + cidx * channel_len;
+                  chn_a[cidx].src_len = channel_len;
+                }
+            }
+            break;
+
           default:
             g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
                         _("Unsupported compression mode: %d"), comp_mode);
@@ -1652,18 +1708,6 @@ add_merged_image (gint32     image_id,
     {
       image_type = get_gimp_image_type (img_a->base_type, img_a->transparency);
 
-      layer_size = img_a->columns * img_a->rows;
-      pixels = g_malloc (layer_size * base_channels * bps);
-      for (cidx = 0; cidx < base_channels; ++cidx)
-        {
-          for (i = 0; i < layer_size; ++i)
-            {
-	      memcpy (&pixels[((i * base_channels) + cidx) * bps],
-		      &chn_a[cidx].data[i * bps], bps);
-            }
-          g_free (chn_a[cidx].data);
-        }
-
       /* Add background layer */
       IFDBG(2) g_debug ("Draw merged image");
       layer_id = gimp_layer_new (image_id, _("Background"),
@@ -1671,18 +1715,12 @@ add_merged_image (gint32     image_id,
                                  image_type,
                                  100, GIMP_NORMAL_MODE);
       gimp_image_insert_layer (image_id, layer_id, -1, 0);
-      buffer = gimp_drawable_get_buffer (layer_id);
-      gegl_buffer_set (buffer, GEGL_RECTANGLE (0, 0, gegl_buffer_get_width (buffer), gegl_buffer_get_height (buffer)),
-		       0, get_pixel_format (img_a), pixels, GEGL_AUTO_ROWSTRIDE);
-      g_object_unref (buffer);
-      g_free (pixels);
-    }
-  else
-    {
-      /* Free merged image data for layered image */
-      if (extra_channels)
-        for (cidx = 0; cidx < base_channels; ++cidx)
-          g_free (chn_a[cidx].data);
+
+      for (cidx = 0; cidx < base_channels; ++cidx)
+        decoders[cidx] = &chn_a[cidx];
+
+      if (draw_channels (layer_id, decoders, base_channels, 0, 0, error) < 0)
+        return -1;
     }
 
   /* ----- Draw extra alpha channels ----- */
@@ -1691,7 +1729,6 @@ add_merged_image (gint32     image_id,
       && image_id > -1)
     {
       IFDBG(2) g_debug ("Add extra channels");
-      pixels = g_malloc(0);
 
       /* Get channel resource data */
       if (img_a->transparency)
@@ -1752,25 +1789,19 @@ add_merged_image (gint32     image_id,
             }
 
           cidx = base_channels + i;
-          pixels = g_realloc (pixels, chn_a[cidx].columns * chn_a[cidx].rows);
-          memcpy (pixels, chn_a[cidx].data, chn_a[cidx].columns * chn_a[cidx].rows);
           channel_id = gimp_channel_new (image_id, alpha_name,
                                          chn_a[cidx].columns, chn_a[cidx].rows,
                                          alpha_opacity, &alpha_rgb);
           gimp_image_insert_channel (image_id, channel_id, -1, 0);
           g_free (alpha_name);
-          buffer = gimp_drawable_get_buffer (channel_id);
           if (alpha_id)
             gimp_item_set_tattoo (channel_id, alpha_id);
           gimp_item_set_visible (channel_id, alpha_visible);
-	  gegl_buffer_set (buffer,
-			   GEGL_RECTANGLE (0, 0, gegl_buffer_get_width (buffer), gegl_buffer_get_height (buffer)),
-			   0, get_pixel_format (img_a), pixels, GEGL_AUTO_ROWSTRIDE);
-          g_object_unref (buffer);
-          g_free (chn_a[cidx].data);
-        }
 
-      g_free (pixels);
+          decoders[0] = &chn_a[cidx];
+          if (draw_channels (channel_id, decoders, 1, 0, 0, error) < 0)
+            return -1;
+        }
       if (img_a->alpha_names)
         g_ptr_array_free (img_a->alpha_names, TRUE);
 
@@ -1785,6 +1816,10 @@ add_merged_image (gint32     image_id,
         }
     }
 
+  for (cidx = 0; cidx < total_channels; ++cidx)
+    decoder_clear (&chn_a[cidx]);
+  g_free (planar_data);
+
   /* Set active layer */
   lyr_lst = gimp_image_get_layers (image_id, &lyr_count);
   if (img_a->layer_state + 1 > lyr_count ||
@@ -1877,234 +1912,548 @@ get_gimp_image_type (GimpImageBaseType image_base_type,
 }
 
 static gint
-read_channel_data (PSDchannel     *channel,
-                   guint16         bps,
-                   guint16         compression,
-                   const guint16  *rle_pack_len,
-                   FILE           *f,
-                   GError        **error)
+decoder_init (PSDdecoder  *dec,
+              PSDimage    *img_a,
+              guint16      compression,
+              guint32      rows,
+              guint32      columns,
+              GError     **error)
 {
-  gchar    *raw_data;
-  gchar    *src;
-  gchar    *dst;
-  guint32   readline_len;
-  gint      i;
-
-  if (bps == 1)
-    readline_len = ((channel->columns + 7) >> 3);
+  memset (dec, 0, sizeof (PSDdecoder));
+
+  dec->bps = img_a->bps;
+  dec->rows = rows;
+  dec->columns = columns;
+
+  switch (compression)
+    {
+      case PSD_COMP_RAW:
+      case PSD_COMP_RLE:
+      case PSD_COMP_ZIP:
+        dec->compression = compression;
+        break;
+
+      case PSD_COMP_ZIP_PRED:
+        dec->compression = PSD_COMP_ZIP;
+        dec->predict = TRUE;
+        break;
+
+      default:
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                    _("Unsupported compression mode: %d"), compression);
+        return -1;
+        break;
+    }
+
+  if (dec->bps == 1)
+    dec->readline_len = ((columns + 7) >> 3);
   else
-    readline_len = (channel->columns * bps >> 3);
+    dec->readline_len = (columns * dec->bps >> 3);
 
-  IFDBG(3) g_debug ("raw data size %d x %d = %d", readline_len,
-                    channel->rows, readline_len * channel->rows);
+  IFDBG(3) g_debug ("raw data size %d x %d = %d", dec->readline_len,
+                    rows, dec->readline_len * rows);
 
   /* sanity check, int overflow check (avoid divisions by zero) */
-  if ((channel->rows == 0) || (channel->columns == 0) ||
-      (channel->rows > G_MAXINT32 / channel->columns / MAX (bps >> 3, 1)))
+  if ((rows == 0) || (columns == 0) ||
+      (rows > G_MAXINT32 / columns / MAX (dec->bps >> 3, 1)))
     {
       g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
                    _("Unsupported or invalid channel size"));
       return -1;
     }
 
-  raw_data = g_malloc (readline_len * channel->rows);
-  switch (compression)
+  return 0;
+}
+
+static gint
+decoder_read_rle_len (PSDdecoder  *dec,
+                      PSDimage    *img_a,
+                      guint64     *packed_len,
+                      FILE        *f,
+                      GError     **error)
+{
+  guchar *buf;
+  gint    count_size;
+  gint    i;
+
+  /* PSB files store the packed row lengths in 4 bytes */
+  count_size = img_a->version == PSB_VERSION ? 4 : 2;
+
+  buf = g_malloc (dec->rows * count_size);
+  if (fread (buf, count_size, dec->rows, f) < dec->rows)
     {
-      case PSD_COMP_RAW:
-        if (fread (raw_data, readline_len, channel->rows, f) < 1)
-          {
-            psd_set_error (feof (f), errno, error);
-            return -1;
-          }
-        break;
+      psd_set_error (feof (f), errno, error);
+      g_free (buf);
+      return -1;
+    }
 
-      case PSD_COMP_RLE:
-        for (i = 0; i < channel->rows; ++i)
-          {
-            src = g_malloc (rle_pack_len[i]);
-            dst = g_malloc (readline_len);
-/*      FIXME check for over-run
-            if (ftell (f) + rle_pack_len[i] > block_end)
-              {
-                psd_set_error (TRUE, errno, error);
-                return -1;
-              }
-*/
-            if (fread (src, rle_pack_len[i], 1, f) < 1)
-              {
-                psd_set_error (feof (f), errno, error);
-                g_free (src);
-                g_free (dst);
-                return -1;
-              }
-            /* FIXME check for errors returned from decode packbits */
-            decode_packbits (src, dst, rle_pack_len[i], readline_len);
-            g_free (src);
-            memcpy (raw_data + i * readline_len, dst, readline_len);
-            g_free (dst);
-          }
-        break;
+  dec->row_offset = g_new (guint64, dec->rows + 1);
+  dec->row_offset[0] = 0;
+
+  for (i = 0; i < dec->rows; ++i)
+    {
+      const guchar *p = buf + i * count_size;
+      guint32       len;
+
+      if (count_size == 4)
+        len = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+      else
+        len = (p[0] << 8) | p[1];
+
+      dec->row_offset[i + 1] = dec->row_offset[i] + len;
     }
 
-  /* Convert channel data to GIMP format */
+  g_free (buf);
+
+  *packed_len = dec->row_offset[dec->rows];
+
+  return 0;
+}
+
+static gint
+decoder_read_data (PSDdecoder  *dec,
+                   guint64      data_len,
+                   FILE        *f,
+                   GError     **error)
+{
+  if (data_len == 0)
+    return 0;
+
+  if (data_len > G_MAXSIZE)
+    dec->data = NULL;
+  else
+    dec->data = g_try_malloc (data_len);
+
+  if (! dec->data)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   _("Unsupported or invalid channel size"));
+      return -1;
+    }
+
+  if (fread (dec->data, data_len, 1, f) < 1)
+    {
+      psd_set_error (feof (f), errno, error);
+      return -1;
+    }
+
+  dec->src = dec->data;
+  dec->src_len = data_len;
+
+  if (dec->compression == PSD_COMP_ZIP)
+    {
+      if (inflateInit (&dec->zs) != Z_OK)
+        {
+          g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                       _("The file is corrupt!"));
+          return -1;
+        }
+      dec->zs_init = TRUE;
+    }
+
+  return 0;
+}
+
+static void
+decoder_clear (PSDdecoder *dec)
+{
+  if (dec->zs_init)
+    inflateEnd (&dec->zs);
+
+  g_free (dec->row_offset);
+  g_free (dec->data);
+
+  memset (dec, 0, sizeof (PSDdecoder));
+}
+
+/* Inflates the next row of a ZIP compressed channel.
+ * Rows have to be requested in order.
+ */
+static gboolean
+decoder_inflate_row (PSDdecoder *dec,
+                     guchar     *line)
+{
+  dec->zs.next_out = line;
+  dec->zs.avail_out = dec->readline_len;
+
+  while (dec->zs.avail_out > 0)
+    {
+      gint ret;
+
+      if (dec->zs.avail_in == 0)
+        {
+          guint64 avail = dec->src_len - dec->zip_pos;
+
+          if (avail == 0)
+            return FALSE;
+
+          dec->zs.next_in = (Bytef *) dec->src + dec->zip_pos;
+          dec->zs.avail_in = MIN (avail, G_MAXUINT);
+          dec->zip_pos += dec->zs.avail_in;
+        }
+
+      ret = inflate (&dec->zs, Z_NO_FLUSH);
+
+      if (ret == Z_STREAM_END)
+        return dec->zs.avail_out == 0;
+      else if (ret != Z_OK)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+decode_job_run (PSDdecodeJob *job)
+{
+  PSDdecoder *dec = job->dec;
+  guchar     *line = NULL;
+  guchar     *tmp = NULL;
+  gint        sample_len;
+  guint32     i;
+  guint32     col;
+
+  sample_len = MAX (dec->bps >> 3, 1);
+
+  if (dec->src)
+    {
+      line = g_malloc (dec->readline_len);
+
+      if (dec->predict && dec->bps == 32)
+        tmp = g_malloc (dec->readline_len);
+    }
+
+  for (i = 0; i < job->n_rows; ++i)
+    {
+      guint32       row  = job->row + i;
+      guchar       *dest = job->dest + i * job->dest_rowstride;
+      const guchar *src;
+
+      /* Channel without data */
+      if (! dec->src)
+        {
+          for (col = 0; col < dec->columns; ++col)
+            memset (dest + col * job->dest_stride, 0, sample_len);
+          continue;
+        }
+
+      switch (dec->compression)
+        {
+          case PSD_COMP_RAW:
+            {
+              guint64 offset = (guint64) row * dec->readline_len;
+
+              if (offset + dec->readline_len > dec->src_len)
+                goto failed;
+
+              memcpy (line, dec->src + offset, dec->readline_len);
+            }
+            break;
+
+          case PSD_COMP_RLE:
+            {
+              guint64 offset = dec->row_offset[row];
+              guint64 len    = dec->row_offset[row + 1] - offset;
+
+              if (offset + len > dec->src_len)
+                goto failed;
+
+              /* FIXME check for errors returned from decode packbits */
+              decode_packbits (dec->src + offset, (gchar *) line,
+                               len, dec->readline_len);
+            }
+            break;
+
+          case PSD_COMP_ZIP:
+            if (! decoder_inflate_row (dec, line))
+              goto failed;
+            break;
+        }
+
+      if (dec->predict)
+        undo_prediction (line, tmp, dec->columns, dec->bps);
+
+      /* Convert channel data to GIMP format */
+      switch (dec->bps)
+        {
+          case 1:
+            /* Bits to bytes left to right, rows are padded to a byte */
+            for (col = 0; col < dec->columns; ++col)
+              dest[col * job->dest_stride] =
+                (line[col >> 3] & (0x80 >> (col & 7))) ? 0 : 1;
+            break;
+
+          case 8:
+            for (col = 0; col < dec->columns; ++col)
+              dest[col * job->dest_stride] = line[col];
+            break;
+
+          default:
+            for (col = 0; col < dec->columns; ++col)
+              memcpy (dest + col * job->dest_stride,
+                      line + col * sample_len, sample_len);
+            break;
+        }
+    }
+
+  g_free (line);
+  g_free (tmp);
+
+  return;
+
+ failed:
+  IFDBG(1) g_debug ("Channel data decode failed at row %d", job->row + i);
+  g_atomic_int_set (&dec->failed, TRUE);
+
+  g_free (line);
+  g_free (tmp);
+}
+
+static void
+decode_job_func (gpointer data,
+                 gpointer user_data)
+{
+  PSDdecodeJob *job = data;
+
+  decode_job_run (job);
+
+  g_mutex_lock (&job->batch->mutex);
+
+  if (--job->batch->n_pending == 0)
+    g_cond_signal (&job->batch->cond);
+
+  g_mutex_unlock (&job->batch->mutex);
+}
+
+/* ZIP prediction stores each sample as the difference to the one on
+ * its left.  32 bit rows are delta coded byte by byte after the bytes
+ * of the samples have been split into planes.
+ */
+static void
+undo_prediction (guchar  *line,
+                 guchar  *tmp,
+                 guint32  columns,
+                 guint16  bps)
+{
+  guint32 i;
+
   switch (bps)
     {
-      case 32:
-      case 16:
       case 8:
-        channel->data = (gchar *) g_malloc (channel->rows * channel->columns * bps / 8 );
-        memcpy (channel->data, raw_data, (channel->rows * channel->columns * bps / 8));
+        for (i = 1; i < columns; ++i)
+          line[i] += line[i - 1];
         break;
 
-      case 1:
-        channel->data = (gchar *) g_malloc (channel->rows * channel->columns);
-        convert_1_bit (raw_data, channel->data, channel->rows, channel->columns);
+      case 16:
+        {
+          guint16 prev = 0;
+
+          for (i = 0; i < columns; ++i)
+            {
+              guint16 val = ((line[i * 2] << 8) | line[i * 2 + 1]) + prev;
+
+              line[i * 2]     = val >> 8;
+              line[i * 2 + 1] = val & 0xff;
+              prev = val;
+            }
+        }
+        break;
+
+      case 32:
+        for (i = 1; i < columns * 4; ++i)
+          line[i] += line[i - 1];
+
+        for (i = 0; i < columns; ++i)
+          {
+            tmp[i * 4]     = line[i];
+            tmp[i * 4 + 1] = line[columns + i];
+            tmp[i * 4 + 2] = line[columns * 2 + i];
+            tmp[i * 4 + 3] = line[columns * 3 + i];
+          }
+
+        memcpy (line, tmp, columns * 4);
         break;
 
       default:
-	return -1;
         break;
     }
-
-  g_free (raw_data);
-
-  return 1;
 }
 
-static void
-convert_1_bit (const gchar *src,
-               gchar       *dst,
-               guint32      rows,
-               guint32      columns)
+/* Decodes the channels band by band into the drawable at x, y.
+ * The decoders provide the components of the drawable format in order,
+ * data outside the drawable is dropped.
+ */
+static gint
+draw_channels (gint32        drawable_id,
+               PSDdecoder  **decoders,
+               gint          n_decoders,
+               gint          x,
+               gint          y,
+               GError      **error)
 {
-/* Convert bits to bytes left to right by row.
-   Rows are padded out to a byte boundary.
-*/
-  guint32 row_pos = 0;
-  gint    i, j;
+  GeglBuffer     *buffer;
+  const Babl     *format;
+  PSDdecodeBatch  batch;
+  PSDdecodeJob   *jobs;
+  guchar         *band;
+  guint32         rows;
+  guint32         columns;
+  guint32         band_rows;
+  guint32         y0;
+  gint            bpp;
+  gint            sample_len;
+  gint            rowstride;
+  gint            n_jobs;
+  gint            cidx;
+  gint            result = 0;
+
+  rows = decoders[0]->rows;
+  columns = decoders[0]->columns;
+
+  if (rows == 0 || columns == 0)
+    return 0;
+
+  buffer = gimp_drawable_get_buffer (drawable_id);
+  format = gimp_drawable_get_format (drawable_id);
+  bpp = babl_format_get_bytes_per_pixel (format);
+  sample_len = MAX (decoders[0]->bps >> 3, 1);
+  rowstride = columns * bpp;
+
+  /* Extra layer channels that the drawable can't hold are dropped */
+  n_decoders = MIN (n_decoders, bpp / sample_len);
+
+  band_rows = CLAMP (DECODE_BAND_SIZE / rowstride, 1, DECODE_BAND_ROWS);
+  band_rows = MIN (band_rows, rows);
+  band = g_malloc0 ((gsize) rowstride * band_rows);
+  jobs = g_new (PSDdecodeJob,
+                n_decoders * ((band_rows + DECODE_JOB_ROWS - 1) / DECODE_JOB_ROWS));
+
+  g_mutex_init (&batch.mutex);
+  g_cond_init (&batch.cond);
+
+  for (y0 = 0; y0 < rows; y0 += band_rows)
+    {
+      GeglRectangle rect;
+      guint32       n_rows = MIN (band_rows, rows - y0);
+      guint32       r;
+      gint          i;
 
-  IFDBG(3)  g_debug ("Start 1 bit conversion");
+      n_jobs = 0;
 
-  for (i = 0; i < rows * ((columns + 7) >> 3); ++i)
-    {
-      guchar    mask = 0x80;
-      for (j = 0; j < 8 && row_pos < columns; ++j)
+      /* ZIP rows can only be inflated in order, RAW and RLE rows are
+       * independent and get split over several jobs
+       */
+      for (cidx = 0; cidx < n_decoders; ++cidx)
         {
-          *dst = (*src & mask) ? 0 : 1;
-          IFDBG(3) g_debug ("byte %d, bit %d, offset %d, src %d, dst %d",
-            i , j, row_pos, *src, *dst);
-          dst++;
-          mask >>= 1;
-          row_pos++;
+          PSDdecoder *dec  = decoders[cidx];
+          guint32     step = n_rows;
+
+          if (dec->src && dec->compression != PSD_COMP_ZIP)
+            step = DECODE_JOB_ROWS;
+
+          for (r = 0; r < n_rows; r += step)
+            {
+              PSDdecodeJob *job = &jobs[n_jobs++];
+
+              job->dec            = dec;
+              job->row            = y0 + r;
+              job->n_rows         = MIN (step, n_rows - r);
+              job->dest           = band + r * rowstride + cidx * sample_len;
+              job->dest_stride    = bpp;
+              job->dest_rowstride = rowstride;
+              job->batch          = &batch;
+            }
+        }
+
+      if (decode_pool && n_jobs > 1)
+        {
+          batch.n_pending = n_jobs;
+
+          for (i = 0; i < n_jobs; ++i)
+            g_thread_pool_push (decode_pool, &jobs[i], NULL);
+
+          g_mutex_lock (&batch.mutex);
+
+          while (batch.n_pending > 0)
+            g_cond_wait (&batch.cond, &batch.mutex);
+
+          g_mutex_unlock (&batch.mutex);
+        }
+      else
+        {
+          for (i = 0; i < n_jobs; ++i)
+            decode_job_run (&jobs[i]);
+        }
+
+      for (cidx = 0; cidx < n_decoders; ++cidx)
+        {
+          if (g_atomic_int_get (&decoders[cidx]->failed))
+            {
+              g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                           _("The file is corrupt!"));
+              result = -1;
+              goto out;
+            }
+        }
+
+      if (gegl_rectangle_intersect (&rect,
+                                    GEGL_RECTANGLE (x, y + y0, columns, n_rows),
+                                    gegl_buffer_get_extent (buffer)))
+        {
+          gegl_buffer_set (buffer, &rect, 0, format,
+                           band + (rect.y - y - (gint) y0) * rowstride +
+                                  (rect.x - x) * bpp,
+                           rowstride);
         }
-      if (row_pos >= columns)
-        row_pos = 0;
-      src++;
     }
-  IFDBG(3)  g_debug ("End 1 bit conversion");
+
+ out:
+  g_mutex_clear (&batch.mutex);
+  g_cond_clear (&batch.cond);
+
+  g_free (jobs);
+  g_free (band);
+  g_object_unref (buffer);
+
+  return result;
 }
 
-static const Babl*
-get_pixel_format (PSDimage *img_a)
+static gint
+read_channel_data (PSDdecoder  *dec,
+                   PSDimage    *img_a,
+                   guint16      compression,
+                   guint32      rows,
+                   guint32      columns,
+                   guint64      data_len,
+                   FILE        *f,
+                   GError     **error)
 {
-  const Babl *format;
+  if (decoder_init (dec, img_a, compression, rows, columns, error) < 0)
+    return -1;
 
-  switch (get_gimp_image_type (img_a->base_type, img_a->transparency))
+  if (dec->compression == PSD_COMP_RLE)
     {
-    case GIMP_GRAY_IMAGE:
-      switch (img_a->bps)
-	{
-	case 32:
-          format = babl_format ("Y u32");
-	  break;
-
-        case 16:
-          format = babl_format ("Y u16");
-	  break;
-
-        case 8:
-        case 1:
-          format = babl_format ("Y u8");
-	  break;
-
-        default:
-          return NULL;
-	  break;
-	}
-      break;
+      guint64 packed_len;
+      guint64 counts_len;
 
-    case GIMP_GRAYA_IMAGE:
-      switch (img_a->bps)
-	{
-	case 32:
-          format = babl_format ("YA u32");
-	  break;
-
-        case 16:
-          format = babl_format ("YA u16");
-          break;
-
-        case 8:
-        case 1:
-          format = babl_format ("YA u8");
-          break;
-
-        default:
-	  return NULL;
-	  break;
-	}
-      break;
+      counts_len = (guint64) rows * (img_a->version == PSB_VERSION ? 4 : 2);
 
-    case GIMP_RGB_IMAGE:
-    case GIMP_INDEXED_IMAGE:
-      switch (img_a->bps)
-	{
-	case 32:
-          format = babl_format ("RGB u32");
-	  break;
-
-        case 16:
-          format = babl_format ("RGB u16");
-          break;
-
-        case 8:
-        case 1:
-          format = babl_format ("RGB u8");
-          break;
-
-        default:
-	  return NULL;
-	  break;
-	}
-      break;
+      IFDBG(3) g_debug ("RLE channel length %" G_GUINT64_FORMAT
+                        ", RLE length data: %" G_GUINT64_FORMAT,
+                        data_len, counts_len);
 
-    case GIMP_RGBA_IMAGE:
-    case GIMP_INDEXEDA_IMAGE:
-      switch (img_a->bps)
-	{
-	case 32:
-          format = babl_format ("RGBA u32");
-	  break;
-
-        case 16:
-          format = babl_format ("RGBA u16");
-	  break;
-
-        case 8:
-        case 1:
-          format = babl_format ("RGBA u8");
-          break;
-
-        default:
-	  return NULL;
-	  break;
-	}
-      break;
+      if (counts_len > data_len)
+        {
+          g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                       _("The file is corrupt!"));
+          return -1;
+        }
 
-    default:
-      return NULL;
-      break;
+      if (decoder_read_rle_len (dec, img_a, &packed_len, f, error) < 0)
+        return -1;
+
+      data_len -= counts_len;
     }
 
-  return format;
+  return decoder_read_data (dec, data_len, f, error);
 }
@@ -166,7 +166,7 @@ read_header_block (PSDimage  *img_a,
       psd_set_error (feof (f), errno, error);
       return -1;
     }
-  version = GUINT16_FROM_BE (version);
+  img_a->version = version = GUINT16_FROM_BE (version);
   img_a->channels = GUINT16_FROM_BE (img_a->channels);
   img_a->rows = GUINT32_FROM_BE (img_a->rows);
   img_a->columns = GUINT32_FROM_BE (img_a->columns);
@@ -182,7 +182,7 @@ read_header_block (PSDimage  *img_a,
   if (memcmp (sig, "8BPS", 4) != 0)
     return -1;
 
-  if (version != 1)
+  if (version != PSD_VERSION && version != PSB_VERSION)
     return -1;
 
   if (img_a->channels > MAX_CHANNELS)
@@ -349,10 +349,37 @@ fwrite_unicode_string (const gchar  *src,
   return bytes_written;
 }
 
+gint
+psd_read_len (FILE    *f,
+              guint64 *data,
+              guint16  psd_version)
+{
+  if (psd_version == PSB_VERSION)
+    {
+      guint64 len;
+
+      if (fread (&len, 8, 1, f) < 1)
+        return 0;
+
+      *data = GUINT64_FROM_BE (len);
+    }
+  else
+    {
+      guint32 len;
+
+      if (fread (&len, 4, 1, f) < 1)
+        return 0;
+
+      *data = GUINT32_FROM_BE (len);
+    }
+
+  return 1;
+}
+
 gint
 decode_packbits (const gchar *src,
                  gchar       *dst,
-                 guint16      packed_len,
+                 guint32      packed_len,
                  guint32      unpacked_len)
 {
   /*
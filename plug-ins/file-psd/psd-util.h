@@ -66,9 +66,17 @@ gint32                  fwrite_unicode_string  (const gchar    *src,
                                                 FILE           *f,
                                                 GError        **error);
 
+/*
+ * Reads a length field, which is 4 bytes in PSD files and 8 bytes
+ * in PSB files.
+ */
+gint                    psd_read_len           (FILE           *f,
+                                                guint64        *data,
+                                                guint16         psd_version);
+
 gint                    decode_packbits        (const gchar    *src,
                                                 gchar          *dst,
-                                                guint16         packed_len,
+                                                guint32         packed_len,
                                                 guint32         unpacked_len);
 
 gchar                 * encode_packbits        (const gchar    *src,
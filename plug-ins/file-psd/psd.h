@@ -62,6 +62,8 @@
 
 /* PSD spec defines */
 #define MAX_CHANNELS    56              /* Photoshop CS to CS3 support 56 channels */
+#define PSD_VERSION     1               /* Photoshop document */
+#define PSB_VERSION     2               /* Photoshop large document format */
 
 /* PSD spec constants */
 
@@ -490,7 +492,7 @@ typedef struct {
 typedef struct
 {
   gint16        channel_id;             /* Channel ID */
-  guint32       data_len;               /* Layer left */
+  guint64       data_len;               /* Channel data length */
 } ChannelLengthInfo;
 
 /* PSD Layer flags */
@@ -643,10 +645,11 @@ typedef struct
 /* PSD File data structures */
 typedef struct
 {
+  guint16               version;                /* File version: PSD_VERSION or PSB_VERSION */
   guint16               channels;               /* Number of channels: 1- 56 */
   gboolean              transparency;           /* Image has merged transparency alpha channel */
-  guint32               rows;                   /* Number of rows: 1 - 30000 */
-  guint32               columns;                /* Number of columns: 1 - 30000 */
+  guint32               rows;                   /* Number of rows: 1 - 30000 (PSB: 300000) */
+  guint32               columns;                /* Number of columns: 1 - 30000 (PSB: 300000) */
   guint16               bps;                    /* Bits per sample: 1, 8, 16, or 32 */
   guint16               color_mode;             /* Image color mode: {PSDColorMode} */
   GimpImageBaseType     base_type;              /* Image base color mode: (GIMP) */
@@ -656,13 +659,13 @@ typedef struct
   guint32               color_map_entries;      /* Color map number of entries */
   guint32               image_res_start;        /* Image resource block start address */
   guint32               image_res_len;          /* Image resource block length */
-  guint32               mask_layer_start;       /* Mask & layer block start address */
-  guint32               mask_layer_len;         /* Mask & layer block length */
+  guint64               mask_layer_start;       /* Mask & layer block start address */
+  guint64               mask_layer_len;         /* Mask & layer block length */
   gint16                num_layers;             /* Number of layers */
-  guint32               layer_data_start;       /* Layer pixel data start */
-  guint32               layer_data_len;         /* Layer pixel data length */
-  guint32               merged_image_start;     /* Merged image pixel data block start address */
-  guint32               merged_image_len;       /* Merged image pixel data block length */
+  guint64               layer_data_start;       /* Layer pixel data start */
+  guint64               layer_data_len;         /* Layer pixel data length */
+  guint64               merged_image_start;     /* Merged image pixel data block start address */
+  guint64               merged_image_len;       /* Merged image pixel data block length */
   gboolean              no_icc;                 /* Do not use ICC profile */
   guint16               layer_state;            /* Active layer number counting from bottom up */
   GPtrArray            *alpha_names;            /* Alpha channel names */